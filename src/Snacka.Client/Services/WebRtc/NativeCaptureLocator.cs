@@ -321,13 +321,17 @@ public class NativeCaptureLocator
     {
         var args = new List<string>();
 
-        // Source type - Linux version uses display index
+        // Source type - Linux version uses display index or X11 window ID
         if (source == null || source.Type == ScreenCaptureSourceType.Display)
         {
             var displayIndex = source?.Id ?? "0";
             args.Add($"--display {displayIndex}");
         }
-        // Note: Window capture not yet supported in SnackaCaptureLinux
+        else if (source.Type == ScreenCaptureSourceType.Window)
+        {
+            // XComposite window capture
+            args.Add($"--window {source.Id}");
+        }
 
         // Resolution and framerate
         args.Add($"--width {width}");
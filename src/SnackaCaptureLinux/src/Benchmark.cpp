@@ -0,0 +1,977 @@
+#include "Benchmark.h"
+#include "CameraFormatConverter.h"
+#include "ColorConverter.h"
+#include "FrameInfo.h"
+#include "FramePyramid.h"
+#include "MjpegDecodePool.h"
+#include "MjpegDecoder.h"
+#include "WorkerPool.h"
+#include "Protocol.h"
+#include "X11Util.h"
+#include "XRenderScaler.h"
+#include "XcbShm.h"
+
+#include <X11/Xlib-xcb.h>
+#include <poll.h>
+
+#include <cstdio>
+#include <jpeglib.h>
+
+#include <iostream>
+#include <iomanip>
+#include <iterator>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace snacka {
+
+namespace {
+
+// Reference clock for cycles/pixel (TSC on x86; 0 elsewhere, only ms is reported then)
+uint64_t ReadCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Deterministic noise with some smooth regions, so neither kernel path is favoured
+std::vector<uint8_t> MakeTestImage(int width, int height) {
+    std::vector<uint8_t> image(static_cast<size_t>(width) * height * 4);
+    uint32_t seed = 0x12345678;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            uint8_t* p = image.data() + (static_cast<size_t>(y) * width + x) * 4;
+            bool noisy = ((x / 64) + (y / 64)) % 2 == 0;
+            p[0] = noisy ? static_cast<uint8_t>(seed >> 24) : static_cast<uint8_t>(x);
+            p[1] = noisy ? static_cast<uint8_t>(seed >> 16) : static_cast<uint8_t>(y);
+            p[2] = noisy ? static_cast<uint8_t>(seed >> 8) : static_cast<uint8_t>(x + y);
+            p[3] = 0xFF;
+        }
+    }
+    return image;
+}
+
+int MaxAbsDiff(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+    int maxDiff = 0;
+    for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+        maxDiff = std::max(maxDiff, std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i])));
+    }
+    return maxDiff;
+}
+
+int BenchmarkColorConversion(const BenchmarkOptions& options) {
+    int width = options.width;
+    int height = options.height;
+    double pixels = static_cast<double>(width) * height;
+
+    std::cerr << "BGRX -> NV12 conversion, bt601 (" << width << "x" << height
+              << ", " << options.iterations << " iterations)\n";
+
+    auto source = MakeTestImage(width, height);
+    std::vector<uint8_t> reference(CalculateNV12FrameSize(width, height));
+    std::vector<uint8_t> output(reference.size());
+
+    ColorConverter scalar(CpuLevel::Scalar);
+    scalar.Configure(width, height, width, height);
+    scalar.Convert(source.data(), width * 4, 4, reference.data());
+
+    int result = 0;
+    for (CpuLevel level : {CpuLevel::Scalar, CpuLevel::SSE41, CpuLevel::AVX2}) {
+        if (!ColorConverter::IsCpuLevelSupported(level)) {
+            std::cerr << "  " << std::left << std::setw(8) << ColorConverter::GetCpuLevelName(level)
+                      << " not supported by this CPU\n";
+            continue;
+        }
+
+        ColorConverter converter(level);
+        converter.Configure(width, height, width, height);
+
+        // Warm up caches and page in the output buffer
+        converter.Convert(source.data(), width * 4, 4, output.data());
+        int maxDiff = MaxAbsDiff(reference, output);
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t startCycles = ReadCycleCounter();
+        for (int i = 0; i < options.iterations; i++) {
+            converter.Convert(source.data(), width * 4, 4, output.data());
+        }
+        uint64_t cycles = ReadCycleCounter() - startCycles;
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        double msPerFrame = std::chrono::duration<double, std::milli>(elapsed).count() / options.iterations;
+        double cyclesPerPixel = static_cast<double>(cycles) / options.iterations / pixels;
+
+        std::cerr << "  " << std::left << std::setw(8) << ColorConverter::GetCpuLevelName(level)
+                  << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(9) << msPerFrame << " ms/frame"
+                  << std::setw(8) << std::setprecision(2) << cyclesPerPixel << " cycles/pixel"
+                  << "  max diff vs scalar: " << maxDiff << "\n";
+
+        if (maxDiff > 1) {
+            std::cerr << "  ERROR: " << ColorConverter::GetCpuLevelName(level)
+                      << " output differs from the scalar reference\n";
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+int BenchmarkColorSpaces(const BenchmarkOptions& options) {
+    int width = options.width;
+    int height = options.height;
+    int iterations = std::max(options.iterations / 4, 1);
+
+    std::cerr << "Color space / source layout specializations (" << width << "x" << height
+              << ", " << iterations << " iterations, ms/frame)\n";
+
+    auto source = MakeTestImage(width, height);
+    std::vector<uint8_t> reference(CalculateNV12FrameSize(width, height));
+    std::vector<uint8_t> output(reference.size());
+
+    const CpuLevel levels[] = {CpuLevel::Scalar, CpuLevel::SSE41, CpuLevel::AVX2};
+    const PixelLayout layouts[] = {PixelLayout::BGRX, PixelLayout::RGBX, PixelLayout::XBGR};
+    const char* layoutNames[] = {"BGRX", "RGBX", "XBGR"};
+
+    std::cerr << "  " << std::left << std::setw(17) << "";
+    for (CpuLevel level : levels) {
+        std::cerr << std::right << std::setw(9) << ColorConverter::GetCpuLevelName(level);
+    }
+    std::cerr << "\n";
+
+    int result = 0;
+    for (ColorMatrix matrix : {ColorMatrix::BT601, ColorMatrix::BT709}) {
+        for (ColorRange range : {ColorRange::Limited, ColorRange::Full}) {
+            for (size_t l = 0; l < std::size(layouts); l++) {
+                ColorSpace space{matrix, range};
+                std::cerr << "  " << std::left << std::setw(11) << GetColorSpaceName(space)
+                          << std::setw(6) << layoutNames[l] << std::right;
+
+                ColorConverter scalar(CpuLevel::Scalar);
+                scalar.SetColorSpace(space);
+                scalar.SetPixelLayout(layouts[l]);
+                scalar.Configure(width, height, width, height);
+                scalar.Convert(source.data(), width * 4, 4, reference.data());
+
+                bool mismatch = false;
+                for (CpuLevel level : levels) {
+                    if (!ColorConverter::IsCpuLevelSupported(level)) {
+                        std::cerr << std::setw(9) << "-";
+                        continue;
+                    }
+
+                    ColorConverter converter(level);
+                    converter.SetColorSpace(space);
+                    converter.SetPixelLayout(layouts[l]);
+                    converter.Configure(width, height, width, height);
+                    converter.Convert(source.data(), width * 4, 4, output.data());
+                    mismatch |= MaxAbsDiff(reference, output) > 1;
+
+                    auto start = std::chrono::steady_clock::now();
+                    for (int i = 0; i < iterations; i++) {
+                        converter.Convert(source.data(), width * 4, 4, output.data());
+                    }
+                    auto elapsed = std::chrono::steady_clock::now() - start;
+                    std::cerr << std::fixed << std::setprecision(3) << std::setw(9)
+                              << std::chrono::duration<double, std::milli>(elapsed).count() / iterations;
+                }
+                std::cerr << (mismatch ? "  ERROR: differs from the scalar reference" : "") << "\n";
+                if (mismatch) {
+                    result = 1;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+int BenchmarkScaledConversion(const BenchmarkOptions& options) {
+    struct ScaleCase {
+        int srcWidth, srcHeight, dstWidth, dstHeight;
+    };
+    const ScaleCase cases[] = {
+        {2560, 1440, 1280, 720},   // 2:1
+        {1920, 1080, 1280, 720},   // 3:2
+        {3840, 2160, 2560, 1440},  // 3:2
+        {2560, 1440, 1920, 1080},  // 4:3
+        {1920, 1080, 1366, 768},   // non-integer ratio
+    };
+
+    std::cerr << "Scaled conversion (" << ColorConverter::GetCpuLevelName(ColorConverter::DetectCpuLevel())
+              << ", " << options.iterations << " iterations)\n";
+
+    for (const auto& c : cases) {
+        auto source = MakeTestImage(c.srcWidth, c.srcHeight);
+        std::vector<uint8_t> output(CalculateNV12FrameSize(c.dstWidth, c.dstHeight));
+        double sourceMiB = static_cast<double>(source.size()) / (1024.0 * 1024.0);
+
+        for (ScaleFilter filter : {ScaleFilter::Nearest, ScaleFilter::Smooth}) {
+            ColorConverter converter;
+            converter.SetScaleFilter(filter);
+            converter.Configure(c.srcWidth, c.srcHeight, c.dstWidth, c.dstHeight);
+            converter.Convert(source.data(), c.srcWidth * 4, 4, output.data());
+
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < options.iterations; i++) {
+                converter.Convert(source.data(), c.srcWidth * 4, 4, output.data());
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            double msPerFrame = std::chrono::duration<double, std::milli>(elapsed).count() / options.iterations;
+            double readMiB = static_cast<double>(converter.GetSourceBytesRead()) / (1024.0 * 1024.0);
+
+            std::cerr << "  " << std::right << std::setw(4) << c.srcWidth << "x" << std::left << std::setw(4)
+                      << c.srcHeight << " -> " << std::right << std::setw(4) << c.dstWidth << "x" << std::left
+                      << std::setw(4) << c.dstHeight << " " << std::setw(8)
+                      << (filter == ScaleFilter::Nearest ? "nearest" : "smooth")
+                      << std::right << std::fixed << std::setprecision(3)
+                      << std::setw(9) << msPerFrame << " ms/frame"
+                      << std::setprecision(1) << std::setw(7) << readMiB << "/" << sourceMiB << " MiB read"
+                      << "  (" << converter.GetScaleDescription() << ")\n";
+        }
+    }
+
+    return 0;
+}
+
+int BenchmarkPyramid(const BenchmarkOptions& options) {
+    int width = options.width;
+    int height = options.height;
+
+    // A typical simulcast ladder: 2/3, then halves
+    std::vector<FrameSize> layers;
+    FrameSize size = {(width * 2 / 3) & ~1, (height * 2 / 3) & ~1};
+    while (layers.size() < 3 && size.width >= 2 && size.height >= 2) {
+        layers.push_back(size);
+        size = {(size.width / 2) & ~1, (size.height / 2) & ~1};
+    }
+
+    FramePyramid pyramid;
+    if (layers.empty() || !pyramid.Configure(width, height, layers)) {
+        return 0;
+    }
+
+    auto source = MakeTestImage(width, height);
+    std::vector<uint8_t> base(CalculateNV12FrameSize(width, height));
+    ColorConverter converter;
+    converter.Configure(width, height, width, height);
+    converter.Convert(source.data(), width * 4, 4, base.data());
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.iterations; i++) {
+        converter.Convert(source.data(), width * 4, 4, base.data());
+    }
+    double baseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() /
+                    options.iterations;
+
+    std::cerr << "Simulcast pyramid (" << width << "x" << height << " base, "
+              << ColorConverter::GetCpuLevelName(converter.GetCpuLevel()) << ", " << options.iterations
+              << " iterations)\n"
+              << "  base conversion " << std::fixed << std::setprecision(3) << baseMs << " ms/frame\n";
+
+    // Whole frames, then a 256x256 change as a typing or scrolling-sized update
+    FrameInfo fullInfo;
+    fullInfo.fullFrame = true;
+    FrameInfo partialInfo;
+    partialInfo.fullFrame = false;
+    partialInfo.dirtyRects.push_back(
+        {(width / 4) & ~1, (height / 4) & ~1, std::min(256, (width / 2) & ~1), std::min(256, (height / 2) & ~1)});
+
+    std::vector<double> fullMs(layers.size(), 0.0);
+    std::vector<double> partialMs(layers.size(), 0.0);
+    pyramid.Update(base.data(), fullInfo);
+    for (int i = 0; i < options.iterations; i++) {
+        pyramid.Update(base.data(), fullInfo);
+        for (size_t l = 0; l < layers.size(); l++) {
+            fullMs[l] += pyramid.GetLayerMs(static_cast<int>(l));
+        }
+        pyramid.Update(base.data(), partialInfo);
+        for (size_t l = 0; l < layers.size(); l++) {
+            partialMs[l] += pyramid.GetLayerMs(static_cast<int>(l));
+        }
+    }
+
+    // What each layer would cost as a capture of its own: converting the screen straight to its size
+    for (size_t l = 0; l < layers.size(); l++) {
+        ColorConverter direct;
+        direct.Configure(width, height, layers[l].width, layers[l].height);
+        std::vector<uint8_t> output(CalculateNV12FrameSize(layers[l].width, layers[l].height));
+        direct.Convert(source.data(), width * 4, 4, output.data());
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < options.iterations; i++) {
+            direct.Convert(source.data(), width * 4, 4, output.data());
+        }
+        double directMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() /
+                          options.iterations;
+
+        double full = fullMs[l] / options.iterations;
+        std::cerr << "  layer " << l + 1 << " " << std::right << std::setw(4) << layers[l].width << "x" << std::left
+                  << std::setw(4) << layers[l].height << std::right << std::setprecision(3) << std::setw(9) << full
+                  << " ms/frame" << std::setprecision(1) << std::setw(6) << full / baseMs * 100.0 << "% of base"
+                  << std::setprecision(3) << std::setw(9) << partialMs[l] / options.iterations << " ms for 256x256"
+                  << std::setw(9) << directMs << " ms converted directly\n";
+    }
+
+    return 0;
+}
+
+int BenchmarkThreadScaling(const BenchmarkOptions& options) {
+    int width = options.width;
+    int height = options.height;
+
+    std::cerr << "Threaded conversion (" << width << "x" << height << ", "
+              << ColorConverter::GetCpuLevelName(ColorConverter::DetectCpuLevel()) << ", "
+              << std::thread::hardware_concurrency() << " hardware threads)\n";
+
+    auto source = MakeTestImage(width, height);
+    std::vector<uint8_t> output(CalculateNV12FrameSize(width, height));
+
+    double singleThreadMs = 0.0;
+    for (int threads = 1; threads <= options.maxThreads; threads *= 2) {
+        ColorConverter converter;
+        converter.Configure(width, height, width, height, threads);
+        int stripes = converter.GetStripeCount();
+        if (stripes < threads) {
+            break;  // Frame too short to split further
+        }
+
+        WorkerPool pool(stripes);
+        std::vector<double> stripeMs(stripes, 0.0);
+        auto convertFrame = [&](bool timed) {
+            pool.Run(stripes, [&](int stripe) {
+                auto start = std::chrono::steady_clock::now();
+                converter.ConvertStripe(stripe, source.data(), width * 4, 4, output.data());
+                if (timed) {
+                    stripeMs[stripe] += std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start).count();
+                }
+            });
+        };
+
+        convertFrame(false);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < options.iterations; i++) {
+            convertFrame(true);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double msPerFrame = std::chrono::duration<double, std::milli>(elapsed).count() / options.iterations;
+        if (threads == 1) {
+            singleThreadMs = msPerFrame;
+        }
+
+        double maxStripe = 0.0;
+        double sumStripe = 0.0;
+        for (double ms : stripeMs) {
+            maxStripe = std::max(maxStripe, ms);
+            sumStripe += ms;
+        }
+        double meanStripe = sumStripe / stripes;
+
+        std::cerr << "  " << std::setw(2) << threads << " thread(s)"
+                  << std::fixed << std::setprecision(3) << std::setw(9) << msPerFrame << " ms/frame"
+                  << std::setprecision(2) << std::setw(7) << singleThreadMs / msPerFrame << "x speedup"
+                  << "  stripe imbalance " << std::setprecision(0)
+                  << (meanStripe > 0.0 ? (maxStripe - meanStripe) / meanStripe * 100.0 : 0.0) << "%\n";
+    }
+
+    return 0;
+}
+
+// Raw camera formats -> NV12 per kernel level, bit-exact against the scalar kernels
+int BenchmarkCameraConversion(const BenchmarkOptions& options) {
+    int width = options.width;
+    int height = options.height;
+    double pixels = static_cast<double>(width) * height;
+
+    std::cerr << "Camera format -> NV12 conversion (" << width << "x" << height
+              << ", " << options.iterations << " iterations)\n";
+
+    // Reuse the noise image bytes as camera samples; every format fits in 4 bytes per pixel
+    auto source = MakeTestImage(width, height);
+    const uint8_t* src = source.data();
+
+    struct Format {
+        const char* name;
+        bool inPlace;          // Converts the output buffer, which starts as a copy of the source
+        bool rgb;              // Runs ColorConverter's RGB kernels (SSE4.1 rather than SSE2)
+        std::function<void(CameraFormatConverter&, uint8_t*)> convert;
+    };
+    const Format formats[] = {
+        {"YUYV", false, false, [&](CameraFormatConverter& c, uint8_t* out) {
+             c.ConvertYUYV(src, width * 2, width, height, out);
+         }},
+        {"UYVY", false, false, [&](CameraFormatConverter& c, uint8_t* out) {
+             c.ConvertUYVY(src, width * 2, width, height, out);
+         }},
+        {"NV21", false, false, [&](CameraFormatConverter& c, uint8_t* out) {
+             c.ConvertNV21(src, width, width, height, out);
+         }},
+        {"NV21 in place", true, false, [&](CameraFormatConverter& c, uint8_t* out) {
+             c.ConvertNV21(out, width, width, height, out);
+         }},
+        {"YU12", false, false, [&](CameraFormatConverter& c, uint8_t* out) {
+             c.ConvertI420(src, width, width, height, false, out);
+         }},
+        {"BGR3", false, true, [&](CameraFormatConverter& c, uint8_t* out) {
+             c.ConvertRGB24(src, width * 3, width, height, PixelLayout::BGRX, out);
+         }},
+    };
+
+    std::vector<uint8_t> reference(CalculateNV12FrameSize(width, height));
+    std::vector<uint8_t> output(reference.size());
+
+    int result = 0;
+    for (const auto& format : formats) {
+        // In-place conversion must match the copying one
+        CameraFormatConverter scalar(CpuLevel::Scalar);
+        if (format.inPlace) {
+            scalar.ConvertNV21(src, width, width, height, reference.data());
+        } else {
+            format.convert(scalar, reference.data());
+        }
+
+        for (CpuLevel level : {CpuLevel::Scalar, CpuLevel::SSE41, CpuLevel::AVX2}) {
+            const char* name = level == CpuLevel::SSE41 && !format.rgb ? "sse2" : ColorConverter::GetCpuLevelName(level);
+            if (!ColorConverter::IsCpuLevelSupported(level)) {
+                std::cerr << "  " << std::left << std::setw(14) << format.name << std::setw(8) << name
+                          << std::right << " not supported by this CPU\n";
+                continue;
+            }
+
+            CameraFormatConverter converter(level);
+            if (format.inPlace) {
+                std::copy(source.begin(), source.begin() + output.size(), output.begin());
+            }
+            format.convert(converter, output.data());
+            bool exact = output == reference;
+
+            auto start = std::chrono::steady_clock::now();
+            uint64_t startCycles = ReadCycleCounter();
+            for (int i = 0; i < options.iterations; i++) {
+                format.convert(converter, output.data());
+            }
+            uint64_t cycles = ReadCycleCounter() - startCycles;
+            auto elapsed = std::chrono::steady_clock::now() - start;
+
+            double msPerFrame = std::chrono::duration<double, std::milli>(elapsed).count() / options.iterations;
+            double cyclesPerPixel = static_cast<double>(cycles) / options.iterations / pixels;
+
+            auto flags = std::cerr.flags();
+            auto precision = std::cerr.precision();
+            std::cerr << "  " << std::left << std::setw(14) << format.name << std::setw(8) << name
+                      << std::right << std::fixed << std::setprecision(3)
+                      << std::setw(9) << msPerFrame << " ms/frame"
+                      << std::setw(8) << std::setprecision(2) << cyclesPerPixel << " cycles/pixel"
+                      << "  " << (exact ? "bit-exact" : "DIFFERS") << "\n";
+            std::cerr.flags(flags);
+            std::cerr.precision(precision);
+
+            if (!exact) {
+                std::cerr << "  ERROR: " << format.name << " " << name << " output differs from the scalar kernel\n";
+                result = 1;
+            }
+        }
+    }
+
+    return result;
+}
+
+// Encode a BGRA image as a 4:2:2 baseline JPEG with the standard Huffman tables, like a UVC camera
+std::vector<uint8_t> EncodeTestJpeg(const std::vector<uint8_t>& image, int width, int height) {
+    jpeg_compress_struct info;
+    jpeg_error_mgr error;
+    info.err = jpeg_std_error(&error);
+    jpeg_create_compress(&info);
+
+    unsigned char* buffer = nullptr;
+    unsigned long size = 0;
+    jpeg_mem_dest(&info, &buffer, &size);
+    info.image_width = width;
+    info.image_height = height;
+    info.input_components = 4;
+    info.in_color_space = JCS_EXT_BGRX;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, 85, TRUE);
+    info.comp_info[0].h_samp_factor = 2;
+    info.comp_info[0].v_samp_factor = 1;
+
+    jpeg_start_compress(&info, TRUE);
+    while (info.next_scanline < info.image_height) {
+        JSAMPROW row = const_cast<uint8_t*>(image.data()) + static_cast<size_t>(info.next_scanline) * width * 4;
+        jpeg_write_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_compress(&info);
+
+    std::vector<uint8_t> jpeg(buffer, buffer + size);
+    free(buffer);
+    jpeg_destroy_compress(&info);
+    return jpeg;
+}
+
+// Drop the DHT segments ahead of the scan, as many UVC cameras do
+std::vector<uint8_t> StripHuffmanTables(const std::vector<uint8_t>& jpeg) {
+    std::vector<uint8_t> stripped(jpeg.begin(), jpeg.begin() + 2);
+    size_t pos = 2;
+    while (pos + 4 <= jpeg.size() && jpeg[pos + 1] != 0xDA) {
+        size_t length = (static_cast<size_t>(jpeg[pos + 2]) << 8) | jpeg[pos + 3];
+        if (jpeg[pos + 1] != 0xC4) {
+            stripped.insert(stripped.end(), jpeg.begin() + pos, jpeg.begin() + pos + 2 + length);
+        }
+        pos += 2 + length;
+    }
+    stripped.insert(stripped.end(), jpeg.begin() + pos, jpeg.end());
+    return stripped;
+}
+
+// Time MJPEG decoding of a list of frames, one decoder reused throughout like the camera loop
+double TimeMjpegDecode(MjpegDecoder& decoder, const std::vector<std::pair<const uint8_t*, size_t>>& frames,
+                       int width, int height, int iterations, std::vector<uint8_t>& output, bool& ok) {
+    ok = true;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        for (const auto& frame : frames) {
+            ok = decoder.Decode(frame.first, frame.second, width, height, output.data()) && ok;
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::milli>(elapsed).count() / (static_cast<double>(iterations) * frames.size());
+}
+
+// FNV-1a over a decoded frame: enough to notice any change in a stored replay's output
+uint64_t ChecksumFrame(const std::vector<uint8_t>& frame) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t byte : frame) {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Decode every frame of a replayed stream once and compare its NV12 checksum with the stored
+// ones ("<frame> <checksum>" lines, '#' comments), or store them with --write-checksums
+int CheckMjpegChecksums(const BenchmarkOptions& options, const std::vector<std::pair<const uint8_t*, size_t>>& frames,
+                        int width, int height) {
+    MjpegDecoder decoder;
+    std::vector<uint8_t> output(CalculateNV12FrameSize(width, height));
+    std::vector<uint64_t> checksums;
+    for (const auto& frame : frames) {
+        std::fill(output.begin(), output.end(), 0);
+        decoder.Decode(frame.first, frame.second, width, height, output.data());
+        checksums.push_back(ChecksumFrame(output));
+    }
+
+    if (options.writeChecksums) {
+        std::ofstream file(options.mjpegChecksums);
+        file << "# NV12 checksums (FNV-1a 64) of each frame of " << options.mjpegFile << ", written by\n"
+             << "# 'SnackaCaptureLinux benchmark --mjpeg <stream> --mjpeg-checksums <this file> --write-checksums'\n";
+        for (size_t i = 0; i < checksums.size(); i++) {
+            file << i << " " << std::hex << std::setw(16) << std::setfill('0') << checksums[i] << std::dec << "\n";
+        }
+        if (!file) {
+            std::cerr << "  ERROR: could not write " << options.mjpegChecksums << "\n";
+            return 1;
+        }
+        std::cerr << "  checksums      " << checksums.size() << " frames written to " << options.mjpegChecksums << "\n";
+        return 0;
+    }
+
+    std::ifstream file(options.mjpegChecksums);
+    if (!file) {
+        std::cerr << "  ERROR: could not read " << options.mjpegChecksums << "\n";
+        return 1;
+    }
+    std::vector<uint64_t> expected;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        size_t index = 0;
+        uint64_t checksum = 0;
+        if (!(fields >> index >> std::hex >> checksum) || index != expected.size()) {
+            std::cerr << "  ERROR: malformed checksum line in " << options.mjpegChecksums << ": " << line << "\n";
+            return 1;
+        }
+        expected.push_back(checksum);
+    }
+
+    size_t mismatched = 0;
+    for (size_t i = 0; i < checksums.size(); i++) {
+        if ((i >= expected.size() || checksums[i] != expected[i]) && ++mismatched <= 5) {
+            std::cerr << "  ERROR: frame " << i << " decodes differently than stored in " << options.mjpegChecksums
+                      << "\n";
+        }
+    }
+    std::cerr << "  checksums      " << checksums.size() - mismatched << " of " << checksums.size()
+              << " frames match (" << expected.size() << " stored)\n";
+    return mismatched == 0 && expected.size() == checksums.size() ? 0 : 1;
+}
+
+// MJPEG camera frames to NV12: a synthetic frame with and without Huffman tables, then an
+// optional captured stream, so the camera decode path runs without a camera
+int BenchmarkMjpeg(const BenchmarkOptions& options) {
+    int width = options.width & ~1;
+    int height = options.height & ~1;
+
+    std::cerr << "MJPEG -> NV12 decode, 4:2:2 (" << width << "x" << height
+              << ", " << options.iterations << " iterations)\n";
+
+    auto jpeg = EncodeTestJpeg(MakeTestImage(width, height), width, height);
+    auto stripped = StripHuffmanTables(jpeg);
+    std::vector<uint8_t> reference(CalculateNV12FrameSize(width, height));
+    std::vector<uint8_t> output(reference.size());
+
+    int result = 0;
+    MjpegDecoder decoder;
+    bool ok = false;
+    TimeMjpegDecode(decoder, {{jpeg.data(), jpeg.size()}}, width, height, 1, reference, ok);  // Warm-up
+    double withTables = TimeMjpegDecode(decoder, {{jpeg.data(), jpeg.size()}}, width, height,
+                                        options.iterations, reference, ok);
+    bool strippedOk = false;
+    double withoutTables = TimeMjpegDecode(decoder, {{stripped.data(), stripped.size()}}, width, height,
+                                           options.iterations, output, strippedOk);
+
+    auto flags = std::cerr.flags();
+    auto precision = std::cerr.precision();
+    std::cerr << std::fixed << std::setprecision(3)
+              << "  with DHT       " << std::setw(9) << withTables << " ms/frame (" << jpeg.size() / 1024
+              << " KiB)\n"
+              << "  without DHT    " << std::setw(9) << withoutTables << " ms/frame"
+              << "  max diff vs with DHT: " << MaxAbsDiff(reference, output) << "\n";
+    std::cerr.flags(flags);
+    std::cerr.precision(precision);
+
+    if (!ok || !strippedOk || reference != output) {
+        std::cerr << "  ERROR: frames without Huffman tables do not decode like the original\n";
+        result = 1;
+    }
+
+    if (options.mjpegFile.empty()) {
+        return result;
+    }
+
+    std::ifstream file(options.mjpegFile, std::ios::binary);
+    std::vector<uint8_t> stream((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    auto spans = MjpegDecoder::SplitFrames(stream.data(), stream.size());
+    int streamWidth = 0;
+    int streamHeight = 0;
+    if (spans.empty() || !MjpegDecoder::ReadSize(stream.data() + spans[0].first, spans[0].second, streamWidth,
+                                                 streamHeight)) {
+        std::cerr << "  ERROR: no JPEG frames in " << options.mjpegFile << "\n";
+        return 1;
+    }
+
+    std::vector<std::pair<const uint8_t*, size_t>> frames;
+    size_t missingTables = 0;
+    for (const auto& span : spans) {
+        frames.emplace_back(stream.data() + span.first, span.second);
+        bool hasHuffmanTables = false;
+        if (MjpegDecoder::Inspect(frames.back().first, frames.back().second, hasHuffmanTables) &&
+            !hasHuffmanTables) {
+            missingTables++;
+        }
+    }
+
+    std::cerr << "MJPEG replay of " << options.mjpegFile << " (" << frames.size() << " frames, "
+              << streamWidth << "x" << streamHeight << ", " << missingTables << " without DHT)\n";
+
+    MjpegDecoder replayDecoder;
+    output.resize(CalculateNV12FrameSize(streamWidth, streamHeight));
+    bool replayOk = false;
+    int passes = std::max(1, options.iterations / static_cast<int>(frames.size()));
+    double replayMs = TimeMjpegDecode(replayDecoder, frames, streamWidth, streamHeight, passes, output, replayOk);
+
+    flags = std::cerr.flags();
+    precision = std::cerr.precision();
+    std::cerr << std::fixed << std::setprecision(3) << "  decode         " << std::setw(9) << replayMs
+              << " ms/frame (" << replayDecoder.DescribeStats() << ")\n";
+    std::cerr.flags(flags);
+    std::cerr.precision(precision);
+
+    if (!replayOk) {
+        std::cerr << "  ERROR: some frames failed to decode\n";
+        result = 1;
+    }
+    if (!options.mjpegChecksums.empty()) {
+        result |= CheckMjpegChecksums(options, frames, streamWidth, streamHeight);
+    }
+    return result;
+}
+
+// Decode throughput of the MJPEG thread pool against one decoder, as a camera faster than one
+// core would drive it: a new frame whenever a thread is free, delivered in submission order
+int BenchmarkMjpegThreads(const BenchmarkOptions& options) {
+    int width = options.width & ~1;
+    int height = options.height & ~1;
+    int maxThreads = std::min(options.maxThreads, 4);
+
+    std::cerr << "MJPEG decode threads (" << width << "x" << height << ", " << options.iterations
+              << " frames)\n";
+
+    auto jpeg = EncodeTestJpeg(MakeTestImage(width, height), width, height);
+    std::vector<uint8_t> reference(CalculateNV12FrameSize(width, height));
+    MjpegDecoder decoder;
+    bool ok = false;
+    double singleMs = TimeMjpegDecode(decoder, {{jpeg.data(), jpeg.size()}}, width, height, options.iterations,
+                                      reference, ok);
+
+    auto flags = std::cerr.flags();
+    auto precision = std::cerr.precision();
+    std::cerr << std::fixed << std::setprecision(1) << "  1 thread   " << std::setw(7) << 1000.0 / singleMs
+              << " fps\n";
+
+    int result = 0;
+    for (int threads = 2; threads <= maxThreads; threads++) {
+        MjpegDecodePool pool(threads, width, height);
+        int submitted = 0;
+        int delivered = 0;
+        bool inOrder = true;
+        bool matches = true;
+
+        auto start = std::chrono::steady_clock::now();
+        while (delivered < options.iterations) {
+            MjpegDecodePool::Job job;
+            job.jpeg = jpeg.data();
+            job.size = jpeg.size();
+            job.timestamp = static_cast<uint64_t>(submitted);
+            if (submitted < options.iterations && pool.Submit(std::move(job))) {
+                submitted++;
+                continue;
+            }
+
+            struct pollfd pfd = {pool.GetEventFd(), POLLIN, 0};
+            poll(&pfd, 1, 1000);
+            MjpegDecodePool::Job done;
+            while (pool.PopCompleted(done)) {
+                inOrder = inOrder && done.timestamp == static_cast<uint64_t>(delivered);
+                matches = matches && done.decoded &&
+                          std::equal(reference.begin(), reference.end(), done.nv12.data());
+                delivered++;
+            }
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double fps = options.iterations / std::chrono::duration<double>(elapsed).count();
+
+        std::cerr << "  " << threads << " threads  " << std::setw(7) << fps << " fps"
+                  << std::setw(7) << std::setprecision(2) << fps * singleMs / 1000.0 << "x  ("
+                  << pool.DescribeStats() << ")\n" << std::setprecision(1);
+
+        if (!inOrder || !matches) {
+            std::cerr << "  ERROR: " << threads << " threads delivered frames "
+                      << (!inOrder ? "out of order" : "that differ from a single decoder") << "\n";
+            result = 1;
+        }
+    }
+
+    std::cerr.flags(flags);
+    std::cerr.precision(precision);
+    return result;
+}
+
+// Full-screen and scattered-tile grabs from the running X server through each backend
+int BenchmarkGrab(const BenchmarkOptions& options) {
+    Display* display = XOpenDisplay(nullptr);
+    if (!display) {
+        std::cerr << "Grab backends: no X display, skipped\n";
+        return 0;
+    }
+
+    int screen = DefaultScreen(display);
+    Window root = RootWindow(display, screen);
+    int width = DisplayWidth(display, screen);
+    int height = DisplayHeight(display, screen);
+    int depth = DefaultDepth(display, screen);
+    xcb_connection_t* xcb = XGetXCBConnection(display);
+    int iterations = options.iterations;
+
+    bool fdPassing = false;
+    int bytesPerPixel = 0;
+    int stride = 0;
+    if (!XShmQueryExtension(display) || !XcbShmSegment::QuerySupport(xcb, fdPassing) ||
+        !XcbShmSegment::GetImageLayout(xcb, depth, width, bytesPerPixel, stride)) {
+        std::cerr << "Grab backends: MIT-SHM not available, skipped\n";
+        XCloseDisplay(display);
+        return 0;
+    }
+
+    // 64 tiles of 64x64 spread over the screen, like a typical damage batch
+    constexpr int TILE = 64;
+    std::vector<FrameRect> tiles;
+    for (int i = 0; i < 64; i++) {
+        int x = (i * 7919) % std::max(width - TILE, 1);
+        int y = (i * 104729) % std::max(height - TILE, 1);
+        tiles.push_back({x, y, std::min(TILE, width), std::min(TILE, height)});
+    }
+    int tileStride = 0;
+    XcbShmSegment::GetImageLayout(xcb, depth, TILE, bytesPerPixel, tileStride);
+
+    std::cerr << "Grab backends (" << width << "x" << height << " root window, depth " << depth
+              << ", MIT-SHM fd passing " << (fdPassing ? "yes" : "no") << ")\n";
+
+    double frameMiB = static_cast<double>(stride) * height / (1024.0 * 1024.0);
+    auto report = [&](const char* name, double totalMs, double mibPerIteration) {
+        double ms = totalMs / iterations;
+        std::cerr << "  " << std::left << std::setw(28) << name << std::right << std::fixed
+                  << std::setprecision(3) << std::setw(9) << ms << " ms"
+                  << std::setprecision(0) << std::setw(8) << mibPerIteration / (ms / 1000.0) << " MiB/s\n";
+    };
+    auto timeLoop = [&](auto&& body) {
+        body(0);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            body(i);
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    int result = 0;
+
+    // Xlib: every XShmGetImage waits for the server copy
+    XImage* image = nullptr;
+    XShmSegmentInfo shmInfo = {};
+    XImage* tileImage = nullptr;
+    XShmSegmentInfo tileShmInfo = {};
+    if (CreateShmImage(display, DefaultVisual(display, screen), depth, width, height, image, shmInfo) &&
+        CreateShmImage(display, DefaultVisual(display, screen), depth, TILE, TILE, tileImage, tileShmInfo)) {
+        report("xlib full frame", timeLoop([&](int) {
+            XShmGetImage(display, root, image, 0, 0, AllPlanes);
+        }), frameMiB);
+        report("xlib 64 tiles", timeLoop([&](int) {
+            for (const auto& tile : tiles) {
+                XShmGetImage(display, root, tileImage, tile.x, tile.y, AllPlanes);
+            }
+        }), tileStride * TILE * tiles.size() / (1024.0 * 1024.0));
+    } else {
+        result = 1;
+    }
+    DestroyShmImage(display, tileImage, tileShmInfo);
+    DestroyShmImage(display, image, shmInfo);
+
+    XcbShmSegment segments[2];
+    XcbShmSegment tileSegment;
+    size_t frameBytes = static_cast<size_t>(stride) * height;
+    if (segments[0].Create(xcb, frameBytes, fdPassing) && segments[1].Create(xcb, frameBytes, fdPassing) &&
+        tileSegment.Create(xcb, static_cast<size_t>(tileStride) * TILE * tiles.size(), fdPassing)) {
+        report(segments[0].IsMemfd() ? "xcb full frame (memfd)" : "xcb full frame (sysv)", timeLoop([&](int) {
+            segments[0].WaitImage(segments[0].RequestImage(root, 0, 0, width, height, 0));
+        }), frameMiB);
+
+        // Next request goes out before the previous reply is collected, as in the capture pipeline
+        xcb_shm_get_image_cookie_t inFlight = segments[1].RequestImage(root, 0, 0, width, height, 0);
+        report("xcb full frame, 2 in flight", timeLoop([&](int i) {
+            XcbShmSegment& next = segments[i % 2];
+            xcb_shm_get_image_cookie_t cookie = next.RequestImage(root, 0, 0, width, height, 0);
+            xcb_flush(xcb);
+            segments[(i + 1) % 2].WaitImage(inFlight);
+            inFlight = cookie;
+        }), frameMiB);
+        segments[0].WaitImage(inFlight);
+
+        std::vector<xcb_shm_get_image_cookie_t> cookies(tiles.size());
+        report("xcb 64 tiles, batched", timeLoop([&](int) {
+            for (size_t t = 0; t < tiles.size(); t++) {
+                cookies[t] = tileSegment.RequestImage(root, tiles[t].x, tiles[t].y, tiles[t].width, tiles[t].height,
+                                                      static_cast<uint32_t>(t * tileStride * TILE));
+            }
+            for (auto cookie : cookies) {
+                tileSegment.WaitImage(cookie);
+            }
+        }), tileStride * TILE * tiles.size() / (1024.0 * 1024.0));
+    } else {
+        result = 1;
+    }
+
+    for (auto& segment : segments) {
+        segment.Destroy();
+    }
+    tileSegment.Destroy();
+
+    // Server-side XRender downscale against a full grab scaled while converting, for
+    // outputs a third and a quarter of the screen (one conversion thread each)
+    bool renderAvailable = XRenderScaler::QuerySupport(display);
+    if (!renderAvailable) {
+        std::cerr << "  XRender not available, server-side scaling skipped\n";
+    }
+    for (int divisor : {3, 4}) {
+        if (!renderAvailable) {
+            break;
+        }
+        int outputWidth = (width / divisor) & ~1;
+        int outputHeight = (height / divisor) & ~1;
+        FrameSize scaled = XRenderScaler::PickScaledSize(width, height, outputWidth, outputHeight);
+        double clientGrabMs = 0.0;
+        double serverGrabMs = 0.0;
+        if (!XRenderScaler::Measure(display, root, DefaultVisual(display, screen), depth, {0, 0, width, height},
+                                    scaled.width, scaled.height, iterations, clientGrabMs, serverGrabMs)) {
+            result = 1;
+            continue;
+        }
+
+        auto timeConversion = [&](int srcWidth, int srcHeight) {
+            auto source = MakeTestImage(srcWidth, srcHeight);
+            std::vector<uint8_t> output(CalculateNV12FrameSize(outputWidth, outputHeight));
+            ColorConverter converter;
+            converter.Configure(srcWidth, srcHeight, outputWidth, outputHeight);
+            return timeLoop([&](int) {
+                converter.Convert(source.data(), srcWidth * 4, 4, output.data());
+            }) / iterations;
+        };
+        double clientConvertMs = timeConversion(width, height);
+        double serverConvertMs = timeConversion(scaled.width, scaled.height);
+
+        std::cerr << "  to " << outputWidth << "x" << outputHeight << ", client scaling: " << std::fixed
+                  << std::setprecision(3) << clientGrabMs << " ms grab + " << clientConvertMs
+                  << " ms convert; xrender via " << scaled.width << "x" << scaled.height << ": " << serverGrabMs
+                  << " ms grab + " << serverConvertMs << " ms convert\n";
+    }
+
+    XCloseDisplay(display);
+    return result;
+}
+
+}  // namespace
+
+int RunBenchmark(const BenchmarkOptions& options) {
+    std::cerr << "=== SnackaCaptureLinux Benchmark ===\n";
+    std::cerr << "Best CPU level: " << ColorConverter::GetCpuLevelName(ColorConverter::DetectCpuLevel()) << "\n\n";
+
+    int result = BenchmarkColorConversion(options);
+    std::cerr << "\n";
+    result |= BenchmarkColorSpaces(options);
+    std::cerr << "\n";
+    result |= BenchmarkScaledConversion(options);
+    std::cerr << "\n";
+    result |= BenchmarkPyramid(options);
+    std::cerr << "\n";
+    result |= BenchmarkThreadScaling(options);
+    std::cerr << "\n";
+    result |= BenchmarkCameraConversion(options);
+    std::cerr << "\n";
+    result |= BenchmarkMjpeg(options);
+    std::cerr << "\n";
+    result |= BenchmarkMjpegThreads(options);
+    if (options.grab) {
+        std::cerr << "\n";
+        result |= BenchmarkGrab(options);
+    }
+
+    std::cerr << "\n";
+    return result;
+}
+
+}  // namespace snacka
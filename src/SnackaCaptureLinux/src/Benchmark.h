@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+namespace snacka {
+
+/// Options for the 'benchmark' command
+struct BenchmarkOptions {
+    int width = 1920;
+    int height = 1080;
+    int iterations = 100;
+    int maxThreads = 8;  // Upper bound for the conversion thread scaling run
+    bool grab = false;   // Also time screen grabs per backend (needs an X server)
+    std::string mjpegFile;  // Captured MJPEG stream (concatenated JPEG frames) to replay through the decoder
+    std::string mjpegChecksums;  // NV12 checksums each replayed frame must decode to
+    bool writeChecksums = false;  // Store the replay's checksums in mjpegChecksums instead of comparing
+};
+
+/// Run CPU micro-benchmarks for the capture pipeline stages on synthetic frames.
+/// Prints results to stderr; needs no X server, camera or GPU unless grab is set.
+/// @return 0 on success, 1 if a SIMD kernel disagrees with the scalar reference, an MJPEG frame fails
+///         to decode or a replayed frame does not match its stored checksum
+int RunBenchmark(const BenchmarkOptions& options);
+
+}  // namespace snacka
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace snacka {
+
+/// Fixed-capacity FIFO for handing frames between pipeline threads.
+/// Push and Pop block while the queue is full or empty; Close() wakes every waiter
+/// so stage threads can exit. Also used as a free list of buffer indices.
+template <typename T>
+class BoundedQueue {
+public:
+    /// @param capacity Maximum number of queued items (at least 1)
+    explicit BoundedQueue(size_t capacity) : m_capacity(capacity > 0 ? capacity : 1) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /// Append an item, waiting for space
+    /// @return false if the queue was closed
+    bool Push(T item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed) {
+            return false;
+        }
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    /// Remove the oldest item, waiting for one to arrive
+    /// @return false if the queue was closed
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_closed) {
+            return false;
+        }
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    /// Remove the oldest item if there is one, without waiting
+    bool TryPop(T& item) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed || m_items.empty()) {
+            return false;
+        }
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    /// Wake all waiters; further Push/Pop calls fail
+    void Close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+    /// Drop all items and reopen the queue
+    void Reset() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_items.clear();
+        m_closed = false;
+    }
+
+    size_t GetSize() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items.size();
+    }
+
+private:
+    const size_t m_capacity;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    std::deque<T> m_items;
+    bool m_closed = false;
+};
+
+}  // namespace snacka
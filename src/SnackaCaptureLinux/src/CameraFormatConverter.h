@@ -0,0 +1,65 @@
+#pragma once
+
+#include "CameraFormatKernels.h"
+#include "ColorConverter.h"
+
+#include <cstdint>
+
+namespace snacka {
+
+/// Converts raw camera frames to NV12 in a single pass, two rows at a time, with
+/// the best row kernels for the CPU. The SIMD kernels are bit-exact with the scalar ones.
+/// Frame sizes are even except for YUYV and UYVY, which also take odd sizes.
+class CameraFormatConverter {
+public:
+    /// @param level Kernel level; falls back to the best supported one if the CPU lacks it.
+    ///              SSE4.1 selects the SSE2 kernels; AVX2 keeps them for YUYV and UYVY.
+    explicit CameraFormatConverter(CpuLevel level = ColorConverter::DetectCpuLevel());
+
+    /// Convert a YUYV (packed 4:2:2) frame; chroma rows are averaged in pairs
+    /// @param srcStride Bytes per source row (at least width * 2)
+    /// @param nv12 Output of CalculateNV12FrameSize(width, height) bytes, UV rows width bytes apart
+    void ConvertYUYV(const uint8_t* yuyv, int srcStride, int width, int height, uint8_t* nv12) const;
+
+    /// Convert a UYVY (packed 4:2:2, chroma first) frame, like ConvertYUYV
+    void ConvertUYVY(const uint8_t* uyvy, int srcStride, int width, int height, uint8_t* nv12) const;
+
+    /// Repack an NV12 frame whose rows are padded to srcStride bytes
+    void CopyNV12(const uint8_t* src, int srcStride, int width, int height, uint8_t* nv12) const;
+
+    /// Convert an NV21 (VU order) frame by swapping each chroma pair.
+    /// nv12 may be nv21 itself when srcStride == width: then only the chroma plane is rewritten.
+    void ConvertNV21(const uint8_t* nv21, int srcStride, int width, int height, uint8_t* nv12) const;
+
+    /// Convert a planar 4:2:0 frame (YU12/I420, or YV12 with swapChroma)
+    /// @param srcStride Bytes per luma row; chroma rows are srcStride / 2 bytes
+    void ConvertI420(const uint8_t* i420, int srcStride, int width, int height, bool swapChroma,
+                     uint8_t* nv12) const;
+
+    /// Convert packed 24-bit RGB to BT.601 limited range NV12 (the camera output colorimetry)
+    /// with the SIMD RGB kernels of ColorConverter
+    /// @param layout PixelLayout::BGRX for BGR3 (B, G, R bytes), RGBX for RGB3
+    void ConvertRGB24(const uint8_t* rgb, int srcStride, int width, int height, PixelLayout layout,
+                      uint8_t* nv12);
+
+    /// Get the kernel level in use
+    CpuLevel GetCpuLevel() const { return m_level; }
+
+private:
+    void ConvertPacked422(kernels::ConvertYuyvRowPairFn rowPair, int lumaByte, const uint8_t* src,
+                          int srcStride, int width, int height, uint8_t* nv12) const;
+
+    CpuLevel m_level = CpuLevel::Scalar;
+    kernels::ConvertYuyvRowPairFn m_yuyvRowPair = nullptr;
+    kernels::ConvertYuyvRowPairFn m_uyvyRowPair = nullptr;
+    kernels::SwapUVRowFn m_swapUVRow = nullptr;
+    kernels::InterleaveUVRowFn m_interleaveUVRow = nullptr;
+
+    // RGB cameras, configured on first use and whenever the size or byte order changes
+    ColorConverter m_rgbConverter;
+    int m_rgbWidth = 0;
+    int m_rgbHeight = 0;
+    PixelLayout m_rgbLayout = PixelLayout::BGRX;
+};
+
+}  // namespace snacka
@@ -0,0 +1,99 @@
+// SSE2 raw camera format to NV12 row kernels. Compiled with -msse2, dispatched at runtime.
+
+#include "CameraFormatKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <emmintrin.h>
+
+namespace snacka::kernels {
+
+namespace {
+
+// Truncating byte average, (a + b) >> 1: pavgb rounds up, so take back the odd bit
+inline __m128i AverageDown(__m128i a, __m128i b) {
+    __m128i odd = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+    return _mm_sub_epi8(_mm_avg_epu8(a, b), odd);
+}
+
+// Even (Byte 0) or odd (Byte 1) bytes of each 16-bit word, zero extended
+template <int Byte>
+inline __m128i SelectByte(__m128i v) {
+    if constexpr (Byte == 0) {
+        return _mm_and_si128(v, _mm_set1_epi16(0x00FF));
+    } else {
+        return _mm_srli_epi16(v, 8);
+    }
+}
+
+template <int LumaByte>
+void ConvertPacked422RowPair(const uint8_t* src0, const uint8_t* src1,
+                             uint8_t* y0, uint8_t* y1, uint8_t* uv, int width) {
+    constexpr int ChromaByte = 1 - LumaByte;
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + x * 2));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + x * 2 + 16));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + x * 2));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + x * 2 + 16));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x),
+                         _mm_packus_epi16(SelectByte<LumaByte>(a0), SelectByte<LumaByte>(a1)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x),
+                         _mm_packus_epi16(SelectByte<LumaByte>(b0), SelectByte<LumaByte>(b1)));
+
+        // Chroma bytes are U V U V ..., already in NV12 order
+        __m128i chroma0 = _mm_packus_epi16(SelectByte<ChromaByte>(a0), SelectByte<ChromaByte>(a1));
+        __m128i chroma1 = _mm_packus_epi16(SelectByte<ChromaByte>(b0), SelectByte<ChromaByte>(b1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x), AverageDown(chroma0, chroma1));
+    }
+
+    if (x < width) {
+        ConvertPacked422RowPairReference<LumaByte>(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x, uv + x, width - x);
+    }
+}
+
+}  // namespace
+
+void ConvertYuyvRowPairSSE2(const uint8_t* src0, const uint8_t* src1,
+                            uint8_t* y0, uint8_t* y1, uint8_t* uv, int width) {
+    ConvertPacked422RowPair<0>(src0, src1, y0, y1, uv, width);
+}
+
+void ConvertUyvyRowPairSSE2(const uint8_t* src0, const uint8_t* src1,
+                            uint8_t* y0, uint8_t* y1, uint8_t* uv, int width) {
+    ConvertPacked422RowPair<1>(src0, src1, y0, y1, uv, width);
+}
+
+void SwapUVRowSSE2(const uint8_t* src, uint8_t* dst, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        // Rotating each 16-bit word by 8 swaps V and U
+        __m128i vu = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                         _mm_or_si128(_mm_slli_epi16(vu, 8), _mm_srli_epi16(vu, 8)));
+    }
+
+    if (x < width) {
+        SwapUVRowReference(src + x, dst + x, width - x);
+    }
+}
+
+void InterleaveUVRowSSE2(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width) {
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m128i us = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x / 2));
+        __m128i vs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + x / 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x), _mm_unpacklo_epi8(us, vs));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x + 16), _mm_unpackhi_epi8(us, vs));
+    }
+
+    if (x < width) {
+        InterleaveUVRowReference(u + x / 2, v + x / 2, uv + x, width - x);
+    }
+}
+
+}  // namespace snacka::kernels
+
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+
+// Raw camera format to NV12 row building blocks shared by the camera format kernel files.
+// Internal linkage for the same reason as ColorConverterKernels.h: the SIMD files are
+// compiled with ISA flags and must not lend their copy of an inline function to the
+// scalar path.
+
+#include <cstdint>
+
+namespace snacka::kernels {
+
+/// Convert two packed 4:2:2 rows (YUYV or UYVY) to two Y rows and one interleaved UV row.
+/// Chroma is the truncating average of the two rows; width is in pixels.
+using ConvertYuyvRowPairFn = void (*)(const uint8_t* src0, const uint8_t* src1,
+                                      uint8_t* y0, uint8_t* y1, uint8_t* uv, int width);
+
+/// Swap the bytes of each VU pair of an NV21 chroma row; width is the frame width (bytes in the row).
+/// src and dst may be the same row.
+using SwapUVRowFn = void (*)(const uint8_t* src, uint8_t* dst, int width);
+
+/// Interleave one row of planar U and V samples into an NV12 chroma row; width is the
+/// frame width (each plane row has width / 2 samples)
+using InterleaveUVRowFn = void (*)(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width);
+
+namespace {
+
+/// Scalar reference for packed 4:2:2: LumaByte is 0 for YUYV (Y0 U0 Y1 V0) and 1 for UYVY
+/// (U0 Y0 V0 Y1). The SIMD kernels must match it exactly, and use it for row tails.
+template <int LumaByte>
+inline void ConvertPacked422RowPairReference(const uint8_t* src0, const uint8_t* src1,
+                                             uint8_t* y0, uint8_t* y1, uint8_t* uv, int width) {
+    constexpr int ChromaByte = 1 - LumaByte;
+    int x = 0;
+    for (; x + 1 < width; x += 2) {
+        const uint8_t* a = src0 + x * 2;
+        const uint8_t* b = src1 + x * 2;
+        y0[x] = a[LumaByte];
+        y0[x + 1] = a[LumaByte + 2];
+        y1[x] = b[LumaByte];
+        y1[x + 1] = b[LumaByte + 2];
+        uv[x] = static_cast<uint8_t>((a[ChromaByte] + b[ChromaByte]) / 2);
+        uv[x + 1] = static_cast<uint8_t>((a[ChromaByte + 2] + b[ChromaByte + 2]) / 2);
+    }
+
+    // Odd width: last column has luma only
+    if (x < width) {
+        y0[x] = src0[x * 2 + LumaByte];
+        y1[x] = src1[x * 2 + LumaByte];
+    }
+}
+
+inline void ConvertYuyvRowPairReference(const uint8_t* src0, const uint8_t* src1,
+                                        uint8_t* y0, uint8_t* y1, uint8_t* uv, int width) {
+    ConvertPacked422RowPairReference<0>(src0, src1, y0, y1, uv, width);
+}
+
+inline void ConvertUyvyRowPairReference(const uint8_t* src0, const uint8_t* src1,
+                                        uint8_t* y0, uint8_t* y1, uint8_t* uv, int width) {
+    ConvertPacked422RowPairReference<1>(src0, src1, y0, y1, uv, width);
+}
+
+inline void SwapUVRowReference(const uint8_t* src, uint8_t* dst, int width) {
+    for (int x = 0; x + 1 < width; x += 2) {
+        uint8_t v = src[x];
+        dst[x] = src[x + 1];
+        dst[x + 1] = v;
+    }
+}
+
+inline void InterleaveUVRowReference(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width) {
+    for (int x = 0; x < width / 2; x++) {
+        uv[x * 2] = u[x];
+        uv[x * 2 + 1] = v[x];
+    }
+}
+
+}  // namespace
+
+/// Scalar kernels (always available)
+void ConvertYuyvRowPairScalar(const uint8_t* src0, const uint8_t* src1,
+                              uint8_t* y0, uint8_t* y1, uint8_t* uv, int width);
+void ConvertUyvyRowPairScalar(const uint8_t* src0, const uint8_t* src1,
+                              uint8_t* y0, uint8_t* y1, uint8_t* uv, int width);
+void SwapUVRowScalar(const uint8_t* src, uint8_t* dst, int width);
+void InterleaveUVRowScalar(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width);
+
+#if defined(__x86_64__) || defined(__i386__)
+// Built with per-file ISA flags, only call the kernels after checking CPU support
+void ConvertYuyvRowPairSSE2(const uint8_t* src0, const uint8_t* src1,
+                            uint8_t* y0, uint8_t* y1, uint8_t* uv, int width);
+void ConvertUyvyRowPairSSE2(const uint8_t* src0, const uint8_t* src1,
+                            uint8_t* y0, uint8_t* y1, uint8_t* uv, int width);
+void SwapUVRowSSE2(const uint8_t* src, uint8_t* dst, int width);
+void InterleaveUVRowSSE2(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width);
+
+void SwapUVRowAVX2(const uint8_t* src, uint8_t* dst, int width);
+void InterleaveUVRowAVX2(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width);
+#endif
+
+}  // namespace snacka::kernels
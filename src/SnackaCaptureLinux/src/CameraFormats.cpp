@@ -0,0 +1,334 @@
+#include "CameraFormats.h"
+
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+namespace snacka {
+
+namespace {
+
+// Ranked by work per frame: NV12 is delivered from the capture buffer as is, NV21 only
+// has its chroma bytes swapped in place, planar 4:2:0 and packed 4:2:2 take one copy
+// pass (4:2:2 reading a third more bytes), RGB needs the full matrix conversion and
+// MJPEG a decode.
+constexpr CameraFormatInfo kFormats[] = {
+    {V4L2_PIX_FMT_NV12, "NV12", 0, 1, "zero-copy"},
+    {V4L2_PIX_FMT_NV21, "NV21", 1, 1, "chroma swapped in place"},
+    {V4L2_PIX_FMT_YUV420, "YU12", 2, 1, "chroma planes interleaved"},
+    {V4L2_PIX_FMT_YVU420, "YV12", 2, 1, "chroma planes interleaved"},
+    {V4L2_PIX_FMT_YUYV, "YUYV", 3, 2, "4:2:2 repacked"},
+    {V4L2_PIX_FMT_UYVY, "UYVY", 3, 2, "4:2:2 repacked"},
+    {V4L2_PIX_FMT_BGR24, "BGR3", 5, 3, "RGB converted"},
+    {V4L2_PIX_FMT_RGB24, "RGB3", 5, 3, "RGB converted"},
+    {V4L2_PIX_FMT_MJPEG, "MJPG", 8, 0, "JPEG decoded"},
+};
+
+// Largest size recorded for a format whose driver lists no sizes
+constexpr int kAnySize = 16384;
+
+// Rates within 1% count as reached, so 29.97 fps satisfies a 30 fps request
+bool Reaches(const FrameInterval& interval, int fps) {
+    return interval.GetFps() >= fps * 0.99;
+}
+
+// Rates of a mode at one of its sizes. Stepwise sizes are probed at the largest one;
+// the rate at the size actually picked is queried again when choosing.
+void EnumerateIntervals(int fd, CameraMode& mode, int width, int height) {
+    mode.intervals.clear();
+    mode.intervalRange = false;
+    for (uint32_t index = 0;; index++) {
+        struct v4l2_frmivalenum ival;
+        memset(&ival, 0, sizeof(ival));
+        ival.index = index;
+        ival.pixel_format = mode.pixelFormat;
+        ival.width = width;
+        ival.height = height;
+        if (ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &ival) < 0) {
+            break;
+        }
+        if (ival.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
+            mode.intervals.push_back({ival.discrete.numerator, ival.discrete.denominator});
+            continue;
+        }
+        // Stepwise or continuous: only index 0 is valid
+        mode.intervals.push_back({ival.stepwise.min.numerator, ival.stepwise.min.denominator});
+        mode.intervals.push_back({ival.stepwise.max.numerator, ival.stepwise.max.denominator});
+        mode.intervalRange = true;
+        return;
+    }
+    std::sort(mode.intervals.begin(), mode.intervals.end(), [](const FrameInterval& a, const FrameInterval& b) {
+        return a.GetFps() > b.GetFps();
+    });
+}
+
+struct Candidate {
+    const CameraMode* mode;
+    const CameraFormatInfo* format;
+    int width;
+    int height;
+    FrameInterval interval;
+    bool ratesListed;  // The interval is one the driver listed
+    bool exact;        // Has the requested size
+    bool fast;         // Reaches the requested rate (or lists no rates)
+};
+
+// Nearest size of a stepwise range to the request, even where the range has one:
+// NV12 needs even sizes
+int FitToRange(int requested, int minimum, int maximum, int step) {
+    int clamped = std::clamp(requested, minimum, maximum);
+    int fitted = clamped;
+    if (step > 1) {
+        fitted = minimum + (clamped - minimum + step / 2) / step * step;
+        fitted = fitted > maximum ? fitted - step : fitted;
+    }
+    if (fitted % 2 == 0) {
+        return fitted;
+    }
+
+    // An odd step has even sizes on either side; an even step from an odd minimum has none
+    int below = fitted - step;
+    int above = fitted + step;
+    bool belowFits = below >= minimum && below % 2 == 0;
+    bool aboveFits = above <= maximum && above % 2 == 0;
+    if (belowFits && (!aboveFits || requested - below <= above - requested)) {
+        return below;
+    }
+    return aboveFits ? above : fitted;
+}
+
+// Slowest native interval that still reaches the rate, else the fastest there is
+FrameInterval PickInterval(const CameraMode& mode, int fps, bool& fast) {
+    fast = true;
+    FrameInterval requested{1, static_cast<uint32_t>(fps)};
+    if (mode.intervals.empty()) {
+        return requested;
+    }
+
+    const FrameInterval& fastest = mode.intervals.front();
+    if (!Reaches(fastest, fps)) {
+        fast = false;
+        return fastest;
+    }
+    if (mode.intervalRange) {
+        const FrameInterval& slowest = mode.intervals.back();
+        return slowest.GetFps() > fps ? slowest : requested;
+    }
+    for (auto it = mode.intervals.rbegin(); it != mode.intervals.rend(); ++it) {
+        if (Reaches(*it, fps)) {
+            return *it;
+        }
+    }
+    return fastest;
+}
+
+std::string DescribeSize(int width, int height) {
+    return std::to_string(width) + "x" + std::to_string(height);
+}
+
+std::string DescribeFps(double fps) {
+    std::ostringstream out;
+    if (fps == static_cast<int>(fps)) {
+        out << static_cast<int>(fps);
+    } else {
+        out << std::fixed << std::setprecision(2) << fps;
+    }
+    return out.str();
+}
+
+}  // namespace
+
+const CameraFormatInfo* FindCameraFormat(uint32_t pixelFormat) {
+    for (const auto& format : kFormats) {
+        if (format.pixelFormat == pixelFormat) {
+            return &format;
+        }
+    }
+    return nullptr;
+}
+
+std::string GetFourccName(uint32_t pixelFormat) {
+    std::string name;
+    for (int i = 0; i < 4; i++) {
+        char c = static_cast<char>((pixelFormat >> (i * 8)) & 0xFF);
+        name += (c >= 0x20 && c < 0x7F) ? c : '?';
+    }
+    // Trailing spaces pad short fourccs (e.g. "GREY" vs "Y10 ")
+    while (!name.empty() && name.back() == ' ') {
+        name.pop_back();
+    }
+    return name;
+}
+
+bool ProbeCameraModes(int fd, CameraCapabilities& capabilities) {
+    capabilities = CameraCapabilities();
+
+    for (uint32_t index = 0;; index++) {
+        struct v4l2_fmtdesc desc;
+        memset(&desc, 0, sizeof(desc));
+        desc.index = index;
+        desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (ioctl(fd, VIDIOC_ENUM_FMT, &desc) < 0) {
+            break;
+        }
+        capabilities.offered.push_back(GetFourccName(desc.pixelformat));
+        if (!FindCameraFormat(desc.pixelformat)) {
+            continue;
+        }
+
+        size_t firstMode = capabilities.modes.size();
+        for (uint32_t sizeIndex = 0;; sizeIndex++) {
+            struct v4l2_frmsizeenum size;
+            memset(&size, 0, sizeof(size));
+            size.index = sizeIndex;
+            size.pixel_format = desc.pixelformat;
+            if (ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) < 0) {
+                break;
+            }
+
+            CameraMode mode;
+            mode.pixelFormat = desc.pixelformat;
+            bool discrete = size.type == V4L2_FRMSIZE_TYPE_DISCRETE;
+            if (discrete) {
+                mode.width = mode.maxWidth = size.discrete.width;
+                mode.height = mode.maxHeight = size.discrete.height;
+            } else {
+                // Stepwise or continuous (step 1): only index 0 is valid
+                mode.width = size.stepwise.min_width;
+                mode.height = size.stepwise.min_height;
+                mode.maxWidth = size.stepwise.max_width;
+                mode.maxHeight = size.stepwise.max_height;
+                mode.stepWidth = std::max<int>(size.stepwise.step_width, 1);
+                mode.stepHeight = std::max<int>(size.stepwise.step_height, 1);
+            }
+            EnumerateIntervals(fd, mode, mode.maxWidth, mode.maxHeight);
+            capabilities.modes.push_back(std::move(mode));
+            if (!discrete) {
+                break;
+            }
+        }
+
+        // Drivers without ENUM_FRAMESIZES round whatever size they are given
+        if (capabilities.modes.size() == firstMode) {
+            CameraMode mode;
+            mode.pixelFormat = desc.pixelformat;
+            mode.width = mode.height = 1;
+            mode.maxWidth = mode.maxHeight = kAnySize;
+            mode.stepWidth = mode.stepHeight = 1;
+            capabilities.modes.push_back(std::move(mode));
+        }
+    }
+
+    return !capabilities.offered.empty();
+}
+
+bool ChooseCameraMode(const CameraCapabilities& capabilities, int width, int height, int fps, int fd,
+                      CameraFormatChoice& choice) {
+    choice = CameraFormatChoice();
+    fps = std::max(fps, 1);
+
+    std::vector<Candidate> candidates;
+    for (const auto& mode : capabilities.modes) {
+        const CameraFormatInfo* format = FindCameraFormat(mode.pixelFormat);
+        if (!format) {
+            continue;
+        }
+        Candidate candidate{&mode, format, mode.width, mode.height, {}, !mode.intervals.empty(), false, false};
+        const CameraMode* rates = &mode;
+        CameraMode fitted;
+        if (mode.stepWidth > 0) {
+            candidate.width = FitToRange(width, mode.width, mode.maxWidth, mode.stepWidth);
+            candidate.height = FitToRange(height, mode.height, mode.maxHeight, mode.stepHeight);
+
+            // Smaller sizes often run faster than the largest one the rates were probed at
+            if (fd >= 0 && (candidate.width != mode.maxWidth || candidate.height != mode.maxHeight)) {
+                fitted = mode;
+                EnumerateIntervals(fd, fitted, candidate.width, candidate.height);
+                if (!fitted.intervals.empty()) {
+                    rates = &fitted;
+                    candidate.ratesListed = true;
+                }
+            }
+        }
+        candidate.exact = candidate.width == width && candidate.height == height;
+        candidate.interval = PickInterval(*rates, fps, candidate.fast);
+        candidates.push_back(candidate);
+    }
+
+    if (candidates.empty()) {
+        return false;
+    }
+
+    // Requested size, then requested rate, then closest size, then cheapest conversion
+    int64_t requestedArea = static_cast<int64_t>(width) * height;
+    auto distance = [&](const Candidate& candidate) {
+        return std::llabs(static_cast<int64_t>(candidate.width) * candidate.height - requestedArea);
+    };
+    auto better = [&](const Candidate& a, const Candidate& b) {
+        if (a.exact != b.exact) {
+            return a.exact;
+        }
+        if (a.fast != b.fast) {
+            return a.fast;
+        }
+        if (distance(a) != distance(b)) {
+            return distance(a) < distance(b);
+        }
+        if (!a.fast && a.interval.GetFps() != b.interval.GetFps()) {
+            return a.interval.GetFps() > b.interval.GetFps();
+        }
+        return a.format->cost < b.format->cost;
+    };
+
+    const Candidate* best = &candidates[0];
+    for (const auto& candidate : candidates) {
+        if (better(candidate, *best)) {
+            best = &candidate;
+        }
+    }
+
+    // Other formats that would also have done, to say what was passed over
+    std::vector<const char*> alternatives;
+    for (const auto& candidate : candidates) {
+        if (candidate.format != best->format && candidate.width == best->width &&
+            candidate.height == best->height && candidate.fast == best->fast &&
+            std::find(alternatives.begin(), alternatives.end(), candidate.format->name) == alternatives.end()) {
+            alternatives.push_back(candidate.format->name);
+        }
+    }
+
+    std::string size = DescribeSize(width, height);
+    std::ostringstream reason;
+    if (!best->exact) {
+        reason << "no native " << size << " mode, " << DescribeSize(best->width, best->height) << " is closest";
+    } else if (!best->fast) {
+        reason << "no native mode reaches " << fps << " fps at " << size;
+    } else if (alternatives.empty()) {
+        reason << "only native mode for " << size << " at " << fps << " fps";
+    } else {
+        reason << "cheapest native mode for " << size << " at " << fps << " fps (over";
+        for (const char* name : alternatives) {
+            reason << " " << name;
+        }
+        reason << ")";
+    }
+    if (best->ratesListed) {
+        reason << "; runs at " << DescribeFps(best->interval.GetFps()) << " fps";
+    }
+    reason << "; " << best->format->conversion << " to NV12";
+
+    choice.pixelFormat = best->format->pixelFormat;
+    choice.width = best->width;
+    choice.height = best->height;
+    choice.interval = best->interval;
+    choice.sizeListed = best->mode->maxWidth != kAnySize;
+    choice.reason = reason.str();
+    return true;
+}
+
+}  // namespace snacka
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace snacka {
+
+/// A camera pixel format the V4L2 capturer can turn into NV12
+struct CameraFormatInfo {
+    uint32_t pixelFormat;     // V4L2 fourcc
+    const char* name;         // Fourcc as text, e.g. "YUYV"
+    int cost;                 // Relative cost of getting NV12 out of a frame; lower is cheaper
+    int bytesPerPixel;        // Bytes per pixel in the first plane row (0 for compressed formats)
+    const char* conversion;   // How frames become NV12, e.g. "zero-copy"
+};
+
+/// Look up a pixel format
+/// @return nullptr if the capturer cannot convert it
+const CameraFormatInfo* FindCameraFormat(uint32_t pixelFormat);
+
+/// Get the fourcc of a V4L2 pixel format as text, e.g. "H264"
+std::string GetFourccName(uint32_t pixelFormat);
+
+/// Time per frame as a fraction of a second (V4L2 timeperframe)
+struct FrameInterval {
+    uint32_t numerator = 0;
+    uint32_t denominator = 0;
+
+    double GetFps() const { return numerator > 0 ? static_cast<double>(denominator) / numerator : 0.0; }
+};
+
+/// One native camera mode: a pixel format at a frame size (or a stepwise range of
+/// sizes) and the frame intervals it runs at
+struct CameraMode {
+    uint32_t pixelFormat = 0;
+    int width = 0;              // Discrete size, or the smallest size of a stepwise range
+    int height = 0;
+    int maxWidth = 0;           // Largest size of a stepwise range; width/height when discrete
+    int maxHeight = 0;
+    int stepWidth = 0;          // Size step of a stepwise range; 0 when discrete
+    int stepHeight = 0;
+    std::vector<FrameInterval> intervals;  // Discrete intervals, fastest first; empty if not listed.
+                                           // At the largest size of a stepwise range.
+    bool intervalRange = false;            // intervals holds the fastest and slowest end of a range
+};
+
+/// The native modes of a camera, as enumerated from the driver
+struct CameraCapabilities {
+    std::vector<std::string> offered;   // Every format the device lists, in driver order
+    std::vector<CameraMode> modes;      // Modes of the formats the capturer can convert
+};
+
+/// Enumerate a device's formats, frame sizes and frame intervals (VIDIOC_ENUM_FMT,
+/// VIDIOC_ENUM_FRAMESIZES, VIDIOC_ENUM_FRAMEINTERVALS). Formats whose driver lists no
+/// sizes are recorded as accepting any size.
+/// @param fd Open V4L2 capture device
+/// @return false if the device lists no formats at all
+bool ProbeCameraModes(int fd, CameraCapabilities& capabilities);
+
+/// The mode picked for a camera, and why
+struct CameraFormatChoice {
+    uint32_t pixelFormat = 0;
+    int width = 0;
+    int height = 0;
+    FrameInterval interval;               // Native interval to request; 1/fps when none is listed
+    bool sizeListed = false;              // The driver listed the size (false: it rounds what it is given)
+    std::string reason;                   // e.g. "cheapest of 2 native modes for 640x480 at 30 fps ..."
+};
+
+/// Camera capture size and rate when the command line leaves them out; `list` reports the
+/// mode a capture with these would use
+constexpr int DEFAULT_CAMERA_WIDTH = 640;
+constexpr int DEFAULT_CAMERA_HEIGHT = 480;
+constexpr int DEFAULT_CAMERA_FPS = 15;
+
+/// Pick the cheapest native mode for a request: modes at the requested size first, then
+/// modes fast enough for the requested rate, then (when nothing has the size) the closest
+/// size, then the cheapest conversion to NV12. The interval is the slowest native one that
+/// still reaches the rate, so the camera sends no frames that would only be skipped.
+/// USB cameras commonly only reach 720p and up at 30 fps in MJPEG and offer raw formats
+/// at lower rates, which the rate rule handles without special cases.
+/// @param fd Open device, to query the rates of stepwise modes at the size picked from
+///           them (probing lists them at the largest size), or -1 to go by the probed rates
+/// @return false if the camera has no mode the capturer can convert
+bool ChooseCameraMode(const CameraCapabilities& capabilities, int width, int height, int fps, int fd,
+                      CameraFormatChoice& choice);
+
+}  // namespace snacka
@@ -0,0 +1,237 @@
+#include "CameraModeCache.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace snacka {
+
+namespace {
+
+constexpr const char* kHeader = "SnackaCaptureLinux camera modes 1";
+
+// Cache fields are tab separated, one record per line
+std::string Sanitize(const std::string& text) {
+    std::string result = text;
+    for (char& c : result) {
+        if (c == '\t' || c == '\n' || c == '\r') {
+            c = ' ';
+        }
+    }
+    return result;
+}
+
+std::vector<std::string> SplitFields(const std::string& line) {
+    std::vector<std::string> fields;
+    std::istringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, '\t')) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+// First line of a sysfs attribute, empty if it does not exist
+std::string ReadSysfs(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+std::string FormatMode(const CameraMode& mode) {
+    std::ostringstream out;
+    out << "mode\t" << mode.pixelFormat << "\t" << mode.width << "\t" << mode.height << "\t" << mode.maxWidth
+        << "\t" << mode.maxHeight << "\t" << mode.stepWidth << "\t" << mode.stepHeight << "\t"
+        << (mode.intervalRange ? 1 : 0);
+    for (const auto& interval : mode.intervals) {
+        out << "\t" << interval.numerator << "/" << interval.denominator;
+    }
+    return out.str();
+}
+
+// Throws std::invalid_argument / std::out_of_range on malformed numbers
+CameraMode ParseMode(const std::vector<std::string>& fields) {
+    if (fields.size() < 9) {
+        throw std::invalid_argument("short mode record");
+    }
+    CameraMode mode;
+    mode.pixelFormat = static_cast<uint32_t>(std::stoul(fields[1]));
+    mode.width = std::stoi(fields[2]);
+    mode.height = std::stoi(fields[3]);
+    mode.maxWidth = std::stoi(fields[4]);
+    mode.maxHeight = std::stoi(fields[5]);
+    mode.stepWidth = std::stoi(fields[6]);
+    mode.stepHeight = std::stoi(fields[7]);
+    mode.intervalRange = fields[8] == "1";
+    for (size_t i = 9; i < fields.size(); i++) {
+        size_t slash = fields[i].find('/');
+        if (slash == std::string::npos) {
+            throw std::invalid_argument("bad interval");
+        }
+        FrameInterval interval;
+        interval.numerator = static_cast<uint32_t>(std::stoul(fields[i].substr(0, slash)));
+        interval.denominator = static_cast<uint32_t>(std::stoul(fields[i].substr(slash + 1)));
+        mode.intervals.push_back(interval);
+    }
+    return mode;
+}
+
+}  // namespace
+
+CameraModeCache::CameraModeCache() {
+    Load();
+}
+
+std::string CameraModeCache::GetPath() {
+    std::string directory;
+    const char* cacheHome = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (cacheHome && cacheHome[0] == '/') {
+        directory = cacheHome;
+    } else if (home && home[0] != '\0') {
+        directory = std::string(home) + "/.cache";
+    } else {
+        return "";
+    }
+    return directory + "/snacka/camera-modes";
+}
+
+std::string CameraModeCache::GetDeviceKey(const std::string& devicePath, const v4l2_capability& cap) {
+    // The USB interface and device the node belongs to (absent for non-USB devices)
+    std::string node = devicePath.substr(devicePath.rfind('/') + 1);
+    std::string sysfsDevice = "/sys/class/video4linux/" + node + "/device";
+    std::string interface;
+    char resolved[PATH_MAX];
+    if (realpath(sysfsDevice.c_str(), resolved)) {
+        interface = resolved;
+        interface = interface.substr(interface.rfind('/') + 1);
+    }
+    std::string firmware = ReadSysfs(sysfsDevice + "/../bcdDevice");
+    std::string usbId = ReadSysfs(sysfsDevice + "/../idVendor") + ":" + ReadSysfs(sysfsDevice + "/../idProduct");
+
+    std::ostringstream key;
+    key << reinterpret_cast<const char*>(cap.driver) << "|" << reinterpret_cast<const char*>(cap.card) << "|"
+        << reinterpret_cast<const char*>(cap.bus_info) << "|" << interface << "|" << ((cap.version >> 16) & 0xFF)
+        << "." << ((cap.version >> 8) & 0xFF) << "." << (cap.version & 0xFF) << "|" << firmware << "|" << usbId;
+    return Sanitize(key.str());
+}
+
+bool CameraModeCache::GetCapabilities(int fd, const std::string& key, CameraCapabilities& capabilities,
+                                      bool& cached) {
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        capabilities = it->second;
+        cached = true;
+        return true;
+    }
+
+    cached = false;
+    if (!ProbeCameraModes(fd, capabilities)) {
+        return false;
+    }
+    m_entries[key] = capabilities;
+    m_dirty = true;
+    return true;
+}
+
+void CameraModeCache::Remove(const std::string& key) {
+    if (m_entries.erase(key) > 0) {
+        m_dirty = true;
+    }
+}
+
+void CameraModeCache::Load() {
+    std::string path = GetPath();
+    if (path.empty()) {
+        return;
+    }
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line != kHeader) {
+        return;  // Missing, or written by an incompatible version
+    }
+
+    // A damaged file is dropped as a whole rather than trusted in part
+    try {
+        CameraCapabilities* entry = nullptr;
+        while (std::getline(file, line)) {
+            std::vector<std::string> fields = SplitFields(line);
+            if (fields.empty()) {
+                continue;
+            }
+            if (fields[0] == "camera" && fields.size() == 2) {
+                entry = &m_entries[fields[1]];
+            } else if (fields[0] == "offered" && entry) {
+                entry->offered.assign(fields.begin() + 1, fields.end());
+            } else if (fields[0] == "mode" && entry) {
+                entry->modes.push_back(ParseMode(fields));
+            } else {
+                throw std::invalid_argument("unknown record");
+            }
+        }
+    } catch (const std::exception&) {
+        std::cerr << "CameraModeCache: Ignoring damaged cache " << path << "\n";
+        m_entries.clear();
+    }
+}
+
+bool CameraModeCache::Save() {
+    if (!m_dirty) {
+        return true;
+    }
+    std::string path = GetPath();
+    if (path.empty()) {
+        return false;
+    }
+
+    // Create ~/.cache and ~/.cache/snacka as needed
+    std::string directory = path.substr(0, path.rfind('/'));
+    mkdir(directory.substr(0, directory.rfind('/')).c_str(), 0755);
+    mkdir(directory.c_str(), 0700);
+
+    // Write a private temporary file and rename it over the cache, so readers never see half a file
+    std::string temporary = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        file << kHeader << "\n";
+        for (const auto& [key, capabilities] : m_entries) {
+            file << "camera\t" << key << "\n";
+            file << "offered";
+            for (const auto& name : capabilities.offered) {
+                file << "\t" << Sanitize(name);
+            }
+            file << "\n";
+            for (const auto& mode : capabilities.modes) {
+                file << FormatMode(mode) << "\n";
+            }
+        }
+        file.flush();
+        if (!file) {
+            std::cerr << "CameraModeCache: Could not write " << temporary << ": " << strerror(errno) << "\n";
+            file.close();
+            unlink(temporary.c_str());
+            return false;
+        }
+    }
+    if (rename(temporary.c_str(), path.c_str()) < 0) {
+        std::cerr << "CameraModeCache: Could not replace " << path << ": " << strerror(errno) << "\n";
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    m_dirty = false;
+    return true;
+}
+
+}  // namespace snacka
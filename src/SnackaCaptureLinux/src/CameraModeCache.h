@@ -0,0 +1,49 @@
+#pragma once
+
+#include "CameraFormats.h"
+
+#include <linux/videodev2.h>
+
+#include <map>
+#include <string>
+
+namespace snacka {
+
+/// Camera modes saved across runs, so starting a camera or listing cameras does not
+/// enumerate every format, frame size and frame interval again.
+/// Entries are keyed by driver, bus position and firmware revision: a different camera
+/// in the same port, or a firmware update, is probed afresh. The file lives in
+/// $XDG_CACHE_HOME/snacka (or ~/.cache/snacka) and is replaced atomically on Save;
+/// a missing or unreadable file only means probing again.
+class CameraModeCache {
+public:
+    /// Load the cache file (an empty cache if there is none)
+    CameraModeCache();
+
+    /// Build the cache key of an open device, e.g. "uvcvideo|HD Webcam|usb-0000:00:14.0-2|1-2:1.0|0.12|046d:0825"
+    /// @param devicePath Device node (used to find the USB descriptors in sysfs)
+    static std::string GetDeviceKey(const std::string& devicePath, const v4l2_capability& cap);
+
+    /// Get a device's modes from the cache, probing (and remembering) them on a miss
+    /// @param cached Receives whether the modes came from the cache
+    /// @return false if probing failed
+    bool GetCapabilities(int fd, const std::string& key, CameraCapabilities& capabilities, bool& cached);
+
+    /// Forget a device, e.g. when the driver no longer accepts a cached mode
+    void Remove(const std::string& key);
+
+    /// Write the cache back if anything changed. Entries another process added since
+    /// this one loaded are lost and will be probed again.
+    bool Save();
+
+    /// Get the cache file path (empty if no cache directory can be determined)
+    static std::string GetPath();
+
+private:
+    void Load();
+
+    std::map<std::string, CameraCapabilities> m_entries;
+    bool m_dirty = false;
+};
+
+}  // namespace snacka
@@ -0,0 +1,658 @@
+#include "ColorConverter.h"
+#include "ColorConverterKernels.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace snacka {
+
+bool ParseColorSpace(const std::string& name, ColorSpace& space) {
+    if (name == "bt601") {
+        space = {ColorMatrix::BT601, ColorRange::Limited};
+    } else if (name == "bt709") {
+        space = {ColorMatrix::BT709, ColorRange::Limited};
+    } else if (name == "bt601-full") {
+        space = {ColorMatrix::BT601, ColorRange::Full};
+    } else if (name == "bt709-full") {
+        space = {ColorMatrix::BT709, ColorRange::Full};
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* GetColorSpaceName(const ColorSpace& space) {
+    bool full = space.range == ColorRange::Full;
+    if (space.matrix == ColorMatrix::BT709) {
+        return full ? "bt709-full" : "bt709";
+    }
+    return full ? "bt601-full" : "bt601";
+}
+
+namespace kernels {
+
+ConvertRowPairFn SelectConvertRowPairScalar(const ColorSpace& space, PixelLayout layout) {
+    return SelectKernel<ConvertRowPairFn>(space, layout, []<typename Format>() {
+        return &ConvertRowPairReference<Format>;
+    });
+}
+
+ConvertRowYFn SelectConvertRowYScalar(const ColorSpace& space, PixelLayout layout) {
+    return SelectKernel<ConvertRowYFn>(space, layout, []<typename Format>() {
+        return &ConvertRowYReference<Format>;
+    });
+}
+
+}  // namespace kernels
+
+ColorConverter::ColorConverter(CpuLevel level) {
+    m_level = IsCpuLevelSupported(level) ? level : DetectCpuLevel();
+}
+
+int ColorConverter::PickStripeCount(int requested, int dstWidth, int dstHeight) {
+    if (requested > 0) {
+        return requested;
+    }
+    int64_t pixels = static_cast<int64_t>(dstWidth) * dstHeight;
+    int threads = static_cast<int>((pixels + 1920 * 1080 - 1) / (1920 * 1080));
+    threads = std::min(threads, std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+    return std::clamp(threads, 1, 8);
+}
+
+CpuLevel ColorConverter::DetectCpuLevel() {
+#if defined(__x86_64__) || defined(__i386__)
+    // __builtin_cpu_supports reads CPUID (and XGETBV for AVX state) once at startup
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return CpuLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return CpuLevel::SSE41;
+    }
+#endif
+    return CpuLevel::Scalar;
+}
+
+bool ColorConverter::IsCpuLevelSupported(CpuLevel level) {
+    return static_cast<uint8_t>(level) <= static_cast<uint8_t>(DetectCpuLevel());
+}
+
+const char* ColorConverter::GetCpuLevelName(CpuLevel level) {
+    switch (level) {
+        case CpuLevel::Scalar: return "scalar";
+        case CpuLevel::SSE41: return "sse4.1";
+        case CpuLevel::AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+void ColorConverter::BuildAxis(FilterAxis& axis, int srcSize, int dstSize) {
+    using Kind = FilterAxis::Kind;
+
+    if (srcSize == dstSize) {
+        axis.kind = Kind::Copy;
+    } else if (srcSize == 2 * dstSize) {
+        axis.kind = Kind::Half;
+    } else if (2 * srcSize == 3 * dstSize) {
+        axis.kind = Kind::ThreeTwo;
+    } else if (3 * srcSize == 4 * dstSize) {
+        axis.kind = Kind::FourThree;
+    } else {
+        axis.kind = Kind::Generic;
+    }
+
+    // Area average for integer ratios, the 3:2/4:3 fast paths and anything beyond 2:1
+    // (where bilinear would skip source pixels); bilinear for the remaining ratios
+    bool area = axis.kind != Kind::Generic || srcSize % dstSize == 0 || srcSize > 2 * dstSize;
+
+    std::vector<std::vector<uint16_t>> taps(dstSize);
+    std::vector<int> first(dstSize);
+
+    for (int o = 0; o < dstSize; o++) {
+        if (area) {
+            // Output o covers [o * src, (o + 1) * src) in units where a source pixel is dst wide
+            int64_t begin = static_cast<int64_t>(o) * srcSize;
+            int64_t end = begin + srcSize;
+            int s0 = static_cast<int>(begin / dstSize);
+            int s1 = static_cast<int>((end - 1) / dstSize);
+            first[o] = s0;
+
+            int total = 0;
+            size_t largest = 0;
+            for (int s = s0; s <= s1; s++) {
+                int64_t overlap = std::min(end, static_cast<int64_t>(s + 1) * dstSize) -
+                                  std::max(begin, static_cast<int64_t>(s) * dstSize);
+                auto weight = static_cast<uint16_t>((overlap * 256 + srcSize / 2) / srcSize);
+                taps[o].push_back(weight);
+                total += weight;
+                if (weight > taps[o][largest]) {
+                    largest = taps[o].size() - 1;
+                }
+            }
+            // Rounding remainder goes to the dominant tap so weights sum to exactly 256
+            taps[o][largest] = static_cast<uint16_t>(taps[o][largest] + 256 - total);
+        } else {
+            // Sample centers aligned: src = (o + 0.5) * src / dst - 0.5, in 1/256 units
+            int64_t pos = ((2 * static_cast<int64_t>(o) + 1) * srcSize * 256) / (2 * dstSize) - 128;
+            pos = std::clamp<int64_t>(pos, 0, static_cast<int64_t>(srcSize - 1) * 256);
+            first[o] = static_cast<int>(pos >> 8);
+            auto frac = static_cast<uint16_t>(pos & 255);
+            taps[o] = {static_cast<uint16_t>(256 - frac), frac};
+        }
+    }
+
+    axis.taps = 1;
+    for (const auto& t : taps) {
+        axis.taps = std::max(axis.taps, static_cast<int>(t.size()));
+    }
+    axis.taps = std::min(axis.taps, srcSize);
+
+    // Fixed tap count per output: pad with zero weights and keep reads inside the source
+    axis.offsets.assign(dstSize, 0);
+    axis.weights.assign(static_cast<size_t>(dstSize) * axis.taps, 0);
+    for (int o = 0; o < dstSize; o++) {
+        int offset = std::min(first[o], srcSize - axis.taps);
+        axis.offsets[o] = offset;
+        for (size_t t = 0; t < taps[o].size(); t++) {
+            int index = first[o] + static_cast<int>(t) - offset;
+            if (index < axis.taps) {
+                axis.weights[static_cast<size_t>(o) * axis.taps + index] += taps[o][t];
+            }
+        }
+    }
+}
+
+void ColorConverter::Configure(int srcWidth, int srcHeight, int dstWidth, int dstHeight, int stripeCount) {
+    m_srcWidth = srcWidth;
+    m_srcHeight = srcHeight;
+    m_dstWidth = dstWidth;
+    m_dstHeight = dstHeight;
+    m_scaled = (srcWidth != dstWidth || srcHeight != dstHeight);
+
+    // Kernels specialized for the output color space and source byte order
+    switch (m_level) {
+#if defined(__x86_64__) || defined(__i386__)
+        case CpuLevel::AVX2:
+            m_convertRowPair = kernels::SelectConvertRowPairAVX2(m_colorSpace, m_layout);
+            break;
+        case CpuLevel::SSE41:
+            m_convertRowPair = kernels::SelectConvertRowPairSSE41(m_colorSpace, m_layout);
+            break;
+#endif
+        default:
+            m_convertRowPair = kernels::SelectConvertRowPairScalar(m_colorSpace, m_layout);
+            break;
+    }
+    m_convertRowY = kernels::SelectConvertRowYScalar(m_colorSpace, m_layout);
+
+    // Integer nearest-neighbour maps (no per-pixel float math in the hot loop)
+    m_xMap.resize(dstWidth);
+    for (int x = 0; x < dstWidth; x++) {
+        m_xMap[x] = static_cast<int>(static_cast<int64_t>(x) * srcWidth / dstWidth);
+    }
+
+    m_yMap.resize(dstHeight);
+    for (int y = 0; y < dstHeight; y++) {
+        m_yMap[y] = static_cast<int>(static_cast<int64_t>(y) * srcHeight / dstHeight);
+    }
+
+    bool smooth = m_scaled && m_filter == ScaleFilter::Smooth;
+    if (smooth) {
+        BuildAxis(m_horizontal, srcWidth, dstWidth);
+        BuildAxis(m_vertical, srcHeight, dstHeight);
+
+        // Distinct source columns with a non-zero weight: what one filtered row reads
+        std::vector<bool> used(srcWidth, false);
+        for (int x = 0; x < dstWidth; x++) {
+            for (int t = 0; t < m_horizontal.taps; t++) {
+                if (m_horizontal.weights[static_cast<size_t>(x) * m_horizontal.taps + t] != 0) {
+                    used[m_horizontal.offsets[x] + t] = true;
+                }
+            }
+        }
+        m_sourceColumnsRead = static_cast<int>(std::count(used.begin(), used.end(), true));
+
+        auto describe = [](const FilterAxis& axis, int srcSize, int dstSize) -> std::string {
+            using Kind = FilterAxis::Kind;
+            switch (axis.kind) {
+                case Kind::Copy: return "copy";
+                case Kind::Half: return "area 2:1";
+                case Kind::ThreeTwo: return "area 3:2";
+                case Kind::FourThree: return "area 4:3";
+                case Kind::Generic: break;
+            }
+            if (srcSize % dstSize == 0) {
+                return "area " + std::to_string(srcSize / dstSize) + ":1";
+            }
+            return srcSize > 2 * dstSize ? "area" : "bilinear";
+        };
+        m_scaleDescription = describe(m_horizontal, srcWidth, dstWidth) + " x " +
+                             describe(m_vertical, srcHeight, dstHeight);
+    } else {
+        m_sourceColumnsRead = dstWidth;
+        m_scaleDescription = m_scaled ? "nearest" : "none";
+    }
+
+    // Stripe boundaries: a row r starts Y at r * width and UV at (r / 2) * width, so
+    // r / 2 must be a multiple of CACHE_LINE / gcd(width, CACHE_LINE) for both planes
+    // to start on a fresh cache line
+    constexpr int CACHE_LINE = 64;
+    int rowAlignment = 2 * (CACHE_LINE / std::gcd(std::max(dstWidth, 1), CACHE_LINE));
+    int alignedRows = (dstHeight / rowAlignment) * rowAlignment;
+    stripeCount = std::clamp(stripeCount, 1, std::max(alignedRows / rowAlignment, 1));
+
+    m_stripeRows.resize(stripeCount + 1);
+    for (int i = 0; i < stripeCount; i++) {
+        int units = alignedRows / rowAlignment;
+        m_stripeRows[i] = static_cast<int>(static_cast<int64_t>(units) * i / stripeCount) * rowAlignment;
+    }
+    m_stripeRows[stripeCount] = dstHeight;
+
+    // Ring holds every source row an output row pair can touch, so each is filtered once
+    int ringRows = smooth ? 2 * m_vertical.taps + 2 : 0;
+    size_t rowValues = static_cast<size_t>(dstWidth) * 4;
+
+    m_stripes = std::vector<StripeState>(stripeCount);
+    for (auto& state : m_stripes) {
+        state.rows.resize(rowValues * 2);
+        state.ring.resize(rowValues * ringRows);
+        state.ringKeys.assign(ringRows, -1);
+        state.accumulator.resize(smooth ? rowValues : 0);
+    }
+}
+
+uint64_t ColorConverter::GetSourceBytesRead() const {
+    uint64_t total = 0;
+    for (const auto& state : m_stripes) {
+        total += state.bytesRead;
+    }
+    return total;
+}
+
+void ColorConverter::ResetSourceBytesRead() {
+    for (auto& state : m_stripes) {
+        state.bytesRead = 0;
+    }
+}
+
+void ColorConverter::FilterColumns(const uint8_t* __restrict src, int srcBytesPerPixel, uint16_t* __restrict out,
+                                   int x0, int x1) const {
+    int taps = m_horizontal.taps;
+    int x = x0;
+#if defined(__SSE2__)
+    // Bilinear on BGRX: both taps are one 8-byte load, weighted per pixel
+    if (taps == 2 && srcBytesPerPixel == 4) {
+        const __m128i zero = _mm_setzero_si128();
+        auto filterPixel = [&](int index) {
+            int32_t pair;
+            memcpy(&pair, m_horizontal.weights.data() + static_cast<size_t>(index) * 2, sizeof(pair));
+            __m128i weight = _mm_cvtsi32_si128(pair);
+            weight = _mm_unpacklo_epi16(weight, weight);
+            weight = _mm_unpacklo_epi32(weight, weight);
+            __m128i px = _mm_loadl_epi64(
+                reinterpret_cast<const __m128i*>(src + m_horizontal.offsets[index] * 4));
+            __m128i product = _mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), weight);
+            return _mm_add_epi16(product, _mm_srli_si128(product, 8));
+        };
+        for (; x + 2 <= x1; x += 2) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4),
+                             _mm_unpacklo_epi64(filterPixel(x), filterPixel(x + 1)));
+        }
+    }
+#endif
+    for (; x < x1; x++) {
+        const uint8_t* p = src + m_horizontal.offsets[x] * srcBytesPerPixel;
+        const uint16_t* w = m_horizontal.weights.data() + static_cast<size_t>(x) * taps;
+        // All four bytes for 32-bit sources: the X byte comes first in XBGR
+        uint32_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+        for (int t = 0; t < taps; t++) {
+            c0 += w[t] * p[0];
+            c1 += w[t] * p[1];
+            c2 += w[t] * p[2];
+            if (srcBytesPerPixel == 4) {
+                c3 += w[t] * p[3];
+            }
+            p += srcBytesPerPixel;
+        }
+        out[x * 4] = static_cast<uint16_t>(c0);
+        out[x * 4 + 1] = static_cast<uint16_t>(c1);
+        out[x * 4 + 2] = static_cast<uint16_t>(c2);
+        out[x * 4 + 3] = static_cast<uint16_t>(c3);
+    }
+}
+
+const uint16_t* ColorConverter::FilterSourceRow(const uint8_t* bgra, int srcStride, int srcBytesPerPixel,
+                                                int srcY, int x0, int x1, StripeState& state) const {
+    using Kind = FilterAxis::Kind;
+
+    int ringRows = static_cast<int>(state.ringKeys.size());
+    int slot = srcY % ringRows;
+    size_t rowValues = static_cast<size_t>(m_dstWidth) * 4;
+    uint16_t* __restrict out = state.ring.data() + rowValues * slot;
+
+    if (state.ringKeys[slot] == srcY) {
+        return out;
+    }
+    state.ringKeys[slot] = srcY;
+
+    // Source columns behind [x0, x1): exact count for full rows, tap span otherwise
+    int columns = m_sourceColumnsRead;
+    if (x0 != 0 || x1 != m_dstWidth) {
+        columns = m_horizontal.offsets[x1 - 1] + m_horizontal.taps - m_horizontal.offsets[x0];
+    }
+    state.bytesRead += static_cast<uint64_t>(columns) * srcBytesPerPixel;
+
+    // Restrict-qualified so the byte loads don't alias the 16-bit stores and the loops vectorize
+    const uint8_t* __restrict src = bgra + static_cast<size_t>(srcY) * srcStride;
+    Kind kind = srcBytesPerPixel == 4 ? m_horizontal.kind : Kind::Generic;
+
+    // Output values are weighted sums with weights totalling 256 (8.8 fixed point).
+    // x0 is even, so 2:1 and 3:2 groups start aligned; 4:3 groups of 3 may not
+    switch (kind) {
+        case Kind::Copy:
+            for (size_t i = static_cast<size_t>(x0) * 4; i < static_cast<size_t>(x1) * 4; i++) {
+                out[i] = static_cast<uint16_t>(src[i] << 8);
+            }
+            break;
+
+        case Kind::Half: {
+            int x = x0;
+#if defined(__SSE2__)
+            // SSE2 is part of the x86-64 baseline, so these loops need no runtime dispatch
+            const __m128i zero = _mm_setzero_si128();
+            for (; x + 2 <= x1; x += 2) {
+                __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 8));
+                __m128i ab = _mm_unpacklo_epi8(px, zero);
+                __m128i cd = _mm_unpackhi_epi8(px, zero);
+                __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(ab, cd), _mm_unpackhi_epi64(ab, cd));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_slli_epi16(sum, 7));
+            }
+#endif
+            for (; x < x1; x++) {
+                const uint8_t* p = src + x * 8;
+                for (int c = 0; c < 4; c++) {
+                    out[x * 4 + c] = static_cast<uint16_t>((p[c] + p[4 + c]) << 7);
+                }
+            }
+            break;
+        }
+
+        case Kind::ThreeTwo: {
+            int x = x0;
+#if defined(__SSE2__)
+            // Each step loads 4 pixels and uses 3; stop before the load would pass the row end
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i wAB = _mm_setr_epi16(171, 171, 171, 171, 85, 85, 85, 85);
+            const __m128i wBC = _mm_setr_epi16(85, 85, 85, 85, 171, 171, 171, 171);
+            int vectorEnd = std::min(x1, m_dstWidth - 2);
+            for (; x + 1 < vectorEnd; x += 2) {
+                __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (x / 2) * 12));
+                __m128i ab = _mm_unpacklo_epi8(px, zero);
+                __m128i bc = _mm_unpacklo_epi64(_mm_srli_si128(ab, 8), _mm_unpackhi_epi8(px, zero));
+                __m128i sum = _mm_add_epi16(_mm_mullo_epi16(ab, wAB), _mm_mullo_epi16(bc, wBC));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), sum);
+            }
+#endif
+            for (; x + 1 < x1; x += 2) {
+                const uint8_t* p = src + (x / 2) * 12;
+                for (int c = 0; c < 4; c++) {
+                    out[x * 4 + c] = static_cast<uint16_t>(171 * p[c] + 85 * p[4 + c]);
+                    out[x * 4 + 4 + c] = static_cast<uint16_t>(85 * p[4 + c] + 171 * p[8 + c]);
+                }
+            }
+            break;
+        }
+
+        case Kind::FourThree: {
+            // Partial groups at either end use the generic taps (same weights)
+            int groupBegin = std::min((x0 + 2) / 3 * 3, x1);
+            int groupEnd = std::max(x1 / 3 * 3, groupBegin);
+            FilterColumns(src, srcBytesPerPixel, out, x0, groupBegin);
+            FilterColumns(src, srcBytesPerPixel, out, groupEnd, x1);
+
+            int x = groupBegin;
+#if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i wAB = _mm_setr_epi16(192, 192, 192, 192, 128, 128, 128, 128);
+            const __m128i wBC = _mm_setr_epi16(64, 64, 64, 64, 128, 128, 128, 128);
+            const __m128i wCD = _mm_setr_epi16(64, 64, 64, 64, 192, 192, 192, 192);
+            for (; x + 2 < groupEnd; x += 3) {
+                __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (x / 3) * 16));
+                __m128i ab = _mm_unpacklo_epi8(px, zero);
+                __m128i cd = _mm_unpackhi_epi8(px, zero);
+                __m128i bc = _mm_unpacklo_epi64(_mm_srli_si128(ab, 8), cd);
+                __m128i first = _mm_add_epi16(_mm_mullo_epi16(ab, wAB), _mm_mullo_epi16(bc, wBC));
+                __m128i third = _mm_mullo_epi16(cd, wCD);
+                third = _mm_add_epi16(third, _mm_srli_si128(third, 8));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), first);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4 + 8), third);
+            }
+#endif
+            for (; x + 2 < groupEnd; x += 3) {
+                const uint8_t* p = src + (x / 3) * 16;
+                for (int c = 0; c < 4; c++) {
+                    out[x * 4 + c] = static_cast<uint16_t>(192 * p[c] + 64 * p[4 + c]);
+                    out[x * 4 + 4 + c] = static_cast<uint16_t>(128 * p[4 + c] + 128 * p[8 + c]);
+                    out[x * 4 + 8 + c] = static_cast<uint16_t>(64 * p[8 + c] + 192 * p[12 + c]);
+                }
+            }
+            break;
+        }
+
+        case Kind::Generic:
+            FilterColumns(src, srcBytesPerPixel, out, x0, x1);
+            break;
+    }
+
+    return out;
+}
+
+const uint8_t* ColorConverter::ScaleRow(const uint8_t* bgra, int srcStride, int srcBytesPerPixel,
+                                        int y, int x0, int x1, uint8_t* __restrict output,
+                                        StripeState& state) const {
+    size_t begin = static_cast<size_t>(x0) * 4;
+    size_t end = static_cast<size_t>(x1) * 4;
+    int taps = m_vertical.taps;
+    int srcY = m_vertical.offsets[y];
+    const uint16_t* w = m_vertical.weights.data() + static_cast<size_t>(y) * taps;
+
+    if (taps == 1) {
+        const uint16_t* __restrict row = FilterSourceRow(bgra, srcStride, srcBytesPerPixel, srcY, x0, x1, state);
+        for (size_t i = begin; i < end; i++) {
+            output[i] = static_cast<uint8_t>((row[i] + 128) >> 8);
+        }
+        return output;
+    }
+
+    if (taps == 2) {
+        const uint16_t* __restrict row0 = FilterSourceRow(bgra, srcStride, srcBytesPerPixel, srcY, x0, x1, state);
+        const uint16_t* __restrict row1 = FilterSourceRow(bgra, srcStride, srcBytesPerPixel, srcY + 1, x0, x1, state);
+        uint32_t w0 = w[0];
+        uint32_t w1 = w[1];
+        size_t i = begin;
+#if defined(__SSE2__)
+        // 16x16 -> 32-bit products from the low/high halves (SSE2 has no 32-bit mullo)
+        const __m128i weight0 = _mm_set1_epi16(static_cast<int16_t>(w0));
+        const __m128i weight1 = _mm_set1_epi16(static_cast<int16_t>(w1));
+        const __m128i round = _mm_set1_epi32(32768);
+        for (; i + 16 <= end; i += 16) {
+            __m128i result[2];
+            for (int half = 0; half < 2; half++) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + i + half * 8));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + i + half * 8));
+                __m128i aLo = _mm_mullo_epi16(a, weight0);
+                __m128i aHi = _mm_mulhi_epu16(a, weight0);
+                __m128i bLo = _mm_mullo_epi16(b, weight1);
+                __m128i bHi = _mm_mulhi_epu16(b, weight1);
+                __m128i lo = _mm_add_epi32(_mm_unpacklo_epi16(aLo, aHi), _mm_unpacklo_epi16(bLo, bHi));
+                __m128i hi = _mm_add_epi32(_mm_unpackhi_epi16(aLo, aHi), _mm_unpackhi_epi16(bLo, bHi));
+                lo = _mm_srli_epi32(_mm_add_epi32(lo, round), 16);
+                hi = _mm_srli_epi32(_mm_add_epi32(hi, round), 16);
+                result[half] = _mm_packs_epi32(lo, hi);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packus_epi16(result[0], result[1]));
+        }
+#endif
+        for (; i < end; i++) {
+            output[i] = static_cast<uint8_t>((w0 * row0[i] + w1 * row1[i] + 32768) >> 16);
+        }
+        return output;
+    }
+
+    uint32_t* __restrict acc = state.accumulator.data();
+    std::fill(acc + begin, acc + end, 32768u);
+    for (int t = 0; t < taps; t++) {
+        if (w[t] == 0) {
+            continue;
+        }
+        const uint16_t* __restrict row = FilterSourceRow(bgra, srcStride, srcBytesPerPixel, srcY + t, x0, x1, state);
+        uint32_t weight = w[t];
+        for (size_t i = begin; i < end; i++) {
+            acc[i] += weight * row[i];
+        }
+    }
+    for (size_t i = begin; i < end; i++) {
+        output[i] = static_cast<uint8_t>(acc[i] >> 16);
+    }
+    return output;
+}
+
+const uint8_t* ColorConverter::PrepareRow(const uint8_t* bgra, int srcStride, int srcBytesPerPixel,
+                                          int y, int x0, int x1, uint8_t* scratch, StripeState& state) const {
+    if (m_scaled && m_filter == ScaleFilter::Smooth) {
+        return ScaleRow(bgra, srcStride, srcBytesPerPixel, y, x0, x1, scratch, state);
+    }
+
+    const uint8_t* srcRow = bgra + static_cast<size_t>(m_yMap[y]) * srcStride;
+    state.bytesRead += static_cast<uint64_t>(x1 - x0) * srcBytesPerPixel;
+
+    if (!m_scaled && srcBytesPerPixel == 4) {
+        return srcRow;
+    }
+
+    // Gather sampled pixels into a packed BGRX row for the row kernels
+    if (srcBytesPerPixel == 4) {
+        for (int x = x0; x < x1; x++) {
+            memcpy(scratch + x * 4, srcRow + m_xMap[x] * 4, 4);
+        }
+    } else {
+        for (int x = x0; x < x1; x++) {
+            const uint8_t* p = srcRow + m_xMap[x] * srcBytesPerPixel;
+            scratch[x * 4] = p[0];
+            scratch[x * 4 + 1] = p[1];
+            scratch[x * 4 + 2] = p[2];
+            scratch[x * 4 + 3] = 0;
+        }
+    }
+    return scratch;
+}
+
+void ColorConverter::Convert(const uint8_t* bgra, int srcStride, int srcBytesPerPixel, uint8_t* nv12) {
+    for (int stripe = 0; stripe < GetStripeCount(); stripe++) {
+        ConvertStripe(stripe, bgra, srcStride, srcBytesPerPixel, nv12);
+    }
+}
+
+void ColorConverter::ConvertStripe(int stripe, const uint8_t* bgra, int srcStride, int srcBytesPerPixel,
+                                   uint8_t* nv12) {
+    StripeState& state = m_stripes[stripe];
+    state.bytesRead = 0;
+    ConvertRows(state, bgra, srcStride, srcBytesPerPixel, nv12,
+                m_stripeRows[stripe], m_stripeRows[stripe + 1], 0, m_dstWidth);
+}
+
+void ColorConverter::ConvertRect(int stripe, const uint8_t* bgra, int srcStride, int srcBytesPerPixel,
+                                 uint8_t* nv12, const FrameRect& rect) {
+    int x0 = std::max(rect.x, 0) & ~1;
+    int y0 = std::max(rect.y, 0) & ~1;
+    int x1 = std::min(rect.x + rect.width, m_dstWidth);
+    int y1 = std::min(rect.y + rect.height, m_dstHeight);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    // Odd ends are only allowed at the frame edge, where there is no partner pixel
+    x1 = std::min((x1 + 1) & ~1, m_dstWidth);
+    y1 = std::min((y1 + 1) & ~1, m_dstHeight);
+
+    ConvertRows(m_stripes[stripe], bgra, srcStride, srcBytesPerPixel, nv12, y0, y1, x0, x1);
+}
+
+void ColorConverter::ConvertRows(StripeState& state, const uint8_t* bgra, int srcStride, int srcBytesPerPixel,
+                                 uint8_t* nv12, int rowBegin, int rowEnd, int x0, int x1) {
+    int width = m_dstWidth;
+    int height = m_dstHeight;
+    int columns = x1 - x0;
+
+    // New region: nothing in the filtered-row ring is valid any more
+    std::fill(state.ringKeys.begin(), state.ringKeys.end(), -1);
+
+    uint8_t* yPlane = nv12;
+    uint8_t* uvPlane = nv12 + static_cast<size_t>(width) * height;
+    uint8_t* scratch0 = state.rows.data();
+    uint8_t* scratch1 = scratch0 + static_cast<size_t>(width) * 4;
+
+    int y = rowBegin;
+    for (; y + 1 < rowEnd; y += 2) {
+        const uint8_t* row0 = PrepareRow(bgra, srcStride, srcBytesPerPixel, y, x0, x1, scratch0, state);
+        const uint8_t* row1 = PrepareRow(bgra, srcStride, srcBytesPerPixel, y + 1, x0, x1, scratch1, state);
+
+        m_convertRowPair(row0 + x0 * 4, row1 + x0 * 4,
+                         yPlane + static_cast<size_t>(y) * width + x0,
+                         yPlane + static_cast<size_t>(y + 1) * width + x0,
+                         uvPlane + static_cast<size_t>(y / 2) * width + x0,
+                         columns);
+    }
+
+    // Odd height: last row has luma only
+    if (y < rowEnd) {
+        const uint8_t* row = PrepareRow(bgra, srcStride, srcBytesPerPixel, y, x0, x1, scratch0, state);
+        m_convertRowY(row + x0 * 4, yPlane + static_cast<size_t>(y) * width + x0, columns);
+    }
+}
+
+FrameRect ColorConverter::MapSourceRect(const FrameRect& source) const {
+    bool smooth = m_scaled && m_filter == ScaleFilter::Smooth;
+
+    // Output indices whose source footprint intersects [begin, end); maps are monotonic
+    auto mapAxis = [smooth](const std::vector<int>& map, const FilterAxis& axis, int begin, int end,
+                            int& outBegin, int& outEnd) {
+        if (smooth) {
+            auto first = std::lower_bound(axis.offsets.begin(), axis.offsets.end(), begin - axis.taps + 1);
+            auto last = std::lower_bound(axis.offsets.begin(), axis.offsets.end(), end);
+            outBegin = static_cast<int>(first - axis.offsets.begin());
+            outEnd = static_cast<int>(last - axis.offsets.begin());
+        } else {
+            outBegin = static_cast<int>(std::lower_bound(map.begin(), map.end(), begin) - map.begin());
+            outEnd = static_cast<int>(std::lower_bound(map.begin(), map.end(), end) - map.begin());
+        }
+    };
+
+    FrameRect result;
+    int x0, x1, y0, y1;
+    mapAxis(m_xMap, m_horizontal, source.x, source.x + source.width, x0, x1);
+    mapAxis(m_yMap, m_vertical, source.y, source.y + source.height, y0, y1);
+    if (x0 >= x1 || y0 >= y1) {
+        return result;
+    }
+
+    // Chroma is shared by 2x2 blocks, so widen to even coordinates
+    x0 &= ~1;
+    y0 &= ~1;
+    x1 = std::min((x1 + 1) & ~1, m_dstWidth);
+    y1 = std::min((y1 + 1) & ~1, m_dstHeight);
+
+    result.x = x0;
+    result.y = y0;
+    result.width = x1 - x0;
+    result.height = y1 - y0;
+    return result;
+}
+
+}  // namespace snacka
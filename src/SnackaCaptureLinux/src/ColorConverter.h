@@ -0,0 +1,259 @@
+#pragma once
+
+#include "FrameInfo.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace snacka {
+
+/// Instruction set levels the color conversion kernels are built for
+enum class CpuLevel : uint8_t {
+    Scalar = 0,
+    SSE41 = 1,
+    AVX2 = 2
+};
+
+/// RGB to YCbCr matrix
+enum class ColorMatrix : uint8_t {
+    BT601 = 0,  // SD content, what receivers assume when nothing is signalled
+    BT709 = 1   // HD content
+};
+
+/// YCbCr quantization range
+enum class ColorRange : uint8_t {
+    Limited = 0,  // Y 16..235, UV 16..240 (video levels, the default for H.264)
+    Full = 1      // 0..255 (JPEG levels)
+};
+
+/// Output colorimetry: the matrix and range the converter writes with
+struct ColorSpace {
+    ColorMatrix matrix = ColorMatrix::BT601;
+    ColorRange range = ColorRange::Limited;
+};
+
+/// Byte order of a 4-byte source pixel in memory (3-byte sources drop the X byte)
+enum class PixelLayout : uint8_t {
+    BGRX = 0,  // Little-endian X servers with red in bits 16-23, the common case
+    RGBX = 1,  // Red in bits 0-7
+    XBGR = 2   // Red in bits 24-31
+};
+
+/// Resampling used when the source and output sizes differ
+enum class ScaleFilter : uint8_t {
+    Nearest = 0,  // Point sampling, cheapest but aliases text
+    Smooth = 1    // Area average for integer and 3:2/4:3 ratios, bilinear otherwise
+};
+
+/// 8-bit fixed point RGB -> YUV coefficients (x256) and luma offset
+struct ColorCoefficients {
+    int16_t yR, yG, yB;
+    int16_t uR, uG, uB;
+    int16_t vR, vG, vB;
+    int16_t yOffset;
+
+    /// Limited range coefficients keep results in 16..240; full range ones use 127
+    /// for the 0.5 chroma terms so saturated blue and red stay within 255
+    static constexpr ColorCoefficients For(ColorMatrix matrix, ColorRange range) {
+        if (range == ColorRange::Full) {
+            return matrix == ColorMatrix::BT709
+                ? ColorCoefficients{54, 183, 19, -29, -98, 127, 127, -115, -12, 0}
+                : ColorCoefficients{77, 150, 29, -43, -84, 127, 127, -107, -20, 0};
+        }
+        return matrix == ColorMatrix::BT709
+            ? ColorCoefficients{47, 157, 16, -26, -86, 112, 112, -102, -10, 16}
+            : ColorCoefficients{66, 129, 25, -38, -74, 112, 112, -94, -18, 16};
+    }
+};
+
+/// Parse a --colorspace value (bt601, bt709, bt601-full, bt709-full)
+bool ParseColorSpace(const std::string& name, ColorSpace& space);
+
+/// Get the --colorspace name of a color space
+const char* GetColorSpaceName(const ColorSpace& space);
+
+/// Converts two source rows into two Y rows and one interleaved UV row
+using ConvertRowPairFn = void (*)(const uint8_t* src0, const uint8_t* src1,
+                                  uint8_t* y0, uint8_t* y1, uint8_t* uv, int width);
+
+/// Converts one source row into a Y row (last row of an odd-height frame)
+using ConvertRowYFn = void (*)(const uint8_t* src, uint8_t* y, int width);
+
+/// CPU RGB to NV12 converter with runtime SIMD dispatch.
+/// Not tied to any capture source: callers hand it a packed 32-bit (or 24-bit) image
+/// and an NV12 destination, and it picks the fastest kernel the CPU supports (AVX2,
+/// SSE4.1 or the scalar reference). All kernels produce the same output as the scalar path.
+///
+/// Every kernel is specialized at compile time for each color matrix, range and
+/// source byte order, so the coefficients and channel positions are constants in the
+/// inner loop; Configure looks up the specialization once.
+///
+/// When the output is smaller than the source, the Smooth filter downscales and
+/// converts in one streaming pass: each source row is read once, filtered
+/// horizontally into a small ring of rows, combined vertically into two output rows
+/// and converted straight to Y/UV while still in L1.
+///
+/// The output can be split into horizontal stripes that are converted independently
+/// (e.g. one per worker thread). Stripe boundaries fall on row pairs whose Y and UV
+/// offsets are multiples of the cache line size, so no two stripes write the same line.
+class ColorConverter {
+public:
+    /// @param level Kernel level to use (clamped to what the CPU supports)
+    explicit ColorConverter(CpuLevel level = DetectCpuLevel());
+
+    /// Set the resampling filter (call before Configure)
+    void SetScaleFilter(ScaleFilter filter) { m_filter = filter; }
+
+    /// Set the output color matrix and range (call before Configure)
+    void SetColorSpace(const ColorSpace& space) { m_colorSpace = space; }
+
+    /// Get the output color matrix and range
+    const ColorSpace& GetColorSpace() const { return m_colorSpace; }
+
+    /// Set the source pixel byte order (call before Configure)
+    void SetPixelLayout(PixelLayout layout) { m_layout = layout; }
+
+    /// Prepare scaling tables for a source/output size pair
+    /// @param srcWidth Source image width in pixels
+    /// @param srcHeight Source image height in pixels
+    /// @param dstWidth Output NV12 width
+    /// @param dstHeight Output NV12 height
+    /// @param stripeCount Number of stripes to split the output into (for threading)
+    void Configure(int srcWidth, int srcHeight, int dstWidth, int dstHeight, int stripeCount = 1);
+
+    /// Convert a 32-bit (or packed 24-bit) RGB image to NV12
+    /// @param bgra Source pixels in the configured PixelLayout
+    /// @param srcStride Bytes per source row
+    /// @param srcBytesPerPixel Bytes per source pixel (4, or 3 for packed BGR/RGB)
+    /// @param nv12 Output buffer of CalculateNV12FrameSize(dstWidth, dstHeight) bytes
+    void Convert(const uint8_t* bgra, int srcStride, int srcBytesPerPixel, uint8_t* nv12);
+
+    /// Convert one output stripe; stripes may run concurrently on different threads
+    /// @param stripe Stripe index in [0, GetStripeCount())
+    void ConvertStripe(int stripe, const uint8_t* bgra, int srcStride, int srcBytesPerPixel, uint8_t* nv12);
+
+    /// Reconvert one output rectangle (e.g. a damaged region) in place.
+    /// Rectangles passed to concurrent calls must not overlap and must use different stripe indices.
+    /// @param stripe Index of the working memory to use, in [0, GetStripeCount())
+    /// @param rect Output rectangle; widened to even coordinates for 2x2 chroma
+    void ConvertRect(int stripe, const uint8_t* bgra, int srcStride, int srcBytesPerPixel, uint8_t* nv12,
+                     const FrameRect& rect);
+
+    /// Get the output rectangle whose pixels depend on a source rectangle
+    /// (covers the scaling filter footprint, aligned to even coordinates)
+    FrameRect MapSourceRect(const FrameRect& source) const;
+
+    /// Get the number of stripes the output was actually split into
+    /// (may be less than requested for short frames)
+    int GetStripeCount() const { return static_cast<int>(m_stripeRows.size()) - 1; }
+
+    /// Get the first output row of a stripe (stripe == GetStripeCount() gives the frame height)
+    int GetStripeRow(int stripe) const { return m_stripeRows[stripe]; }
+
+    /// Get the source bytes read by the most recent conversion of each stripe
+    /// (i.e. per output frame once every stripe has run), plus any ConvertRect calls since
+    uint64_t GetSourceBytesRead() const;
+
+    /// Zero the source byte counters (call before a frame made of ConvertRect calls)
+    void ResetSourceBytesRead();
+
+    /// Get a short description of the scaling path per axis (e.g. "area 3:2 x bilinear")
+    const char* GetScaleDescription() const { return m_scaleDescription.c_str(); }
+
+    /// Get the kernel level in use
+    CpuLevel GetCpuLevel() const { return m_level; }
+
+    /// Detect the best kernel level supported by this CPU (CPUID based)
+    static CpuLevel DetectCpuLevel();
+
+    /// Check whether a kernel level can run on this CPU
+    static bool IsCpuLevelSupported(CpuLevel level);
+
+    /// Get a printable name for a kernel level
+    static const char* GetCpuLevelName(CpuLevel level);
+
+    /// Pick a conversion thread count: the requested one, or by default one per
+    /// 1080p worth of output pixels (capped by the CPU count and 8)
+    /// @param requested Requested thread count, 0 = auto
+    static int PickStripeCount(int requested, int dstWidth, int dstHeight);
+
+private:
+    /// Resampling taps for one axis: output i reads source [offsets[i], offsets[i] + taps)
+    /// with weights summing to 256
+    struct FilterAxis {
+        enum class Kind : uint8_t { Copy, Half, ThreeTwo, FourThree, Generic };
+        Kind kind = Kind::Copy;
+        int taps = 1;
+        std::vector<int> offsets;
+        std::vector<uint16_t> weights;
+    };
+
+    /// Per-stripe working memory; cache-line aligned so stripes don't share lines
+    struct alignas(64) StripeState {
+        // Gathered/scaled BGRX rows fed to the row kernels
+        std::vector<uint8_t> rows;
+        // Ring of horizontally filtered rows (16-bit, x256) keyed by source row
+        std::vector<uint16_t> ring;
+        std::vector<int> ringKeys;
+        std::vector<uint32_t> accumulator;
+        uint64_t bytesRead = 0;
+    };
+
+    static void BuildAxis(FilterAxis& axis, int srcSize, int dstSize);
+
+    // Row pipeline; [x0, x1) is the output column range, x0 even
+    void ConvertRows(StripeState& state, const uint8_t* bgra, int srcStride, int srcBytesPerPixel,
+                     uint8_t* nv12, int rowBegin, int rowEnd, int x0, int x1);
+    const uint8_t* PrepareRow(const uint8_t* bgra, int srcStride, int srcBytesPerPixel,
+                              int y, int x0, int x1, uint8_t* scratch, StripeState& state) const;
+    const uint8_t* ScaleRow(const uint8_t* bgra, int srcStride, int srcBytesPerPixel,
+                            int y, int x0, int x1, uint8_t* output, StripeState& state) const;
+    const uint16_t* FilterSourceRow(const uint8_t* bgra, int srcStride, int srcBytesPerPixel,
+                                    int srcY, int x0, int x1, StripeState& state) const;
+    void FilterColumns(const uint8_t* src, int srcBytesPerPixel, uint16_t* out, int x0, int x1) const;
+
+    CpuLevel m_level = CpuLevel::Scalar;
+    ConvertRowPairFn m_convertRowPair = nullptr;
+    ConvertRowYFn m_convertRowY = nullptr;
+    ScaleFilter m_filter = ScaleFilter::Smooth;
+    ColorSpace m_colorSpace;
+    PixelLayout m_layout = PixelLayout::BGRX;
+
+    int m_srcWidth = 0;
+    int m_srcHeight = 0;
+    int m_dstWidth = 0;
+    int m_dstHeight = 0;
+    bool m_scaled = false;
+
+    // Nearest-neighbour source index per output column/row
+    std::vector<int> m_xMap;
+    std::vector<int> m_yMap;
+
+    // Smooth filter taps
+    FilterAxis m_horizontal;
+    FilterAxis m_vertical;
+    int m_sourceColumnsRead = 0;
+    std::string m_scaleDescription;
+
+    // First output row of each stripe, plus the frame height as the end marker
+    std::vector<int> m_stripeRows;
+    std::vector<StripeState> m_stripes;
+};
+
+namespace kernels {
+
+// Look up the kernel specialized for a color space and source layout.
+// The scalar reference kernels are always available
+ConvertRowPairFn SelectConvertRowPairScalar(const ColorSpace& space, PixelLayout layout);
+ConvertRowYFn SelectConvertRowYScalar(const ColorSpace& space, PixelLayout layout);
+
+#if defined(__x86_64__) || defined(__i386__)
+// Built with per-file ISA flags, only call the kernels after checking CPU support
+ConvertRowPairFn SelectConvertRowPairSSE41(const ColorSpace& space, PixelLayout layout);
+ConvertRowPairFn SelectConvertRowPairAVX2(const ColorSpace& space, PixelLayout layout);
+#endif
+
+}  // namespace kernels
+
+}  // namespace snacka
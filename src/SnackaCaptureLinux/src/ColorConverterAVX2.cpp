@@ -0,0 +1,106 @@
+// AVX2 RGB to NV12 row kernels. Compiled with -mavx2, dispatched at runtime.
+// No namespace-scope vector constants: static initializers would execute AVX
+// instructions on CPUs that never select this path.
+
+#include "ColorConverterKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+namespace snacka::kernels {
+
+namespace {
+
+// 8 pixels -> 8 luma values as int32, in pixel order
+inline __m256i Luma8(__m256i px, __m256i coeff, int offset) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lo = _mm256_unpacklo_epi8(px, zero);
+    __m256i hi = _mm256_unpackhi_epi8(px, zero);
+    __m256i sum = _mm256_hadd_epi32(_mm256_madd_epi16(lo, coeff), _mm256_madd_epi16(hi, coeff));
+    sum = _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8);
+    return _mm256_add_epi32(sum, _mm256_set1_epi32(offset));
+}
+
+// 16 pixels -> 16 luma bytes
+inline __m128i Luma16(__m256i px0, __m256i px1, __m256i coeff, int offset) {
+    // packs interleaves 128-bit lanes: reorder quads back to pixel order
+    __m256i words = _mm256_permute4x64_epi64(
+        _mm256_packs_epi32(Luma8(px0, coeff, offset), Luma8(px1, coeff, offset)), _MM_SHUFFLE(3, 1, 2, 0));
+    return _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+}
+
+// 8 pixels from each of two rows -> averaged channels of four 2x2 blocks (16-bit)
+// Lane 0 holds blocks 0-1, lane 1 holds blocks 2-3
+inline __m256i Average2x2(__m256i top, __m256i bottom) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(top, zero), _mm256_unpacklo_epi8(bottom, zero));
+    __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(top, zero), _mm256_unpackhi_epi8(bottom, zero));
+    lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+    hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+    return _mm256_srli_epi16(_mm256_unpacklo_epi64(lo, hi), 2);
+}
+
+// Blocks 0-3 and 4-7 -> one chroma component per block as int32
+// Result order: 0, 1, 4, 5 | 2, 3, 6, 7
+inline __m256i Chroma8(__m256i blocksA, __m256i blocksB, __m256i coeff) {
+    __m256i sum = _mm256_hadd_epi32(_mm256_madd_epi16(blocksA, coeff), _mm256_madd_epi16(blocksB, coeff));
+    sum = _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8);
+    return _mm256_add_epi32(sum, _mm256_set1_epi32(128));
+}
+
+// Coefficients laid out to match the source bytes widened to 16 bits, two pixels per lane
+template <typename Format>
+inline __m256i PixelCoefficients(int16_t r, int16_t g, int16_t b) {
+    auto c = Format::Arrange(r, g, b);
+    return _mm256_setr_epi16(c[0], c[1], c[2], c[3], c[0], c[1], c[2], c[3],
+                             c[0], c[1], c[2], c[3], c[0], c[1], c[2], c[3]);
+}
+
+template <typename Format>
+void ConvertRowPairAVX2(const uint8_t* src0, const uint8_t* src1,
+                        uint8_t* y0, uint8_t* y1, uint8_t* uv, int width) {
+    constexpr ColorCoefficients coeff = Format::coeff;
+    const __m256i yCoeff = PixelCoefficients<Format>(coeff.yR, coeff.yG, coeff.yB);
+    const __m256i uCoeff = PixelCoefficients<Format>(coeff.uR, coeff.uG, coeff.uB);
+    const __m256i vCoeff = PixelCoefficients<Format>(coeff.vR, coeff.vG, coeff.vB);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src0 + x * 4));
+        __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src0 + x * 4 + 32));
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src1 + x * 4));
+        __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src1 + x * 4 + 32));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), Luma16(a0, a1, yCoeff, coeff.yOffset));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), Luma16(b0, b1, yCoeff, coeff.yOffset));
+
+        __m256i blocksA = Average2x2(a0, b0);
+        __m256i blocksB = Average2x2(a1, b1);
+        __m256i u = Chroma8(blocksA, blocksB, uCoeff);
+        __m256i v = Chroma8(blocksA, blocksB, vCoeff);
+
+        // Interleave to U V pairs, then restore block order 0-3 | 4-7 across lanes
+        __m256i interleaved = _mm256_packs_epi32(_mm256_unpacklo_epi32(u, v), _mm256_unpackhi_epi32(u, v));
+        interleaved = _mm256_permute4x64_epi64(interleaved, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x),
+                         _mm_packus_epi16(_mm256_castsi256_si128(interleaved),
+                                          _mm256_extracti128_si256(interleaved, 1)));
+    }
+
+    if (x < width) {
+        ConvertRowPairReference<Format>(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x, uv + x, width - x);
+    }
+}
+
+}  // namespace
+
+ConvertRowPairFn SelectConvertRowPairAVX2(const ColorSpace& space, PixelLayout layout) {
+    return SelectKernel<ConvertRowPairFn>(space, layout, []<typename Format>() {
+        return &ConvertRowPairAVX2<Format>;
+    });
+}
+
+}  // namespace snacka::kernels
+
+#endif
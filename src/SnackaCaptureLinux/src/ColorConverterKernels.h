@@ -0,0 +1,125 @@
+#pragma once
+
+// Compile-time specialized RGB to NV12 building blocks shared by the kernel files.
+// Everything here has internal linkage: the SIMD files are compiled with ISA flags,
+// and a shared out-of-line copy of an inline function could otherwise be picked for
+// the scalar path of a CPU without those instructions.
+
+#include "ColorConverter.h"
+
+#include <array>
+
+namespace snacka::kernels {
+
+namespace {
+
+/// Conversion parameters of one kernel specialization
+template <ColorMatrix Matrix, ColorRange Range, PixelLayout Layout>
+struct ColorFormat {
+    static constexpr ColorCoefficients coeff = ColorCoefficients::For(Matrix, Range);
+
+    // Byte offsets of R, G and B within a source pixel
+    static constexpr int r = Layout == PixelLayout::BGRX ? 2 : (Layout == PixelLayout::RGBX ? 0 : 3);
+    static constexpr int g = Layout == PixelLayout::XBGR ? 2 : 1;
+    static constexpr int b = Layout == PixelLayout::BGRX ? 0 : (Layout == PixelLayout::RGBX ? 2 : 1);
+
+    /// Place per-channel weights at the source byte positions (0 for the X byte)
+    static constexpr std::array<int16_t, 4> Arrange(int16_t wr, int16_t wg, int16_t wb) {
+        std::array<int16_t, 4> weights{};
+        weights[r] = wr;
+        weights[g] = wg;
+        weights[b] = wb;
+        return weights;
+    }
+};
+
+template <typename Format>
+inline uint8_t RgbToY(int r, int g, int b) {
+    constexpr ColorCoefficients c = Format::coeff;
+    return static_cast<uint8_t>(((c.yR * r + c.yG * g + c.yB * b + 128) >> 8) + c.yOffset);
+}
+
+template <typename Format>
+inline uint8_t RgbToU(int r, int g, int b) {
+    constexpr ColorCoefficients c = Format::coeff;
+    return static_cast<uint8_t>(((c.uR * r + c.uG * g + c.uB * b + 128) >> 8) + 128);
+}
+
+template <typename Format>
+inline uint8_t RgbToV(int r, int g, int b) {
+    constexpr ColorCoefficients c = Format::coeff;
+    return static_cast<uint8_t>(((c.vR * r + c.vG * g + c.vB * b + 128) >> 8) + 128);
+}
+
+/// Scalar reference: the SIMD kernels must match it exactly, and use it for row tails
+template <typename Format>
+void ConvertRowPairReference(const uint8_t* src0, const uint8_t* src1,
+                             uint8_t* y0, uint8_t* y1, uint8_t* uv, int width) {
+    constexpr int R = Format::r;
+    constexpr int G = Format::g;
+    constexpr int B = Format::b;
+
+    int x = 0;
+    for (; x + 1 < width; x += 2) {
+        const uint8_t* a = src0 + x * 4;
+        const uint8_t* b = src1 + x * 4;
+
+        y0[x] = RgbToY<Format>(a[R], a[G], a[B]);
+        y0[x + 1] = RgbToY<Format>(a[4 + R], a[4 + G], a[4 + B]);
+        y1[x] = RgbToY<Format>(b[R], b[G], b[B]);
+        y1[x + 1] = RgbToY<Format>(b[4 + R], b[4 + G], b[4 + B]);
+
+        // Average the 2x2 block for chroma
+        int rAvg = (a[R] + a[4 + R] + b[R] + b[4 + R]) >> 2;
+        int gAvg = (a[G] + a[4 + G] + b[G] + b[4 + G]) >> 2;
+        int bAvg = (a[B] + a[4 + B] + b[B] + b[4 + B]) >> 2;
+
+        uv[x] = RgbToU<Format>(rAvg, gAvg, bAvg);
+        uv[x + 1] = RgbToV<Format>(rAvg, gAvg, bAvg);
+    }
+
+    // Odd width: last column has luma only
+    if (x < width) {
+        const uint8_t* a = src0 + x * 4;
+        const uint8_t* b = src1 + x * 4;
+        y0[x] = RgbToY<Format>(a[R], a[G], a[B]);
+        y1[x] = RgbToY<Format>(b[R], b[G], b[B]);
+    }
+}
+
+template <typename Format>
+void ConvertRowYReference(const uint8_t* src, uint8_t* y, int width) {
+    for (int x = 0; x < width; x++) {
+        const uint8_t* p = src + x * 4;
+        y[x] = RgbToY<Format>(p[Format::r], p[Format::g], p[Format::b]);
+    }
+}
+
+/// Instantiate a kernel for every format and return the one for the runtime parameters
+/// @param make Lambda templated on the ColorFormat, returning the kernel's address
+template <typename Fn, typename Make>
+Fn SelectKernel(const ColorSpace& space, PixelLayout layout, Make make) {
+    auto forLayout = [&]<ColorMatrix Matrix, ColorRange Range>() -> Fn {
+        switch (layout) {
+            case PixelLayout::RGBX:
+                return make.template operator()<ColorFormat<Matrix, Range, PixelLayout::RGBX>>();
+            case PixelLayout::XBGR:
+                return make.template operator()<ColorFormat<Matrix, Range, PixelLayout::XBGR>>();
+            case PixelLayout::BGRX:
+            default:
+                return make.template operator()<ColorFormat<Matrix, Range, PixelLayout::BGRX>>();
+        }
+    };
+
+    bool full = space.range == ColorRange::Full;
+    if (space.matrix == ColorMatrix::BT709) {
+        return full ? forLayout.template operator()<ColorMatrix::BT709, ColorRange::Full>()
+                    : forLayout.template operator()<ColorMatrix::BT709, ColorRange::Limited>();
+    }
+    return full ? forLayout.template operator()<ColorMatrix::BT601, ColorRange::Full>()
+                : forLayout.template operator()<ColorMatrix::BT601, ColorRange::Limited>();
+}
+
+}  // namespace
+
+}  // namespace snacka::kernels
@@ -0,0 +1,95 @@
+// SSE4.1 RGB to NV12 row kernels. Compiled with -msse4.1, dispatched at runtime.
+
+#include "ColorConverterKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <smmintrin.h>
+
+namespace snacka::kernels {
+
+namespace {
+
+// 4 pixels -> 4 luma values as int32
+inline __m128i Luma4(__m128i px, __m128i coeff, int offset) {
+    __m128i lo = _mm_cvtepu8_epi16(px);
+    __m128i hi = _mm_unpackhi_epi8(px, _mm_setzero_si128());
+    __m128i sum = _mm_hadd_epi32(_mm_madd_epi16(lo, coeff), _mm_madd_epi16(hi, coeff));
+    sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8);
+    return _mm_add_epi32(sum, _mm_set1_epi32(offset));
+}
+
+// 8 pixels -> 8 luma bytes in the low half
+inline __m128i Luma8(__m128i px0, __m128i px1, __m128i coeff, int offset) {
+    __m128i words = _mm_packs_epi32(Luma4(px0, coeff, offset), Luma4(px1, coeff, offset));
+    return _mm_packus_epi16(words, words);
+}
+
+// 4 pixels from each of two rows -> averaged channels of the two 2x2 blocks (16-bit)
+inline __m128i Average2x2(__m128i top, __m128i bottom) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(_mm_cvtepu8_epi16(top), _mm_cvtepu8_epi16(bottom));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+    return _mm_srli_epi16(_mm_unpacklo_epi64(lo, hi), 2);
+}
+
+// Two averaged block registers (4 blocks) -> one chroma component per block as int32
+inline __m128i Chroma4(__m128i blocks01, __m128i blocks23, __m128i coeff) {
+    __m128i sum = _mm_hadd_epi32(_mm_madd_epi16(blocks01, coeff), _mm_madd_epi16(blocks23, coeff));
+    sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8);
+    return _mm_add_epi32(sum, _mm_set1_epi32(128));
+}
+
+// Coefficients laid out to match the source bytes widened to 16 bits, two pixels per register
+template <typename Format>
+inline __m128i PixelCoefficients(int16_t r, int16_t g, int16_t b) {
+    auto c = Format::Arrange(r, g, b);
+    return _mm_setr_epi16(c[0], c[1], c[2], c[3], c[0], c[1], c[2], c[3]);
+}
+
+template <typename Format>
+void ConvertRowPairSSE41(const uint8_t* src0, const uint8_t* src1,
+                         uint8_t* y0, uint8_t* y1, uint8_t* uv, int width) {
+    constexpr ColorCoefficients coeff = Format::coeff;
+    const __m128i yCoeff = PixelCoefficients<Format>(coeff.yR, coeff.yG, coeff.yB);
+    const __m128i uCoeff = PixelCoefficients<Format>(coeff.uR, coeff.uG, coeff.uB);
+    const __m128i vCoeff = PixelCoefficients<Format>(coeff.vR, coeff.vG, coeff.vB);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + x * 4));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + x * 4 + 16));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + x * 4));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + x * 4 + 16));
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(y0 + x), Luma8(a0, a1, yCoeff, coeff.yOffset));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(y1 + x), Luma8(b0, b1, yCoeff, coeff.yOffset));
+
+        __m128i blocks01 = Average2x2(a0, b0);
+        __m128i blocks23 = Average2x2(a1, b1);
+        __m128i u = Chroma4(blocks01, blocks23, uCoeff);
+        __m128i v = Chroma4(blocks01, blocks23, vCoeff);
+
+        // U0 V0 U1 V1 U2 V2 U3 V3
+        __m128i interleaved = _mm_packs_epi32(_mm_unpacklo_epi32(u, v), _mm_unpackhi_epi32(u, v));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(uv + x), _mm_packus_epi16(interleaved, interleaved));
+    }
+
+    if (x < width) {
+        ConvertRowPairReference<Format>(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x, uv + x, width - x);
+    }
+}
+
+}  // namespace
+
+ConvertRowPairFn SelectConvertRowPairSSE41(const ColorSpace& space, PixelLayout layout) {
+    return SelectKernel<ConvertRowPairFn>(space, layout, []<typename Format>() {
+        return &ConvertRowPairSSE41<Format>;
+    });
+}
+
+}  // namespace snacka::kernels
+
+#endif
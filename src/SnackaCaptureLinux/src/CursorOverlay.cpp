@@ -0,0 +1,146 @@
+#include "CursorOverlay.h"
+
+#include <algorithm>
+
+namespace snacka {
+
+namespace {
+
+// Premultiplied source over: the cursor already carries its alpha in r, g, b
+inline uint8_t BlendOver(int background, int alpha, int premultiplied) {
+    return static_cast<uint8_t>(std::clamp((background * (255 - alpha) + 127) / 255 + premultiplied, 0, 255));
+}
+
+}  // namespace
+
+void CursorOverlay::Configure(int srcWidth, int srcHeight, int dstWidth, int dstHeight, const ColorSpace& space) {
+    m_srcWidth = srcWidth;
+    m_srcHeight = srcHeight;
+    m_dstWidth = dstWidth;
+    m_dstHeight = dstHeight;
+    m_coefficients = ColorCoefficients::For(space.matrix, space.range);
+    m_source.reset();
+    m_scaled.reset();
+}
+
+std::shared_ptr<const CursorImage> CursorOverlay::Scale(const std::shared_ptr<const CursorImage>& source) {
+    if (!source || source->width <= 0 || source->height <= 0) {
+        return nullptr;
+    }
+    if (m_source && m_source->serial == source->serial) {
+        return m_scaled;
+    }
+
+    m_source = source;
+    if (m_srcWidth == m_dstWidth && m_srcHeight == m_dstHeight) {
+        m_scaled = source;
+        return m_scaled;
+    }
+
+    // Nearest sampling: cursors are small and mostly hard-edged
+    auto scaled = std::make_shared<CursorImage>();
+    scaled->serial = source->serial;
+    scaled->width = std::max(1, static_cast<int>(static_cast<int64_t>(source->width) * m_dstWidth / m_srcWidth));
+    scaled->height = std::max(1, static_cast<int>(static_cast<int64_t>(source->height) * m_dstHeight / m_srcHeight));
+    scaled->xhot = static_cast<int>(static_cast<int64_t>(source->xhot) * m_dstWidth / m_srcWidth);
+    scaled->yhot = static_cast<int>(static_cast<int64_t>(source->yhot) * m_dstHeight / m_srcHeight);
+    scaled->argb.resize(static_cast<size_t>(scaled->width) * scaled->height);
+    for (int y = 0; y < scaled->height; y++) {
+        int sy = y * source->height / scaled->height;
+        for (int x = 0; x < scaled->width; x++) {
+            int sx = x * source->width / scaled->width;
+            scaled->argb[static_cast<size_t>(y) * scaled->width + x] =
+                source->argb[static_cast<size_t>(sy) * source->width + sx];
+        }
+    }
+    m_scaled = std::move(scaled);
+    return m_scaled;
+}
+
+void CursorOverlay::MapPosition(int srcX, int srcY, int& dstX, int& dstY) const {
+    dstX = static_cast<int>(static_cast<int64_t>(srcX) * m_dstWidth / std::max(m_srcWidth, 1));
+    dstY = static_cast<int>(static_cast<int64_t>(srcY) * m_dstHeight / std::max(m_srcHeight, 1));
+}
+
+FrameRect CursorOverlay::GetRect(const FrameCursor& cursor) const {
+    if (!cursor.visible || !cursor.shape) {
+        return {};
+    }
+
+    int left = cursor.x - cursor.shape->xhot;
+    int top = cursor.y - cursor.shape->yhot;
+    int x0 = std::max(left, 0) & ~1;
+    int y0 = std::max(top, 0) & ~1;
+    int x1 = std::min((std::min(left + cursor.shape->width, m_dstWidth) + 1) & ~1, m_dstWidth);
+    int y1 = std::min((std::min(top + cursor.shape->height, m_dstHeight) + 1) & ~1, m_dstHeight);
+    if (x0 >= x1 || y0 >= y1) {
+        return {};
+    }
+    return {x0, y0, x1 - x0, y1 - y0};
+}
+
+void CursorOverlay::Blend(const FrameCursor& cursor, uint8_t* nv12) const {
+    FrameRect rect = GetRect(cursor);
+    if (rect.width <= 0) {
+        return;
+    }
+
+    const CursorImage& shape = *cursor.shape;
+    const ColorCoefficients& c = m_coefficients;
+    int left = cursor.x - shape.xhot;
+    int top = cursor.y - shape.yhot;
+
+    // Transparent outside the image, so the even-aligned rect can overhang it
+    auto pixelAt = [&](int x, int y) -> uint32_t {
+        int px = x - left;
+        int py = y - top;
+        if (px < 0 || py < 0 || px >= shape.width || py >= shape.height) {
+            return 0;
+        }
+        return shape.argb[static_cast<size_t>(py) * shape.width + px];
+    };
+
+    uint8_t* yPlane = nv12;
+    uint8_t* uvPlane = nv12 + static_cast<size_t>(m_dstWidth) * m_dstHeight;
+    for (int y = rect.y; y < rect.y + rect.height; y += 2) {
+        for (int x = rect.x; x < rect.x + rect.width; x += 2) {
+            int sumA = 0;
+            int sumR = 0;
+            int sumG = 0;
+            int sumB = 0;
+            for (int dy = 0; dy < 2 && y + dy < m_dstHeight; dy++) {
+                for (int dx = 0; dx < 2 && x + dx < m_dstWidth; dx++) {
+                    uint32_t p = pixelAt(x + dx, y + dy);
+                    int a = p >> 24;
+                    if (a == 0) {
+                        continue;
+                    }
+                    int r = (p >> 16) & 0xFF;
+                    int g = (p >> 8) & 0xFF;
+                    int b = p & 0xFF;
+                    uint8_t& luma = yPlane[static_cast<size_t>(y + dy) * m_dstWidth + x + dx];
+                    int premultiplied = ((c.yR * r + c.yG * g + c.yB * b + 128) >> 8) + (c.yOffset * a + 127) / 255;
+                    luma = BlendOver(luma, a, premultiplied);
+                    sumA += a;
+                    sumR += r;
+                    sumG += g;
+                    sumB += b;
+                }
+            }
+            if (sumA == 0 || x + 1 >= m_dstWidth) {
+                continue;  // Odd width: the last column has luma only
+            }
+
+            // Chroma of the 2x2 block, averaged the same way the converter does
+            int a = sumA >> 2;
+            int r = sumR >> 2;
+            int g = sumG >> 2;
+            int b = sumB >> 2;
+            uint8_t* uv = uvPlane + static_cast<size_t>(y / 2) * m_dstWidth + x;
+            uv[0] = BlendOver(uv[0], a, ((c.uR * r + c.uG * g + c.uB * b + 128) >> 8) + (128 * a + 127) / 255);
+            uv[1] = BlendOver(uv[1], a, ((c.vR * r + c.vG * g + c.vB * b + 128) >> 8) + (128 * a + 127) / 255);
+        }
+    }
+}
+
+}  // namespace snacka
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "ColorConverter.h"
+#include "FrameInfo.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace snacka {
+
+/// Draws the pointer into NV12 output frames.
+/// The cursor image is scaled to the output once per shape, then blended straight
+/// into the Y and UV planes after the tiles beneath it are converted, so the screen
+/// mirror never gets a composited copy and only the tiles under the old and new
+/// pointer positions need converting when the pointer alone moves.
+class CursorOverlay {
+public:
+    /// Set the source (captured area) and output sizes; drops the cached shape
+    /// @param space Color matrix and range the converter writes with
+    void Configure(int srcWidth, int srcHeight, int dstWidth, int dstHeight, const ColorSpace& space);
+
+    /// Get a shape scaled to the output, cached until the serial changes
+    /// @param source Cursor image in screen pixels
+    std::shared_ptr<const CursorImage> Scale(const std::shared_ptr<const CursorImage>& source);
+
+    /// Map a pointer position in the captured area to output pixels
+    void MapPosition(int srcX, int srcY, int& dstX, int& dstY) const;
+
+    /// Get the output rectangle a cursor covers, widened to even coordinates for 2x2 chroma
+    /// (empty when it lies outside the output)
+    FrameRect GetRect(const FrameCursor& cursor) const;
+
+    /// Blend a cursor over freshly converted output pixels
+    /// @param nv12 Output buffer of CalculateNV12FrameSize(dstWidth, dstHeight) bytes
+    void Blend(const FrameCursor& cursor, uint8_t* nv12) const;
+
+private:
+    int m_srcWidth = 0;
+    int m_srcHeight = 0;
+    int m_dstWidth = 0;
+    int m_dstHeight = 0;
+    ColorCoefficients m_coefficients = ColorCoefficients::For(ColorMatrix::BT601, ColorRange::Limited);
+    std::shared_ptr<const CursorImage> m_source;
+    std::shared_ptr<const CursorImage> m_scaled;
+};
+
+}  // namespace snacka
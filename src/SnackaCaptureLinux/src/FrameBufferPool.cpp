@@ -0,0 +1,262 @@
+#include "FrameBufferPool.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+namespace snacka {
+
+namespace {
+
+constexpr size_t ALIGNMENT = 64;
+constexpr size_t PAGE_SIZE_BYTES = 4096;
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+size_t RoundUp(size_t value, size_t granularity) {
+    return (value + granularity - 1) / granularity * granularity;
+}
+
+double ToMiB(size_t bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+}  // namespace
+
+FrameBuffer::FrameBuffer(Block* block) : m_block(block) {
+    m_block->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+FrameBuffer::FrameBuffer(const FrameBuffer& other) : m_block(other.m_block) {
+    if (m_block) {
+        m_block->references.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FrameBuffer::FrameBuffer(FrameBuffer&& other) noexcept : m_block(other.m_block) {
+    other.m_block = nullptr;
+}
+
+FrameBuffer& FrameBuffer::operator=(const FrameBuffer& other) {
+    if (this != &other) {
+        FrameBuffer copy(other);
+        std::swap(m_block, copy.m_block);
+    }
+    return *this;
+}
+
+FrameBuffer& FrameBuffer::operator=(FrameBuffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        m_block = other.m_block;
+        other.m_block = nullptr;
+    }
+    return *this;
+}
+
+FrameBuffer::~FrameBuffer() {
+    reset();
+}
+
+void FrameBuffer::reset() {
+    if (!m_block) {
+        return;
+    }
+
+    // Writes through other handles must be visible before the memory is handed out again
+    if (m_block->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_block->pool->Release(m_block);
+    }
+    m_block = nullptr;
+}
+
+FrameBufferPool::~FrameBufferPool() {
+    for (auto* block : m_free) {
+        Free(block);
+    }
+    m_free.clear();
+}
+
+FrameBufferPool& FrameBufferPool::Shared() {
+    static FrameBufferPool pool;
+    return pool;
+}
+
+void FrameBufferPool::SetHugePageMode(HugePageMode mode) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_hugePageMode = mode;
+}
+
+FrameBuffer FrameBufferPool::Acquire(size_t size) {
+    size_t capacity = RoundUp(std::max<size_t>(size, 1), size < HUGE_PAGE_SIZE ? PAGE_SIZE_BYTES : HUGE_PAGE_SIZE);
+
+    FrameBuffer::Block* block = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_acquires++;
+
+        // Smallest free block that fits, unless it would waste more than it holds
+        auto best = m_free.end();
+        for (auto it = m_free.begin(); it != m_free.end(); ++it) {
+            size_t available = (*it)->capacity;
+            if (available >= capacity && available <= 2 * capacity &&
+                (best == m_free.end() || available < (*best)->capacity)) {
+                best = it;
+            }
+        }
+        if (best != m_free.end()) {
+            block = *best;
+            *best = m_free.back();
+            m_free.pop_back();
+        }
+    }
+
+    if (!block) {
+        block = Allocate(capacity);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    block->size = size;
+    m_liveBytes += block->capacity;
+    m_liveBuffers++;
+    if (m_liveBytes > m_peakBytes) {
+        m_peakBytes = m_liveBytes;
+        m_peakBuffers = m_liveBuffers;
+    }
+    return FrameBuffer(block);
+}
+
+FrameBuffer FrameBufferPool::Resize(FrameBuffer buffer, size_t size, size_t keepBytes) {
+    if (buffer.m_block && buffer.use_count() == 1 && size <= buffer.capacity()) {
+        buffer.m_block->size = size;
+        return buffer;
+    }
+
+    FrameBuffer resized = Acquire(size);
+    size_t keep = std::min({keepBytes, size, buffer.size()});
+    if (keep > 0) {
+        std::memcpy(resized.data(), buffer.data(), keep);
+    }
+    return resized;
+}
+
+FrameBuffer::Block* FrameBufferPool::Allocate(size_t capacity) {
+    HugePageMode mode;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        mode = m_hugePageMode;
+        if (mode == HugePageMode::Reserved && m_hugeTlbFailed) {
+            mode = HugePageMode::Advise;
+        }
+    }
+
+    auto* block = new FrameBuffer::Block;
+    block->capacity = capacity;
+    block->pool = this;
+
+    if (capacity >= HUGE_PAGE_SIZE && mode == HugePageMode::Reserved) {
+        void* address = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (address != MAP_FAILED) {
+            block->mapping = address;
+            block->mappedBytes = capacity;
+            block->data = static_cast<uint8_t*>(address);
+            block->hugeTlb = true;
+        } else {
+            // Nothing reserved (or not enough): later buffers go straight to THP
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_hugeTlbFailed) {
+                std::cerr << "SnackaCaptureLinux: No reserved huge pages for frame buffers (" << strerror(errno)
+                          << "), using transparent huge pages\n";
+                m_hugeTlbFailed = true;
+            }
+            mode = HugePageMode::Advise;
+        }
+    }
+
+    bool advised = false;
+    if (!block->data && capacity >= HUGE_PAGE_SIZE && mode == HugePageMode::Advise) {
+        // Over-map by a huge page and trim so the buffer starts on a huge page boundary;
+        // THP can only back aligned 2 MiB ranges
+        size_t mappedBytes = capacity + HUGE_PAGE_SIZE;
+        void* address = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (address != MAP_FAILED) {
+            auto start = reinterpret_cast<uintptr_t>(address);
+            uintptr_t aligned = RoundUp(start, HUGE_PAGE_SIZE);
+            if (aligned > start) {
+                munmap(address, aligned - start);
+            }
+            size_t tail = start + mappedBytes - (aligned + capacity);
+            if (tail > 0) {
+                munmap(reinterpret_cast<void*>(aligned + capacity), tail);
+            }
+            block->mapping = reinterpret_cast<void*>(aligned);
+            block->mappedBytes = capacity;
+            block->data = reinterpret_cast<uint8_t*>(aligned);
+            advised = madvise(block->mapping, capacity, MADV_HUGEPAGE) == 0;
+        }
+    }
+
+    if (!block->data) {
+        block->data = static_cast<uint8_t*>(std::aligned_alloc(ALIGNMENT, capacity));
+        if (!block->data) {
+            delete block;
+            throw std::bad_alloc();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_allocations++;
+    m_allocatedBytes += capacity;
+    m_hugeTlbBuffers += block->hugeTlb ? 1 : 0;
+    m_thpBuffers += advised ? 1 : 0;
+    return block;
+}
+
+void FrameBufferPool::Free(FrameBuffer::Block* block) {
+    if (block->mapping) {
+        munmap(block->mapping, block->mappedBytes);
+    } else {
+        std::free(block->data);
+    }
+    delete block;
+}
+
+void FrameBufferPool::Release(FrameBuffer::Block* block) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_liveBytes -= block->capacity;
+    m_liveBuffers--;
+    m_free.push_back(block);
+}
+
+size_t FrameBufferPool::GetPeakBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peakBytes;
+}
+
+std::string FrameBufferPool::DescribeStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1)
+        << "peak " << ToMiB(m_peakBytes) << " MiB in " << m_peakBuffers << " buffers, "
+        << ToMiB(m_allocatedBytes) << " MiB allocated (thp: " << m_thpBuffers << ", hugetlb: " << m_hugeTlbBuffers
+        << "), " << m_acquires << " acquires, " << m_allocations << " allocations";
+    return out.str();
+}
+
+const char* FrameBufferPool::GetHugePageModeName(HugePageMode mode) {
+    switch (mode) {
+        case HugePageMode::Off: return "off";
+        case HugePageMode::Advise: return "thp";
+        case HugePageMode::Reserved: return "hugetlb";
+    }
+    return "unknown";
+}
+
+}  // namespace snacka
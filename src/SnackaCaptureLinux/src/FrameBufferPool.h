@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace snacka {
+
+/// How large pool buffers are backed
+enum class HugePageMode : uint8_t {
+    Off = 0,      // Regular pages
+    Advise = 1,   // Transparent huge pages (madvise), used when the kernel has them to spare
+    Reserved = 2  // MAP_HUGETLB from the reserved pool (vm.nr_hugepages), falling back to Advise
+};
+
+class FrameBufferPool;
+
+/// Handle to a pooled buffer, reference counted like a shared_ptr without the
+/// allocation: copies share the memory, and the last one to go returns it to the
+/// pool. Memory is 64-byte aligned and not initialized. Empty by default.
+class FrameBuffer {
+public:
+    FrameBuffer() = default;
+    FrameBuffer(const FrameBuffer& other);
+    FrameBuffer(FrameBuffer&& other) noexcept;
+    FrameBuffer& operator=(const FrameBuffer& other);
+    FrameBuffer& operator=(FrameBuffer&& other) noexcept;
+    ~FrameBuffer();
+
+    uint8_t* data() const { return m_block ? m_block->data : nullptr; }
+    size_t size() const { return m_block ? m_block->size : 0; }
+    bool empty() const { return size() == 0; }
+    uint8_t* begin() const { return data(); }
+    uint8_t* end() const { return data() + size(); }
+
+    /// Bytes usable without a new buffer (the requested size rounded up to the pool's granularity)
+    size_t capacity() const { return m_block ? m_block->capacity : 0; }
+
+    /// Number of handles sharing the memory
+    int use_count() const { return m_block ? m_block->references.load() : 0; }
+
+    /// Drop this handle's reference
+    void reset();
+
+private:
+    friend class FrameBufferPool;
+
+    struct Block {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        size_t capacity = 0;
+        size_t mappedBytes = 0;  // 0 for heap blocks
+        void* mapping = nullptr;
+        bool hugeTlb = false;
+        std::atomic<int> references{0};
+        FrameBufferPool* pool = nullptr;
+    };
+
+    explicit FrameBuffer(Block* block);
+
+    Block* m_block = nullptr;
+};
+
+/// Reusable frame buffers shared by capturers, converters and encoders.
+/// Released buffers are kept and handed out again for the next request they fit,
+/// so a running pipeline stops allocating after its first frames. Buffers of 2 MiB
+/// and up are mmapped on a huge page boundary and backed by huge pages per the
+/// HugePageMode: a 4K NV12 frame then spans 6 TLB entries instead of over 3000.
+/// Thread-safe; the pool must outlive its buffers.
+class FrameBufferPool {
+public:
+    FrameBufferPool() = default;
+    ~FrameBufferPool();
+
+    FrameBufferPool(const FrameBufferPool&) = delete;
+    FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+
+    /// Get the process-wide pool
+    static FrameBufferPool& Shared();
+
+    /// Set how new large buffers are backed (buffers already allocated keep theirs)
+    void SetHugePageMode(HugePageMode mode);
+
+    /// Get a buffer of exactly size bytes (contents undefined)
+    FrameBuffer Acquire(size_t size);
+
+    /// Get a buffer of size bytes keeping the first keepBytes of an existing one.
+    /// The existing buffer is reused in place when it is the only handle and large enough.
+    FrameBuffer Resize(FrameBuffer buffer, size_t size, size_t keepBytes);
+
+    /// Most bytes held by live buffers at any one time
+    size_t GetPeakBytes() const;
+
+    /// Summarize usage, e.g. "peak 24.9 MiB in 9 buffers, 26.0 MiB allocated (thp: 6, hugetlb: 0),
+    /// 5400 acquires, 12 allocations"
+    std::string DescribeStats() const;
+
+    /// Name of a huge page mode as accepted on the command line
+    static const char* GetHugePageModeName(HugePageMode mode);
+
+private:
+    friend class FrameBuffer;
+
+    FrameBuffer::Block* Allocate(size_t capacity);
+    void Free(FrameBuffer::Block* block);
+    void Release(FrameBuffer::Block* block);
+
+    mutable std::mutex m_mutex;
+    HugePageMode m_hugePageMode = HugePageMode::Advise;
+    bool m_hugeTlbFailed = false;
+
+    // Released blocks waiting for reuse
+    std::vector<FrameBuffer::Block*> m_free;
+
+    // Statistics
+    size_t m_liveBytes = 0;
+    size_t m_liveBuffers = 0;
+    size_t m_peakBytes = 0;
+    size_t m_peakBuffers = 0;
+    size_t m_allocatedBytes = 0;
+    size_t m_thpBuffers = 0;
+    size_t m_hugeTlbBuffers = 0;
+    uint64_t m_acquires = 0;
+    uint64_t m_allocations = 0;
+};
+
+}  // namespace snacka
@@ -0,0 +1,114 @@
+#include "FrameChangeDetector.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace snacka {
+
+namespace {
+
+constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+
+inline uint64_t Rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+    return Rotl(acc + input * PRIME2, 31) * PRIME1;
+}
+
+inline uint64_t Load64(const uint8_t* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Four independent lanes over 32-byte blocks so the multiplies pipeline;
+// not a cryptographic hash, only needs to make accidental collisions negligible
+void HashBytes(const uint8_t* data, size_t length, uint64_t lanes[4]) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        lanes[0] = Round(lanes[0], Load64(data + i));
+        lanes[1] = Round(lanes[1], Load64(data + i + 8));
+        lanes[2] = Round(lanes[2], Load64(data + i + 16));
+        lanes[3] = Round(lanes[3], Load64(data + i + 24));
+    }
+    for (; i + 8 <= length; i += 8) {
+        lanes[0] = Round(lanes[0], Load64(data + i));
+    }
+    if (i < length) {
+        uint64_t tail = 0;
+        memcpy(&tail, data + i, length - i);
+        lanes[1] = Round(lanes[1], tail ^ (length - i));
+    }
+}
+
+}  // namespace
+
+void FrameChangeDetector::Configure(int width, int height, int tileSize) {
+    m_width = width;
+    m_height = height;
+    m_candidates.Configure(width, height, tileSize);
+    m_changed.Configure(width, height, tileSize);
+    m_hashes.assign(static_cast<size_t>(m_changed.GetColumns()) * m_changed.GetRows(), 0);
+    m_primed = false;
+}
+
+uint64_t FrameChangeDetector::HashTile(const uint8_t* nv12, int column, int row) const {
+    FrameRect rect = m_changed.GetTileRect(column, row);
+    uint64_t lanes[4] = {PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1};
+
+    const uint8_t* yPlane = nv12;
+    for (int y = rect.y; y < rect.y + rect.height; y++) {
+        HashBytes(yPlane + static_cast<size_t>(y) * m_width + rect.x, rect.width, lanes);
+    }
+
+    // Interleaved UV rows have the same byte width as Y rows, at half the height. An odd
+    // height has no UV row for its last luma row: the buffer holds height / 2 of them.
+    const uint8_t* uvPlane = nv12 + static_cast<size_t>(m_width) * m_height;
+    int uvRowEnd = std::min((rect.y + rect.height + 1) / 2, m_height / 2);
+    for (int y = rect.y / 2; y < uvRowEnd; y++) {
+        HashBytes(uvPlane + static_cast<size_t>(y) * m_width + rect.x, rect.width, lanes);
+    }
+
+    uint64_t hash = Rotl(lanes[0], 1) + Rotl(lanes[1], 7) + Rotl(lanes[2], 12) + Rotl(lanes[3], 18);
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+int FrameChangeDetector::Update(const uint8_t* nv12, const FrameInfo& info) {
+    m_candidates.Clear();
+    if (info.fullFrame || !m_primed) {
+        m_candidates.MarkAll();
+    } else {
+        for (const auto& rect : info.dirtyRects) {
+            m_candidates.MarkRect(rect);
+        }
+    }
+
+    m_changed.Clear();
+    int changed = 0;
+    for (int row = 0; row < m_candidates.GetRows(); row++) {
+        for (int column = 0; column < m_candidates.GetColumns(); column++) {
+            if (!m_candidates.IsDirty(column, row)) {
+                continue;
+            }
+
+            uint64_t hash = HashTile(nv12, column, row);
+            uint64_t& previous = m_hashes[static_cast<size_t>(row) * m_candidates.GetColumns() + column];
+            if (hash != previous || !m_primed) {
+                previous = hash;
+                m_changed.MarkTile(column, row);
+                changed++;
+            }
+        }
+    }
+
+    m_primed = true;
+    return changed;
+}
+
+}  // namespace snacka
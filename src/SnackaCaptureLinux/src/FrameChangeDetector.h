@@ -0,0 +1,45 @@
+#pragma once
+
+#include "FrameInfo.h"
+#include "TileMap.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace snacka {
+
+/// Detects unchanged NV12 frames by hashing 64x64 tiles (Y plus the matching UV rows).
+/// Only tiles inside the frame's dirty rectangles are rehashed, so with damage
+/// tracking an idle screen costs nothing; without it every tile is hashed.
+class FrameChangeDetector {
+public:
+    /// Set the frame size; the next Update reports every tile as changed
+    /// @param width Frame width in pixels
+    /// @param height Frame height in pixels
+    /// @param tileSize Tile edge in pixels (even)
+    void Configure(int width, int height, int tileSize = 64);
+
+    /// Hash the tiles that may have changed and compare them with the previous frame
+    /// @param nv12 Frame of CalculateNV12FrameSize(width, height) bytes
+    /// @param info Dirty regions reported by the capturer
+    /// @return Number of tiles whose content differs from the previous frame
+    int Update(const uint8_t* nv12, const FrameInfo& info);
+
+    /// Get the tiles that changed in the last Update
+    const TileMap& GetChangedTiles() const { return m_changed; }
+
+    /// Get the total number of tiles
+    int GetTileCount() const { return m_changed.GetColumns() * m_changed.GetRows(); }
+
+private:
+    uint64_t HashTile(const uint8_t* nv12, int column, int row) const;
+
+    int m_width = 0;
+    int m_height = 0;
+    bool m_primed = false;
+    TileMap m_candidates;
+    TileMap m_changed;
+    std::vector<uint64_t> m_hashes;
+};
+
+}  // namespace snacka
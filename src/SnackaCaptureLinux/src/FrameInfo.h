@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace snacka {
+
+/// Rectangle in pixel coordinates
+struct FrameRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+/// Size of an output image in pixels
+struct FrameSize {
+    int width = 0;
+    int height = 0;
+};
+
+/// Cursor image, premultiplied ARGB (0xAARRGGBB) rows without padding
+struct CursorImage {
+    uint32_t serial = 0;  // Changes whenever the image does
+    int width = 0;
+    int height = 0;
+    int xhot = 0;
+    int yhot = 0;
+    std::vector<uint32_t> argb;
+};
+
+/// Pointer state for a frame, in output pixels
+struct FrameCursor {
+    bool visible = false;
+    int x = 0;  // Hotspot position
+    int y = 0;
+    std::shared_ptr<const CursorImage> shape;  // Scaled to the output
+};
+
+/// Per-frame metadata delivered alongside the NV12 pixels
+struct FrameInfo {
+    /// Output regions that changed since the previous frame (empty = nothing changed)
+    std::vector<FrameRect> dirtyRects;
+
+    /// True when the whole frame must be treated as changed (first frame, no damage tracking)
+    bool fullFrame = true;
+
+    /// Pointer position and image (display capture only)
+    FrameCursor cursor;
+};
+
+}  // namespace snacka
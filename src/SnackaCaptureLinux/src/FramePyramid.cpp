@@ -0,0 +1,335 @@
+#include "FramePyramid.h"
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace snacka {
+
+namespace {
+
+// One tap of the vertical pass: row = (first ? 0 : row) + weight * p
+// (sums stay below 65536 because the weights total 256)
+void AccumulateRow(uint16_t* __restrict row, const uint8_t* __restrict p, uint16_t weight, size_t count, bool first) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    // -O2 leaves the scalar loop alone, so the common path is spelled out
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_set1_epi16(static_cast<int16_t>(weight));
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(bytes, zero), w);
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(bytes, zero), w);
+        if (!first) {
+            lo = _mm_add_epi16(lo, _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)));
+            hi = _mm_add_epi16(hi, _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i + 8)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i + 8), hi);
+    }
+#endif
+    for (; i < count; i++) {
+        row[i] = static_cast<uint16_t>((first ? 0 : row[i]) + weight * p[i]);
+    }
+}
+
+// 2:1 columns of a vertically filtered row: each output averages two x256 inputs per channel
+template <int Channels>
+void HalfColumns(const uint16_t* __restrict a, uint8_t* __restrict out, int x0, int x1) {
+    int x = x0;
+#if defined(__SSE2__)
+    // SSE2 is part of the x86-64 baseline, so this needs no runtime dispatch.
+    // Pair sums overflow 16 bits, so they are formed in 32-bit lanes: the low and
+    // high halves of each lane are the two inputs (after moving UV pairs together)
+    const __m128i low = _mm_set1_epi32(0xFFFF);
+    const __m128i round = _mm_set1_epi32(256);
+    for (; x + 8 / Channels <= x1; x += 8 / Channels) {
+        __m128i sums[2];
+        for (int half = 0; half < 2; half++) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + (x - x0) * 2 * Channels + half * 8));
+            if constexpr (Channels == 2) {
+                // U0 V0 U1 V1 -> U0 U1 V0 V1
+                v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+                v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+            }
+            __m128i sum = _mm_add_epi32(_mm_and_si128(v, low), _mm_srli_epi32(v, 16));
+            sums[half] = _mm_srli_epi32(_mm_add_epi32(sum, round), 9);
+        }
+        __m128i words = _mm_packs_epi32(sums[0], sums[1]);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * Channels), _mm_packus_epi16(words, words));
+    }
+#endif
+    for (; x < x1; x++) {
+        const uint16_t* p = a + (x - x0) * 2 * Channels;
+        for (int c = 0; c < Channels; c++) {
+            out[x * Channels + c] = static_cast<uint8_t>((p[c] + p[Channels + c] + 256u) >> 9);
+        }
+    }
+}
+
+// 3:2 columns: outputs 2g and 2g + 1 weigh inputs 3g..3g + 2 as (171, 85, 0) and (0, 85, 171)
+template <int Channels>
+void ThreeTwoColumns(const uint16_t* __restrict row, const std::vector<int>& offsets, int sourceX,
+                     uint8_t* __restrict out, int x0, int x1) {
+    auto single = [&](int x) {
+        const uint16_t* a = row + static_cast<size_t>(offsets[x] - sourceX) * Channels;
+        uint32_t first = (x & 1) == 0 ? 171u : 85u;
+        for (int c = 0; c < Channels; c++) {
+            out[x * Channels + c] =
+                static_cast<uint8_t>((first * a[c] + (256u - first) * a[Channels + c] + 32768) >> 16);
+        }
+    };
+
+    int x = x0;
+    if (x & 1) {
+        single(x++);
+    }
+    const uint16_t* a = row + static_cast<size_t>(x / 2 * 3 - sourceX) * Channels;
+    uint8_t* o = out + x * Channels;
+    for (; x + 1 < x1; x += 2, a += 3 * Channels, o += 2 * Channels) {
+        for (int c = 0; c < Channels; c++) {
+            uint32_t middle = 85u * a[Channels + c] + 32768;
+            o[c] = static_cast<uint8_t>((171u * a[c] + middle) >> 16);
+            o[Channels + c] = static_cast<uint8_t>((middle + 171u * a[2 * Channels + c]) >> 16);
+        }
+    }
+    if (x < x1) {
+        single(x);
+    }
+}
+
+}  // namespace
+
+bool FramePyramid::Configure(int baseWidth, int baseHeight, const std::vector<FrameSize>& layers) {
+    m_baseWidth = baseWidth;
+    m_baseHeight = baseHeight;
+    m_primed = false;
+    m_levels.clear();
+
+    int srcWidth = baseWidth;
+    int srcHeight = baseHeight;
+    for (const auto& size : layers) {
+        if (size.width < 2 || size.height < 2 || size.width % 2 != 0 || size.height % 2 != 0 ||
+            size.width > srcWidth || size.height > srcHeight) {
+            m_levels.clear();
+            return false;
+        }
+
+        Level level;
+        level.width = size.width;
+        level.height = size.height;
+        BuildAxis(level.lumaX, srcWidth, size.width);
+        BuildAxis(level.lumaY, srcHeight, size.height);
+        BuildAxis(level.chromaX, srcWidth / 2, size.width / 2);
+        BuildAxis(level.chromaY, srcHeight / 2, size.height / 2);
+        level.nv12 = FrameBufferPool::Shared().Acquire(static_cast<size_t>(size.width) * size.height * 3 / 2);
+        std::fill(level.nv12.begin(), level.nv12.end(), 0);
+        level.dirtyTiles.Configure(size.width, size.height);
+        m_levels.push_back(std::move(level));
+
+        srcWidth = size.width;
+        srcHeight = size.height;
+    }
+
+    // A UV row has as many bytes as a Y row, so one base row covers both planes
+    m_row.resize(static_cast<size_t>(baseWidth));
+    return true;
+}
+
+void FramePyramid::BuildAxis(Axis& axis, int srcSize, int dstSize) {
+    // Output i covers source [i * srcSize, (i + 1) * srcSize) in units of 1/dstSize pixel
+    auto firstOf = [&](int i) { return static_cast<int>(static_cast<int64_t>(i) * srcSize / dstSize); };
+    auto lastOf = [&](int i) { return static_cast<int>((static_cast<int64_t>(i + 1) * srcSize - 1) / dstSize); };
+
+    axis.taps = 1;
+    for (int i = 0; i < dstSize; i++) {
+        axis.taps = std::max(axis.taps, lastOf(i) - firstOf(i) + 1);
+    }
+    axis.offsets.assign(dstSize, 0);
+    axis.weights.assign(static_cast<size_t>(dstSize) * axis.taps, 0);
+
+    for (int i = 0; i < dstSize; i++) {
+        int64_t begin = static_cast<int64_t>(i) * srcSize;
+        int64_t end = begin + srcSize;
+        int first = firstOf(i);
+        int last = lastOf(i);
+        int offset = std::min(first, srcSize - axis.taps);
+        axis.offsets[i] = offset;
+
+        // Overlap-weighted; rounding error goes to the largest tap so weights total 256
+        uint16_t* weights = axis.weights.data() + static_cast<size_t>(i) * axis.taps;
+        int total = 0;
+        int largest = first;
+        for (int j = first; j <= last; j++) {
+            int64_t overlap = std::min<int64_t>(end, static_cast<int64_t>(j + 1) * dstSize) -
+                              std::max<int64_t>(begin, static_cast<int64_t>(j) * dstSize);
+            auto weight = static_cast<uint16_t>((overlap * 256 + srcSize / 2) / srcSize);
+            weights[j - offset] = weight;
+            total += weight;
+            if (weight > weights[largest - offset]) {
+                largest = j;
+            }
+        }
+        weights[largest - offset] = static_cast<uint16_t>(weights[largest - offset] + 256 - total);
+    }
+
+    // The common ratios get unrolled loops; they must produce what the table would
+    auto matches = [&](auto offsetOf, auto firstWeightOf) {
+        for (int i = 0; i < dstSize; i++) {
+            const uint16_t* weights = axis.weights.data() + static_cast<size_t>(i) * axis.taps;
+            if (axis.offsets[i] != offsetOf(i) || weights[0] != firstWeightOf(i) || weights[1] != 256 - weights[0]) {
+                return false;
+            }
+        }
+        return true;
+    };
+    axis.kind = Axis::Kind::Generic;
+    if (axis.taps == 2 && srcSize == dstSize * 2 &&
+        matches([](int i) { return i * 2; }, [](int) { return 128; })) {
+        axis.kind = Axis::Kind::Half;
+    } else if (axis.taps == 2 && srcSize * 2 == dstSize * 3 &&
+               matches([](int i) { return i / 2 * 3 + (i & 1); }, [](int i) { return (i & 1) == 0 ? 171 : 85; })) {
+        axis.kind = Axis::Kind::ThreeTwo;
+    }
+}
+
+void FramePyramid::MapRange(const Axis& axis, int begin, int end, int& outBegin, int& outEnd) {
+    // Outputs whose taps intersect [begin, end); offsets are monotonic
+    auto first = std::lower_bound(axis.offsets.begin(), axis.offsets.end(), begin - axis.taps + 1);
+    auto last = std::lower_bound(axis.offsets.begin(), axis.offsets.end(), end);
+    outBegin = static_cast<int>(first - axis.offsets.begin());
+    outEnd = static_cast<int>(last - axis.offsets.begin());
+}
+
+FrameRect FramePyramid::MapRect(const Level& level, const FrameRect& source) const {
+    int x0, x1, y0, y1;
+    MapRange(level.lumaX, source.x, source.x + source.width, x0, x1);
+    MapRange(level.lumaY, source.y, source.y + source.height, y0, y1);
+
+    // Chroma reads whole 2x2 blocks of the source, so its footprint can reach a little further
+    int cx0, cx1, cy0, cy1;
+    MapRange(level.chromaX, source.x / 2, (source.x + source.width + 1) / 2, cx0, cx1);
+    MapRange(level.chromaY, source.y / 2, (source.y + source.height + 1) / 2, cy0, cy1);
+    if (cx0 < cx1) {
+        x0 = x0 < x1 ? std::min(x0, cx0 * 2) : cx0 * 2;
+        x1 = std::max(x1, cx1 * 2);
+    }
+    if (cy0 < cy1) {
+        y0 = y0 < y1 ? std::min(y0, cy0 * 2) : cy0 * 2;
+        y1 = std::max(y1, cy1 * 2);
+    }
+    if (x0 >= x1 || y0 >= y1) {
+        return {};
+    }
+
+    x0 &= ~1;
+    y0 &= ~1;
+    x1 = std::min((x1 + 1) & ~1, level.width);
+    y1 = std::min((y1 + 1) & ~1, level.height);
+    return {x0, y0, x1 - x0, y1 - y0};
+}
+
+template <int Channels>
+void FramePyramid::ScalePlane(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride, const Axis& xAxis,
+                              const Axis& yAxis, int x0, int x1, int y0, int y1, uint16_t* __restrict row) {
+    if (x0 >= x1) {
+        return;
+    }
+
+    // Source columns behind [x0, x1)
+    int sourceX = xAxis.offsets[x0];
+    size_t begin = static_cast<size_t>(sourceX) * Channels;
+    size_t count = static_cast<size_t>(xAxis.offsets[x1 - 1] + xAxis.taps - sourceX) * Channels;
+
+    for (int y = y0; y < y1; y++) {
+        // Vertical pass first over contiguous rows, so only output rows reach the horizontal gather
+        const uint8_t* rows = src + static_cast<size_t>(yAxis.offsets[y]) * srcStride + begin;
+        const uint16_t* w = yAxis.weights.data() + static_cast<size_t>(y) * yAxis.taps;
+        AccumulateRow(row, rows, w[0], count, true);
+        for (int t = 1; t < yAxis.taps; t++) {
+            if (w[t] != 0) {
+                AccumulateRow(row, rows + static_cast<size_t>(t) * srcStride, w[t], count, false);
+            }
+        }
+
+        // Horizontal pass: weights total 256 on each axis, so results are x65536
+        uint8_t* __restrict out = dst + static_cast<size_t>(y) * dstStride;
+        switch (xAxis.kind) {
+            case Axis::Kind::Half:
+                HalfColumns<Channels>(row + static_cast<size_t>(x0 * 2 - sourceX) * Channels, out, x0, x1);
+                break;
+
+            case Axis::Kind::ThreeTwo:
+                ThreeTwoColumns<Channels>(row, xAxis.offsets, sourceX, out, x0, x1);
+                break;
+
+            case Axis::Kind::Generic:
+                for (int x = x0; x < x1; x++) {
+                    const uint16_t* a = row + static_cast<size_t>(xAxis.offsets[x] - sourceX) * Channels;
+                    const uint16_t* weights = xAxis.weights.data() + static_cast<size_t>(x) * xAxis.taps;
+                    for (int c = 0; c < Channels; c++) {
+                        uint32_t sum = 32768;
+                        for (int t = 0; t < xAxis.taps; t++) {
+                            sum += static_cast<uint32_t>(weights[t]) * a[t * Channels + c];
+                        }
+                        out[x * Channels + c] = static_cast<uint8_t>(sum >> 16);
+                    }
+                }
+                break;
+        }
+    }
+}
+
+void FramePyramid::ScaleRect(const uint8_t* src, int srcWidth, int srcHeight, Level& level, const FrameRect& rect) {
+    int x1 = rect.x + rect.width;
+    int y1 = rect.y + rect.height;
+    ScalePlane<1>(src, srcWidth, level.nv12.data(), level.width, level.lumaX, level.lumaY,
+                  rect.x, x1, rect.y, y1, m_row.data());
+
+    // Interleaved UV at half resolution; a UV row is as many bytes as a Y row
+    const uint8_t* srcUV = src + static_cast<size_t>(srcWidth) * srcHeight;
+    uint8_t* dstUV = level.nv12.data() + static_cast<size_t>(level.width) * level.height;
+    ScalePlane<2>(srcUV, srcWidth, dstUV, level.width, level.chromaX, level.chromaY,
+                  rect.x / 2, x1 / 2, rect.y / 2, y1 / 2, m_row.data());
+}
+
+void FramePyramid::Update(const uint8_t* baseNv12, const FrameInfo& info) {
+    bool full = info.fullFrame || !m_primed;
+    const uint8_t* src = baseNv12;
+    int srcWidth = m_baseWidth;
+    int srcHeight = m_baseHeight;
+    const std::vector<FrameRect>* srcRects = &info.dirtyRects;
+
+    for (auto& level : m_levels) {
+        auto start = std::chrono::steady_clock::now();
+
+        level.info.fullFrame = full;
+        level.info.dirtyRects.clear();
+        if (full) {
+            level.info.dirtyRects.push_back({0, 0, level.width, level.height});
+        } else if (!srcRects->empty()) {
+            level.dirtyTiles.Clear();
+            for (const auto& rect : *srcRects) {
+                level.dirtyTiles.MarkRect(MapRect(level, rect));
+            }
+            level.dirtyTiles.CollectRects(level.info.dirtyRects);
+        }
+
+        for (const auto& rect : level.info.dirtyRects) {
+            ScaleRect(src, srcWidth, srcHeight, level, rect);
+        }
+
+        level.updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        src = level.nv12.data();
+        srcWidth = level.width;
+        srcHeight = level.height;
+        srcRects = &level.info.dirtyRects;
+    }
+
+    m_primed = true;
+}
+
+}  // namespace snacka
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "FrameBufferPool.h"
+#include "FrameInfo.h"
+#include "TileMap.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace snacka {
+
+/// Simulcast downscale pyramid over NV12 frames.
+/// Each layer is area-filtered from the layer above it rather than from the full
+/// output, so a 1080p -> 720p -> 360p chain reads every level once and each extra
+/// layer costs a fraction of the one before. Layers persist between frames: only
+/// the parts under the frame's dirty rectangles are rescaled, and the rectangles
+/// are mapped down with them so every layer reports its own FrameInfo.
+class FramePyramid {
+public:
+    /// Set the base (full output) size and the layer sizes; every layer starts stale
+    /// @param layers Layer sizes, largest first, each even and no larger than the one above
+    /// @return false if a size is invalid
+    bool Configure(int baseWidth, int baseHeight, const std::vector<FrameSize>& layers);
+
+    /// Rescale what changed in the base frame into every layer
+    /// @param baseNv12 Base frame of CalculateNV12FrameSize(baseWidth, baseHeight) bytes
+    /// @param info Dirty regions of the base frame
+    void Update(const uint8_t* baseNv12, const FrameInfo& info);
+
+    /// Get the number of layers (not counting the base)
+    int GetLayerCount() const { return static_cast<int>(m_levels.size()); }
+
+    /// Get a layer's size
+    FrameSize GetLayerSize(int layer) const { return {m_levels[layer].width, m_levels[layer].height}; }
+
+    /// Get a layer's NV12 pixels as of the last Update
+    const FrameBuffer& GetLayerData(int layer) const { return m_levels[layer].nv12; }
+
+    /// Get the regions of a layer changed by the last Update
+    const FrameInfo& GetLayerInfo(int layer) const { return m_levels[layer].info; }
+
+    /// Get the time the last Update spent on a layer
+    double GetLayerMs(int layer) const { return m_levels[layer].updateMs; }
+
+private:
+    /// Area filter taps for one axis: output i reads source [offsets[i], offsets[i] + taps)
+    /// with weights summing to 256
+    struct Axis {
+        /// Generic reads the tables; Half (2:1) and ThreeTwo (3:2) have fixed weights
+        enum class Kind { Generic, Half, ThreeTwo };
+
+        Kind kind = Kind::Generic;
+        int taps = 1;
+        std::vector<int> offsets;
+        std::vector<uint16_t> weights;
+    };
+
+    struct Level {
+        int width = 0;
+        int height = 0;
+        Axis lumaX, lumaY;
+        Axis chromaX, chromaY;
+        FrameBuffer nv12;
+        FrameInfo info;
+        TileMap dirtyTiles;
+        double updateMs = 0.0;
+    };
+
+    static void BuildAxis(Axis& axis, int srcSize, int dstSize);
+    template <int Channels>
+    static void ScalePlane(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride, const Axis& xAxis,
+                           const Axis& yAxis, int x0, int x1, int y0, int y1, uint16_t* row);
+    static void MapRange(const Axis& axis, int begin, int end, int& outBegin, int& outEnd);
+    FrameRect MapRect(const Level& level, const FrameRect& source) const;
+    void ScaleRect(const uint8_t* src, int srcWidth, int srcHeight, Level& level, const FrameRect& rect);
+
+    int m_baseWidth = 0;
+    int m_baseHeight = 0;
+    bool m_primed = false;
+    std::vector<Level> m_levels;
+
+    // Vertically filtered source row (16-bit, x256) fed to the horizontal pass
+    std::vector<uint16_t> m_row;
+};
+
+}  // namespace snacka
@@ -0,0 +1,103 @@
+#include "FrameRateController.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace snacka {
+
+namespace {
+
+// Stillness needed before each step down; the full 30 -> 2 fps descent takes four seconds
+constexpr auto IDLE_STEP = std::chrono::seconds(1);
+
+}  // namespace
+
+void FrameRateController::Configure(int targetFps, int floorFps) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_levels.clear();
+    m_levels.push_back({targetFps});
+    if (floorFps > 0 && floorFps < targetFps) {
+        for (int fps = targetFps / 2; fps > floorFps; fps /= 2) {
+            m_levels.push_back({fps});
+        }
+        m_levels.push_back({floorFps});
+    }
+
+    auto now = Clock::now();
+    m_level = 0;
+    m_levelSince = now;
+    m_lastChange = now;
+}
+
+void FrameRateController::SetLevel(size_t level, Clock::time_point now) {
+    if (level == m_level) {
+        return;
+    }
+    m_levels[m_level].time += now - m_levelSince;
+    m_level = level;
+    m_levelSince = now;
+}
+
+void FrameRateController::OnFrame(bool changed, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_levels.size() <= 1) {
+        return;
+    }
+
+    if (changed) {
+        m_lastChange = now;
+        SetLevel(0, now);
+        return;
+    }
+
+    size_t steps = static_cast<size_t>((now - m_lastChange) / IDLE_STEP);
+    SetLevel(std::min(steps, m_levels.size() - 1), now);
+}
+
+void FrameRateController::OnActivity(Clock::time_point now) {
+    OnFrame(true, now);
+}
+
+std::chrono::microseconds FrameRateController::GetInterval() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::chrono::microseconds(1000000 / m_levels[m_level].fps);
+}
+
+std::chrono::microseconds FrameRateController::GetTargetInterval() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::chrono::microseconds(1000000 / m_levels[0].fps);
+}
+
+int FrameRateController::GetCurrentFps() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_levels[m_level].fps;
+}
+
+std::string FrameRateController::DescribeTimeAtRates() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Include the time at the current rate that hasn't been booked yet
+    std::vector<double> seconds;
+    double total = 0.0;
+    for (size_t i = 0; i < m_levels.size(); i++) {
+        auto time = m_levels[i].time;
+        if (i == m_level) {
+            time += Clock::now() - m_levelSince;
+        }
+        seconds.push_back(std::chrono::duration<double>(time).count());
+        total += seconds.back();
+    }
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < m_levels.size(); i++) {
+        if (i > 0) {
+            out << ", ";
+        }
+        out << m_levels[i].fps << " fps " << (total > 0.0 ? seconds[i] / total * 100.0 : 0.0) << "%";
+    }
+    return out.str();
+}
+
+}  // namespace snacka
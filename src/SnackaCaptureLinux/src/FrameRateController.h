@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace snacka {
+
+/// Content-adaptive capture rate.
+/// While frames keep coming back unchanged the rate steps down by halves from the
+/// target towards the floor, one step per second of stillness; the first changed
+/// frame (or damage event) returns straight to the target rate. Time spent at each
+/// rate is accumulated for the stats log. Thread-safe: the capture thread drives it,
+/// stats may be read from any thread.
+class FrameRateController {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Set the rates and restart at the target
+    /// @param targetFps Rate while the content changes
+    /// @param floorFps Rate after a long still period; 0 or >= targetFps disables adaptation
+    void Configure(int targetFps, int floorFps);
+
+    /// Check if the rate can drop below the target
+    bool IsAdaptive() const { return m_levels.size() > 1; }
+
+    /// Record whether a captured frame differed from the previous one
+    void OnFrame(bool changed, Clock::time_point now);
+
+    /// Content is known to be changing (e.g. damage arrived): return to the target rate
+    void OnActivity(Clock::time_point now);
+
+    /// Get the interval to the next capture at the current rate
+    std::chrono::microseconds GetInterval() const;
+
+    /// Get the interval at the target rate
+    std::chrono::microseconds GetTargetInterval() const;
+
+    /// Get the current rate in frames per second
+    int GetCurrentFps() const;
+
+    /// Get the share of time spent at each rate so far, e.g. "30 fps 12.5%, 15 fps 2.0%, 2 fps 85.5%"
+    std::string DescribeTimeAtRates() const;
+
+private:
+    struct Level {
+        int fps = 0;
+        Clock::duration time{};
+    };
+
+    void SetLevel(size_t level, Clock::time_point now);
+
+    mutable std::mutex m_mutex;
+    std::vector<Level> m_levels;
+    size_t m_level = 0;
+    Clock::time_point m_levelSince;
+    Clock::time_point m_lastChange;
+};
+
+}  // namespace snacka
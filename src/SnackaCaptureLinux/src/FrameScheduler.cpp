@@ -0,0 +1,157 @@
+#include "FrameScheduler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <iomanip>
+#include <sstream>
+#include <time.h>
+
+namespace snacka {
+
+void FrameScheduler::Histogram::Add(std::chrono::microseconds value) {
+    int64_t us = std::max<int64_t>(value.count(), 0);
+    m_bins[static_cast<size_t>(std::min<int64_t>(us / BIN_US, BINS))]++;
+    m_count++;
+    m_maxUs = std::max(m_maxUs, us);
+}
+
+void FrameScheduler::Histogram::Clear() {
+    m_bins.fill(0);
+    m_count = 0;
+    m_maxUs = 0;
+}
+
+double FrameScheduler::Histogram::GetPercentileMs(double fraction) const {
+    if (m_count == 0) {
+        return 0.0;
+    }
+
+    auto target = static_cast<uint64_t>(fraction * static_cast<double>(m_count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int bin = 0; bin < BINS; bin++) {
+        seen += m_bins[bin];
+        if (seen >= target) {
+            // The overall maximum is a tighter bound for the last occupied bin
+            return std::min((bin + 1) * BIN_US, static_cast<int>(m_maxUs)) / 1000.0;
+        }
+    }
+    return GetMaxMs();
+}
+
+void FrameScheduler::Reset(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_deadline = now;
+    m_hasLastStart = false;
+}
+
+void FrameScheduler::Reset(Clock::time_point now, Clock::time_point origin, std::chrono::microseconds interval) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_deadline = origin;
+    if (now > origin && interval.count() > 0) {
+        auto steps = (now - origin + interval - Clock::duration(1)) / interval;
+        m_deadline = origin + steps * interval;
+    }
+    m_hasLastStart = false;
+}
+
+FrameScheduler::Clock::time_point FrameScheduler::GetDeadline() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_deadline;
+}
+
+void FrameScheduler::MoveDeadline(Clock::time_point deadline) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_deadline = deadline;
+}
+
+void FrameScheduler::WaitForDeadline() const {
+    // steady_clock is CLOCK_MONOTONIC; an absolute sleep does not drift by the time
+    // spent between reading the clock and going to sleep
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(GetDeadline().time_since_epoch()).count();
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+    ts.tv_nsec = static_cast<long>(ns % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+}
+
+void FrameScheduler::OnFrameStart(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    RecordStart(now);
+}
+
+void FrameScheduler::RecordStart(Clock::time_point now) {
+    // Pushed frames may also come early; either way it is distance from the grid
+    auto offset = std::chrono::duration_cast<std::chrono::microseconds>(now - m_deadline);
+    m_jitter.Add(offset < offset.zero() ? -offset : offset);
+    if (m_hasLastStart) {
+        m_intervals.Add(std::chrono::duration_cast<std::chrono::microseconds>(now - m_lastStart));
+    }
+    m_lastStart = now;
+    m_hasLastStart = true;
+}
+
+int FrameScheduler::SkipLate(std::chrono::microseconds interval, Clock::time_point now) {
+    // Slightly late is still served at once; beyond a quarter interval it would land
+    // nearer the next slot than its own, so the slot is given up
+    auto late = now - m_deadline;
+    auto tolerance = interval / 4;
+    if (interval.count() <= 0 || late <= tolerance) {
+        return 0;
+    }
+
+    auto skipped = (late - tolerance) / interval + 1;
+    m_deadline += skipped * interval;
+    m_dropped += static_cast<uint64_t>(skipped);
+    m_dropBursts[static_cast<size_t>(std::min<int64_t>(skipped, 4) - 1)]++;
+    return static_cast<int>(skipped);
+}
+
+int FrameScheduler::Advance(std::chrono::microseconds interval, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_deadline += interval;
+    return SkipLate(interval, now);
+}
+
+bool FrameScheduler::Admit(std::chrono::microseconds interval, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // A source running faster than the target delivers frames well before they are due
+    if (now < m_deadline - interval / 4) {
+        return false;
+    }
+
+    SkipLate(interval, now);
+    RecordStart(now);
+
+    // Follow the source's phase: a device clock slightly off ours must not slowly
+    // walk its frames into the early window
+    m_deadline = now + interval;
+    return true;
+}
+
+std::string FrameScheduler::DescribeStats(bool reset) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2)
+        << "jitter p50 " << m_jitter.GetPercentileMs(0.5) << " p99 " << m_jitter.GetPercentileMs(0.99)
+        << " max " << m_jitter.GetMaxMs() << " ms"
+        << ", interval p50 " << m_intervals.GetPercentileMs(0.5) << " p99 " << m_intervals.GetPercentileMs(0.99)
+        << " max " << m_intervals.GetMaxMs() << " ms"
+        << ", dropped " << m_dropped;
+    if (m_dropped > 0) {
+        out << " (1: " << m_dropBursts[0] << ", 2: " << m_dropBursts[1] << ", 3: " << m_dropBursts[2]
+            << ", 4+: " << m_dropBursts[3] << ")";
+    }
+
+    if (reset) {
+        m_jitter.Clear();
+        m_intervals.Clear();
+        m_dropBursts.fill(0);
+        m_dropped = 0;
+    }
+    return out.str();
+}
+
+}  // namespace snacka
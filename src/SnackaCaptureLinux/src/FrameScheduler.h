@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace snacka {
+
+/// Absolute-deadline frame pacing.
+/// Frames are due on a fixed grid (deadline += interval) instead of "interval after
+/// the last frame", so a slow frame does not push every later one back. A deadline
+/// missed by more than a quarter interval is dropped and counted, and the grid stays
+/// in phase. Timed sources (screen grabs) wait for each deadline; push sources
+/// (cameras) ask whether an arriving frame is due, and the grid follows their phase.
+///
+/// Keeps histograms of how late each frame started (jitter), of the time between
+/// frame starts, and of how many deadlines each drop skipped. Thread-safe: the
+/// capture thread drives it, stats may be read from any thread.
+class FrameScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Put the next deadline at now, e.g. at start or after a pause that should not count as drops
+    void Reset(Clock::time_point now);
+
+    /// Put the next deadline on a grid shared with other schedulers: the first
+    /// origin + k * interval at or after now. Streams reset on the same origin tick
+    /// together wherever their intervals coincide (e.g. every other frame of 30 and 15 fps).
+    void Reset(Clock::time_point now, Clock::time_point origin, std::chrono::microseconds interval);
+
+    /// Get the deadline of the next frame
+    Clock::time_point GetDeadline() const;
+
+    /// Move the next deadline, e.g. to pull a frame in early; the grid continues from it
+    void MoveDeadline(Clock::time_point deadline);
+
+    /// Sleep until the next deadline on the absolute clock
+    void WaitForDeadline() const;
+
+    /// Record that a frame started now, against the current deadline
+    void OnFrameStart(Clock::time_point now);
+
+    /// Step to the deadline after the current one, dropping those already too late
+    /// @param interval Frame interval at the current rate
+    /// @return Number of deadlines dropped
+    int Advance(std::chrono::microseconds interval, Clock::time_point now);
+
+    /// For push sources: decide whether a frame arriving now is due. A due frame is
+    /// recorded as started and the next deadline is one interval after it; a frame
+    /// more than a quarter interval early is left out.
+    /// @return true to deliver the frame
+    bool Admit(std::chrono::microseconds interval, Clock::time_point now);
+
+    /// Summarize the histograms, e.g. "jitter p50 0.06 p99 0.41 max 1.20 ms, interval p50 16.70
+    /// p99 16.90 max 17.30 ms, dropped 3 (1: 1, 2: 1, 3: 0, 4+: 0)"
+    /// @param reset Start a new measurement window afterwards
+    std::string DescribeStats(bool reset);
+
+private:
+    /// Fixed-bin histogram of durations: 50 us bins up to 100 ms, then one overflow bin
+    class Histogram {
+    public:
+        void Add(std::chrono::microseconds value);
+        void Clear();
+        uint64_t GetCount() const { return m_count; }
+        /// Upper edge of the bin holding the given fraction of samples, in milliseconds
+        double GetPercentileMs(double fraction) const;
+        double GetMaxMs() const { return m_maxUs / 1000.0; }
+
+    private:
+        static constexpr int BIN_US = 50;
+        static constexpr int BINS = 2000;
+
+        std::array<uint32_t, BINS + 1> m_bins{};
+        uint64_t m_count = 0;
+        int64_t m_maxUs = 0;
+    };
+
+    void RecordStart(Clock::time_point now);
+    int SkipLate(std::chrono::microseconds interval, Clock::time_point now);
+
+    mutable std::mutex m_mutex;
+    Clock::time_point m_deadline;
+    Clock::time_point m_lastStart;
+    bool m_hasLastStart = false;
+
+    Histogram m_jitter;
+    Histogram m_intervals;
+
+    // Drop events by how many deadlines they skipped: 1, 2, 3, 4 or more
+    std::array<uint64_t, 4> m_dropBursts{};
+    uint64_t m_dropped = 0;
+};
+
+}  // namespace snacka
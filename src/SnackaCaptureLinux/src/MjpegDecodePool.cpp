@@ -0,0 +1,138 @@
+#include "MjpegDecodePool.h"
+#include "Protocol.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace snacka {
+
+MjpegDecodePool::MjpegDecodePool(int threadCount, int width, int height)
+    : m_width(width),
+      m_height(height),
+      m_frameSize(CalculateNV12FrameSize(width, height)),
+      m_pending(static_cast<size_t>(std::max(threadCount, 1))),
+      m_startTime(std::chrono::steady_clock::now()) {
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    threadCount = std::max(threadCount, 1);
+    for (int i = 0; i < threadCount; i++) {
+        m_decoders.push_back(std::make_unique<MjpegDecoder>());
+    }
+    for (int i = 0; i < threadCount; i++) {
+        m_threads.emplace_back(&MjpegDecodePool::DecodeLoop, this, i);
+    }
+}
+
+MjpegDecodePool::~MjpegDecodePool() {
+    m_pending.Close();
+    for (auto& thread : m_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    if (m_eventFd >= 0) {
+        close(m_eventFd);
+    }
+}
+
+int MjpegDecodePool::PickThreadCount(int requested, int width, int height, int fps) {
+    if (requested > 0) {
+        return requested;
+    }
+    int64_t pixelRate = static_cast<int64_t>(width) * height * fps;
+    if (pixelRate <= int64_t{1280} * 720 * 30) {
+        return 1;
+    }
+    int64_t fullHd30 = int64_t{1920} * 1080 * 30;
+    int threads = static_cast<int>((pixelRate + fullHd30 - 1) / fullHd30) + 1;
+    int cores = static_cast<int>(std::thread::hardware_concurrency());
+    return std::clamp(std::min(threads, cores / 2), 1, 4);
+}
+
+bool MjpegDecodePool::Submit(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_inFlight >= GetThreadCount()) {
+            return false;
+        }
+        job.sequence = m_nextSequence++;
+        m_inFlight++;
+    }
+
+    // Never blocks: there are as many slots as threads and every in-flight job holds one at most
+    return m_pending.Push(std::move(job));
+}
+
+bool MjpegDecodePool::PopCompleted(Job& job) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Clear the wakeup; EAGAIN just means nothing finished since the last call
+    uint64_t count = 0;
+    [[maybe_unused]] ssize_t cleared = read(m_eventFd, &count, sizeof(count));
+
+    auto it = m_completed.find(m_nextDelivery);
+    if (it == m_completed.end()) {
+        return false;
+    }
+    job = std::move(it->second);
+    m_completed.erase(it);
+    m_nextDelivery++;
+    m_inFlight--;
+    return true;
+}
+
+int MjpegDecodePool::GetInFlight() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_inFlight;
+}
+
+void MjpegDecodePool::DecodeLoop(int threadIndex) {
+    MjpegDecoder& decoder = *m_decoders[threadIndex];
+    Job job;
+    while (m_pending.Pop(job)) {
+        auto start = std::chrono::steady_clock::now();
+        job.nv12 = FrameBufferPool::Shared().Acquire(m_frameSize);
+        job.decoded = decoder.Decode(job.jpeg, job.size, m_width, m_height, job.nv12.data());
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        job.decodeTime = elapsed;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busyTime += elapsed;
+            m_maxDecodeTime = std::max<std::chrono::nanoseconds>(m_maxDecodeTime, elapsed);
+            if (job.decoded) {
+                m_decodedFrames++;
+            } else {
+                m_failedFrames++;
+            }
+            m_completed.emplace(job.sequence, std::move(job));
+        }
+
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t signalled = write(m_eventFd, &one, sizeof(one));
+        job = Job();
+    }
+}
+
+std::string MjpegDecodePool::DescribeStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint64_t frames = m_decodedFrames + m_failedFrames;
+    double busyMs = std::chrono::duration<double, std::milli>(m_busyTime).count();
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_startTime).count();
+    double averageMs = frames > 0 ? busyMs / frames : 0.0;
+    double maxMs = std::chrono::duration<double, std::milli>(m_maxDecodeTime).count();
+    double busyPercent = wallMs > 0 ? 100.0 * busyMs / (wallMs * GetThreadCount()) : 0.0;
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << GetThreadCount() << " threads, decode " << averageMs
+        << " ms avg / " << maxMs << " ms max, " << std::setprecision(0) << busyPercent << "% busy, "
+        << m_failedFrames << " failed";
+    return out.str();
+}
+
+}  // namespace snacka
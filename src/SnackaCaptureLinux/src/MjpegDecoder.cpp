@@ -0,0 +1,468 @@
+#include "MjpegDecoder.h"
+
+#include <cstdio>
+#include <jpeglib.h>
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace snacka {
+
+namespace {
+
+constexpr uint8_t MARKER_SOI = 0xD8;
+constexpr uint8_t MARKER_EOI = 0xD9;
+constexpr uint8_t MARKER_SOS = 0xDA;
+constexpr uint8_t MARKER_DHT = 0xC4;
+
+// Default Huffman tables from ITU-T T.81 Annex K.3, which the AVI1 MJPEG format makes
+// implicit. Written as four DHT segments in the order libjpeg emits them.
+constexpr uint8_t DC_LUMINANCE_BITS[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+constexpr uint8_t DC_CHROMINANCE_BITS[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+constexpr uint8_t DC_VALUES[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+constexpr uint8_t AC_LUMINANCE_BITS[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+constexpr uint8_t AC_LUMINANCE_VALUES[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa};
+
+constexpr uint8_t AC_CHROMINANCE_BITS[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+constexpr uint8_t AC_CHROMINANCE_VALUES[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa};
+
+// JFIF YCbCr is full range, NV12 output has video levels like the other camera formats:
+// 16 + round(v * 219 / 255) for luma and 16 + round(v * 224 / 255) for chroma, in fixed
+// point that is exact for every byte value
+inline uint8_t LimitLuma(uint32_t value) {
+    return static_cast<uint8_t>(16 + ((value * 56284 + 32768) >> 16));
+}
+
+inline uint8_t LimitChroma(uint32_t value) {
+    return static_cast<uint8_t>(16 + ((value * 57569 + 32768) >> 16));
+}
+
+// Plain loop over bytes, so the compiler vectorizes it; src may equal dst
+void LimitLumaRow(const uint8_t* src, uint8_t* dst, int width) {
+    for (int x = 0; x < width; x++) {
+        dst[x] = LimitLuma(src[x]);
+    }
+}
+
+void AppendHuffmanTable(std::vector<uint8_t>& out, uint8_t tableClassAndId, const uint8_t* bits,
+                        const uint8_t* values, size_t valueCount) {
+    size_t length = 2 + 1 + 16 + valueCount;
+    out.push_back(0xFF);
+    out.push_back(MARKER_DHT);
+    out.push_back(static_cast<uint8_t>(length >> 8));
+    out.push_back(static_cast<uint8_t>(length));
+    out.push_back(tableClassAndId);
+    out.insert(out.end(), bits, bits + 16);
+    out.insert(out.end(), values, values + valueCount);
+}
+
+bool IsStandalone(uint8_t marker) {
+    return marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7) || marker == MARKER_SOI || marker == MARKER_EOI;
+}
+
+// Walk the marker segments after SOI up to the first SOS. Returns the SOS offset, or 0
+// if the header is malformed or truncated.
+size_t FindStartOfScan(const uint8_t* jpeg, size_t size, bool& hasHuffmanTables) {
+    hasHuffmanTables = false;
+    if (size < 4 || jpeg[0] != 0xFF || jpeg[1] != MARKER_SOI) {
+        return 0;
+    }
+
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (jpeg[pos] != 0xFF) {
+            return 0;
+        }
+        uint8_t marker = jpeg[pos + 1];
+        if (marker == 0xFF) {
+            pos++;  // Fill byte
+            continue;
+        }
+        if (marker == MARKER_SOS) {
+            return pos;
+        }
+        if (IsStandalone(marker)) {
+            pos += 2;
+            continue;
+        }
+        if (marker == MARKER_DHT) {
+            hasHuffmanTables = true;
+        }
+        size_t length = (static_cast<size_t>(jpeg[pos + 2]) << 8) | jpeg[pos + 3];
+        if (length < 2) {
+            return 0;
+        }
+        pos += 2 + length;
+    }
+    return 0;
+}
+
+// Get the end of the frame starting at start (just past EOI), or 0 if it is malformed or truncated
+size_t FindFrameEnd(const uint8_t* data, size_t size, size_t start) {
+    size_t pos = start + 2;
+    bool inScan = false;
+    while (pos + 1 < size) {
+        if (inScan) {
+            // Entropy-coded data: 0xFF is followed by a stuffed zero or a restart marker
+            uint8_t next = data[pos + 1];
+            if (data[pos] != 0xFF || next == 0x00 || (next >= 0xD0 && next <= 0xD7)) {
+                pos++;
+                continue;
+            }
+            inScan = false;
+        }
+        if (data[pos] != 0xFF) {
+            return 0;
+        }
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        if (marker == MARKER_EOI) {
+            return pos + 2;
+        }
+        if (IsStandalone(marker)) {
+            pos += 2;
+            continue;
+        }
+        if (pos + 4 > size) {
+            return 0;
+        }
+        size_t length = (static_cast<size_t>(data[pos + 2]) << 8) | data[pos + 3];
+        if (length < 2) {
+            return 0;
+        }
+        pos += 2 + length;
+        inScan = marker == MARKER_SOS;
+    }
+    return 0;
+}
+
+}  // namespace
+
+struct MjpegDecoder::Context {
+    struct ErrorManager {
+        jpeg_error_mgr base;
+        jmp_buf jump;
+        uint64_t warnings = 0;
+    };
+
+    jpeg_decompress_struct info;
+    ErrorManager error;
+
+    static void OnError(j_common_ptr cinfo) {
+        auto* error = reinterpret_cast<ErrorManager*>(cinfo->err);
+        longjmp(error->jump, 1);
+    }
+
+    static void OnMessage(j_common_ptr cinfo, int level) {
+        // Level -1 is corrupt data that libjpeg recovered from (gray fill, skipped bytes)
+        if (level < 0) {
+            reinterpret_cast<ErrorManager*>(cinfo->err)->warnings++;
+        }
+    }
+
+    static void OnOutput(j_common_ptr) {}
+};
+
+MjpegDecoder::MjpegDecoder() : m_context(std::make_unique<Context>()) {
+    m_context->info.err = jpeg_std_error(&m_context->error.base);
+    m_context->error.base.error_exit = Context::OnError;
+    m_context->error.base.emit_message = Context::OnMessage;
+    m_context->error.base.output_message = Context::OnOutput;
+    jpeg_create_decompress(&m_context->info);
+}
+
+MjpegDecoder::~MjpegDecoder() {
+    jpeg_destroy_decompress(&m_context->info);
+}
+
+bool MjpegDecoder::Inspect(const uint8_t* jpeg, size_t size, bool& hasHuffmanTables) {
+    return FindStartOfScan(jpeg, size, hasHuffmanTables) != 0;
+}
+
+bool MjpegDecoder::ReadSize(const uint8_t* jpeg, size_t size, int& width, int& height) {
+    bool hasHuffmanTables = false;
+    size_t end = FindStartOfScan(jpeg, size, hasHuffmanTables);
+    size_t pos = 2;
+    while (pos + 9 <= end) {
+        uint8_t marker = jpeg[pos + 1];
+        if (marker == 0xFF || IsStandalone(marker)) {
+            pos += marker == 0xFF ? 1 : 2;
+            continue;
+        }
+        // SOF0..SOF15 except DHT, JPG and DAC carry the frame size
+        if (marker >= 0xC0 && marker <= 0xCF && marker != MARKER_DHT && marker != 0xC8 && marker != 0xCC) {
+            height = (jpeg[pos + 5] << 8) | jpeg[pos + 6];
+            width = (jpeg[pos + 7] << 8) | jpeg[pos + 8];
+            return width > 0 && height > 0;
+        }
+        pos += 2 + ((static_cast<size_t>(jpeg[pos + 2]) << 8) | jpeg[pos + 3]);
+    }
+    return false;
+}
+
+std::vector<std::pair<size_t, size_t>> MjpegDecoder::SplitFrames(const uint8_t* data, size_t size) {
+    std::vector<std::pair<size_t, size_t>> frames;
+    size_t pos = 0;
+    while (pos + 3 < size) {
+        if (data[pos] != 0xFF || data[pos + 1] != MARKER_SOI || data[pos + 2] != 0xFF) {
+            pos++;
+            continue;
+        }
+        size_t end = FindFrameEnd(data, size, pos);
+        if (end == 0) {
+            // Resynchronize on the next SOI
+            pos += 2;
+            continue;
+        }
+        frames.emplace_back(pos, end - pos);
+        pos = end;
+    }
+    return frames;
+}
+
+const uint8_t* MjpegDecoder::RepairHuffmanTables(const uint8_t* jpeg, size_t& size) {
+    bool hasHuffmanTables = false;
+    size_t startOfScan = FindStartOfScan(jpeg, size, hasHuffmanTables);
+    if (startOfScan == 0 || hasHuffmanTables) {
+        // Malformed headers are left for libjpeg to report
+        return jpeg;
+    }
+
+    m_repaired.clear();
+    m_repaired.insert(m_repaired.end(), jpeg, jpeg + startOfScan);
+    AppendHuffmanTable(m_repaired, 0x00, DC_LUMINANCE_BITS, DC_VALUES, sizeof(DC_VALUES));
+    AppendHuffmanTable(m_repaired, 0x10, AC_LUMINANCE_BITS, AC_LUMINANCE_VALUES, sizeof(AC_LUMINANCE_VALUES));
+    AppendHuffmanTable(m_repaired, 0x01, DC_CHROMINANCE_BITS, DC_VALUES, sizeof(DC_VALUES));
+    AppendHuffmanTable(m_repaired, 0x11, AC_CHROMINANCE_BITS, AC_CHROMINANCE_VALUES,
+                       sizeof(AC_CHROMINANCE_VALUES));
+    m_repaired.insert(m_repaired.end(), jpeg + startOfScan, jpeg + size);
+    m_repairedFrames++;
+
+    size = m_repaired.size();
+    return m_repaired.data();
+}
+
+bool MjpegDecoder::Decode(const uint8_t* jpeg, size_t size, int width, int height, uint8_t* nv12) {
+    m_frames++;
+    jpeg = RepairHuffmanTables(jpeg, size);
+
+    jpeg_decompress_struct& info = m_context->info;
+    const char* failure = nullptr;
+    char message[JMSG_LENGTH_MAX] = {};
+
+    // Only trivially destructible locals between here and the libjpeg calls: a longjmp
+    // out of error_exit skips destructors
+    if (setjmp(m_context->error.jump) == 0) {
+        jpeg_mem_src(&info, jpeg, static_cast<unsigned long>(size));
+        jpeg_read_header(&info, TRUE);
+
+        // Raw planes for 4:2:0, 4:2:2 and grayscale; anything else goes through full-resolution YCbCr
+        const jpeg_component_info* components = info.comp_info;
+        bool chromaSubsampled = info.num_components == 3 && info.jpeg_color_space == JCS_YCbCr &&
+                                components[0].h_samp_factor == 2 &&
+                                (components[0].v_samp_factor == 1 || components[0].v_samp_factor == 2) &&
+                                components[1].h_samp_factor == 1 && components[1].v_samp_factor == 1 &&
+                                components[2].h_samp_factor == 1 && components[2].v_samp_factor == 1;
+        bool grayscale = info.num_components == 1;
+
+        if (static_cast<int>(info.image_width) != width || static_cast<int>(info.image_height) != height) {
+            std::snprintf(message, sizeof(message), "frame is %ux%u, expected %dx%d", info.image_width,
+                          info.image_height, width, height);
+            failure = message;
+        } else {
+            if (m_subsampling.empty()) {
+                m_subsampling = grayscale ? "grayscale"
+                                : chromaSubsampled ? (components[0].v_samp_factor == 2 ? "4:2:0" : "4:2:2")
+                                                   : "other (full-resolution path)";
+            }
+            bool decoded = chromaSubsampled || grayscale ? DecodeRaw(width, height, nv12)
+                                                         : DecodeScanlines(width, height, nv12);
+            if (decoded) {
+                jpeg_finish_decompress(&info);
+                return true;
+            }
+            failure = "frame ended early";
+        }
+    } else {
+        m_context->error.base.format_message(reinterpret_cast<j_common_ptr>(&info), message);
+        failure = message;
+    }
+
+    // Leaves the decompressor ready for the next frame
+    jpeg_abort_decompress(&info);
+    if (m_failed < 5 || m_failed % 100 == 0) {
+        std::cerr << "MjpegDecoder: Failed to decode frame " << m_frames << ": " << failure << "\n";
+    }
+    m_failed++;
+    return false;
+}
+
+bool MjpegDecoder::DecodeRaw(int width, int height, uint8_t* nv12) {
+    jpeg_decompress_struct& info = m_context->info;
+    info.raw_data_out = TRUE;
+    jpeg_start_decompress(&info);
+
+    const jpeg_component_info* components = info.comp_info;
+    bool grayscale = info.num_components == 1;
+    int rowsPerPass = info.max_v_samp_factor * DCTSIZE;
+    int lumaStride = static_cast<int>(components[0].width_in_blocks) * DCTSIZE;
+    int chromaStride = grayscale ? 0 : static_cast<int>(components[1].width_in_blocks) * DCTSIZE;
+    int chromaRows = DCTSIZE;
+    bool verticalAverage = !grayscale && components[0].v_samp_factor == 1;
+
+    size_t lumaScratch = static_cast<size_t>(lumaStride) * rowsPerPass;
+    size_t chromaScratch = static_cast<size_t>(chromaStride) * chromaRows;
+    if (m_scratch.size() < lumaScratch + 2 * chromaScratch) {
+        m_scratch.resize(lumaScratch + 2 * chromaScratch);
+    }
+    uint8_t* scratchY = m_scratch.data();
+    uint8_t* scratchU = scratchY + lumaScratch;
+    uint8_t* scratchV = scratchU + chromaScratch;
+
+    uint8_t* yPlane = nv12;
+    uint8_t* uvPlane = nv12 + static_cast<size_t>(width) * height;
+    int chromaWidth = width / 2;
+    if (grayscale) {
+        std::memset(uvPlane, 128, static_cast<size_t>(width) * (height / 2));
+    }
+
+    // Luma rows are decoded into the Y plane when libjpeg's padded rows fit it exactly and
+    // scaled in place, otherwise scaled while copying out of scratch
+    bool directLuma = lumaStride == width;
+
+    JSAMPROW yRows[4 * DCTSIZE];
+    JSAMPROW uRows[DCTSIZE];
+    JSAMPROW vRows[DCTSIZE];
+    JSAMPARRAY planes[3] = {yRows, uRows, vRows};
+
+    for (int i = 0; i < chromaRows; i++) {
+        uRows[i] = scratchU + static_cast<size_t>(i) * chromaStride;
+        vRows[i] = scratchV + static_cast<size_t>(i) * chromaStride;
+    }
+
+    while (info.output_scanline < info.output_height) {
+        int top = static_cast<int>(info.output_scanline);
+        for (int i = 0; i < rowsPerPass; i++) {
+            yRows[i] = directLuma && top + i < height ? yPlane + static_cast<size_t>(top + i) * width
+                                                      : scratchY + static_cast<size_t>(i) * lumaStride;
+        }
+
+        if (jpeg_read_raw_data(&info, planes, rowsPerPass) == 0) {
+            return false;
+        }
+
+        int rows = std::min(rowsPerPass, height - top);
+        for (int i = 0; i < rows; i++) {
+            LimitLumaRow(yRows[i], yPlane + static_cast<size_t>(top + i) * width, width);
+        }
+        if (grayscale) {
+            continue;
+        }
+
+        // 4:2:0 chroma rows map one to one onto NV12; 4:2:2 pairs are averaged like YUYV
+        int uvTop = top / 2;
+        int uvRows = (rows + 1) / 2;
+        for (int j = 0; j < uvRows; j++) {
+            uint8_t* uvRow = uvPlane + static_cast<size_t>(uvTop + j) * width;
+            if (verticalAverage) {
+                const uint8_t* u0 = uRows[j * 2];
+                const uint8_t* u1 = uRows[j * 2 + 1];
+                const uint8_t* v0 = vRows[j * 2];
+                const uint8_t* v1 = vRows[j * 2 + 1];
+                for (int x = 0; x < chromaWidth; x++) {
+                    uvRow[x * 2] = LimitChroma((u0[x] + u1[x]) / 2);
+                    uvRow[x * 2 + 1] = LimitChroma((v0[x] + v1[x]) / 2);
+                }
+            } else {
+                const uint8_t* u = uRows[j];
+                const uint8_t* v = vRows[j];
+                for (int x = 0; x < chromaWidth; x++) {
+                    uvRow[x * 2] = LimitChroma(u[x]);
+                    uvRow[x * 2 + 1] = LimitChroma(v[x]);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool MjpegDecoder::DecodeScanlines(int width, int height, uint8_t* nv12) {
+    jpeg_decompress_struct& info = m_context->info;
+    info.raw_data_out = FALSE;
+    info.out_color_space = JCS_YCbCr;
+    jpeg_start_decompress(&info);
+    m_scanlineFrames++;
+
+    size_t rowBytes = static_cast<size_t>(width) * 3;
+    if (m_scratch.size() < rowBytes * 2) {
+        m_scratch.resize(rowBytes * 2);
+    }
+    JSAMPROW rows[2] = {m_scratch.data(), m_scratch.data() + rowBytes};
+
+    uint8_t* yPlane = nv12;
+    uint8_t* uvPlane = nv12 + static_cast<size_t>(width) * height;
+    for (int y = 0; y < height; y += 2) {
+        for (int i = 0; i < 2; i++) {
+            if (jpeg_read_scanlines(&info, &rows[i], 1) != 1) {
+                return false;
+            }
+        }
+
+        // Full-resolution YCbCr: copy Y, average each 2x2 block of chroma
+        uint8_t* y0 = yPlane + static_cast<size_t>(y) * width;
+        uint8_t* y1 = y0 + width;
+        uint8_t* uvRow = uvPlane + static_cast<size_t>(y / 2) * width;
+        const uint8_t* r0 = rows[0];
+        const uint8_t* r1 = rows[1];
+        for (int x = 0; x < width; x += 2) {
+            y0[x] = LimitLuma(r0[x * 3]);
+            y0[x + 1] = LimitLuma(r0[x * 3 + 3]);
+            y1[x] = LimitLuma(r1[x * 3]);
+            y1[x + 1] = LimitLuma(r1[x * 3 + 3]);
+            uvRow[x] = LimitChroma((r0[x * 3 + 1] + r0[x * 3 + 4] + r1[x * 3 + 1] + r1[x * 3 + 4] + 2) / 4);
+            uvRow[x + 1] = LimitChroma((r0[x * 3 + 2] + r0[x * 3 + 5] + r1[x * 3 + 2] + r1[x * 3 + 5] + 2) / 4);
+        }
+    }
+    return true;
+}
+
+std::string MjpegDecoder::DescribeStats() const {
+    std::ostringstream out;
+    out << m_frames << " frames, " << m_failed << " failed, " << m_repairedFrames
+        << " with default Huffman tables, " << m_context->error.warnings << " corrupt data warnings";
+    if (!m_subsampling.empty()) {
+        out << ", " << m_subsampling;
+    }
+    return out.str();
+}
+
+}  // namespace snacka
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace snacka {
+
+/// Decodes Motion-JPEG camera frames to NV12 with libjpeg-turbo.
+/// Frames are decoded as raw YCbCr planes (jpeg_read_raw_data), so the IDCT output goes
+/// straight into the NV12 planes without color conversion or chroma upsampling; 4:2:2
+/// chroma is only averaged down vertically. JFIF samples are full range and are scaled to
+/// video levels (Y 16-235, UV 16-240) on the way, so the output matches the other camera
+/// formats' BT.601 limited range. Subsamplings other than 4:2:0, 4:2:2 and
+/// grayscale take a slower full-resolution YCbCr path.
+/// The decompressor is created once and reused for every frame. Many UVC cameras omit
+/// the Huffman tables (DHT) from their frames and rely on the defaults from the AVI1
+/// MJPEG spec; those are inserted before decoding.
+/// Not thread-safe: use one decoder per thread.
+class MjpegDecoder {
+public:
+    MjpegDecoder();
+    ~MjpegDecoder();
+
+    MjpegDecoder(const MjpegDecoder&) = delete;
+    MjpegDecoder& operator=(const MjpegDecoder&) = delete;
+
+    /// Decode one frame
+    /// @param jpeg Compressed frame (may have trailing padding after EOI)
+    /// @param size Bytes in jpeg
+    /// @param width Expected frame width (even)
+    /// @param height Expected frame height (even)
+    /// @param nv12 Output buffer of CalculateNV12FrameSize(width, height) bytes
+    /// @return false if the frame is corrupt or not width x height; nv12 is then undefined
+    bool Decode(const uint8_t* jpeg, size_t size, int width, int height, uint8_t* nv12);
+
+    /// Read the dimensions from a frame's header without decoding it
+    static bool ReadSize(const uint8_t* jpeg, size_t size, int& width, int& height);
+
+    /// Check that a frame starts with SOI and has Huffman tables before its first scan
+    /// @param hasHuffmanTables Receives whether a DHT segment precedes SOS
+    /// @return false if the markers up to SOS are malformed
+    static bool Inspect(const uint8_t* jpeg, size_t size, bool& hasHuffmanTables);
+
+    /// Split a stream of concatenated JPEG frames (e.g. a raw MJPEG capture file) into frames
+    static std::vector<std::pair<size_t, size_t>> SplitFrames(const uint8_t* data, size_t size);
+
+    /// Summarize decoding, e.g. "900 frames, 0 failed, 900 with default Huffman tables,
+    /// 0 corrupt data warnings, 4:2:2"
+    std::string DescribeStats() const;
+
+private:
+    struct Context;
+
+    bool DecodeRaw(int width, int height, uint8_t* nv12);
+    bool DecodeScanlines(int width, int height, uint8_t* nv12);
+    const uint8_t* RepairHuffmanTables(const uint8_t* jpeg, size_t& size);
+
+    std::unique_ptr<Context> m_context;
+
+    // Frame with the default tables inserted, kept to avoid reallocating per frame
+    std::vector<uint8_t> m_repaired;
+
+    // Scratch rows for one iMCU row of each component
+    std::vector<uint8_t> m_scratch;
+
+    // Statistics
+    uint64_t m_frames = 0;
+    uint64_t m_failed = 0;
+    uint64_t m_repairedFrames = 0;
+    uint64_t m_scanlineFrames = 0;
+    std::string m_subsampling;
+};
+
+}  // namespace snacka
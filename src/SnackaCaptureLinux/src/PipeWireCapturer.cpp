@@ -0,0 +1,707 @@
+#include "PipeWireCapturer.h"
+#include "Protocol.h"
+
+#include <spa/buffer/meta.h>
+
+#include <linux/dma-buf.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace snacka {
+
+namespace {
+
+// Above this share of tiles a single full conversion beats many partial ones
+constexpr double FULL_CONVERT_THRESHOLD = 0.5;
+
+// How long Initialize waits for the producer to agree on a format
+constexpr int FORMAT_TIMEOUT_SECONDS = 5;
+
+// Buffers in the stream's pool: one waiting for its deadline, one being converted, the rest with the producer
+constexpr int STREAM_BUFFERS = 8;
+
+// Damage rectangles per frame; producers merge anything beyond this into fewer, larger ones
+constexpr int MAX_DAMAGE_REGIONS = 16;
+
+// Damage rectangles kept for frames waiting to be converted; beyond this the next conversion is a full one
+constexpr size_t MAX_PENDING_DAMAGE = MAX_DAMAGE_REGIONS * 4;
+
+constexpr uint32_t MAX_STREAM_SIZE = 16384;
+constexpr uint32_t MAX_STREAM_FPS = 1000;
+
+// DRM_FORMAT_MOD_LINEAR from drm_fourcc.h: plain row-major pixels, the only layout mmap can read
+constexpr uint64_t DRM_MODIFIER_LINEAR = 0;
+
+// Our mapping of a DMA-BUF the stream did not map itself, kept in pw_buffer::user_data
+struct DmaBufMapping {
+    void* address = nullptr;
+    size_t size = 0;
+};
+
+bool GetPixelLayout(spa_video_format format, PixelLayout& layout) {
+    switch (format) {
+        case SPA_VIDEO_FORMAT_BGRx:
+        case SPA_VIDEO_FORMAT_BGRA:
+            layout = PixelLayout::BGRX;
+            return true;
+        case SPA_VIDEO_FORMAT_RGBx:
+        case SPA_VIDEO_FORMAT_RGBA:
+            layout = PixelLayout::RGBX;
+            return true;
+        case SPA_VIDEO_FORMAT_xBGR:
+            layout = PixelLayout::XBGR;
+            return true;
+        default:
+            return false;
+    }
+}
+
+const char* GetVideoFormatName(spa_video_format format) {
+    switch (format) {
+        case SPA_VIDEO_FORMAT_BGRx: return "BGRx";
+        case SPA_VIDEO_FORMAT_BGRA: return "BGRA";
+        case SPA_VIDEO_FORMAT_RGBx: return "RGBx";
+        case SPA_VIDEO_FORMAT_RGBA: return "RGBA";
+        case SPA_VIDEO_FORMAT_xBGR: return "xBGR";
+        default: return "unsupported";
+    }
+}
+
+}  // namespace
+
+PipeWireCapturer::PipeWireCapturer() {
+}
+
+PipeWireCapturer::~PipeWireCapturer() {
+    Stop();
+    Cleanup();
+}
+
+bool PipeWireCapturer::Initialize(int remoteFd, const std::string& target, int width, int height, int fps) {
+    m_width = width;
+    m_height = height;
+    m_fps = fps;
+    m_interval = std::chrono::microseconds(1000000 / fps);
+    bool portalRemote = remoteFd >= 0;
+
+    // Output starts black until the first frame arrives
+    const ColorSpace& colorSpace = m_converter.GetColorSpace();
+    m_nv12Buffer = FrameBufferPool::Shared().Acquire(CalculateNV12FrameSize(m_width, m_height));
+    size_t lumaSize = static_cast<size_t>(m_width) * m_height;
+    std::fill(m_nv12Buffer.begin(), m_nv12Buffer.begin() + lumaSize,
+              ColorCoefficients::For(colorSpace.matrix, colorSpace.range).yOffset);
+    std::fill(m_nv12Buffer.begin() + lumaSize, m_nv12Buffer.end(), 128);
+
+    // The source size is not known until the format is negotiated
+    m_stripeCount = ColorConverter::PickStripeCount(m_convertThreads, m_width, m_height);
+    m_converter.Configure(m_width, m_height, m_width, m_height, m_stripeCount);
+    m_workerPool = std::make_unique<WorkerPool>(m_converter.GetStripeCount());
+    m_outputTiles.Configure(m_width, m_height);
+
+    pw_init(nullptr, nullptr);
+    m_pipeWireInitialized = true;
+
+    m_loop = pw_thread_loop_new("snacka-pipewire", nullptr);
+    if (!m_loop) {
+        std::cerr << "SnackaCaptureLinux: Failed to create PipeWire loop\n";
+        return false;
+    }
+    m_context = pw_context_new(pw_thread_loop_get_loop(m_loop), nullptr, 0);
+    if (!m_context) {
+        std::cerr << "SnackaCaptureLinux: Failed to create PipeWire context\n";
+        return false;
+    }
+    if (pw_thread_loop_start(m_loop) < 0) {
+        std::cerr << "SnackaCaptureLinux: Failed to start PipeWire loop\n";
+        return false;
+    }
+
+    pw_thread_loop_lock(m_loop);
+
+    m_core = portalRemote ? pw_context_connect_fd(m_context, remoteFd, nullptr, 0)
+                          : pw_context_connect(m_context, nullptr, 0);
+    if (!m_core) {
+        pw_thread_loop_unlock(m_loop);
+        std::cerr << "SnackaCaptureLinux: Failed to connect to PipeWire: " << strerror(errno) << "\n";
+        return false;
+    }
+    m_coreEvents.version = PW_VERSION_CORE_EVENTS;
+    m_coreEvents.error = OnCoreError;
+    pw_core_add_listener(m_core, &m_coreListener, &m_coreEvents, this);
+
+    // The portal's node is given by id on a remote that only exposes it; on the local
+    // daemon the session manager resolves an id, name or serial
+    uint32_t targetId = PW_ID_ANY;
+    if (!target.empty() && std::all_of(target.begin(), target.end(), [](unsigned char c) { return std::isdigit(c); })) {
+        targetId = static_cast<uint32_t>(std::stoul(target));
+    }
+    pw_properties* props = pw_properties_new(PW_KEY_MEDIA_TYPE, "Video", PW_KEY_MEDIA_CATEGORY, "Capture",
+                                             PW_KEY_MEDIA_ROLE, "Screen", nullptr);
+    if (!portalRemote && !target.empty()) {
+        pw_properties_set(props, PW_KEY_TARGET_OBJECT, target.c_str());
+        // A missing node must fail, not fall back to the default source (often a camera)
+        pw_properties_set(props, "node.dont-fallback", "true");
+    }
+
+    m_stream = pw_stream_new(m_core, "SnackaCaptureLinux", props);
+    if (!m_stream) {
+        pw_thread_loop_unlock(m_loop);
+        std::cerr << "SnackaCaptureLinux: Failed to create PipeWire stream\n";
+        return false;
+    }
+    m_streamEvents.version = PW_VERSION_STREAM_EVENTS;
+    m_streamEvents.state_changed = OnStreamStateChanged;
+    m_streamEvents.param_changed = OnStreamParamChanged;
+    m_streamEvents.add_buffer = OnStreamAddBuffer;
+    m_streamEvents.remove_buffer = OnStreamRemoveBuffer;
+    m_streamEvents.process = OnStreamProcess;
+    pw_stream_add_listener(m_stream, &m_streamListener, &m_streamEvents, this);
+
+    m_returnEvent = pw_loop_add_event(pw_thread_loop_get_loop(m_loop), OnBuffersReturned, this);
+
+    uint8_t podBuffer[1024];
+    spa_pod_builder builder;
+    spa_pod_builder_init(&builder, podBuffer, sizeof(podBuffer));
+    const spa_pod* params[2];
+    int paramCount = BuildFormats(builder, params);
+
+    int result = pw_stream_connect(m_stream, PW_DIRECTION_INPUT, targetId,
+                                   static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS),
+                                   params, static_cast<uint32_t>(paramCount));
+    if (result < 0) {
+        pw_thread_loop_unlock(m_loop);
+        std::cerr << "SnackaCaptureLinux: Failed to connect PipeWire stream: " << strerror(-result) << "\n";
+        return false;
+    }
+
+    // The producer picks the format once the session manager has linked the stream
+    auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(FORMAT_TIMEOUT_SECONDS);
+    while (!m_formatReady && !m_streamEnded && std::chrono::steady_clock::now() < giveUp) {
+        pw_thread_loop_timed_wait(m_loop, 1);
+    }
+    bool ready = m_formatReady && !m_streamEnded;
+    int sourceWidth = m_sourceWidth;
+    int sourceHeight = m_sourceHeight;
+    bool dmaBuf = m_dmaBuf;
+    pw_thread_loop_unlock(m_loop);
+
+    if (!ready) {
+        std::cerr << "SnackaCaptureLinux: PipeWire stream "
+                  << (target.empty() ? std::string("(default source)") : "for node " + target)
+                  << " did not agree on a video format\n";
+        return false;
+    }
+
+    std::cerr << "SnackaCaptureLinux: PipeWire capture initialized for node "
+              << (target.empty() ? std::string("(default source)") : target) << " ("
+              << sourceWidth << "x" << sourceHeight << ", " << (dmaBuf ? "DMA-BUF" : "shared memory")
+              << (portalRemote ? ", via portal" : "") << ") to output " << m_width << "x" << m_height
+              << " @ " << m_fps << "fps"
+              << " (conversion: " << ColorConverter::GetCpuLevelName(m_converter.GetCpuLevel())
+              << ", " << m_converter.GetStripeCount() << " thread(s), "
+              << GetColorSpaceName(colorSpace) << ")\n";
+
+    return true;
+}
+
+int PipeWireCapturer::BuildFormats(spa_pod_builder& builder, const spa_pod** params) {
+    spa_rectangle defaultSize{static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height)};
+    spa_rectangle minSize{1, 1};
+    spa_rectangle maxSize{MAX_STREAM_SIZE, MAX_STREAM_SIZE};
+    spa_fraction defaultRate{static_cast<uint32_t>(m_fps), 1};
+    spa_fraction minRate{0, 1};
+    spa_fraction lowestMaxRate{1, 1};
+    spa_fraction maxRate{MAX_STREAM_FPS, 1};
+
+    // Shared memory first, as it is always CPU-readable. The second variant takes
+    // linear DMA-BUFs from producers that only export GPU buffers; a mandatory
+    // modifier is what marks a format as DMA-BUF.
+    for (int i = 0; i < 2; i++) {
+        spa_pod_frame frame;
+        spa_pod_builder_push_object(&builder, &frame, SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
+        spa_pod_builder_add(&builder,
+            SPA_FORMAT_mediaType, SPA_POD_Id(SPA_MEDIA_TYPE_video),
+            SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+            SPA_FORMAT_VIDEO_format, SPA_POD_CHOICE_ENUM_Id(6, SPA_VIDEO_FORMAT_BGRx, SPA_VIDEO_FORMAT_BGRx,
+                                                           SPA_VIDEO_FORMAT_BGRA, SPA_VIDEO_FORMAT_RGBx,
+                                                           SPA_VIDEO_FORMAT_RGBA, SPA_VIDEO_FORMAT_xBGR),
+            SPA_FORMAT_VIDEO_size, SPA_POD_CHOICE_RANGE_Rectangle(&defaultSize, &minSize, &maxSize),
+            // Screencasts are variable rate (0/1) and cap it with maxFramerate; test sources have a fixed rate
+            SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(&defaultRate, &minRate, &maxRate),
+            SPA_FORMAT_VIDEO_maxFramerate, SPA_POD_CHOICE_RANGE_Fraction(&defaultRate, &lowestMaxRate, &defaultRate),
+            0);
+        if (i == 1) {
+            spa_pod_builder_prop(&builder, SPA_FORMAT_VIDEO_modifier, SPA_POD_PROP_FLAG_MANDATORY);
+            spa_pod_builder_long(&builder, static_cast<int64_t>(DRM_MODIFIER_LINEAR));
+        }
+        params[i] = static_cast<const spa_pod*>(spa_pod_builder_pop(&builder, &frame));
+    }
+    return 2;
+}
+
+void PipeWireCapturer::Start(FrameCallback callback) {
+    if (m_running || !m_loop) {
+        return;
+    }
+
+    m_callback = callback;
+    m_scheduler.Reset(std::chrono::steady_clock::now());
+    m_running = true;
+    m_frameThread = std::thread(&PipeWireCapturer::FrameLoop, this);
+}
+
+void PipeWireCapturer::Stop() {
+    if (!m_running || !m_loop) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_frameMutex);
+        m_running = false;
+    }
+    m_frameCondition.notify_all();
+
+    // The loop lock is never held across the callback, and removing the buffers waits
+    // at most for the conversion in flight, so a slow callback cannot hold this up
+    pw_thread_loop_lock(m_loop);
+    pw_buffer* pending = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_frameMutex);
+        pending = m_pendingBuffer;
+        m_pendingBuffer = nullptr;
+    }
+    if (pending) {
+        pw_stream_queue_buffer(m_stream, pending);
+    }
+    pw_stream_disconnect(m_stream);
+    pw_thread_loop_unlock(m_loop);
+
+    // Only the callback already running is waited for; it must not outlive the capturer
+    if (m_frameThread.joinable()) {
+        m_frameThread.join();
+    }
+
+    std::cerr << "SnackaCaptureLinux: PipeWire capture stopped (frames: " << m_frameCount
+              << ", received: " << m_receivedCount << ", converted: " << m_convertedCount << ")\n";
+}
+
+void PipeWireCapturer::Cleanup() {
+    // The loop thread must be gone before the objects its callbacks use
+    if (m_loop) {
+        pw_thread_loop_stop(m_loop);
+    }
+    if (m_stream) {
+        // Removes the buffers, and with them our DMA-BUF mappings
+        pw_stream_destroy(m_stream);
+        m_stream = nullptr;
+    }
+    if (m_returnEvent) {
+        pw_loop_destroy_source(pw_thread_loop_get_loop(m_loop), m_returnEvent);
+        m_returnEvent = nullptr;
+    }
+    if (m_core) {
+        spa_hook_remove(&m_coreListener);
+        pw_core_disconnect(m_core);
+        m_core = nullptr;
+    }
+    if (m_context) {
+        pw_context_destroy(m_context);
+        m_context = nullptr;
+    }
+    if (m_loop) {
+        pw_thread_loop_destroy(m_loop);
+        m_loop = nullptr;
+    }
+    if (m_pipeWireInitialized) {
+        pw_deinit();
+        m_pipeWireInitialized = false;
+    }
+}
+
+void PipeWireCapturer::OnCoreError(void* data, uint32_t id, int seq, int res, const char* message) {
+    auto* self = static_cast<PipeWireCapturer*>(data);
+    (void)seq;
+    std::cerr << "SnackaCaptureLinux: PipeWire error on object " << id << ": " << (message ? message : "")
+              << " (" << strerror(-res) << ")\n";
+
+    // Errors on the core mean the connection itself is gone
+    if (id == PW_ID_CORE) {
+        self->m_streamEnded = true;
+        pw_thread_loop_signal(self->m_loop, false);
+    }
+}
+
+void PipeWireCapturer::OnStreamStateChanged(void* data, pw_stream_state old, pw_stream_state state, const char* error) {
+    auto* self = static_cast<PipeWireCapturer*>(data);
+    std::cerr << "SnackaCaptureLinux: PipeWire stream " << pw_stream_state_as_string(old) << " -> "
+              << pw_stream_state_as_string(state) << (error ? std::string(": ") + error : "") << "\n";
+
+    // Unconnected after having been linked: the producer went away or sharing was stopped
+    if (state == PW_STREAM_STATE_ERROR || (state == PW_STREAM_STATE_UNCONNECTED && old != PW_STREAM_STATE_UNCONNECTED)) {
+        self->m_streamEnded = true;
+        pw_thread_loop_signal(self->m_loop, false);
+    }
+}
+
+void PipeWireCapturer::OnStreamParamChanged(void* data, uint32_t id, const spa_pod* param) {
+    if (param && id == SPA_PARAM_Format) {
+        static_cast<PipeWireCapturer*>(data)->ApplyFormat(param);
+    }
+}
+
+void PipeWireCapturer::ApplyFormat(const spa_pod* param) {
+    uint32_t mediaType = 0;
+    uint32_t mediaSubtype = 0;
+    if (spa_format_parse(param, &mediaType, &mediaSubtype) < 0 || mediaType != SPA_MEDIA_TYPE_video ||
+        mediaSubtype != SPA_MEDIA_SUBTYPE_raw) {
+        return;
+    }
+
+    spa_video_info_raw info = {};
+    if (spa_format_video_raw_parse(param, &info) < 0) {
+        return;
+    }
+
+    PixelLayout layout = PixelLayout::BGRX;
+    if (!GetPixelLayout(info.format, layout) || info.size.width == 0 || info.size.height == 0) {
+        std::cerr << "SnackaCaptureLinux: PipeWire stream format " << GetVideoFormatName(info.format) << " "
+                  << info.size.width << "x" << info.size.height << " not supported\n";
+        return;
+    }
+
+    m_dmaBuf = spa_pod_find_prop(param, nullptr, SPA_FORMAT_VIDEO_modifier) != nullptr;
+    {
+        // The frame thread reconfigures its converter before the next frame
+        std::lock_guard<std::mutex> lock(m_frameMutex);
+        m_sourceWidth = static_cast<int>(info.size.width);
+        m_sourceHeight = static_cast<int>(info.size.height);
+        m_sourceLayout = layout;
+        m_formatChanged = true;
+        m_pendingFullDamage = true;
+        m_pendingDamage.clear();
+    }
+
+    uint8_t podBuffer[1024];
+    spa_pod_builder builder;
+    spa_pod_builder_init(&builder, podBuffer, sizeof(podBuffer));
+    int dataTypes = m_dmaBuf ? (1 << SPA_DATA_DmaBuf) : (1 << SPA_DATA_MemFd) | (1 << SPA_DATA_MemPtr);
+    const spa_pod* params[3];
+    params[0] = static_cast<const spa_pod*>(spa_pod_builder_add_object(&builder,
+        SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+        SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(STREAM_BUFFERS, 2, 16),
+        SPA_PARAM_BUFFERS_dataType, SPA_POD_CHOICE_FLAGS_Int(dataTypes)));
+    params[1] = static_cast<const spa_pod*>(spa_pod_builder_add_object(&builder,
+        SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+        SPA_PARAM_META_type, SPA_POD_Id(SPA_META_Header),
+        SPA_PARAM_META_size, SPA_POD_Int(sizeof(spa_meta_header))));
+    params[2] = static_cast<const spa_pod*>(spa_pod_builder_add_object(&builder,
+        SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+        SPA_PARAM_META_type, SPA_POD_Id(SPA_META_VideoDamage),
+        SPA_PARAM_META_size, SPA_POD_CHOICE_RANGE_Int(sizeof(spa_meta_region) * MAX_DAMAGE_REGIONS,
+                                                      sizeof(spa_meta_region),
+                                                      sizeof(spa_meta_region) * MAX_DAMAGE_REGIONS)));
+    pw_stream_update_params(m_stream, params, 3);
+
+    std::cerr << "SnackaCaptureLinux: PipeWire stream format " << GetVideoFormatName(info.format) << " "
+              << m_sourceWidth << "x" << m_sourceHeight << " in " << (m_dmaBuf ? "DMA-BUF" : "shared memory")
+              << " buffers\n";
+
+    m_formatReady = true;
+    pw_thread_loop_signal(m_loop, false);
+}
+
+void PipeWireCapturer::OnStreamAddBuffer(void* data, pw_buffer* buffer) {
+    (void)data;
+    spa_data& plane = buffer->buffer->datas[0];
+    if (plane.type != SPA_DATA_DmaBuf || plane.data) {
+        return;
+    }
+
+    // Mapped once per buffer, not per frame: the pool is reused for the whole stream
+    size_t size = static_cast<size_t>(plane.maxsize) + plane.mapoffset;
+    void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, static_cast<int>(plane.fd), 0);
+    if (address == MAP_FAILED) {
+        std::cerr << "SnackaCaptureLinux: Failed to map PipeWire DMA-BUF: " << strerror(errno) << "\n";
+        return;
+    }
+    buffer->user_data = new DmaBufMapping{address, size};
+}
+
+void PipeWireCapturer::OnStreamRemoveBuffer(void* data, pw_buffer* buffer) {
+    auto* self = static_cast<PipeWireCapturer*>(data);
+    {
+        // The frame thread may be reading it. It returns buffers before calling back, so
+        // this waits for one conversion at most.
+        std::unique_lock<std::mutex> lock(self->m_frameMutex);
+        self->m_frameCondition.wait(lock, [&] { return self->m_convertingBuffer != buffer; });
+        if (buffer == self->m_pendingBuffer) {
+            // Its damage is lost with it
+            self->m_pendingBuffer = nullptr;
+            self->m_pendingFullDamage = true;
+            self->m_pendingDamage.clear();
+        }
+        auto& returned = self->m_returnedBuffers;
+        returned.erase(std::remove(returned.begin(), returned.end(), buffer), returned.end());
+    }
+
+    auto* mapping = static_cast<DmaBufMapping*>(buffer->user_data);
+    if (mapping) {
+        munmap(mapping->address, mapping->size);
+        delete mapping;
+        buffer->user_data = nullptr;
+    }
+}
+
+void PipeWireCapturer::OnStreamProcess(void* data) {
+    static_cast<PipeWireCapturer*>(data)->ProcessBuffers();
+}
+
+void PipeWireCapturer::OnBuffersReturned(void* data, uint64_t count) {
+    auto* self = static_cast<PipeWireCapturer*>(data);
+    (void)count;
+    {
+        std::lock_guard<std::mutex> lock(self->m_frameMutex);
+        self->m_requeueBuffers.swap(self->m_returnedBuffers);
+    }
+    for (pw_buffer* buffer : self->m_requeueBuffers) {
+        pw_stream_queue_buffer(self->m_stream, buffer);
+    }
+    self->m_requeueBuffers.clear();
+}
+
+bool PipeWireCapturer::IsFrameUsable(const pw_buffer* buffer) const {
+    const spa_buffer* frame = buffer->buffer;
+    if (frame->n_datas < 1 || !frame->datas[0].chunk) {
+        return false;
+    }
+
+    // Screencasts send empty buffers when only the pointer moved; DMA-BUF chunks may leave the size unset
+    const spa_chunk* chunk = frame->datas[0].chunk;
+    if ((chunk->size == 0 && frame->datas[0].type != SPA_DATA_DmaBuf) || (chunk->flags & SPA_CHUNK_FLAG_CORRUPTED)) {
+        return false;
+    }
+
+    auto* header = static_cast<const spa_meta_header*>(
+        spa_buffer_find_meta_data(frame, SPA_META_Header, sizeof(spa_meta_header)));
+    return !header || (header->flags & SPA_META_HEADER_FLAG_CORRUPTED) == 0;
+}
+
+void PipeWireCapturer::AccumulateDamage(const spa_buffer* buffer) {
+    if (m_pendingFullDamage) {
+        return;
+    }
+    spa_meta* damage = spa_buffer_find_meta(buffer, SPA_META_VideoDamage);
+    if (!damage) {
+        m_pendingFullDamage = true;
+        return;
+    }
+
+    size_t listed = m_pendingDamage.size();
+    spa_meta_region* region = nullptr;
+    spa_meta_for_each(region, damage) {
+        if (!spa_meta_region_is_valid(region)) {
+            break;
+        }
+        m_pendingDamage.push_back(FrameRect{region->region.position.x, region->region.position.y,
+                                            static_cast<int>(region->region.size.width),
+                                            static_cast<int>(region->region.size.height)});
+    }
+
+    // A frame with no regions listed says nothing about what changed
+    if (m_pendingDamage.size() == listed || m_pendingDamage.size() > MAX_PENDING_DAMAGE) {
+        m_pendingFullDamage = true;
+        m_pendingDamage.clear();
+    }
+}
+
+void PipeWireCapturer::ProcessBuffers() {
+    // Keep only the newest frame for the frame thread; the ones it replaces go straight
+    // back to the producer but still count for their damage
+    bool received = false;
+    pw_buffer* buffer = nullptr;
+    while ((buffer = pw_stream_dequeue_buffer(m_stream)) != nullptr) {
+        if (!m_formatReady || !IsFrameUsable(buffer)) {
+            pw_stream_queue_buffer(m_stream, buffer);
+            continue;
+        }
+        pw_buffer* replaced = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_frameMutex);
+            AccumulateDamage(buffer->buffer);
+            replaced = m_pendingBuffer;
+            m_pendingBuffer = buffer;
+        }
+        if (replaced) {
+            pw_stream_queue_buffer(m_stream, replaced);
+        }
+        m_receivedCount++;
+        received = true;
+    }
+
+    if (received) {
+        m_frameCondition.notify_all();
+    }
+}
+
+void PipeWireCapturer::FrameLoop() {
+    std::unique_lock<std::mutex> lock(m_frameMutex);
+    while (m_running) {
+        // A frame more than a quarter interval early waits for its deadline (newer ones
+        // replace it); a deadline without a new frame repeats the last one
+        auto now = std::chrono::steady_clock::now();
+        bool due = (m_pendingBuffer || now >= m_scheduler.GetDeadline()) && m_scheduler.Admit(m_interval, now);
+        if (!due) {
+            m_frameCondition.wait_until(lock, m_scheduler.GetDeadline());
+            continue;
+        }
+
+        pw_buffer* buffer = m_pendingBuffer;
+        m_pendingBuffer = nullptr;
+        m_convertingBuffer = buffer;
+        bool formatChanged = m_formatChanged;
+        m_formatChanged = false;
+        int sourceWidth = m_sourceWidth;
+        int sourceHeight = m_sourceHeight;
+        PixelLayout layout = m_sourceLayout;
+        bool fullDamage = m_pendingFullDamage;
+        m_pendingFullDamage = false;
+        m_damageRects.swap(m_pendingDamage);
+        m_pendingDamage.clear();
+        lock.unlock();
+
+        if (formatChanged) {
+            // Output size is fixed; only the scaling from the stream changes
+            m_converter.SetPixelLayout(layout);
+            m_converter.Configure(sourceWidth, sourceHeight, m_width, m_height, m_stripeCount);
+            m_sourceTiles.Configure(sourceWidth, sourceHeight);
+            m_convertWidth = sourceWidth;
+            m_convertHeight = sourceHeight;
+            std::cerr << "SnackaCaptureLinux: PipeWire conversion from " << sourceWidth << "x" << sourceHeight
+                      << " (scaling: " << m_converter.GetScaleDescription() << ")\n";
+        }
+        if (fullDamage) {
+            m_sourceTiles.MarkAll();
+        } else {
+            for (const auto& rect : m_damageRects) {
+                m_sourceTiles.MarkRect(rect);
+            }
+        }
+
+        EmitFrame(buffer);
+        lock.lock();
+    }
+}
+
+void PipeWireCapturer::EmitFrame(pw_buffer* buffer) {
+    m_frameInfo.fullFrame = false;
+    m_frameInfo.dirtyRects.clear();
+
+    if (buffer) {
+        uint64_t received = m_receivedCount;
+        if (ConvertBuffer(buffer)) {
+            m_convertedCount++;
+        } else if (received - m_convertedCount <= 5 || (received - m_convertedCount) % 100 == 0) {
+            std::cerr << "SnackaCaptureLinux: PipeWire frame could not be read ("
+                      << received - m_convertedCount << " of " << received << ")\n";
+        }
+        ReturnBuffer(buffer);
+    }
+
+    // Invoke callback with NV12 data
+    if (m_callback) {
+        m_callback(m_nv12Buffer.data(), m_nv12Buffer.size(), GetTimestampMs(), m_frameInfo);
+    }
+
+    if (++m_frameCount % 300 == 0) {
+        std::cerr << "SnackaCaptureLinux: PipeWire pacing: " << m_scheduler.DescribeStats(true)
+                  << " (received " << m_receivedCount << ", converted " << m_convertedCount << ")\n";
+    }
+}
+
+bool PipeWireCapturer::ConvertBuffer(pw_buffer* buffer) {
+    const spa_data& plane = buffer->buffer->datas[0];
+    const uint8_t* base = static_cast<const uint8_t*>(plane.data);
+    int dmaBufFd = -1;
+    if (!base) {
+        auto* mapping = static_cast<const DmaBufMapping*>(buffer->user_data);
+        if (!mapping) {
+            return false;
+        }
+        base = static_cast<const uint8_t*>(mapping->address) + plane.mapoffset;
+        dmaBufFd = static_cast<int>(plane.fd);
+    }
+
+    // Bounds come from the buffer, not the format: a producer mid-resize may send either size
+    const int srcBytesPerPixel = 4;
+    int srcStride = plane.chunk->stride > 0 ? plane.chunk->stride : m_convertWidth * srcBytesPerPixel;
+    size_t needed = static_cast<size_t>(plane.chunk->offset) + static_cast<size_t>(srcStride) * (m_convertHeight - 1) +
+                    static_cast<size_t>(m_convertWidth) * srcBytesPerPixel;
+    if (m_convertWidth == 0 || srcStride < m_convertWidth * srcBytesPerPixel || needed > plane.maxsize) {
+        return false;
+    }
+    const uint8_t* pixels = base + plane.chunk->offset;
+
+    // CPU reads of a DMA-BUF must be bracketed so caches are coherent with the GPU's writes
+    if (dmaBufFd >= 0) {
+        dma_buf_sync sync = {DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ};
+        ioctl(dmaBufFd, DMA_BUF_IOCTL_SYNC, &sync);
+    }
+
+    int dirtyTiles = m_sourceTiles.GetDirtyCount();
+    if (dirtyTiles > FULL_CONVERT_THRESHOLD * m_sourceTiles.GetColumns() * m_sourceTiles.GetRows()) {
+        m_workerPool->Run(m_converter.GetStripeCount(), [&](int stripe) {
+            m_converter.ConvertStripe(stripe, pixels, srcStride, srcBytesPerPixel, m_nv12Buffer.data());
+        });
+        m_frameInfo.fullFrame = true;
+        m_frameInfo.dirtyRects.assign(1, FrameRect{0, 0, m_width, m_height});
+    } else if (dirtyTiles > 0) {
+        m_sourceTiles.CollectRects(m_convertRects);
+        m_outputTiles.Clear();
+        for (const auto& rect : m_convertRects) {
+            m_outputTiles.MarkRect(m_converter.MapSourceRect(rect));
+        }
+        m_outputTiles.CollectRects(m_frameInfo.dirtyRects);
+
+        // Rectangles are tile-aligned and disjoint, so workers never write the same bytes
+        const auto& rects = m_frameInfo.dirtyRects;
+        int tasks = std::min(m_converter.GetStripeCount(), static_cast<int>(rects.size()));
+        m_workerPool->Run(tasks, [&](int task) {
+            for (size_t i = task; i < rects.size(); i += tasks) {
+                m_converter.ConvertRect(task, pixels, srcStride, srcBytesPerPixel, m_nv12Buffer.data(), rects[i]);
+            }
+        });
+    }
+
+    if (dmaBufFd >= 0) {
+        dma_buf_sync sync = {DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ};
+        ioctl(dmaBufFd, DMA_BUF_IOCTL_SYNC, &sync);
+    }
+
+    m_sourceTiles.Clear();
+    return true;
+}
+
+void PipeWireCapturer::ReturnBuffer(pw_buffer* buffer) {
+    // The loop thread queues it back, as the stream is only used there
+    {
+        std::lock_guard<std::mutex> lock(m_frameMutex);
+        m_convertingBuffer = nullptr;
+        m_returnedBuffers.push_back(buffer);
+    }
+    m_frameCondition.notify_all();
+    pw_loop_signal_event(pw_thread_loop_get_loop(m_loop), m_returnEvent);
+}
+
+uint64_t PipeWireCapturer::GetTimestampMs() const {
+    auto now = std::chrono::steady_clock::now();
+    auto duration = now.time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+}  // namespace snacka
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "ColorConverter.h"
+#include "FrameBufferPool.h"
+#include "FrameInfo.h"
+#include "FrameScheduler.h"
+#include "TileMap.h"
+#include "WorkerPool.h"
+#include "X11Capturer.h"
+
+#include <pipewire/pipewire.h>
+#include <spa/param/video/format-utils.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace snacka {
+
+/// Screen capture from a PipeWire video stream, for Wayland sessions where XShm only
+/// sees XWayland windows. Consumes a pw_stream node: the screencast stream handed out
+/// by the portal (see ScreenCastPortal) or any Video/Source on the local daemon.
+/// Buffers are shared memory (memfd) or, when the producer only offers that,
+/// linear DMA-BUFs mapped for reading. Frames go through the same NV12 conversion as
+/// X11 capture; the producer's damage regions limit it to what changed.
+///
+/// Producers deliver frames only when the content changes. Frames are paced on the
+/// FrameScheduler grid: a frame arriving early waits for its deadline (newer ones
+/// replace it), and a deadline without a new frame repeats the last one, unchanged.
+/// The PipeWire loop thread only dequeues buffers and keeps the newest; conversion and
+/// the callback run on a frame thread, which hands each buffer back to the loop once
+/// it is converted, so a slow callback never holds up the stream or its buffers.
+class PipeWireCapturer {
+public:
+    PipeWireCapturer();
+    ~PipeWireCapturer();
+
+    PipeWireCapturer(const PipeWireCapturer&) = delete;
+    PipeWireCapturer& operator=(const PipeWireCapturer&) = delete;
+
+    /// Set the number of color conversion threads (call before Initialize)
+    /// @param threads Thread count including the frame thread, 0 = pick from output size
+    void SetConvertThreads(int threads) { m_convertThreads = threads; }
+
+    /// Set the filter used when the output is smaller/larger than the stream (call before Initialize)
+    void SetScaleFilter(ScaleFilter filter) { m_converter.SetScaleFilter(filter); }
+
+    /// Set the output color matrix and range (call before Initialize, default BT.601 limited)
+    void SetColorSpace(const ColorSpace& space) { m_converter.SetColorSpace(space); }
+
+    /// Initialize the capturer and wait for the stream format to be negotiated
+    /// @param remoteFd PipeWire remote opened by the portal (taken over), or -1 for the local daemon
+    /// @param target Node to capture: the portal's node id, or a node id, name or serial on the local daemon
+    /// @param width Output width (the stream is scaled to fill it)
+    /// @param height Output height
+    /// @param fps Target frames per second
+    /// @return true if the stream connected and agreed on a format
+    bool Initialize(int remoteFd, const std::string& target, int width, int height, int fps);
+
+    /// Start capturing
+    /// @param callback Callback to receive captured frames, called on the frame thread
+    void Start(FrameCallback callback);
+
+    /// Stop capturing
+    void Stop();
+
+    /// Check if capturing is running (false once the stream ends, e.g. sharing was stopped)
+    bool IsRunning() const { return m_running && !m_streamEnded; }
+
+private:
+    static void OnCoreError(void* data, uint32_t id, int seq, int res, const char* message);
+    static void OnStreamStateChanged(void* data, pw_stream_state old, pw_stream_state state, const char* error);
+    static void OnStreamParamChanged(void* data, uint32_t id, const spa_pod* param);
+    static void OnStreamAddBuffer(void* data, pw_buffer* buffer);
+    static void OnStreamRemoveBuffer(void* data, pw_buffer* buffer);
+    static void OnStreamProcess(void* data);
+    static void OnBuffersReturned(void* data, uint64_t count);
+
+    int BuildFormats(spa_pod_builder& builder, const spa_pod** params);
+    void ApplyFormat(const spa_pod* param);
+    bool IsFrameUsable(const pw_buffer* buffer) const;
+    void AccumulateDamage(const spa_buffer* buffer);
+    void ProcessBuffers();
+    void FrameLoop();
+    void EmitFrame(pw_buffer* buffer);
+    bool ConvertBuffer(pw_buffer* buffer);
+    void ReturnBuffer(pw_buffer* buffer);
+    void Cleanup();
+    uint64_t GetTimestampMs() const;
+
+    // PipeWire objects; the stream and its callbacks live on the thread loop
+    bool m_pipeWireInitialized = false;
+    pw_thread_loop* m_loop = nullptr;
+    pw_context* m_context = nullptr;
+    pw_core* m_core = nullptr;
+    pw_stream* m_stream = nullptr;
+    spa_source* m_returnEvent = nullptr;
+    spa_hook m_coreListener = {};
+    spa_hook m_streamListener = {};
+    pw_core_events m_coreEvents = {};
+    pw_stream_events m_streamEvents = {};
+
+    // Negotiated stream format; the size and layout are also read by the frame thread
+    bool m_formatReady = false;
+    bool m_dmaBuf = false;
+    int m_sourceWidth = 0;
+    int m_sourceHeight = 0;
+    PixelLayout m_sourceLayout = PixelLayout::BGRX;
+
+    // Configuration
+    int m_width = 0;
+    int m_height = 0;
+    int m_fps = 30;
+    std::chrono::microseconds m_interval{33333};
+
+    // Thread control
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_streamEnded{false};
+    std::thread m_frameThread;
+
+    // Callback
+    FrameCallback m_callback;
+
+    // Hand-over between the loop and frame threads, guarded by m_frameMutex. The newest
+    // frame waits in m_pendingBuffer (older ones are returned as soon as it arrives) with
+    // the damage of every frame since the last hand-over; converted buffers wait in
+    // m_returnedBuffers for the loop thread to queue them back to the stream.
+    std::mutex m_frameMutex;
+    std::condition_variable m_frameCondition;
+    pw_buffer* m_pendingBuffer = nullptr;
+    pw_buffer* m_convertingBuffer = nullptr;
+    std::vector<pw_buffer*> m_returnedBuffers;
+    std::vector<FrameRect> m_pendingDamage;
+    bool m_pendingFullDamage = true;
+    bool m_formatChanged = false;
+
+    // Buffers being queued back, owned by the loop thread
+    std::vector<pw_buffer*> m_requeueBuffers;
+
+    // Damage not yet converted, owned by the frame thread. Source tiles keep it until a
+    // conversion succeeds.
+    std::vector<FrameRect> m_damageRects;
+    TileMap m_sourceTiles;
+    TileMap m_outputTiles;
+    std::vector<FrameRect> m_convertRects;
+    int m_convertWidth = 0;
+    int m_convertHeight = 0;
+
+    // Source pixels -> NV12 conversion, reconfigured when the stream size changes
+    ColorConverter m_converter;
+    int m_convertThreads = 0;
+    int m_stripeCount = 1;
+    std::unique_ptr<WorkerPool> m_workerPool;
+
+    // NV12 output buffer and what changed in it
+    FrameBuffer m_nv12Buffer;
+    FrameInfo m_frameInfo;
+
+    // Frame deadlines on a fixed grid, with pacing statistics
+    FrameScheduler m_scheduler;
+    uint64_t m_frameCount = 0;
+    std::atomic<uint64_t> m_receivedCount{0};
+    uint64_t m_convertedCount = 0;
+};
+
+}  // namespace snacka
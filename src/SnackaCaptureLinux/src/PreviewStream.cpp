@@ -0,0 +1,145 @@
+#include "PreviewStream.h"
+#include "Protocol.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+namespace snacka {
+
+namespace {
+
+// One preview being written while the next is scaled
+constexpr int PREVIEW_BUFFERS = 2;
+
+}  // namespace
+
+PreviewStream::~PreviewStream() {
+    Stop();
+}
+
+bool PreviewStream::Configure(int frameWidth, int frameHeight, int previewWidth, int previewHeight, int fps) {
+    if (fps <= 0 || !m_pyramid.Configure(frameWidth, frameHeight, {FrameSize{previewWidth, previewHeight}})) {
+        return false;
+    }
+
+    m_previewWidth = previewWidth;
+    m_previewHeight = previewHeight;
+    m_intervalMs = 1000 / static_cast<uint64_t>(fps);
+    m_nextTimestamp = 0;
+    m_pendingTiles.Configure(frameWidth, frameHeight);
+    m_pendingTiles.MarkAll();
+
+    size_t packetSize = sizeof(PreviewPacketHeader) + CalculateNV12FrameSize(previewWidth, previewHeight);
+    m_packets.clear();
+    for (int i = 0; i < PREVIEW_BUFFERS; i++) {
+        m_packets.push_back(FrameBufferPool::Shared().Acquire(packetSize));
+    }
+    return true;
+}
+
+void PreviewStream::Start(PreviewPacketWriter writer) {
+    if (m_running || m_packets.empty()) {
+        return;
+    }
+
+    m_writer = std::move(writer);
+    m_freePackets = std::make_unique<BoundedQueue<int>>(m_packets.size());
+    m_readyPackets = std::make_unique<BoundedQueue<int>>(m_packets.size());
+    for (size_t i = 0; i < m_packets.size(); i++) {
+        m_freePackets->Push(static_cast<int>(i));
+    }
+
+    m_running = true;
+    m_writeThread = std::thread(&PreviewStream::WriteLoop, this);
+}
+
+void PreviewStream::Stop() {
+    if (!m_running) {
+        return;
+    }
+
+    m_running = false;
+    m_readyPackets->Close();
+    m_freePackets->Close();
+    if (m_writeThread.joinable()) {
+        m_writeThread.join();
+    }
+
+    std::cerr << "SnackaCaptureLinux: Preview stopped (previews: " << m_written.load() << ")\n";
+}
+
+void PreviewStream::OfferFrame(const uint8_t* nv12, uint64_t timestamp, const FrameInfo& info) {
+    if (!m_running) {
+        return;
+    }
+
+    if (info.fullFrame) {
+        m_pendingTiles.MarkAll();
+    } else {
+        for (const auto& rect : info.dirtyRects) {
+            m_pendingTiles.MarkRect(rect);
+        }
+    }
+    if (timestamp < m_nextTimestamp) {
+        return;
+    }
+
+    int packet = 0;
+    if (!m_freePackets->TryPop(packet)) {
+        // The writer is still busy with earlier previews: this one is not worth a wait
+        m_skipped++;
+        m_nextTimestamp = timestamp + m_intervalMs;
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    m_pendingInfo.fullFrame = false;
+    m_pendingTiles.CollectRects(m_pendingInfo.dirtyRects);
+    m_pendingTiles.Clear();
+    m_pyramid.Update(nv12, m_pendingInfo);
+
+    const auto& pixels = m_pyramid.GetLayerData(0);
+    PreviewPacketHeader header(static_cast<uint16_t>(m_previewWidth), static_cast<uint16_t>(m_previewHeight),
+                               PreviewFormat::NV12, timestamp, static_cast<uint32_t>(pixels.size()));
+    uint8_t* data = m_packets[packet].data();
+    std::memcpy(data, &header, sizeof(header));
+    std::memcpy(data + sizeof(header), pixels.data(), pixels.size());
+    m_scaleMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Keep the cadence from the schedule rather than from frame arrival, without a
+    // burst of catch-up previews after a stall
+    uint64_t due = m_nextTimestamp == 0 ? timestamp : m_nextTimestamp;
+    m_nextTimestamp = std::max(due + m_intervalMs, timestamp + m_intervalMs / 2);
+    m_readyPackets->Push(packet);
+
+    m_sent++;
+    if (m_sent <= 5 || m_sent % 100 == 0) {
+        ReportStats();
+    }
+}
+
+void PreviewStream::ReportStats() {
+    auto flags = std::cerr.flags();
+    auto precision = std::cerr.precision();
+    std::cerr << "SnackaCaptureLinux: Preview " << m_sent << " (" << m_previewWidth << "x" << m_previewHeight
+              << " NV12, " << std::fixed << std::setprecision(2) << m_scaleMs / m_sent << " ms to scale, "
+              << m_skipped << " skipped while writing)\n";
+    std::cerr.flags(flags);
+    std::cerr.precision(precision);
+}
+
+void PreviewStream::WriteLoop() {
+    int packet = 0;
+    while (m_readyPackets->Pop(packet)) {
+        if (m_writer) {
+            m_writer(m_packets[packet].data(), m_packets[packet].size());
+        }
+        m_written++;
+        m_freePackets->Push(packet);
+    }
+}
+
+}  // namespace snacka
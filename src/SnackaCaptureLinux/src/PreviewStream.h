@@ -0,0 +1,85 @@
+#pragma once
+
+#include "BoundedQueue.h"
+#include "FrameBufferPool.h"
+#include "FrameInfo.h"
+#include "FramePyramid.h"
+#include "TileMap.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace snacka {
+
+/// Writes a finished packet (header and pixels) somewhere; called on the preview thread
+using PreviewPacketWriter = std::function<void(const uint8_t* data, size_t size)>;
+
+/// Low-rate thumbnail of the video output as PREV packets.
+/// OfferFrame runs on the frame thread. Between previews it only collects the
+/// frames' dirty regions; a due frame rescales just those into the thumbnail, which
+/// is copied into a free packet buffer. A thread of its own writes the packets, so a
+/// slow stderr reader costs skipped previews, never a late video frame.
+class PreviewStream {
+public:
+    PreviewStream() = default;
+    ~PreviewStream();
+
+    PreviewStream(const PreviewStream&) = delete;
+    PreviewStream& operator=(const PreviewStream&) = delete;
+
+    /// Set the sizes and rate
+    /// @param frameWidth Width of the NV12 frames that will be offered
+    /// @param frameHeight Height of the NV12 frames
+    /// @param previewWidth Preview width (even, no larger than the frame)
+    /// @param previewHeight Preview height (even, no larger than the frame)
+    /// @param fps Previews per second
+    /// @return false if a size is invalid
+    bool Configure(int frameWidth, int frameHeight, int previewWidth, int previewHeight, int fps);
+
+    /// Start the writer thread
+    void Start(PreviewPacketWriter writer);
+
+    /// Stop the writer thread, dropping previews not yet written
+    void Stop();
+
+    /// Note a frame's changes and, if a preview is due and a buffer is free, scale it
+    /// @param nv12 Frame of CalculateNV12FrameSize(frameWidth, frameHeight) bytes
+    /// @param timestamp Frame timestamp in milliseconds
+    /// @param info Regions that changed since the previous offered frame
+    void OfferFrame(const uint8_t* nv12, uint64_t timestamp, const FrameInfo& info);
+
+private:
+    void WriteLoop();
+    void ReportStats();
+
+    int m_previewWidth = 0;
+    int m_previewHeight = 0;
+    uint64_t m_intervalMs = 1000;
+    uint64_t m_nextTimestamp = 0;
+
+    // Thumbnail as a one-layer pyramid, and the frame tiles changed since it was last scaled
+    FramePyramid m_pyramid;
+    TileMap m_pendingTiles;
+    FrameInfo m_pendingInfo;
+
+    // Packet buffers (header then NV12 pixels) cycling between OfferFrame and the writer
+    std::vector<FrameBuffer> m_packets;
+    std::unique_ptr<BoundedQueue<int>> m_freePackets;
+    std::unique_ptr<BoundedQueue<int>> m_readyPackets;
+
+    PreviewPacketWriter m_writer;
+    std::thread m_writeThread;
+    bool m_running = false;
+
+    // Frame thread statistics
+    int m_sent = 0;
+    int m_skipped = 0;
+    double m_scaleMs = 0.0;
+    std::atomic<uint64_t> m_written{0};
+};
+
+}  // namespace snacka
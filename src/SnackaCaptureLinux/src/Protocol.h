@@ -88,6 +88,105 @@ struct PreviewPacketHeader {
 
 static_assert(sizeof(PreviewPacketHeader) == 21, "PreviewPacketHeader must be 21 bytes");
 
+// Repeat frame marker for stderr unified protocol, sent instead of an unchanged video frame
+// Format: [magic: 4] [timestamp: 8]
+// All multi-byte fields are big-endian
+#pragma pack(push, 1)
+struct RepeatFramePacketHeader {
+    uint32_t magic;      // 0x52455054 "REPT" big-endian
+    uint64_t timestamp;  // Milliseconds (big-endian)
+
+    static constexpr uint32_t MAGIC = 0x52455054;  // "REPT" in big-endian
+
+    RepeatFramePacketHeader() = default;
+    explicit RepeatFramePacketHeader(uint64_t ts)
+        : magic(htonl(MAGIC))
+        , timestamp(ToBigEndian64(ts)) {}
+};
+#pragma pack(pop)
+
+static_assert(sizeof(RepeatFramePacketHeader) == 12, "RepeatFramePacketHeader must be 12 bytes");
+
+// Pointer position for stderr unified protocol (--cursor metadata), sent when it moves
+// Format: [magic: 4] [timestamp: 8] [x: 4] [y: 4] [visible: 1]
+// Position is the hotspot in output pixels (may lie outside the frame); all multi-byte fields are big-endian
+#pragma pack(push, 1)
+struct CursorPositionPacketHeader {
+    uint32_t magic;      // 0x43555250 "CURP" big-endian
+    uint64_t timestamp;  // Milliseconds (big-endian)
+    int32_t  x;          // Hotspot x (big-endian)
+    int32_t  y;          // Hotspot y (big-endian)
+    uint8_t  visible;    // 0 when the pointer is on another screen
+
+    static constexpr uint32_t MAGIC = 0x43555250;  // "CURP" in big-endian
+
+    CursorPositionPacketHeader() = default;
+    CursorPositionPacketHeader(uint64_t ts, int32_t px, int32_t py, bool isVisible)
+        : magic(htonl(MAGIC))
+        , timestamp(ToBigEndian64(ts))
+        , x(static_cast<int32_t>(htonl(static_cast<uint32_t>(px))))
+        , y(static_cast<int32_t>(htonl(static_cast<uint32_t>(py))))
+        , visible(isVisible ? 1 : 0) {}
+};
+#pragma pack(pop)
+
+static_assert(sizeof(CursorPositionPacketHeader) == 21, "CursorPositionPacketHeader must be 21 bytes");
+
+// Pointer image for stderr unified protocol (--cursor metadata), sent when it changes
+// Format: [magic: 4] [length: 4] [serial: 4] [width: 2] [height: 2] [xhot: 2] [yhot: 2] [pixels...]
+// Pixels are B, G, R, A bytes with premultiplied alpha, scaled to the output; header fields are big-endian
+#pragma pack(push, 1)
+struct CursorImagePacketHeader {
+    uint32_t magic;   // 0x43555249 "CURI" big-endian
+    uint32_t length;  // Payload length after this field (big-endian)
+    uint32_t serial;  // Image identifier (big-endian)
+    uint16_t width;   // Image width (big-endian)
+    uint16_t height;  // Image height (big-endian)
+    uint16_t xhot;    // Hotspot offset from the left (big-endian)
+    uint16_t yhot;    // Hotspot offset from the top (big-endian)
+
+    static constexpr uint32_t MAGIC = 0x43555249;  // "CURI" in big-endian
+
+    CursorImagePacketHeader() = default;
+    CursorImagePacketHeader(uint32_t id, uint16_t w, uint16_t h, uint16_t hotX, uint16_t hotY)
+        : magic(htonl(MAGIC))
+        , length(htonl(4 + 2 + 2 + 2 + 2 + static_cast<uint32_t>(w) * h * 4))
+        , serial(htonl(id))
+        , width(htons(w))
+        , height(htons(h))
+        , xhot(htons(hotX))
+        , yhot(htons(hotY)) {}
+};
+#pragma pack(pop)
+
+static_assert(sizeof(CursorImagePacketHeader) == 20, "CursorImagePacketHeader must be 20 bytes");
+
+// Video colorimetry for stderr unified protocol, sent once before the first video frame
+// Format: [magic: 4] [primaries: 1] [transfer: 1] [matrix: 1] [fullRange: 1]
+// Values are ISO/IEC 23091-2 code points, as in the H.264 VUI colour description
+#pragma pack(push, 1)
+struct ColorInfoPacketHeader {
+    uint32_t magic;      // 0x434F4C52 "COLR" big-endian
+    uint8_t  primaries;  // 1 = BT.709, 6 = SMPTE 170M
+    uint8_t  transfer;   // 1 = BT.709, 6 = SMPTE 170M, 13 = sRGB
+    uint8_t  matrix;     // 1 = BT.709, 6 = SMPTE 170M (BT.601)
+    uint8_t  fullRange;  // 0 = limited (16..235), 1 = full (0..255)
+
+    static constexpr uint32_t MAGIC = 0x434F4C52;  // "COLR" in big-endian
+
+    ColorInfoPacketHeader() = default;
+    ColorInfoPacketHeader(uint8_t colourPrimaries, uint8_t transferCharacteristics, uint8_t matrixCoefficients,
+                          bool isFullRange)
+        : magic(htonl(MAGIC))
+        , primaries(colourPrimaries)
+        , transfer(transferCharacteristics)
+        , matrix(matrixCoefficients)
+        , fullRange(isFullRange ? 1 : 0) {}
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ColorInfoPacketHeader) == 8, "ColorInfoPacketHeader must be 8 bytes");
+
 // Log level values
 enum class LogLevel : uint8_t {
     Debug = 0,
@@ -133,6 +232,9 @@ struct CameraInfo {
     std::string id;          // Device path (e.g., /dev/video0)
     std::string name;        // Device name from V4L2
     int index;               // Index in device list
+    std::string format;      // Pixel format capture would use at the default 640x480, 15 fps (empty if none is usable)
+    std::string formatReason;  // Why that format was picked
+    std::vector<std::string> formats;  // Every pixel format the device lists
 };
 
 struct MicrophoneInfo {
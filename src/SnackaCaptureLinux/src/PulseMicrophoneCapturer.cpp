@@ -436,12 +436,10 @@ void PulseMicrophoneCapturer::ProcessAudio(const void* data, size_t length) {
 
     std::lock_guard<std::mutex> lock(m_callbackMutex);
     if (m_callback) {
-        if (m_noiseSuppressionEnabled) {
-            // Copy to vector for RNNoise processing
-            std::vector<int16_t> samples(inputSamples, inputSamples + sampleCount * 2);
-            ProcessWithRNNoise(samples);
-            if (!samples.empty()) {
-                m_callback(samples.data(), samples.size() / 2, timestamp);
+        if (m_noiseSuppressionEnabled && m_rnnoiseLeft && m_rnnoiseRight) {
+            ProcessWithRNNoise(inputSamples, sampleCount);
+            if (!m_processedSamples.empty()) {
+                m_callback(m_processedSamples.data(), m_processedSamples.size() / 2, timestamp);
             }
         } else {
             m_callback(inputSamples, sampleCount, timestamp);
@@ -449,54 +447,40 @@ void PulseMicrophoneCapturer::ProcessAudio(const void* data, size_t length) {
     }
 }
 
-void PulseMicrophoneCapturer::ProcessWithRNNoise(std::vector<int16_t>& samples) {
+void PulseMicrophoneCapturer::ProcessWithRNNoise(const int16_t* samples, size_t frameCount) {
+    m_processedSamples.clear();
     if (!m_rnnoiseLeft || !m_rnnoiseRight) return;
 
     // Convert stereo Int16 samples to separate float channels
-    size_t frameCount = samples.size() / 2;
-
     for (size_t i = 0; i < frameCount; i++) {
         // RNNoise expects float values in range -32768 to 32767
         m_leftBuffer.push_back(static_cast<float>(samples[i * 2]));
         m_rightBuffer.push_back(static_cast<float>(samples[i * 2 + 1]));
     }
 
-    // Process complete 480-sample frames and rebuild output
-    std::vector<int16_t> processedSamples;
-
-    while (m_leftBuffer.size() >= RNNOISE_FRAME_SIZE &&
-           m_rightBuffer.size() >= RNNOISE_FRAME_SIZE) {
-        // Process left channel
-        std::vector<float> leftFrame(m_leftBuffer.begin(),
-                                     m_leftBuffer.begin() + RNNOISE_FRAME_SIZE);
-        std::vector<float> processedLeft(RNNOISE_FRAME_SIZE);
-        rnnoise_process_frame(m_rnnoiseLeft, processedLeft.data(), leftFrame.data());
-
-        // Process right channel
-        std::vector<float> rightFrame(m_rightBuffer.begin(),
-                                      m_rightBuffer.begin() + RNNOISE_FRAME_SIZE);
-        std::vector<float> processedRight(RNNOISE_FRAME_SIZE);
-        rnnoise_process_frame(m_rnnoiseRight, processedRight.data(), rightFrame.data());
+    // Process complete 480-sample frames straight out of the channel buffers; every
+    // buffer here keeps its capacity, so a running stream does not allocate
+    size_t consumed = 0;
+    while (m_leftBuffer.size() - consumed >= RNNOISE_FRAME_SIZE &&
+           m_rightBuffer.size() - consumed >= RNNOISE_FRAME_SIZE) {
+        rnnoise_process_frame(m_rnnoiseLeft, m_processedLeft, m_leftBuffer.data() + consumed);
+        rnnoise_process_frame(m_rnnoiseRight, m_processedRight, m_rightBuffer.data() + consumed);
 
         // Convert back to Int16 stereo and append to output
         for (int i = 0; i < RNNOISE_FRAME_SIZE; i++) {
             int16_t leftSample = static_cast<int16_t>(
-                std::clamp(processedLeft[i], -32768.0f, 32767.0f));
+                std::clamp(m_processedLeft[i], -32768.0f, 32767.0f));
             int16_t rightSample = static_cast<int16_t>(
-                std::clamp(processedRight[i], -32768.0f, 32767.0f));
-            processedSamples.push_back(leftSample);
-            processedSamples.push_back(rightSample);
+                std::clamp(m_processedRight[i], -32768.0f, 32767.0f));
+            m_processedSamples.push_back(leftSample);
+            m_processedSamples.push_back(rightSample);
         }
-
-        // Remove processed samples from buffers
-        m_leftBuffer.erase(m_leftBuffer.begin(),
-                          m_leftBuffer.begin() + RNNOISE_FRAME_SIZE);
-        m_rightBuffer.erase(m_rightBuffer.begin(),
-                           m_rightBuffer.begin() + RNNOISE_FRAME_SIZE);
+        consumed += RNNOISE_FRAME_SIZE;
     }
 
-    // Replace output with processed samples
-    samples = std::move(processedSamples);
+    // Remove processed samples from buffers
+    m_leftBuffer.erase(m_leftBuffer.begin(), m_leftBuffer.begin() + consumed);
+    m_rightBuffer.erase(m_rightBuffer.begin(), m_rightBuffer.begin() + consumed);
 }
 
 uint64_t PulseMicrophoneCapturer::GetTimestampMs() const {
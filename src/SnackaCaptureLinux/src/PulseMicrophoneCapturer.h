@@ -92,9 +92,12 @@ private:
     static constexpr int RNNOISE_FRAME_SIZE = 480;
     std::vector<float> m_leftBuffer;
     std::vector<float> m_rightBuffer;
+    float m_processedLeft[RNNOISE_FRAME_SIZE];
+    float m_processedRight[RNNOISE_FRAME_SIZE];
+    std::vector<int16_t> m_processedSamples;
 
-    // Process audio through RNNoise
-    void ProcessWithRNNoise(std::vector<int16_t>& samples);
+    // Process frameCount stereo frames through RNNoise into m_processedSamples
+    void ProcessWithRNNoise(const int16_t* samples, size_t frameCount);
 
     // Static data for enumeration callback
     static std::vector<MicrophoneInfo>* s_enumeratedMicrophones;
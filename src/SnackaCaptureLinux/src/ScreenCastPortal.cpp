@@ -0,0 +1,288 @@
+#include "ScreenCastPortal.h"
+
+#include <gio/gunixfdlist.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+
+namespace snacka {
+
+namespace {
+
+constexpr const char* PORTAL_BUS_NAME = "org.freedesktop.portal.Desktop";
+constexpr const char* PORTAL_OBJECT_PATH = "/org/freedesktop/portal/desktop";
+constexpr const char* SCREENCAST_INTERFACE = "org.freedesktop.portal.ScreenCast";
+constexpr const char* REQUEST_INTERFACE = "org.freedesktop.portal.Request";
+constexpr const char* SESSION_INTERFACE = "org.freedesktop.portal.Session";
+
+// Source type and cursor mode bits of the ScreenCast interface
+constexpr uint32_t SOURCE_TYPE_MONITOR = 1;
+constexpr uint32_t CURSOR_MODE_HIDDEN = 1;
+constexpr uint32_t CURSOR_MODE_EMBEDDED = 2;
+
+// Request responses: 0 = success, 1 = cancelled by the user, 2 = ended some other way
+constexpr uint32_t RESPONSE_SUCCESS = 0;
+constexpr uint32_t RESPONSE_CANCELLED = 1;
+
+// How often the wait for the user's answer checks whether to give up
+constexpr guint WAIT_POLL_MS = 100;
+
+struct RequestState {
+    bool done = false;
+    uint32_t response = 2;
+    GVariant* results = nullptr;
+};
+
+void OnRequestResponse(GDBusConnection*, const gchar*, const gchar*, const gchar*, const gchar*,
+                       GVariant* parameters, gpointer userData) {
+    auto* state = static_cast<RequestState*>(userData);
+    guint32 response = 2;
+    GVariant* results = nullptr;
+    g_variant_get(parameters, "(u@a{sv})", &response, &results);
+    state->response = response;
+    state->results = results;
+    state->done = true;
+}
+
+gboolean WakeUp(gpointer) {
+    return G_SOURCE_CONTINUE;
+}
+
+std::string TakeErrorMessage(GError* error) {
+    std::string message = error ? error->message : "unknown error";
+    if (error) {
+        g_error_free(error);
+    }
+    return message;
+}
+
+}  // namespace
+
+ScreenCastPortal::~ScreenCastPortal() {
+    if (m_pipeWireFd >= 0) {
+        close(m_pipeWireFd);
+        m_pipeWireFd = -1;
+    }
+
+    if (m_connection) {
+        if (!m_sessionHandle.empty()) {
+            GVariant* reply = g_dbus_connection_call_sync(m_connection, PORTAL_BUS_NAME, m_sessionHandle.c_str(),
+                                                          SESSION_INTERFACE, "Close", nullptr, nullptr,
+                                                          G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+            if (reply) {
+                g_variant_unref(reply);
+            }
+        }
+        g_object_unref(m_connection);
+        m_connection = nullptr;
+    }
+}
+
+bool ScreenCastPortal::Open(bool showCursor, const std::atomic<bool>& keepWaiting) {
+    GError* error = nullptr;
+    m_connection = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &error);
+    if (!m_connection) {
+        std::cerr << "SnackaCaptureLinux: No D-Bus session bus for the ScreenCast portal: "
+                  << TakeErrorMessage(error) << "\n";
+        return false;
+    }
+
+    // Request object paths embed our unique bus name, ":1.42" as "1_42"
+    m_senderName = g_dbus_connection_get_unique_name(m_connection) + 1;
+    std::replace(m_senderName.begin(), m_senderName.end(), '.', '_');
+
+    uint32_t cursorModes = GetAvailableCursorModes();
+    if (cursorModes == 0) {
+        std::cerr << "SnackaCaptureLinux: ScreenCast portal not available\n";
+        return false;
+    }
+
+    GVariantBuilder options;
+    GVariant* results = nullptr;
+
+    std::string token = NewToken();
+    g_variant_builder_init(&options, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&options, "{sv}", "handle_token", g_variant_new_string(token.c_str()));
+    g_variant_builder_add(&options, "{sv}", "session_handle_token", g_variant_new_string(NewToken().c_str()));
+    if (!Request("CreateSession", g_variant_new("(a{sv})", &options), token, keepWaiting, results)) {
+        return false;
+    }
+    gchar* sessionHandle = nullptr;
+    g_variant_lookup(results, "session_handle", "s", &sessionHandle);
+    g_variant_unref(results);
+    if (!sessionHandle) {
+        std::cerr << "SnackaCaptureLinux: ScreenCast portal returned no session\n";
+        return false;
+    }
+    m_sessionHandle = sessionHandle;
+    g_free(sessionHandle);
+
+    // One monitor; the pointer is drawn in by the compositor as there is no XFixes to overlay it from
+    token = NewToken();
+    uint32_t cursorMode = showCursor ? CURSOR_MODE_EMBEDDED : CURSOR_MODE_HIDDEN;
+    g_variant_builder_init(&options, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&options, "{sv}", "handle_token", g_variant_new_string(token.c_str()));
+    g_variant_builder_add(&options, "{sv}", "types", g_variant_new_uint32(SOURCE_TYPE_MONITOR));
+    g_variant_builder_add(&options, "{sv}", "multiple", g_variant_new_boolean(FALSE));
+    if (cursorModes & cursorMode) {
+        g_variant_builder_add(&options, "{sv}", "cursor_mode", g_variant_new_uint32(cursorMode));
+    }
+    if (!Request("SelectSources", g_variant_new("(oa{sv})", m_sessionHandle.c_str(), &options), token, keepWaiting,
+                 results)) {
+        return false;
+    }
+    g_variant_unref(results);
+
+    // Start shows the share dialog
+    std::cerr << "SnackaCaptureLinux: Waiting for a monitor to be chosen in the screen share dialog\n";
+    token = NewToken();
+    g_variant_builder_init(&options, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&options, "{sv}", "handle_token", g_variant_new_string(token.c_str()));
+    if (!Request("Start", g_variant_new("(osa{sv})", m_sessionHandle.c_str(), "", &options), token, keepWaiting,
+                 results)) {
+        return false;
+    }
+    GVariant* streams = g_variant_lookup_value(results, "streams", G_VARIANT_TYPE("a(ua{sv})"));
+    g_variant_unref(results);
+    bool haveStream = false;
+    if (streams) {
+        GVariantIter iter;
+        guint32 nodeId = 0;
+        GVariant* properties = nullptr;
+        g_variant_iter_init(&iter, streams);
+        if (g_variant_iter_next(&iter, "(u@a{sv})", &nodeId, &properties)) {
+            m_nodeId = nodeId;
+            haveStream = true;
+            g_variant_unref(properties);
+        }
+        g_variant_unref(streams);
+    }
+    if (!haveStream) {
+        std::cerr << "SnackaCaptureLinux: ScreenCast portal started no stream\n";
+        return false;
+    }
+
+    // The remote only exposes the nodes of this session
+    GUnixFDList* fdList = nullptr;
+    g_variant_builder_init(&options, G_VARIANT_TYPE_VARDICT);
+    GVariant* reply = g_dbus_connection_call_with_unix_fd_list_sync(
+        m_connection, PORTAL_BUS_NAME, PORTAL_OBJECT_PATH, SCREENCAST_INTERFACE, "OpenPipeWireRemote",
+        g_variant_new("(oa{sv})", m_sessionHandle.c_str(), &options), G_VARIANT_TYPE("(h)"),
+        G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &fdList, nullptr, &error);
+    if (!reply) {
+        std::cerr << "SnackaCaptureLinux: Failed to open the PipeWire remote: " << TakeErrorMessage(error) << "\n";
+        return false;
+    }
+    gint32 fdIndex = 0;
+    g_variant_get(reply, "(h)", &fdIndex);
+    g_variant_unref(reply);
+    m_pipeWireFd = fdList ? g_unix_fd_list_get(fdList, fdIndex, &error) : -1;
+    if (fdList) {
+        g_object_unref(fdList);
+    }
+    if (m_pipeWireFd < 0) {
+        std::cerr << "SnackaCaptureLinux: ScreenCast portal returned no PipeWire remote: "
+                  << TakeErrorMessage(error) << "\n";
+        return false;
+    }
+
+    std::cerr << "SnackaCaptureLinux: ScreenCast portal session started (node " << m_nodeId << ", pointer "
+              << ((cursorModes & cursorMode) == 0 ? "as the portal defaults"
+                  : cursorMode == CURSOR_MODE_EMBEDDED ? "drawn in" : "hidden")
+              << ")\n";
+    return true;
+}
+
+int ScreenCastPortal::TakePipeWireFd() {
+    int fd = m_pipeWireFd;
+    m_pipeWireFd = -1;
+    return fd;
+}
+
+bool ScreenCastPortal::Request(const char* method, GVariant* parameters, const std::string& token,
+                               const std::atomic<bool>& keepWaiting, GVariant*& results) {
+    results = nullptr;
+
+    // The answer comes as a Response signal on a request object whose path is known
+    // up front, so subscribing before the call cannot miss a quick one. Signals go to
+    // the thread-default context at subscription time: a private one we iterate here.
+    std::string requestPath = std::string(PORTAL_OBJECT_PATH) + "/request/" + m_senderName + "/" + token;
+    GMainContext* context = g_main_context_new();
+    g_main_context_push_thread_default(context);
+
+    RequestState state;
+    guint subscription = g_dbus_connection_signal_subscribe(m_connection, PORTAL_BUS_NAME, REQUEST_INTERFACE,
+                                                            "Response", requestPath.c_str(), nullptr,
+                                                            G_DBUS_SIGNAL_FLAGS_NONE, OnRequestResponse, &state,
+                                                            nullptr);
+
+    GError* error = nullptr;
+    GVariant* reply = g_dbus_connection_call_sync(m_connection, PORTAL_BUS_NAME, PORTAL_OBJECT_PATH,
+                                                  SCREENCAST_INTERFACE, method, parameters, G_VARIANT_TYPE("(o)"),
+                                                  G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &error);
+    if (reply) {
+        g_variant_unref(reply);
+
+        // Wakes the loop now and then so a shutdown request is noticed during the dialog
+        GSource* wake = g_timeout_source_new(WAIT_POLL_MS);
+        g_source_set_callback(wake, WakeUp, nullptr, nullptr);
+        g_source_attach(wake, context);
+        while (!state.done && keepWaiting) {
+            g_main_context_iteration(context, TRUE);
+        }
+        g_source_destroy(wake);
+        g_source_unref(wake);
+    } else {
+        std::cerr << "SnackaCaptureLinux: ScreenCast " << method << " failed: " << TakeErrorMessage(error) << "\n";
+    }
+
+    g_dbus_connection_signal_unsubscribe(m_connection, subscription);
+    g_main_context_pop_thread_default(context);
+    g_main_context_unref(context);
+
+    if (!state.done) {
+        return false;
+    }
+    if (state.response != RESPONSE_SUCCESS) {
+        std::cerr << "SnackaCaptureLinux: ScreenCast " << method
+                  << (state.response == RESPONSE_CANCELLED ? " was cancelled" : " failed") << "\n";
+        if (state.results) {
+            g_variant_unref(state.results);
+        }
+        return false;
+    }
+
+    results = state.results;
+    return results != nullptr;
+}
+
+uint32_t ScreenCastPortal::GetAvailableCursorModes() {
+    GError* error = nullptr;
+    GVariant* reply = g_dbus_connection_call_sync(m_connection, PORTAL_BUS_NAME, PORTAL_OBJECT_PATH,
+                                                  "org.freedesktop.DBus.Properties", "Get",
+                                                  g_variant_new("(ss)", SCREENCAST_INTERFACE, "AvailableCursorModes"),
+                                                  G_VARIANT_TYPE("(v)"), G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &error);
+    if (!reply) {
+        std::cerr << "SnackaCaptureLinux: ScreenCast portal query failed: " << TakeErrorMessage(error) << "\n";
+        return 0;
+    }
+
+    GVariant* value = nullptr;
+    g_variant_get(reply, "(v)", &value);
+    uint32_t modes = value ? g_variant_get_uint32(value) : 0;
+    if (value) {
+        g_variant_unref(value);
+    }
+    g_variant_unref(reply);
+
+    // Version 1 portals have no cursor modes but can still share the screen
+    return modes != 0 ? modes : CURSOR_MODE_HIDDEN;
+}
+
+std::string ScreenCastPortal::NewToken() {
+    return "snacka" + std::to_string(getpid()) + "_" + std::to_string(++m_tokenCounter);
+}
+
+}  // namespace snacka
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <gio/gio.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace snacka {
+
+/// xdg-desktop-portal ScreenCast session, the way Wayland compositors hand out screen
+/// contents. Open() asks the user which monitor to share (CreateSession, SelectSources,
+/// Start) and opens a PipeWire remote that exposes only that stream's node. The
+/// session lasts until this object is destroyed, so it must outlive the capture.
+class ScreenCastPortal {
+public:
+    ScreenCastPortal() = default;
+    ~ScreenCastPortal();
+
+    ScreenCastPortal(const ScreenCastPortal&) = delete;
+    ScreenCastPortal& operator=(const ScreenCastPortal&) = delete;
+
+    /// Run the portal handshake; blocks while the share dialog is shown
+    /// @param showCursor Ask for the pointer to be drawn into the frames
+    /// @param keepWaiting Cleared (e.g. by a signal handler) to give up waiting for the user
+    /// @return true if the user picked a monitor and the remote is open
+    bool Open(bool showCursor, const std::atomic<bool>& keepWaiting);
+
+    /// Hand over the PipeWire remote file descriptor (-1 once taken or if not open)
+    int TakePipeWireFd();
+
+    /// Get the PipeWire node id of the shared monitor's stream
+    uint32_t GetNodeId() const { return m_nodeId; }
+
+private:
+    bool Request(const char* method, GVariant* parameters, const std::string& token,
+                 const std::atomic<bool>& keepWaiting, GVariant*& results);
+    uint32_t GetAvailableCursorModes();
+    std::string NewToken();
+
+    GDBusConnection* m_connection = nullptr;
+    std::string m_senderName;
+    std::string m_sessionHandle;
+    uint32_t m_nodeId = 0;
+    int m_pipeWireFd = -1;
+    int m_tokenCounter = 0;
+};
+
+}  // namespace snacka
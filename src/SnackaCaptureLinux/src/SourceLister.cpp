@@ -1,4 +1,5 @@
 #include "SourceLister.h"
+#include "CameraModeCache.h"
 #include "PulseMicrophoneCapturer.h"
 
 #include <X11/Xlib.h>
@@ -147,6 +148,7 @@ std::vector<CameraInfo> SourceLister::EnumerateCameras() {
     // Sort devices by name
     std::sort(videoDevices.begin(), videoDevices.end());
 
+    CameraModeCache cache;
     int cameraIndex = 0;
     for (const auto& devicePath : videoDevices) {
         int fd = open(devicePath.c_str(), O_RDWR | O_NONBLOCK);
@@ -172,9 +174,25 @@ std::vector<CameraInfo> SourceLister::EnumerateCameras() {
         info.name = reinterpret_cast<const char*>(cap.card);
         info.index = cameraIndex++;
 
+        // The mode a capture at the default camera size and rate would pick; known cameras
+        // are answered from the mode cache without enumerating their modes again
+        CameraCapabilities capabilities;
+        bool cached = false;
+        CameraFormatChoice choice;
+        if (cache.GetCapabilities(fd, CameraModeCache::GetDeviceKey(devicePath, cap), capabilities, cached) &&
+            ChooseCameraMode(capabilities, DEFAULT_CAMERA_WIDTH, DEFAULT_CAMERA_HEIGHT, DEFAULT_CAMERA_FPS, fd,
+                             choice)) {
+            info.format = FindCameraFormat(choice.pixelFormat)->name;
+            info.formatReason = choice.reason;
+        } else {
+            info.formatReason = "no format the capturer can convert";
+        }
+        info.formats = capabilities.offered;
+
         cameras.push_back(info);
         close(fd);
     }
+    cache.Save();
 
     return cameras;
 }
@@ -204,6 +222,8 @@ void SourceLister::PrintSources(const SourceList& sources) {
         for (const auto& camera : sources.cameras) {
             std::cerr << "  [" << camera.index << "] " << camera.name
                       << " (" << camera.id << ")\n";
+            std::cerr << "      format: " << (camera.format.empty() ? "none" : camera.format)
+                      << " - " << camera.formatReason << "\n";
         }
     }
 
@@ -258,7 +278,14 @@ void SourceLister::PrintSourcesAsJson(const SourceList& sources) {
         std::cout << "    {\n";
         std::cout << "      \"id\": \"" << EscapeJson(camera.id) << "\",\n";
         std::cout << "      \"name\": \"" << EscapeJson(camera.name) << "\",\n";
-        std::cout << "      \"index\": " << camera.index << "\n";
+        std::cout << "      \"index\": " << camera.index << ",\n";
+        std::cout << "      \"format\": \"" << EscapeJson(camera.format) << "\",\n";
+        std::cout << "      \"formatReason\": \"" << EscapeJson(camera.formatReason) << "\",\n";
+        std::cout << "      \"formats\": [";
+        for (size_t f = 0; f < camera.formats.size(); f++) {
+            std::cout << (f > 0 ? ", " : "") << "\"" << EscapeJson(camera.formats[f]) << "\"";
+        }
+        std::cout << "]\n";
         std::cout << "    }" << (i < sources.cameras.size() - 1 ? "," : "") << "\n";
     }
     std::cout << "  ],\n";
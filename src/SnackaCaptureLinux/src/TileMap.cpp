@@ -0,0 +1,118 @@
+#include "TileMap.h"
+
+#include <algorithm>
+
+namespace snacka {
+
+void TileMap::Configure(int width, int height, int tileSize) {
+    m_width = width;
+    m_height = height;
+    m_tileSize = std::max(tileSize, 1);
+    m_columns = (width + m_tileSize - 1) / m_tileSize;
+    m_rows = (height + m_tileSize - 1) / m_tileSize;
+    m_dirty.assign(static_cast<size_t>(m_columns) * m_rows, 0);
+}
+
+void TileMap::Clear() {
+    std::fill(m_dirty.begin(), m_dirty.end(), 0);
+}
+
+void TileMap::MarkAll() {
+    std::fill(m_dirty.begin(), m_dirty.end(), 1);
+}
+
+void TileMap::MarkRect(const FrameRect& rect) {
+    int x0 = std::max(rect.x, 0);
+    int y0 = std::max(rect.y, 0);
+    int x1 = std::min(rect.x + rect.width, m_width);
+    int y1 = std::min(rect.y + rect.height, m_height);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    int column1 = (x1 - 1) / m_tileSize;
+    int row1 = (y1 - 1) / m_tileSize;
+    for (int row = y0 / m_tileSize; row <= row1; row++) {
+        uint8_t* flags = m_dirty.data() + static_cast<size_t>(row) * m_columns;
+        std::fill(flags + x0 / m_tileSize, flags + column1 + 1, 1);
+    }
+}
+
+bool TileMap::IsAnyDirty(const FrameRect& rect) const {
+    int x0 = std::max(rect.x, 0);
+    int y0 = std::max(rect.y, 0);
+    int x1 = std::min(rect.x + rect.width, m_width);
+    int y1 = std::min(rect.y + rect.height, m_height);
+    if (x0 >= x1 || y0 >= y1) {
+        return false;
+    }
+
+    int column1 = (x1 - 1) / m_tileSize;
+    int row1 = (y1 - 1) / m_tileSize;
+    for (int row = y0 / m_tileSize; row <= row1; row++) {
+        const uint8_t* flags = m_dirty.data() + static_cast<size_t>(row) * m_columns;
+        if (std::find(flags + x0 / m_tileSize, flags + column1 + 1, 1) != flags + column1 + 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int TileMap::GetDirtyCount() const {
+    return static_cast<int>(std::count(m_dirty.begin(), m_dirty.end(), 1));
+}
+
+FrameRect TileMap::GetTileRect(int column, int row) const {
+    FrameRect rect;
+    rect.x = column * m_tileSize;
+    rect.y = row * m_tileSize;
+    rect.width = std::min(m_tileSize, m_width - rect.x);
+    rect.height = std::min(m_tileSize, m_height - rect.y);
+    return rect;
+}
+
+void TileMap::CollectRects(std::vector<FrameRect>& rects) const {
+    rects.clear();
+
+    // Rectangles from the previous tile row that may still grow downward
+    std::vector<size_t> open;
+    std::vector<size_t> nextOpen;
+
+    for (int row = 0; row < m_rows; row++) {
+        const uint8_t* flags = m_dirty.data() + static_cast<size_t>(row) * m_columns;
+        int y = row * m_tileSize;
+        int height = std::min(m_tileSize, m_height - y);
+        nextOpen.clear();
+
+        int column = 0;
+        while (column < m_columns) {
+            if (!flags[column]) {
+                column++;
+                continue;
+            }
+            int start = column;
+            while (column < m_columns && flags[column]) {
+                column++;
+            }
+
+            int x = start * m_tileSize;
+            int width = std::min(column * m_tileSize, m_width) - x;
+
+            // Extend a rectangle ending on the row above with exactly this span
+            auto match = std::find_if(open.begin(), open.end(), [&](size_t index) {
+                return rects[index].x == x && rects[index].width == width;
+            });
+            if (match != open.end()) {
+                rects[*match].height += height;
+                nextOpen.push_back(*match);
+            } else {
+                rects.push_back({x, y, width, height});
+                nextOpen.push_back(rects.size() - 1);
+            }
+        }
+
+        open.swap(nextOpen);
+    }
+}
+
+}  // namespace snacka
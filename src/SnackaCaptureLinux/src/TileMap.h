@@ -0,0 +1,61 @@
+#pragma once
+
+#include "FrameInfo.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace snacka {
+
+/// Dirty flags for a grid of square tiles covering an image.
+/// Used to coalesce arbitrary change rectangles (X damage, hash mismatches) into
+/// a few tile-aligned rectangles that are cheap to fetch and reconvert.
+class TileMap {
+public:
+    /// Set the image size and tile size; clears all flags
+    void Configure(int width, int height, int tileSize = 64);
+
+    /// Clear all dirty flags
+    void Clear();
+
+    /// Mark every tile dirty
+    void MarkAll();
+
+    /// Mark the tiles touched by a pixel rectangle (clipped to the image)
+    void MarkRect(const FrameRect& rect);
+
+    /// Mark a single tile
+    void MarkTile(int column, int row) { m_dirty[static_cast<size_t>(row) * m_columns + column] = 1; }
+
+    /// Check whether a tile is dirty
+    bool IsDirty(int column, int row) const { return m_dirty[static_cast<size_t>(row) * m_columns + column] != 0; }
+
+    /// Check whether any tile touched by a pixel rectangle is dirty
+    bool IsAnyDirty(const FrameRect& rect) const;
+
+    /// Get the number of dirty tiles
+    int GetDirtyCount() const;
+
+    /// Merge dirty tiles into pixel rectangles (clipped to the image, non-overlapping).
+    /// Runs of dirty tiles in a tile row become one rectangle; identical runs in
+    /// consecutive rows are merged vertically.
+    void CollectRects(std::vector<FrameRect>& rects) const;
+
+    int GetColumns() const { return m_columns; }
+    int GetRows() const { return m_rows; }
+    int GetTileSize() const { return m_tileSize; }
+
+    /// Get the pixel rectangle of a tile (clipped to the image)
+    FrameRect GetTileRect(int column, int row) const;
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    int m_tileSize = 64;
+    int m_columns = 0;
+    int m_rows = 0;
+    std::vector<uint8_t> m_dirty;
+};
+
+}  // namespace snacka
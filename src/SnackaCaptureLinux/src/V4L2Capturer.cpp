@@ -10,6 +10,7 @@
 #include <iostream>
 #include <cstring>
 #include <algorithm>
+#include <chrono>
 
 namespace snacka {
 
@@ -19,6 +20,8 @@ V4L2Capturer::V4L2Capturer() {
 
 V4L2Capturer::~V4L2Capturer() {
     Stop();
+    // Decode threads may still be reading the mapped buffers
+    m_decodePool.reset();
     CleanupMmap();
     if (m_fd >= 0) {
         close(m_fd);
@@ -43,6 +46,14 @@ bool V4L2Capturer::Initialize(const std::string& cameraId, int width, int height
         return false;
     }
 
+    // MJPEG at high pixel rates decodes on several threads, each holding a buffer while it works
+    if (m_pixelFormat == V4L2_PIX_FMT_MJPEG) {
+        int decodeThreads = MjpegDecodePool::PickThreadCount(m_decodeThreads, m_width, m_height, m_requestedFps);
+        if (decodeThreads > 1) {
+            m_decodePool = std::make_unique<MjpegDecodePool>(decodeThreads, m_width, m_height);
+        }
+    }
+
     // Initialize memory-mapped buffers
     if (!InitMmap()) {
         close(m_fd);
@@ -50,13 +61,21 @@ bool V4L2Capturer::Initialize(const std::string& cameraId, int width, int height
         return false;
     }
 
-    // Allocate conversion buffer if needed
-    auto nv12Size = CalculateNV12FrameSize(m_width, m_height);
-    m_nv12Buffer.resize(nv12Size);
+    // Allocate conversion buffer if needed (the decode pool brings its own)
+    if (m_needsConversion && !m_decodePool) {
+        m_nv12Buffer = FrameBufferPool::Shared().Acquire(CalculateNV12FrameSize(m_width, m_height));
+    }
 
     std::cerr << "V4L2Capturer: Initialized " << m_width << "x" << m_height
               << " @ " << m_requestedFps << "fps"
-              << " (format: " << (m_needsConversion ? "YUYV->NV12" : "NV12") << ")\n";
+              << " (format: " << GetFormatName();
+    if (m_pixelFormat != V4L2_PIX_FMT_NV12) {
+        std::cerr << "->NV12";
+    }
+    if (m_decodePool) {
+        std::cerr << ", " << m_decodePool->GetThreadCount() << " decode threads";
+    }
+    std::cerr << ")\n";
 
     return true;
 }
@@ -105,56 +124,95 @@ bool V4L2Capturer::OpenDevice(const std::string& cameraId) {
         return false;
     }
 
+    m_deviceKey = CameraModeCache::GetDeviceKey(m_devicePath, cap);
     std::cerr << "V4L2Capturer: Opened " << cap.card << " at " << m_devicePath << "\n";
     return true;
 }
 
-bool V4L2Capturer::NegotiateFormat() {
+bool V4L2Capturer::TrySetFormat(uint32_t pixelFormat, int requestedWidth, int requestedHeight,
+                                int& width, int& height, int& bytesPerLine) {
     struct v4l2_format fmt;
     memset(&fmt, 0, sizeof(fmt));
     fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-
-    // Try NV12 first (ideal for encoding)
-    fmt.fmt.pix.width = m_requestedWidth;
-    fmt.fmt.pix.height = m_requestedHeight;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_NV12;
+    fmt.fmt.pix.width = requestedWidth;
+    fmt.fmt.pix.height = requestedHeight;
+    fmt.fmt.pix.pixelformat = pixelFormat;
     fmt.fmt.pix.field = V4L2_FIELD_NONE;
 
-    if (ioctl(m_fd, VIDIOC_S_FMT, &fmt) == 0 && fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_NV12) {
-        m_pixelFormat = V4L2_PIX_FMT_NV12;
-        m_needsConversion = false;
-        m_width = fmt.fmt.pix.width;
-        m_height = fmt.fmt.pix.height;
-        std::cerr << "V4L2Capturer: Using NV12 format\n";
-        goto set_fps;
+    if (ioctl(m_fd, VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != pixelFormat) {
+        return false;
     }
+    width = fmt.fmt.pix.width;
+    height = fmt.fmt.pix.height;
+    bytesPerLine = fmt.fmt.pix.bytesperline;
+    return true;
+}
 
-    // Try YUYV (common webcam format)
-    fmt.fmt.pix.width = m_requestedWidth;
-    fmt.fmt.pix.height = m_requestedHeight;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+bool V4L2Capturer::NegotiateFormat() {
+    // Modes come from the cache when this camera was seen before; enumerating them
+    // costs several ioctls per format, size and rate
+    auto probeStart = std::chrono::steady_clock::now();
+    CameraModeCache cache;
+    CameraCapabilities capabilities;
+    bool cached = false;
+    CameraFormatChoice choice;
+    if (!cache.GetCapabilities(m_fd, m_deviceKey, capabilities, cached) ||
+        !ChooseCameraMode(capabilities, m_requestedWidth, m_requestedHeight, m_requestedFps, m_fd, choice)) {
+        std::cerr << "V4L2Capturer: No supported pixel format found\n";
+        cache.Save();
+        return false;
+    }
 
-    if (ioctl(m_fd, VIDIOC_S_FMT, &fmt) == 0 && fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_YUYV) {
-        m_pixelFormat = V4L2_PIX_FMT_YUYV;
-        m_needsConversion = true;
-        m_width = fmt.fmt.pix.width;
-        m_height = fmt.fmt.pix.height;
-        std::cerr << "V4L2Capturer: Using YUYV format (will convert to NV12)\n";
-        goto set_fps;
+    if (!TrySetFormat(choice.pixelFormat, choice.width, choice.height, m_width, m_height, m_bytesPerLine)) {
+        std::cerr << "V4L2Capturer: VIDIOC_S_FMT failed: " << strerror(errno) << "\n";
+        return false;
     }
 
-    // Try MJPEG as last resort (would need additional decoding, not implemented)
-    std::cerr << "V4L2Capturer: No supported pixel format found\n";
-    return false;
+    // A cached mode the driver no longer honours means the cache is stale: probe again
+    if (cached && choice.sizeListed && (m_width != choice.width || m_height != choice.height)) {
+        std::cerr << "V4L2Capturer: Cached mode " << choice.width << "x" << choice.height
+                  << " was not accepted, probing again\n";
+        cache.Remove(m_deviceKey);
+        if (!cache.GetCapabilities(m_fd, m_deviceKey, capabilities, cached) ||
+            !ChooseCameraMode(capabilities, m_requestedWidth, m_requestedHeight, m_requestedFps, m_fd, choice) ||
+            !TrySetFormat(choice.pixelFormat, choice.width, choice.height, m_width, m_height, m_bytesPerLine)) {
+            std::cerr << "V4L2Capturer: No supported pixel format found\n";
+            cache.Save();
+            return false;
+        }
+    }
+    cache.Save();
+
+    auto probeTime = std::chrono::steady_clock::now() - probeStart;
+    std::cerr << "V4L2Capturer: " << capabilities.modes.size() << " modes " << (cached ? "from cache" : "probed")
+              << ", format set in " << std::chrono::duration_cast<std::chrono::microseconds>(probeTime).count()
+              << " us\n";
+
+    if (m_width % 2 != 0 || m_height % 2 != 0) {
+        std::cerr << "V4L2Capturer: Odd frame size " << m_width << "x" << m_height << " is not supported\n";
+        return false;
+    }
+
+    m_pixelFormat = choice.pixelFormat;
+    const CameraFormatInfo* format = FindCameraFormat(m_pixelFormat);
+    if (format->bytesPerPixel > 0) {
+        // Drivers may pad rows; 0 means unpadded
+        m_bytesPerLine = std::max(m_bytesPerLine, m_width * format->bytesPerPixel);
+    }
 
-set_fps:
-    // Set frame rate
+    // Unpadded NV12 and NV21 frames are delivered straight from the capture buffer
+    bool inPlace = (m_pixelFormat == V4L2_PIX_FMT_NV12 || m_pixelFormat == V4L2_PIX_FMT_NV21) &&
+                   m_bytesPerLine == m_width;
+    m_needsConversion = !inPlace;
+    std::cerr << "V4L2Capturer: Using " << format->name << " " << m_width << "x" << m_height
+              << " (" << choice.reason << ")\n";
+
+    // Set the frame rate to the chosen native interval; delivery is paced to the requested rate either way
     struct v4l2_streamparm parm;
     memset(&parm, 0, sizeof(parm));
     parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    parm.parm.capture.timeperframe.numerator = 1;
-    parm.parm.capture.timeperframe.denominator = m_requestedFps;
+    parm.parm.capture.timeperframe.numerator = choice.interval.numerator;
+    parm.parm.capture.timeperframe.denominator = choice.interval.denominator;
 
     if (ioctl(m_fd, VIDIOC_S_PARM, &parm) < 0) {
         std::cerr << "V4L2Capturer: Warning - Could not set frame rate\n";
@@ -167,7 +225,7 @@ bool V4L2Capturer::InitMmap() {
     // Request buffers
     struct v4l2_requestbuffers req;
     memset(&req, 0, sizeof(req));
-    req.count = NUM_BUFFERS;
+    req.count = NUM_BUFFERS + (m_decodePool ? m_decodePool->GetThreadCount() : 0);
     req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req.memory = V4L2_MEMORY_MMAP;
 
@@ -276,18 +334,31 @@ void V4L2Capturer::Stop() {
 }
 
 void V4L2Capturer::CaptureLoop() {
-    uint64_t frameCount = 0;
-    auto nv12Size = CalculateNV12FrameSize(m_width, m_height);
+    m_frameCount = 0;
+    m_earlyCount = 0;
+    m_busyCount = 0;
+    bool scheduleStarted = false;
+    auto interval = std::chrono::microseconds(1000000 / std::max(m_requestedFps, 1));
+    m_frameInfo.fullFrame = true;
+    m_frameInfo.dirtyRects.assign(1, FrameRect{0, 0, m_width, m_height});
 
     std::cerr << "V4L2Capturer: Capture loop starting\n";
 
     while (m_running) {
-        // Poll for frame
-        struct pollfd pfd;
-        pfd.fd = m_fd;
-        pfd.events = POLLIN;
+        // Poll for frame (and for finished decodes)
+        struct pollfd pfd[2];
+        pfd[0].fd = m_fd;
+        pfd[0].events = POLLIN;
+        pfd[0].revents = 0;
+        nfds_t pollCount = 1;
+        if (m_decodePool) {
+            pfd[1].fd = m_decodePool->GetEventFd();
+            pfd[1].events = POLLIN;
+            pfd[1].revents = 0;
+            pollCount = 2;
+        }
 
-        int ret = poll(&pfd, 1, 100);  // 100ms timeout
+        int ret = poll(pfd, pollCount, 100);  // 100ms timeout
         if (ret < 0) {
             if (errno == EINTR) continue;
             std::cerr << "V4L2Capturer: poll failed: " << strerror(errno) << "\n";
@@ -299,6 +370,16 @@ void V4L2Capturer::CaptureLoop() {
             continue;
         }
 
+        // Decoded frames go out in capture order before the next frame is taken
+        if (m_decodePool) {
+            if (!DeliverDecodedFrames()) {
+                break;
+            }
+            if (pfd[0].revents == 0) {
+                continue;
+            }
+        }
+
         // Dequeue buffer
         struct v4l2_buffer buf;
         memset(&buf, 0, sizeof(buf));
@@ -311,6 +392,20 @@ void V4L2Capturer::CaptureLoop() {
             break;
         }
 
+        // Pace delivery at the requested rate even if the driver did not accept it
+        auto arrival = std::chrono::steady_clock::now();
+        if (!scheduleStarted) {
+            m_scheduler.Reset(arrival);
+            scheduleStarted = true;
+        }
+        if (!m_scheduler.Admit(interval, arrival)) {
+            m_earlyCount++;
+            if (!RequeueBuffer(buf.index)) {
+                break;
+            }
+            continue;
+        }
+
         // Calculate timestamp
         struct timespec now;
         clock_gettime(CLOCK_MONOTONIC, &now);
@@ -322,71 +417,149 @@ void V4L2Capturer::CaptureLoop() {
         // Get frame data
         const uint8_t* frameData = static_cast<const uint8_t*>(m_buffers[buf.index].start);
 
-        if (m_needsConversion) {
-            // Convert YUYV to NV12
-            ConvertYUYVToNV12(frameData, m_nv12Buffer.data());
-            frameData = m_nv12Buffer.data();
+        if (m_decodePool) {
+            // The buffer stays dequeued until its decode finishes
+            MjpegDecodePool::Job job;
+            job.jpeg = frameData;
+            job.size = buf.bytesused;
+            job.bufferIndex = buf.index;
+            job.timestamp = elapsedMs;
+            if (!m_decodePool->Submit(std::move(job))) {
+                // Every decoder is busy: dropping the frame keeps latency bounded, queueing would not
+                m_busyCount++;
+                if (!RequeueBuffer(buf.index)) {
+                    break;
+                }
+            }
+            continue;
         }
 
-        frameCount++;
-        if (frameCount <= 5 || frameCount % 100 == 0) {
-            std::cerr << "V4L2Capturer: Frame " << frameCount
-                      << " (" << m_width << "x" << m_height << " NV12)\n";
+        std::chrono::nanoseconds decodeTime{0};
+        if (m_pixelFormat == V4L2_PIX_FMT_MJPEG) {
+            // A corrupt frame is dropped; the decoder logs why
+            auto decodeStart = std::chrono::steady_clock::now();
+            bool decoded = m_mjpegDecoder.Decode(frameData, buf.bytesused, m_width, m_height, m_nv12Buffer.data());
+            decodeTime = std::chrono::steady_clock::now() - decodeStart;
+            if (!decoded) {
+                if (!RequeueBuffer(buf.index)) {
+                    break;
+                }
+                continue;
+            }
+            frameData = m_nv12Buffer.data();
+        } else {
+            frameData = ConvertFrame(static_cast<uint8_t*>(m_buffers[buf.index].start));
         }
 
-        // Call callback
-        if (m_callback) {
-            m_callback(frameData, nv12Size, elapsedMs);
-        }
+        DeliverFrame(frameData, elapsedMs, decodeTime);
 
         // Re-queue buffer
-        if (ioctl(m_fd, VIDIOC_QBUF, &buf) < 0) {
-            std::cerr << "V4L2Capturer: VIDIOC_QBUF failed: " << strerror(errno) << "\n";
+        if (!RequeueBuffer(buf.index)) {
             break;
         }
     }
 
-    std::cerr << "V4L2Capturer: Capture loop ended (" << frameCount << " frames)\n";
+    std::cerr << "V4L2Capturer: Capture loop ended (" << m_frameCount << " frames)\n";
+    if (m_decodePool) {
+        std::cerr << "V4L2Capturer: MJPEG: " << m_decodePool->DescribeStats() << ", dropped while busy "
+                  << m_busyCount << "\n";
+    } else if (m_pixelFormat == V4L2_PIX_FMT_MJPEG) {
+        std::cerr << "V4L2Capturer: MJPEG: " << m_mjpegDecoder.DescribeStats() << "\n";
+    }
 }
 
-void V4L2Capturer::ConvertYUYVToNV12(const uint8_t* yuyv, uint8_t* nv12) {
-    // YUYV format: Y0 U0 Y1 V0 Y2 U1 Y3 V1 ...
-    // NV12 format: Y plane (full resolution), then interleaved UV plane (half height)
-
-    int yPlaneSize = m_width * m_height;
-    uint8_t* yPlane = nv12;
-    uint8_t* uvPlane = nv12 + yPlaneSize;
+const uint8_t* V4L2Capturer::ConvertFrame(uint8_t* frame) {
+    uint8_t* nv12 = m_needsConversion ? m_nv12Buffer.data() : frame;
+    switch (m_pixelFormat) {
+        case V4L2_PIX_FMT_NV12:
+            if (m_needsConversion) {
+                m_formatConverter.CopyNV12(frame, m_bytesPerLine, m_width, m_height, nv12);
+            }
+            break;
+        case V4L2_PIX_FMT_NV21:
+            // In place when unpadded: the buffer is ours until it is requeued
+            m_formatConverter.ConvertNV21(frame, m_bytesPerLine, m_width, m_height, nv12);
+            break;
+        case V4L2_PIX_FMT_YUV420:
+        case V4L2_PIX_FMT_YVU420:
+            m_formatConverter.ConvertI420(frame, m_bytesPerLine, m_width, m_height,
+                                          m_pixelFormat == V4L2_PIX_FMT_YVU420, nv12);
+            break;
+        case V4L2_PIX_FMT_YUYV:
+            m_formatConverter.ConvertYUYV(frame, m_bytesPerLine, m_width, m_height, nv12);
+            break;
+        case V4L2_PIX_FMT_UYVY:
+            m_formatConverter.ConvertUYVY(frame, m_bytesPerLine, m_width, m_height, nv12);
+            break;
+        case V4L2_PIX_FMT_BGR24:
+        case V4L2_PIX_FMT_RGB24:
+            m_formatConverter.ConvertRGB24(frame, m_bytesPerLine, m_width, m_height,
+                                           m_pixelFormat == V4L2_PIX_FMT_BGR24 ? PixelLayout::BGRX
+                                                                               : PixelLayout::RGBX,
+                                           nv12);
+            break;
+    }
+    return nv12;
+}
 
-    // Extract Y values (every other byte from YUYV)
-    for (int y = 0; y < m_height; y++) {
-        const uint8_t* yuyvRow = yuyv + y * m_width * 2;
-        uint8_t* yRow = yPlane + y * m_width;
+bool V4L2Capturer::DeliverDecodedFrames() {
+    MjpegDecodePool::Job job;
+    while (m_decodePool->PopCompleted(job)) {
+        // The JPEG is no longer needed, so the driver gets its buffer back before the callback runs
+        if (!RequeueBuffer(job.bufferIndex)) {
+            return false;
+        }
+        if (job.decoded) {
+            DeliverFrame(job.nv12.data(), job.timestamp, job.decodeTime);
+        }
+    }
+    return true;
+}
 
-        for (int x = 0; x < m_width; x++) {
-            yRow[x] = yuyvRow[x * 2];
+void V4L2Capturer::DeliverFrame(const uint8_t* nv12, uint64_t timestamp, std::chrono::nanoseconds decodeTime) {
+    m_frameCount++;
+    if (m_frameCount <= 5 || m_frameCount % 100 == 0) {
+        std::cerr << "V4L2Capturer: Frame " << m_frameCount
+                  << " (" << m_width << "x" << m_height << " NV12";
+        if (decodeTime.count() > 0) {
+            std::cerr << ", decoded in " << std::chrono::duration_cast<std::chrono::microseconds>(decodeTime).count()
+                      << " us";
         }
+        std::cerr << ")\n";
+    }
+
+    // Call callback
+    if (m_callback) {
+        m_callback(nv12, CalculateNV12FrameSize(m_width, m_height), timestamp, m_frameInfo);
     }
 
-    // Extract UV values (subsample from every other row)
-    for (int y = 0; y < m_height / 2; y++) {
-        // Average UV from two rows
-        const uint8_t* yuyvRow0 = yuyv + (y * 2) * m_width * 2;
-        const uint8_t* yuyvRow1 = yuyv + (y * 2 + 1) * m_width * 2;
-        uint8_t* uvRow = uvPlane + y * m_width;
-
-        for (int x = 0; x < m_width / 2; x++) {
-            // U comes first in YUYV
-            int u0 = yuyvRow0[x * 4 + 1];
-            int u1 = yuyvRow1[x * 4 + 1];
-            // V comes second
-            int v0 = yuyvRow0[x * 4 + 3];
-            int v1 = yuyvRow1[x * 4 + 3];
-
-            // Average vertically
-            uvRow[x * 2] = static_cast<uint8_t>((u0 + u1) / 2);
-            uvRow[x * 2 + 1] = static_cast<uint8_t>((v0 + v1) / 2);
+    if (m_frameCount % 300 == 0) {
+        std::cerr << "V4L2Capturer: Pacing: " << m_scheduler.DescribeStats(true) << ", skipped early "
+                  << m_earlyCount << "\n";
+        if (m_decodePool) {
+            std::cerr << "V4L2Capturer: MJPEG: " << m_decodePool->DescribeStats() << ", dropped while busy "
+                      << m_busyCount << "\n";
         }
     }
 }
 
+bool V4L2Capturer::RequeueBuffer(uint32_t index) {
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+
+    if (ioctl(m_fd, VIDIOC_QBUF, &buf) < 0) {
+        std::cerr << "V4L2Capturer: VIDIOC_QBUF failed: " << strerror(errno) << "\n";
+        return false;
+    }
+    return true;
+}
+
+const char* V4L2Capturer::GetFormatName() const {
+    const CameraFormatInfo* format = FindCameraFormat(m_pixelFormat);
+    return format ? format->name : "unknown";
+}
+
 }  // namespace snacka
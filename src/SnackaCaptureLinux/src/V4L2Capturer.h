@@ -1,11 +1,21 @@
 #pragma once
 
 #include "Protocol.h"
+#include "CameraFormatConverter.h"
+#include "CameraFormats.h"
+#include "CameraModeCache.h"
+#include "FrameBufferPool.h"
+#include "FrameInfo.h"
+#include "FrameScheduler.h"
+#include "MjpegDecodePool.h"
+#include "MjpegDecoder.h"
 
 #include <linux/videodev2.h>
 
 #include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
@@ -13,16 +23,23 @@
 namespace snacka {
 
 // Callback for frame data (same signature as X11Capturer)
-using CameraFrameCallback = std::function<void(const uint8_t* nv12Data, size_t size, uint64_t timestamp)>;
+using CameraFrameCallback = std::function<void(const uint8_t* nv12Data, size_t size, uint64_t timestamp,
+                                               const FrameInfo& info)>;
 
 /// Camera capture using Video4Linux2.
 /// Outputs NV12 frames compatible with VaapiEncoder.
-/// Handles format negotiation and YUYV to NV12 conversion for webcams.
+/// Picks the native mode (format, size, frame interval) cheapest to turn into NV12 for
+/// the request, from a mode cache that spares re-enumerating known cameras, then
+/// converts raw YUV and RGB formats with SIMD kernels and decodes MJPEG.
 class V4L2Capturer {
 public:
     V4L2Capturer();
     ~V4L2Capturer();
 
+    /// Set the MJPEG decode threads (0 = pick from the camera mode; 1 = decode on the capture thread).
+    /// Call before Initialize.
+    void SetDecodeThreads(int threads) { m_decodeThreads = threads; }
+
     /// Initialize for a specific camera
     /// @param cameraId Device path (e.g., /dev/video0) or index as string
     /// @param width Requested output width
@@ -46,19 +63,27 @@ public:
 
 private:
     void CaptureLoop();
+    const uint8_t* ConvertFrame(uint8_t* frame);
+    bool DeliverDecodedFrames();
+    void DeliverFrame(const uint8_t* nv12, uint64_t timestamp, std::chrono::nanoseconds decodeTime);
+    bool RequeueBuffer(uint32_t index);
     bool OpenDevice(const std::string& cameraId);
     bool InitMmap();
     bool StartStreaming();
     void StopStreaming();
     void CleanupMmap();
     bool NegotiateFormat();
-    void ConvertYUYVToNV12(const uint8_t* yuyv, uint8_t* nv12);
+    bool TrySetFormat(uint32_t pixelFormat, int requestedWidth, int requestedHeight,
+                      int& width, int& height, int& bytesPerLine);
+    const char* GetFormatName() const;
 
     // Configuration
     std::string m_devicePath;
+    std::string m_deviceKey;  // Mode cache key (driver, bus position, firmware)
     int m_requestedWidth = 640;
     int m_requestedHeight = 480;
     int m_requestedFps = 30;
+    int m_decodeThreads = 0;
 
     // Actual dimensions (may differ from requested)
     int m_width = 0;
@@ -71,7 +96,11 @@ private:
 
     // Format info
     uint32_t m_pixelFormat = 0;
-    bool m_needsConversion = false;  // True if camera doesn't output NV12 natively
+    bool m_needsConversion = false;  // True if frames are converted into m_nv12Buffer, not delivered in place
+    int m_bytesPerLine = 0;
+
+    // SIMD kernels for raw formats
+    CameraFormatConverter m_formatConverter;
 
     // Memory-mapped buffers
     struct MmapBuffer {
@@ -82,13 +111,30 @@ private:
     static constexpr int NUM_BUFFERS = 4;
 
     // NV12 conversion buffer
-    std::vector<uint8_t> m_nv12Buffer;
+    FrameBuffer m_nv12Buffer;
+
+    // Decoder for MJPEG cameras, reused across frames
+    MjpegDecoder m_mjpegDecoder;
+
+    // Decoders for MJPEG modes one thread cannot keep up with (replaces m_mjpegDecoder)
+    std::unique_ptr<MjpegDecodePool> m_decodePool;
+
+    // Cameras have no damage information: every frame is reported as fully changed
+    FrameInfo m_frameInfo;
 
     // Callback
     CameraFrameCallback m_callback;
 
     // Timing
     struct timespec m_startTime;
+
+    // Capture loop counters
+    uint64_t m_frameCount = 0;
+    uint64_t m_earlyCount = 0;
+    uint64_t m_busyCount = 0;  // Frames dropped because every decode thread was busy
+
+    // Delivery on a fixed grid at the requested rate; frames a faster device sends early are skipped
+    FrameScheduler m_scheduler;
 };
 
 }  // namespace snacka
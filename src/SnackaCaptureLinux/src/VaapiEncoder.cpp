@@ -252,6 +252,8 @@ bool VaapiEncoder::CreateCodedBuffer() {
         return false;
     }
 
+    // AVCC output is about the size of the Annex-B input, so this rarely has to grow
+    m_avccBuffer = FrameBufferPool::Shared().Acquire(codedBufSize * 3 / 2);
     return true;
 }
 
@@ -526,7 +528,13 @@ bool VaapiEncoder::GetEncodedData(bool isKeyframe) {
 }
 
 void VaapiEncoder::ConvertAnnexBToAVCC(const uint8_t* annexB, size_t size, bool isKeyframe) {
-    m_avccBuffer.clear();
+    // Each NAL grows by at most one byte (3-byte start code to 4-byte length), and NALs
+    // are at least one byte, so this bounds the output without checking per NAL
+    size_t worstCase = size + size / 4 + 4;
+    if (m_avccBuffer.capacity() < worstCase) {
+        m_avccBuffer = FrameBufferPool::Shared().Resize(std::move(m_avccBuffer), worstCase, 0);
+    }
+    size_t avccSize = 0;
 
     // Parse Annex-B format and convert to AVCC (4-byte length prefix)
     size_t i = 0;
@@ -580,18 +588,17 @@ void VaapiEncoder::ConvertAnnexBToAVCC(const uint8_t* annexB, size_t size, bool
             size_t nalSize = nalEnd - nalStart;
             uint32_t beLength = htonl(static_cast<uint32_t>(nalSize));
 
-            size_t offset = m_avccBuffer.size();
-            m_avccBuffer.resize(offset + 4 + nalSize);
-            memcpy(m_avccBuffer.data() + offset, &beLength, 4);
-            memcpy(m_avccBuffer.data() + offset + 4, annexB + nalStart, nalSize);
+            memcpy(m_avccBuffer.data() + avccSize, &beLength, 4);
+            memcpy(m_avccBuffer.data() + avccSize + 4, annexB + nalStart, nalSize);
+            avccSize += 4 + nalSize;
         }
 
         i = nalEnd;
     }
 
     // Invoke callback with AVCC data
-    if (!m_avccBuffer.empty() && m_callback) {
-        m_callback(m_avccBuffer.data(), m_avccBuffer.size(), isKeyframe);
+    if (avccSize > 0 && m_callback) {
+        m_callback(m_avccBuffer.data(), avccSize, isKeyframe);
     }
 }
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "FrameBufferPool.h"
+
 #include <va/va.h>
 #include <va/va_drm.h>
 #include <va/va_enc_h264.h>
@@ -150,8 +152,8 @@ private:
     std::vector<uint8_t> m_pps;
     bool m_haveSpsPs = false;
 
-    // Output buffers
-    std::vector<uint8_t> m_avccBuffer;
+    // Output buffer, sized for the worst case of the last frame (see ConvertAnnexBToAVCC)
+    FrameBuffer m_avccBuffer;
 
     // Callback
     EncodedCallback m_callback;
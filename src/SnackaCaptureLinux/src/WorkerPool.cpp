@@ -0,0 +1,88 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+namespace snacka {
+
+WorkerPool::WorkerPool(int threadCount) {
+    int workerCount = std::max(threadCount, 1) - 1;
+    m_workers.reserve(workerCount);
+    for (int i = 0; i < workerCount; i++) {
+        // Worker i executes task i + 1; task 0 runs on the caller
+        m_workers.emplace_back(&WorkerPool::WorkerLoop, this, i + 1);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_workCondition.notify_all();
+
+    for (auto& worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void WorkerPool::Run(int taskCount, const std::function<void(int)>& task) {
+    taskCount = std::min(taskCount, GetThreadCount());
+    if (taskCount <= 0) {
+        return;
+    }
+
+    if (taskCount == 1) {
+        task(0);
+        return;
+    }
+
+    std::lock_guard<std::mutex> runLock(m_runMutex);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_taskCount = taskCount;
+        m_pending = taskCount - 1;
+        m_generation++;
+    }
+    m_workCondition.notify_all();
+
+    task(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCondition.wait(lock, [this] { return m_pending == 0; });
+    m_task = nullptr;
+}
+
+void WorkerPool::WorkerLoop(int workerIndex) {
+    uint64_t seenGeneration = 0;
+
+    while (true) {
+        const std::function<void(int)>* task = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_workCondition.wait(lock, [&] { return m_stopping || m_generation != seenGeneration; });
+            if (m_stopping) {
+                return;
+            }
+            seenGeneration = m_generation;
+            if (workerIndex >= m_taskCount) {
+                continue;
+            }
+            task = m_task;
+        }
+
+        (*task)(workerIndex);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pending == 0) {
+                m_doneCondition.notify_one();
+            }
+        }
+    }
+}
+
+}  // namespace snacka
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace snacka {
+
+/// Persistent pool of worker threads for fork/join work inside a frame.
+/// Run() hands out task indices 0..count-1 and blocks until all have finished;
+/// the calling thread executes task 0 itself so a pool of N threads keeps N-1
+/// workers parked between frames. Task i always runs on the same worker, which
+/// keeps each worker's output stripe warm in its own cache.
+class WorkerPool {
+public:
+    /// @param threadCount Total threads including the caller (1 = run inline)
+    explicit WorkerPool(int threadCount);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /// Run task(i) for i in [0, taskCount) and wait for completion.
+    /// taskCount must not exceed GetThreadCount().
+    void Run(int taskCount, const std::function<void(int)>& task);
+
+    /// Get the number of threads that execute tasks (including the caller)
+    int GetThreadCount() const { return static_cast<int>(m_workers.size()) + 1; }
+
+private:
+    void WorkerLoop(int workerIndex);
+
+    std::vector<std::thread> m_workers;
+
+    // Serializes Run() calls from different threads
+    std::mutex m_runMutex;
+
+    std::mutex m_mutex;
+    std::condition_variable m_workCondition;
+    std::condition_variable m_doneCondition;
+    const std::function<void(int)>* m_task = nullptr;
+    int m_taskCount = 0;
+    int m_pending = 0;
+    uint64_t m_generation = 0;
+    bool m_stopping = false;
+};
+
+}  // namespace snacka
@@ -1,30 +1,58 @@
 #include "X11Capturer.h"
 #include "Protocol.h"
+#include "X11Util.h"
+
+#include <X11/Xlib-xcb.h>
+#include <poll.h>
 
 #include <iostream>
 #include <chrono>
 #include <cstring>
 #include <algorithm>
+#include <cassert>
+#include <iomanip>
 
 namespace snacka {
 
+namespace {
+
+// Tile edge used to coalesce damage, in screen pixels for fetching and output pixels for conversion
+constexpr int DAMAGE_TILE_SIZE = 64;
+
+// Above this share of tiles a single full grab or conversion beats many partial ones
+constexpr double FULL_GRAB_THRESHOLD = 0.5;
+
+bool SameCursor(const FrameCursor& a, const FrameCursor& b) {
+    if (a.visible != b.visible) {
+        return false;
+    }
+    if (!a.visible) {
+        return true;
+    }
+    return a.x == b.x && a.y == b.y && a.shape == b.shape;
+}
+
+}  // namespace
+
 X11Capturer::X11Capturer() {
 }
 
 X11Capturer::~X11Capturer() {
     Stop();
 
-    if (m_image) {
-        XDestroyImage(m_image);
-        m_image = nullptr;
+    if (m_display) {
+        if (m_damage) {
+            XDamageDestroy(m_display, m_damage);
+            m_damage = 0;
+        }
+        if (m_damageRegion) {
+            XFixesDestroyRegion(m_display, m_damageRegion);
+            m_damageRegion = 0;
+        }
     }
 
-    if (m_shmAttached) {
-        XShmDetach(m_display, &m_shmInfo);
-        shmdt(m_shmInfo.shmaddr);
-        shmctl(m_shmInfo.shmid, IPC_RMID, nullptr);
-        m_shmAttached = false;
-    }
+    DestroySlots();
+    m_serverScaler.Destroy();
 
     if (m_display) {
         XCloseDisplay(m_display);
@@ -45,15 +73,14 @@ bool X11Capturer::Initialize(int displayIndex, int width, int height, int fps) {
         return false;
     }
 
+    InstallXErrorHandler();
+
     // Get root window of default screen
     int screen = DefaultScreen(m_display);
     m_rootWindow = RootWindow(m_display, screen);
 
-    // Get screen dimensions
-    m_screenWidth = DisplayWidth(m_display, screen);
-    m_screenHeight = DisplayHeight(m_display, screen);
-
-    std::cerr << "SnackaCaptureLinux: Screen dimensions: " << m_screenWidth << "x" << m_screenHeight << "\n";
+    std::cerr << "SnackaCaptureLinux: Screen dimensions: " << DisplayWidth(m_display, screen)
+              << "x" << DisplayHeight(m_display, screen) << "\n";
 
     // Check for XShm extension
     if (!XShmQueryExtension(m_display)) {
@@ -61,194 +88,1102 @@ bool X11Capturer::Initialize(int displayIndex, int width, int height, int fps) {
         return false;
     }
 
-    // Create shared memory XImage
-    Visual* visual = DefaultVisual(m_display, screen);
-    int depth = DefaultDepth(m_display, screen);
-
-    m_image = XShmCreateImage(
-        m_display,
-        visual,
-        depth,
-        ZPixmap,
-        nullptr,
-        &m_shmInfo,
-        m_screenWidth,
-        m_screenHeight
-    );
-
-    if (!m_image) {
-        std::cerr << "SnackaCaptureLinux: Failed to create XShm image\n";
+    m_depth = DefaultDepth(m_display, screen);
+    if (m_serverScaleMode != ServerScaleMode::Off) {
+        m_renderAvailable = XRenderScaler::QuerySupport(m_display);
+        if (!m_renderAvailable) {
+            std::cerr << "SnackaCaptureLinux: XRender not available, scaling on the client\n";
+        }
+    }
+    if (m_grabBackend == GrabBackend::Xcb) {
+        m_xcb = XGetXCBConnection(m_display);
+        if (!XcbShmSegment::QuerySupport(m_xcb, m_xcbFdPassing)) {
+            std::cerr << "SnackaCaptureLinux: XCB MIT-SHM not available, using Xlib grabs\n";
+            m_grabBackend = GrabBackend::Xlib;
+        }
+    }
+
+    // Follow mode switches and hotplug of the selected monitor
+    int randrErrorBase = 0;
+    if (XRRQueryExtension(m_display, &m_randrEventBase, &randrErrorBase)) {
+        m_randrAvailable = true;
+        XRRSelectInput(m_display, m_rootWindow,
+                       RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask | RROutputChangeNotifyMask);
+    }
+
+    FrameRect captureRect;
+    bool isRegion = false;
+    if (!QueryCaptureRect(captureRect, isRegion)) {
+        std::cerr << "SnackaCaptureLinux: Display " << displayIndex << " not found, capturing the whole screen\n";
+    }
+    m_regionChanged = false;
+
+    // Pipeline buffers: one XShm mirror and one NV12 frame per step of depth
+    m_pipelineDepth = std::clamp(m_pipelineDepth, 1, 8);
+    m_slots = std::vector<GrabSlot>(m_pipelineDepth);
+    m_buffers.resize(m_pipelineDepth);
+    for (auto& buffer : m_buffers) {
+        buffer.nv12 = FrameBufferPool::Shared().Acquire(CalculateNV12FrameSize(m_width, m_height));
+        buffer.pendingTiles.Configure(m_width, m_height, DAMAGE_TILE_SIZE);
+        buffer.pendingTiles.MarkAll();
+    }
+
+    if (!m_pyramid.Configure(m_width, m_height, m_layerSizes)) {
+        std::cerr << "SnackaCaptureLinux: Simulcast layers must be even and no larger than the output or the layer above\n";
         return false;
     }
 
-    // Allocate shared memory
-    m_shmInfo.shmid = shmget(IPC_PRIVATE, m_image->bytes_per_line * m_image->height, IPC_CREAT | 0777);
-    if (m_shmInfo.shmid < 0) {
-        std::cerr << "SnackaCaptureLinux: Failed to allocate shared memory\n";
-        XDestroyImage(m_image);
-        m_image = nullptr;
+    m_stripeCount = ColorConverter::PickStripeCount(m_convertThreads, m_width, m_height);
+    if (m_workerPool) {
+        m_stripeCount = std::min(m_stripeCount, m_workerPool->GetThreadCount());
+    }
+
+    PixelLayout layout = PixelLayout::BGRX;
+    if (!GetPixelLayout(m_display, DefaultVisual(m_display, screen), m_depth, layout)) {
+        std::cerr << "SnackaCaptureLinux: Unrecognized pixel format for depth " << m_depth << ", assuming BGRX\n";
+    }
+    m_converter.SetPixelLayout(layout);
+
+    if (m_damageTracking && !InitializeDamage()) {
+        std::cerr << "SnackaCaptureLinux: XDamage not available, capturing full frames\n";
+    }
+    if (m_cursorMode != CursorMode::Hidden && !InitializeCursor()) {
+        std::cerr << "SnackaCaptureLinux: XFixes cursor images not available, pointer not captured\n";
+    }
+
+    if (!ApplyCaptureRect(captureRect, isRegion)) {
         return false;
     }
+    if (!m_workerPool) {
+        m_workerPool = std::make_shared<WorkerPool>(m_converter.GetStripeCount());
+    }
+    m_stripeTimings.assign(m_converter.GetStripeCount(), StripeTiming{});
+    m_rateController.Configure(m_fps, m_minFps);
+
+    std::cerr << "SnackaCaptureLinux: X11 capture initialized for output "
+              << m_width << "x" << m_height << " @ " << m_fps << "fps"
+              << " (conversion: " << ColorConverter::GetCpuLevelName(m_converter.GetCpuLevel())
+              << ", " << m_converter.GetStripeCount() << " thread(s), scaling: "
+              << m_converter.GetScaleDescription()
+              << ", " << GetColorSpaceName(m_converter.GetColorSpace())
+              << (m_damage ? ", damage tracking" : "")
+              << (m_cursorAvailable ? (m_cursorMode == CursorMode::Overlay ? ", cursor overlay" : ", cursor metadata") : "")
+              << ", grab: " << (m_grabBackend == GrabBackend::Xcb
+                                    ? (m_slots[0].segment.IsMemfd() ? "xcb memfd" : "xcb sysv")
+                                    : "xlib")
+              << ", pipeline depth " << m_pipelineDepth
+              << (m_rateController.IsAdaptive() ? ", adaptive down to " + std::to_string(m_minFps) + "fps" : "")
+              << (m_layerSizes.empty() ? "" : ", " + std::to_string(m_layerSizes.size()) + " simulcast layer(s)")
+              << ")\n";
 
-    m_shmInfo.shmaddr = m_image->data = static_cast<char*>(shmat(m_shmInfo.shmid, nullptr, 0));
-    if (m_shmInfo.shmaddr == reinterpret_cast<char*>(-1)) {
-        std::cerr << "SnackaCaptureLinux: Failed to attach shared memory\n";
-        shmctl(m_shmInfo.shmid, IPC_RMID, nullptr);
-        XDestroyImage(m_image);
-        m_image = nullptr;
+    return true;
+}
+
+bool X11Capturer::InitializeDamage() {
+    int damageErrorBase = 0;
+    int fixesEventBase = 0;
+    int fixesErrorBase = 0;
+    if (!XDamageQueryExtension(m_display, &m_damageEventBase, &damageErrorBase) ||
+        !XFixesQueryExtension(m_display, &fixesEventBase, &fixesErrorBase)) {
         return false;
     }
 
-    m_shmInfo.readOnly = False;
+    // Both extensions must be told which version the client speaks before use
+    int major = 1;
+    int minor = 1;
+    if (!XDamageQueryVersion(m_display, &major, &minor)) {
+        return false;
+    }
+    major = 2;
+    minor = 0;
+    if (!XFixesQueryVersion(m_display, &major, &minor) || major < 2) {
+        return false;
+    }
 
-    if (!XShmAttach(m_display, &m_shmInfo)) {
-        std::cerr << "SnackaCaptureLinux: Failed to attach XShm\n";
-        shmdt(m_shmInfo.shmaddr);
-        shmctl(m_shmInfo.shmid, IPC_RMID, nullptr);
-        XDestroyImage(m_image);
-        m_image = nullptr;
+    // NonEmpty: one notify per transition from clean to damaged, the rectangles are
+    // collected with XDamageSubtract when the next frame is due
+    m_damage = XDamageCreate(m_display, m_rootWindow, XDamageReportNonEmpty);
+    m_damageRegion = XFixesCreateRegion(m_display, nullptr, 0);
+    if (!m_damage || !m_damageRegion) {
+        if (m_damage) {
+            XDamageDestroy(m_display, m_damage);
+            m_damage = 0;
+        }
         return false;
     }
 
-    m_shmAttached = true;
+    return true;
+}
 
-    // Allocate NV12 buffer for output
-    m_nv12Buffer.resize(CalculateNV12FrameSize(m_width, m_height));
+bool X11Capturer::InitializeCursor() {
+    int fixesErrorBase = 0;
+    int major = 2;
+    int minor = 0;
+    if (!XFixesQueryExtension(m_display, &m_fixesEventBase, &fixesErrorBase) ||
+        !XFixesQueryVersion(m_display, &major, &minor) || major < 2) {
+        return false;
+    }
 
-    std::cerr << "SnackaCaptureLinux: X11 capture initialized for output "
-              << m_width << "x" << m_height << " @ " << m_fps << "fps\n";
+    // Notifies on every shape change; motion is not reported, so position is polled per frame
+    XFixesSelectCursorInput(m_display, m_rootWindow, XFixesDisplayCursorNotifyMask);
+    m_cursorAvailable = true;
+    m_cursorStale = true;
+    return true;
+}
+
+bool X11Capturer::QueryCaptureRect(FrameRect& rect, bool& isRegion) const {
+    int screen = DefaultScreen(m_display);
+    int screenWidth = DisplayWidth(m_display, screen);
+    int screenHeight = DisplayHeight(m_display, screen);
+    rect = {0, 0, screenWidth, screenHeight};
+
+    {
+        // The flag is read with the region, so the rect and what it is of always agree
+        std::lock_guard<std::mutex> lock(m_regionMutex);
+        isRegion = m_useRegion;
+        if (m_useRegion) {
+            // Keep the requested size where possible so moving never reallocates;
+            // shift the region back on screen instead of clipping it
+            rect.width = std::min(m_region.width, screenWidth);
+            rect.height = std::min(m_region.height, screenHeight);
+            rect.x = std::clamp(m_region.x, 0, screenWidth - rect.width);
+            rect.y = std::clamp(m_region.y, 0, screenHeight - rect.height);
+            return true;
+        }
+    }
+
+    if (!m_randrAvailable) {
+        return m_displayIndex == 0;
+    }
+
+    // Current resources don't reprobe outputs, so this is cheap enough to call on every change
+    XRRScreenResources* resources = XRRGetScreenResourcesCurrent(m_display, m_rootWindow);
+    if (!resources) {
+        return false;
+    }
+
+    // Same numbering as SourceLister: the display index is the XRandR output index
+    bool found = false;
+    if (m_displayIndex >= 0 && m_displayIndex < resources->noutput) {
+        XRROutputInfo* outputInfo = XRRGetOutputInfo(m_display, resources, resources->outputs[m_displayIndex]);
+        if (outputInfo && outputInfo->connection == RR_Connected && outputInfo->crtc) {
+            XRRCrtcInfo* crtcInfo = XRRGetCrtcInfo(m_display, resources, outputInfo->crtc);
+            if (crtcInfo) {
+                // Clip to the root window: XShmGetImage fails on anything outside it
+                int x0 = std::max(crtcInfo->x, 0);
+                int y0 = std::max(crtcInfo->y, 0);
+                int x1 = std::min(crtcInfo->x + static_cast<int>(crtcInfo->width), screenWidth);
+                int y1 = std::min(crtcInfo->y + static_cast<int>(crtcInfo->height), screenHeight);
+                if (x1 > x0 && y1 > y0) {
+                    rect = {x0, y0, x1 - x0, y1 - y0};
+                    found = true;
+                }
+                XRRFreeCrtcInfo(crtcInfo);
+            }
+        }
+        if (outputInfo) {
+            XRRFreeOutputInfo(outputInfo);
+        }
+    }
+
+    XRRFreeScreenResources(resources);
+    return found;
+}
+
+void X11Capturer::DestroySlots() {
+    DestroyShmImage(m_display, m_stagingImage, m_stagingShmInfo);
+    m_stagingSegment.Destroy();
+    for (auto& slot : m_slots) {
+        DestroyShmImage(m_display, slot.image, slot.shmInfo);
+        slot.segment.Destroy();
+        slot.pixels = nullptr;
+    }
+}
+
+bool X11Capturer::ApplyCaptureRect(const FrameRect& rect, bool isRegion) {
+    // Callers make sure no slot is in the pipeline. That is the only barrier against the
+    // convert thread, which therefore must not touch the converter once its slot is back.
+    assert(!m_converterBusy && "convert thread still using the converter");
+    DestroySlots();
+    m_captureRect = rect;
+    ConfigureServerScaling(rect);
+    UpdateGrabArea();
+    const int grabWidth = m_grabArea.width;
+    const int grabHeight = m_grabArea.height;
 
+    if (m_grabBackend == GrabBackend::Xcb) {
+        int stride = 0;
+        if (!XcbShmSegment::GetImageLayout(m_xcb, m_depth, grabWidth, m_bytesPerPixel, stride)) {
+            std::cerr << "SnackaCaptureLinux: No pixmap format for depth " << m_depth << "\n";
+            return false;
+        }
+
+        // Segments sized to the grabbed area (also the persistent mirrors for damage capture)
+        for (auto& slot : m_slots) {
+            if (!slot.segment.Create(m_xcb, static_cast<size_t>(stride) * grabHeight, m_xcbFdPassing)) {
+                DestroySlots();
+                return false;
+            }
+            slot.pixels = slot.segment.GetData();
+            slot.stride = stride;
+        }
+
+        // Staging for batched partial grabs: several tile rows of the monitor width
+        if (m_damage && !m_stagingSegment.Create(m_xcb, static_cast<size_t>(stride) * DAMAGE_TILE_SIZE * 4,
+                                                 m_xcbFdPassing)) {
+            DestroySlots();
+            return false;
+        }
+    } else {
+        int screen = DefaultScreen(m_display);
+        Visual* visual = DefaultVisual(m_display, screen);
+
+        // Shared memory XImages sized to the grabbed area (also the persistent mirrors for damage capture)
+        for (auto& slot : m_slots) {
+            if (!CreateShmImage(m_display, visual, m_depth, grabWidth, grabHeight, slot.image, slot.shmInfo)) {
+                DestroySlots();
+                return false;
+            }
+            slot.pixels = reinterpret_cast<uint8_t*>(slot.image->data);
+            slot.stride = slot.image->bytes_per_line;
+            m_bytesPerPixel = slot.image->bits_per_pixel / 8;
+        }
+
+        // Staging image for partial grabs: one tile row of the monitor width
+        if (m_damage && !CreateShmImage(m_display, visual, m_depth, grabWidth, DAMAGE_TILE_SIZE,
+                                        m_stagingImage, m_stagingShmInfo)) {
+            DestroySlots();
+            return false;
+        }
+    }
+
+    for (auto& slot : m_slots) {
+        slot.pendingTiles.Configure(grabWidth, grabHeight, DAMAGE_TILE_SIZE);
+        slot.pendingTiles.MarkAll();
+    }
+
+    if (m_damage) {
+        m_sourceTiles.Configure(grabWidth, grabHeight, DAMAGE_TILE_SIZE);
+        m_outputTiles.Configure(m_width, m_height, DAMAGE_TILE_SIZE);
+    }
+
+    // Output size is fixed; only the scaling from the new source changes
+    m_converter.Configure(grabWidth, grabHeight, m_width, m_height, m_stripeCount);
+    m_cursorOverlay.Configure(rect.width, rect.height, m_width, m_height, m_converter.GetColorSpace());
+    m_needFullFrame = true;
+
+    std::cerr << "SnackaCaptureLinux: Capturing " << (isRegion ? "region" : "display " + std::to_string(m_displayIndex))
+              << " area " << rect.width << "x" << rect.height << "+" << rect.x << "+" << rect.y
+              << (m_serverScaler.IsCreated()
+                      ? " (scaled on the server to " + std::to_string(grabWidth) + "x" + std::to_string(grabHeight) + ")"
+                      : "")
+              << "\n";
     return true;
 }
 
-void X11Capturer::Start(FrameCallback callback) {
+void X11Capturer::ConfigureServerScaling(const FrameRect& rect) {
+    m_serverScaler.Destroy();
+    if (!m_renderAvailable) {
+        return;
+    }
+
+    // Only worth a render pass when it at least halves the pixels grabbed
+    FrameSize scaled = XRenderScaler::PickScaledSize(rect.width, rect.height, m_width, m_height);
+    if (static_cast<int64_t>(scaled.width) * scaled.height * 2 > static_cast<int64_t>(rect.width) * rect.height) {
+        return;
+    }
+
+    // Past 2:1 into the pixmap the bilinear pass skips source pixels; the client's area filter does not
+    if (!XRenderScaler::SamplesCleanly(rect.width, rect.height, scaled.width, scaled.height)) {
+        return;
+    }
+
+    int screen = DefaultScreen(m_display);
+    Visual* visual = DefaultVisual(m_display, screen);
+    if (m_serverScaleMode == ServerScaleMode::Auto &&
+        (rect.width != m_serverScaleMeasuredSize.width || rect.height != m_serverScaleMeasuredSize.height)) {
+        // Only the grab is timed: conversion from the smaller source is cheaper anyway,
+        // so this errs towards client scaling. Servers without a GPU path (Xvfb, some
+        // drivers) can render slower than they copy.
+        double clientMs = 0.0;
+        double serverMs = 0.0;
+        m_serverScaleMeasuredSize = {rect.width, rect.height};
+        m_serverScaleFaster = XRenderScaler::Measure(m_display, m_rootWindow, visual, m_depth, rect, scaled.width,
+                                                     scaled.height, 5, clientMs, serverMs) &&
+                              serverMs < clientMs;
+        auto flags = std::cerr.flags();
+        auto precision = std::cerr.precision();
+        std::cerr << "SnackaCaptureLinux: Full grab " << std::fixed << std::setprecision(2) << clientMs
+                  << " ms, server-scaled to " << scaled.width << "x" << scaled.height << " " << serverMs
+                  << " ms: scaling on the " << (m_serverScaleFaster ? "server" : "client") << "\n";
+        std::cerr.flags(flags);
+        std::cerr.precision(precision);
+    }
+    if (m_serverScaleMode == ServerScaleMode::Auto && !m_serverScaleFaster) {
+        return;
+    }
+
+    if (!m_serverScaler.Create(m_display, m_rootWindow, visual, m_depth, rect, scaled.width, scaled.height)) {
+        std::cerr << "SnackaCaptureLinux: No XRender format for the root visual, scaling on the client\n";
+    }
+}
+
+void X11Capturer::UpdateGrabArea() {
+    if (m_serverScaler.IsCreated()) {
+        m_serverScaler.SetOrigin(m_captureRect.x, m_captureRect.y);
+        m_grabDrawable = m_serverScaler.GetPixmap();
+        m_grabArea = {0, 0, m_serverScaler.GetWidth(), m_serverScaler.GetHeight()};
+    } else {
+        m_grabDrawable = m_rootWindow;
+        m_grabArea = m_captureRect;
+    }
+}
+
+void X11Capturer::SetRegion(const FrameRect& region) {
+    std::lock_guard<std::mutex> lock(m_regionMutex);
+    m_useRegion = true;
+    m_region = region;
+    m_regionChanged = true;
+}
+
+void X11Capturer::ApplyRegionChange() {
+    FrameRect rect;
+    bool isRegion = false;
+    QueryCaptureRect(rect, isRegion);
+    if (rect.width != m_captureRect.width || rect.height != m_captureRect.height) {
+        // New buffer sizes: go through the same drain as a mode switch
+        m_geometryChanged = true;
+        return;
+    }
+    if (rect.x == m_captureRect.x && rect.y == m_captureRect.y) {
+        return;
+    }
+
+    // Same size: the mirrors and converter stay, but none of their content is valid any more
+    m_captureRect = rect;
+    UpdateGrabArea();
+    m_needFullFrame = true;
+    if (++m_regionMoves <= 5 || m_regionMoves % 100 == 0) {
+        std::cerr << "SnackaCaptureLinux: Region moved to +" << rect.x << "+" << rect.y << "\n";
+    }
+}
+
+bool X11Capturer::UpdateCaptureRect() {
+    FrameRect rect;
+    bool isRegion = false;
+    if (!QueryCaptureRect(rect, isRegion)) {
+        std::cerr << "SnackaCaptureLinux: Display " << m_displayIndex << " not available, capturing the whole screen\n";
+    }
+
+    if (m_slots[0].pixels && rect.x == m_captureRect.x && rect.y == m_captureRect.y &&
+        rect.width == m_captureRect.width && rect.height == m_captureRect.height) {
+        return true;
+    }
+    return ApplyCaptureRect(rect, isRegion);
+}
+
+void X11Capturer::ProcessEvents() {
+    while (XPending(m_display) > 0) {
+        XEvent event;
+        XNextEvent(m_display, &event);
+        if (m_damage && event.type == m_damageEventBase + XDamageNotify) {
+            // Any notify means the damage region is non-empty
+            m_damagePending = true;
+        } else if (m_randrAvailable && (event.type == m_randrEventBase + RRScreenChangeNotify ||
+                                        event.type == m_randrEventBase + RRNotify)) {
+            // Keeps DisplayWidth/DisplayHeight in sync with the new root size
+            XRRUpdateConfiguration(&event);
+            m_geometryChanged = true;
+        } else if (m_cursorAvailable && event.type == m_fixesEventBase + XFixesCursorNotify) {
+            m_cursorStale = true;
+        }
+    }
+}
+
+
+void X11Capturer::Start(FrameCallback callback, LayerFrameCallback layerCallback) {
     if (m_running) {
         return;
     }
 
     m_callback = callback;
+    m_layerCallback = layerCallback;
+
+    // Stage queues hold at most one pipeline's worth of frames; every index starts free
+    size_t depth = m_slots.size();
+    m_freeSlots = std::make_unique<BoundedQueue<int>>(depth);
+    m_freeBuffers = std::make_unique<BoundedQueue<int>>(depth);
+    m_grabbedFrames = std::make_unique<BoundedQueue<PipelineFrame>>(depth);
+    m_convertedFrames = std::make_unique<BoundedQueue<PipelineFrame>>(depth);
+    for (size_t i = 0; i < depth; i++) {
+        m_freeSlots->Push(static_cast<int>(i));
+        m_freeBuffers->Push(static_cast<int>(i));
+    }
+
     m_running = true;
+    m_emitThread = std::thread(&X11Capturer::EmitLoop, this);
+    m_convertThread = std::thread(&X11Capturer::ConvertLoop, this);
     m_captureThread = std::thread(&X11Capturer::CaptureLoop, this);
 }
 
 void X11Capturer::Stop() {
     m_running = false;
-    if (m_captureThread.joinable()) {
-        m_captureThread.join();
+
+    // Closing the queues wakes any stage blocked on a full or empty one
+    if (m_freeSlots) {
+        m_freeSlots->Close();
+        m_freeBuffers->Close();
+        m_grabbedFrames->Close();
+        m_convertedFrames->Close();
+    }
+
+    bool wasRunning = false;
+    for (auto* thread : {&m_captureThread, &m_convertThread, &m_emitThread}) {
+        if (thread->joinable()) {
+            thread->join();
+            wasRunning = true;
+        }
+    }
+
+    if (wasRunning && m_rateController.IsAdaptive()) {
+        std::cerr << "SnackaCaptureLinux: Time at each capture rate: " << m_rateController.DescribeTimeAtRates() << "\n";
     }
 }
 
+void X11Capturer::ReportFrameChanged(bool changed) {
+    m_changeFeedback.fetch_or(changed ? 2 : 1);
+}
+
 void X11Capturer::CaptureLoop() {
-    auto frameInterval = std::chrono::microseconds(1000000 / m_fps);
-    auto nextFrameTime = std::chrono::steady_clock::now();
+    ResetSchedule();
 
     while (m_running) {
-        auto startTime = std::chrono::steady_clock::now();
+        if (m_asyncGrabFailed.exchange(false)) {
+            m_needFullFrame = true;
+        }
+
+        // Resize the capture when the monitor's mode or position (or the region) changed
+        ProcessEvents();
+        if (m_regionChanged.exchange(false)) {
+            ApplyRegionChange();
+        }
+        if (m_geometryChanged) {
+            // Take every slot back first so no stage is reading the images being replaced
+            std::vector<int> held;
+            int index = 0;
+            while (held.size() < m_slots.size() && m_freeSlots->Pop(index)) {
+                held.push_back(index);
+            }
+            if (held.size() < m_slots.size()) {
+                break;  // Stopping
+            }
 
-        // Capture screen using XShm
-        if (!XShmGetImage(m_display, m_rootWindow, m_image, 0, 0, AllPlanes)) {
-            std::cerr << "SnackaCaptureLinux: XShmGetImage failed\n";
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            continue;
+            bool updated = UpdateCaptureRect();
+            for (int slot : held) {
+                m_freeSlots->Push(slot);
+            }
+            if (!updated) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                ResetSchedule();
+                continue;
+            }
+            m_geometryChanged = false;
         }
 
-        // Convert BGRA to NV12
-        ConvertBGRAtoNV12(
-            reinterpret_cast<const uint8_t*>(m_image->data),
-            m_screenWidth,
-            m_screenHeight
-        );
+        int slotIndex = 0;
+        if (!m_freeSlots->TryPop(slotIndex)) {
+            // Conversion or the consumer is behind: skip this tick rather than wait,
+            // damage keeps accumulating on the server until the next grab
+            m_droppedFrames++;
+        } else {
+            PipelineFrame frame;
+            frame.slot = slotIndex;
+            frame.grabStart = std::chrono::steady_clock::now();
+            frame.timestamp = GetTimestampMs();
+            m_scheduler.OnFrameStart(frame.grabStart);
 
-        // Invoke callback with NV12 data
-        if (m_callback) {
-            uint64_t timestamp = GetTimestampMs();
-            m_callback(m_nv12Buffer.data(), m_nv12Buffer.size(), timestamp);
+            CollectDamage(frame);
+            bool pointerChanged = UpdateCursor(frame);
+            if (m_damage || pointerChanged) {
+                bool damaged = frame.info.fullFrame || !frame.info.dirtyRects.empty();
+                m_rateController.OnFrame(damaged || pointerChanged, frame.grabStart);
+            }
+            if (!GrabSlotContents(m_slots[slotIndex], frame)) {
+                std::cerr << "SnackaCaptureLinux: XShmGetImage failed\n";
+                m_slots[slotIndex].pendingTiles.MarkAll();
+                m_needFullFrame = true;
+                m_freeSlots->Push(slotIndex);
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                ResetSchedule();
+                continue;
+            }
+
+            auto elapsed = std::chrono::steady_clock::now() - frame.grabStart;
+            frame.grabMs = std::chrono::duration<double, std::milli>(elapsed).count();
+            if (!m_grabbedFrames->Push(std::move(frame))) {
+                break;
+            }
+        }
+
+        // Without damage the consumer's change detection says whether the content is still
+        int feedback = m_changeFeedback.exchange(0);
+        if (!m_damage && feedback != 0) {
+            m_rateController.OnFrame((feedback & 2) != 0, std::chrono::steady_clock::now());
         }
 
-        // Frame rate control
-        nextFrameTime += frameInterval;
+        // Frame rate control: the next slot on the grid, giving up slots already missed
+        m_scheduler.Advance(m_rateController.GetInterval(), std::chrono::steady_clock::now());
+        WaitForNextFrame();
+    }
+}
+
+void X11Capturer::ResetSchedule() {
+    auto now = std::chrono::steady_clock::now();
+    if (m_hasClockOrigin) {
+        m_scheduler.Reset(now, m_clockOrigin, m_rateController.GetInterval());
+    } else {
+        m_scheduler.Reset(now);
+    }
+}
+
+void X11Capturer::WaitForNextFrame() {
+    // At the target rate (or without damage to wake us) there is nothing to watch for
+    auto targetInterval = m_rateController.GetTargetInterval();
+    if (!m_damage || m_rateController.GetInterval() == targetInterval) {
+        m_scheduler.WaitForDeadline();
+        return;
+    }
+
+    // Slowed down: wait on the X connection so damage can pull the next frame in.
+    // Polls are capped at one target interval because the XCB converter may read
+    // events off the socket while waiting for its replies.
+    auto nextFrameTime = m_scheduler.GetDeadline();
+    auto frameStart = nextFrameTime - m_rateController.GetInterval();
+    while (m_running) {
+        // Grab replies may have pulled events into Xlib's queue that poll() won't see
+        ProcessEvents();
         auto now = std::chrono::steady_clock::now();
-        if (nextFrameTime > now) {
-            std::this_thread::sleep_until(nextFrameTime);
+        if (m_damagePending || m_geometryChanged || m_regionChanged) {
+            // Possible motion: capture at the target rate's next slot, which the grid
+            // then continues from. Damage may lie outside the captured area, so whether
+            // the rate goes back up is decided by the dirty tiles of that frame, not here.
+            m_scheduler.MoveDeadline(std::max(frameStart + targetInterval, now));
+            m_scheduler.WaitForDeadline();
+            return;
+        }
+        if (now >= nextFrameTime) {
+            return;
+        }
+
+        auto timeout = std::min(std::chrono::duration_cast<std::chrono::microseconds>(nextFrameTime - now),
+                                targetInterval);
+        pollfd fd = {ConnectionNumber(m_display), POLLIN, 0};
+        poll(&fd, 1, static_cast<int>((timeout.count() + 999) / 1000));
+    }
+}
+
+bool X11Capturer::UpdateCursor(PipelineFrame& frame) {
+    if (!m_cursorAvailable) {
+        return false;
+    }
+
+    if (m_cursorStale) {
+        m_cursorStale = false;
+        if (XFixesCursorImage* image = XFixesGetCursorImage(m_display)) {
+            // Pixels come as longs, premultiplied ARGB in the low 32 bits
+            auto shape = std::make_shared<CursorImage>();
+            shape->serial = static_cast<uint32_t>(image->cursor_serial);
+            shape->width = image->width;
+            shape->height = image->height;
+            shape->xhot = image->xhot;
+            shape->yhot = image->yhot;
+            shape->argb.resize(static_cast<size_t>(image->width) * image->height);
+            for (size_t i = 0; i < shape->argb.size(); i++) {
+                shape->argb[i] = static_cast<uint32_t>(image->pixels[i]);
+            }
+            m_cursorShape = std::move(shape);
+            XFree(image);
+        }
+    }
+
+    Window root = 0;
+    Window child = 0;
+    int rootX = 0;
+    int rootY = 0;
+    int windowX = 0;
+    int windowY = 0;
+    unsigned int mask = 0;
+    FrameCursor& cursor = frame.sourceCursor;
+    cursor.shape = m_cursorShape;
+
+    // False when the pointer is on another X screen
+    cursor.visible = m_cursorShape &&
+                     XQueryPointer(m_display, m_rootWindow, &root, &child, &rootX, &rootY, &windowX, &windowY, &mask);
+    cursor.x = rootX - m_captureRect.x;
+    cursor.y = rootY - m_captureRect.y;
+
+    bool changed = !SameCursor(cursor, m_lastPointer);
+    m_lastPointer = cursor;
+    return changed;
+}
+
+void X11Capturer::CollectDamage(PipelineFrame& frame) {
+    frame.info.fullFrame = true;
+    frame.info.dirtyRects.assign(1, FrameRect{0, 0, m_width, m_height});
+    if (!m_damage) {
+        return;
+    }
+
+    if (m_needFullFrame) {
+        // Discard accumulated damage first so changes made during the grab show up next frame
+        XDamageSubtract(m_display, m_damage, None, None);
+        m_damagePending = false;
+        m_needFullFrame = false;
+        for (auto& slot : m_slots) {
+            slot.pendingTiles.MarkAll();
+        }
+        return;
+    }
+
+    frame.info.fullFrame = false;
+    frame.info.dirtyRects.clear();
+    if (!m_damagePending) {
+        return;
+    }
+    m_damagePending = false;
+
+    // Move the accumulated damage into our region and fetch its rectangles
+    XDamageSubtract(m_display, m_damage, None, m_damageRegion);
+    int count = 0;
+    XRectangle* rects = XFixesFetchRegion(m_display, m_damageRegion, &count);
+
+    // Damage is in root coordinates; MarkRect drops whatever lies on other monitors.
+    // Source tiles are in grab coordinates, i.e. of the pixmap when scaling on the server.
+    m_sourceTiles.Clear();
+    for (int i = 0; i < count; i++) {
+        FrameRect rect = {rects[i].x - m_captureRect.x, rects[i].y - m_captureRect.y, rects[i].width, rects[i].height};
+        m_sourceTiles.MarkRect(m_serverScaler.IsCreated() ? m_serverScaler.MapSourceRect(rect) : rect);
+    }
+    if (rects) {
+        XFree(rects);
+    }
+
+    int dirtyTiles = m_sourceTiles.GetDirtyCount();
+    if (dirtyTiles == 0) {
+        return;
+    }
+
+    // Every mirror is stale in these tiles until it is next grabbed
+    m_sourceTiles.CollectRects(m_grabRects);
+    for (auto& slot : m_slots) {
+        for (const auto& rect : m_grabRects) {
+            slot.pendingTiles.MarkRect(rect);
+        }
+    }
+
+    if (dirtyTiles > FULL_GRAB_THRESHOLD * m_sourceTiles.GetColumns() * m_sourceTiles.GetRows()) {
+        frame.info.fullFrame = true;
+        frame.info.dirtyRects.assign(1, FrameRect{0, 0, m_width, m_height});
+        return;
+    }
+
+    m_outputTiles.Clear();
+    for (const auto& rect : m_grabRects) {
+        m_outputTiles.MarkRect(m_converter.MapSourceRect(rect));
+    }
+    m_outputTiles.CollectRects(frame.info.dirtyRects);
+}
+
+bool X11Capturer::GrabSlotContents(GrabSlot& slot, PipelineFrame& frame) {
+    TileMap& pending = slot.pendingTiles;
+    int dirtyTiles = m_damage ? pending.GetDirtyCount() : pending.GetColumns() * pending.GetRows();
+    if (dirtyTiles == 0) {
+        return true;
+    }
+
+    if (dirtyTiles > FULL_GRAB_THRESHOLD * pending.GetColumns() * pending.GetRows()) {
+        if (m_serverScaler.IsCreated()) {
+            m_serverScaler.Render(m_grabArea);
+        }
+        if (m_grabBackend == GrabBackend::Xcb) {
+            // Only send the request: the converter waits for the copy, so the grab
+            // thread is free to pace and issue the next frame meanwhile
+            frame.imageCookie = slot.segment.RequestImage(m_grabDrawable, m_grabArea.x, m_grabArea.y,
+                                                          m_grabArea.width, m_grabArea.height, 0);
+            frame.awaitingImage = true;
+            xcb_flush(m_xcb);
+        } else if (!XShmGetImage(m_display, m_grabDrawable, slot.image, m_grabArea.x, m_grabArea.y, AllPlanes)) {
+            return false;
+        }
+        frame.grabbedBytes += static_cast<uint64_t>(slot.stride) * m_grabArea.height;
+    } else {
+        pending.CollectRects(m_grabRects);
+        if (m_serverScaler.IsCreated()) {
+            for (const auto& rect : m_grabRects) {
+                m_serverScaler.Render(rect);
+            }
+        }
+        if (m_grabBackend == GrabBackend::Xcb) {
+            if (!GrabRectsXcb(slot, m_grabRects)) {
+                return false;
+            }
         } else {
-            // We're behind, reset the timing
-            nextFrameTime = now;
+            for (const auto& rect : m_grabRects) {
+                if (!GrabRect(slot, rect)) {
+                    return false;
+                }
+            }
+        }
+        for (const auto& rect : m_grabRects) {
+            frame.grabbedBytes += static_cast<uint64_t>(rect.width) * m_bytesPerPixel * rect.height;
+        }
+    }
+
+    pending.Clear();
+    return true;
+}
+
+bool X11Capturer::GrabRectsXcb(GrabSlot& slot, const std::vector<FrameRect>& rects) {
+    bool ok = true;
+
+    // Wait for every queued band (replies must be consumed even after a failure)
+    // and copy the ones that landed into the mirror
+    auto drain = [&]() {
+        for (const auto& band : m_stagedBands) {
+            if (!m_stagingSegment.WaitImage(band.cookie)) {
+                ok = false;
+                continue;
+            }
+            size_t rowBytes = static_cast<size_t>(band.rect.width) * m_bytesPerPixel;
+            const uint8_t* src = m_stagingSegment.GetData() + band.offset;
+            uint8_t* dst = slot.pixels + static_cast<size_t>(band.rect.y) * slot.stride +
+                           static_cast<size_t>(band.rect.x) * m_bytesPerPixel;
+            for (int row = 0; row < band.rect.height; row++) {
+                memcpy(dst + static_cast<size_t>(row) * slot.stride, src + static_cast<size_t>(row) * band.stride,
+                       rowBytes);
+            }
+        }
+        m_stagedBands.clear();
+    };
+
+    // Pack bands into the staging segment and keep all their requests in flight, so a
+    // batch costs one round trip instead of one per band
+    size_t used = 0;
+    for (const auto& rect : rects) {
+        for (int bandY = rect.y; bandY < rect.y + rect.height; bandY += DAMAGE_TILE_SIZE) {
+            StagedBand band;
+            band.rect = {rect.x, bandY, rect.width, std::min(DAMAGE_TILE_SIZE, rect.y + rect.height - bandY)};
+            int bytesPerPixel = 0;
+            XcbShmSegment::GetImageLayout(m_xcb, m_depth, band.rect.width, bytesPerPixel, band.stride);
+            size_t bytes = static_cast<size_t>(band.stride) * band.rect.height;
+
+            if (used + bytes > m_stagingSegment.GetSize()) {
+                drain();
+                used = 0;
+            }
+            band.offset = static_cast<uint32_t>(used);
+            band.cookie = m_stagingSegment.RequestImage(m_grabDrawable, m_grabArea.x + band.rect.x,
+                                                        m_grabArea.y + band.rect.y, band.rect.width,
+                                                        band.rect.height, band.offset);
+            m_stagedBands.push_back(band);
+            used += (bytes + 63) & ~static_cast<size_t>(63);
+        }
+    }
+    drain();
+
+    return ok;
+}
+
+bool X11Capturer::GrabRect(GrabSlot& slot, const FrameRect& rect) {
+    XImage* image = slot.image;
+    int bytesPerPixel = image->bits_per_pixel / 8;
+    size_t rowBytes = static_cast<size_t>(rect.width) * bytesPerPixel;
+
+    // The server writes the staging image with the stride of its current width,
+    // so shrink the header to the rectangle and copy rows into the mirror
+    for (int bandY = rect.y; bandY < rect.y + rect.height; bandY += DAMAGE_TILE_SIZE) {
+        int bandHeight = std::min(DAMAGE_TILE_SIZE, rect.y + rect.height - bandY);
+        m_stagingImage->width = rect.width;
+        m_stagingImage->height = bandHeight;
+        m_stagingImage->bytes_per_line = ((rect.width * m_stagingImage->bits_per_pixel + 31) / 32) * 4;
+
+        if (!XShmGetImage(m_display, m_grabDrawable, m_stagingImage,
+                          m_grabArea.x + rect.x, m_grabArea.y + bandY, AllPlanes)) {
+            return false;
+        }
+
+        for (int row = 0; row < bandHeight; row++) {
+            memcpy(image->data + static_cast<size_t>(bandY + row) * image->bytes_per_line + rect.x * bytesPerPixel,
+                   m_stagingImage->data + static_cast<size_t>(row) * m_stagingImage->bytes_per_line,
+                   rowBytes);
         }
     }
+
+    return true;
 }
 
-void X11Capturer::ConvertBGRAtoNV12(const uint8_t* bgra, int srcWidth, int srcHeight) {
-    // Simple conversion with scaling if needed
-    // For now, we'll do nearest-neighbor scaling if dimensions differ
+void X11Capturer::ConvertLoop() {
+    PipelineFrame frame;
+    while (m_grabbedFrames->Pop(frame)) {
+        if (frame.awaitingImage) {
+            auto waitStart = std::chrono::steady_clock::now();
+            bool landed = m_slots[frame.slot].segment.WaitImage(frame.imageCookie);
+            auto waited = std::chrono::steady_clock::now() - waitStart;
+            frame.grabMs += std::chrono::duration<double, std::milli>(waited).count();
+            if (!landed) {
+                // The mirror may be half written: hand it back and have the grab thread start over
+                std::cerr << "SnackaCaptureLinux: xcb_shm_get_image failed\n";
+                m_asyncGrabFailed = true;
+                m_freeSlots->Push(frame.slot);
+                continue;
+            }
+        }
 
-    float scaleX = static_cast<float>(srcWidth) / m_width;
-    float scaleY = static_cast<float>(srcHeight) / m_height;
+        int bufferIndex = 0;
+        if (!m_freeBuffers->Pop(bufferIndex)) {
+            break;
+        }
+        m_converterBusy = true;
+        auto start = std::chrono::steady_clock::now();
 
-    uint8_t* yPlane = m_nv12Buffer.data();
-    uint8_t* uvPlane = m_nv12Buffer.data() + m_width * m_height;
+        // Every buffer has to pick up this frame's changes, now or when it is next used
+        for (auto& buffer : m_buffers) {
+            if (frame.info.fullFrame) {
+                buffer.pendingTiles.MarkAll();
+            } else {
+                for (const auto& rect : frame.info.dirtyRects) {
+                    buffer.pendingTiles.MarkRect(rect);
+                }
+            }
+        }
 
-    int srcBytesPerPixel = m_image->bits_per_pixel / 8;
-    int srcStride = m_image->bytes_per_line;
+        // The slot's mirror is current everywhere, so any stale tile can be rebuilt from it
+        OutputBuffer& buffer = m_buffers[bufferIndex];
+        const GrabSlot& slot = m_slots[frame.slot];
+        bool drawCursor = PrepareCursor(frame, buffer);
+        int dirtyTiles = buffer.pendingTiles.GetDirtyCount();
+        if (dirtyTiles > FULL_GRAB_THRESHOLD * buffer.pendingTiles.GetColumns() * buffer.pendingTiles.GetRows()) {
+            ConvertFrame(slot, buffer.nv12.data());
+            frame.convertedPixels = static_cast<uint64_t>(m_width) * m_height;
+        } else if (dirtyTiles > 0) {
+            buffer.pendingTiles.CollectRects(m_convertRects);
+            ConvertRects(slot, buffer.nv12.data(), m_convertRects);
+            for (const auto& rect : m_convertRects) {
+                frame.convertedPixels += static_cast<uint64_t>(rect.width) * rect.height;
+            }
+        }
+        buffer.pendingTiles.Clear();
 
-    // Convert to Y plane (full resolution)
-    for (int y = 0; y < m_height; y++) {
-        int srcY = static_cast<int>(y * scaleY);
-        srcY = std::min(srcY, srcHeight - 1);
+        if (drawCursor) {
+            m_cursorOverlay.Blend(frame.info.cursor, buffer.nv12.data());
+            buffer.drawnCursor = frame.info.cursor;
+        }
 
-        for (int x = 0; x < m_width; x++) {
-            int srcX = static_cast<int>(x * scaleX);
-            srcX = std::min(srcX, srcWidth - 1);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        frame.convertMs = std::chrono::duration<double, std::milli>(elapsed).count();
+
+        // The stripe report reads the converter, which the grab thread may reconfigure
+        // as soon as it has every slot back
+        if (++m_timedFrames == 100) {
+            ReportStripeTimings();
+        }
 
-            const uint8_t* pixel = bgra + srcY * srcStride + srcX * srcBytesPerPixel;
-            uint8_t b = pixel[0];
-            uint8_t g = pixel[1];
-            uint8_t r = pixel[2];
+        // No converter, cursor overlay or stripe timing access from here on
+        m_converterBusy = false;
+        m_freeSlots->Push(frame.slot);
+        frame.slot = -1;
+        frame.buffer = bufferIndex;
 
-            // BT.601 conversion
-            int yVal = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
-            yPlane[y * m_width + x] = static_cast<uint8_t>(std::clamp(yVal, 0, 255));
+        if (!m_convertedFrames->Push(std::move(frame))) {
+            break;
         }
     }
+}
 
-    // Convert to UV plane (half resolution, interleaved)
-    for (int y = 0; y < m_height / 2; y++) {
-        int srcY = static_cast<int>(y * 2 * scaleY);
-        srcY = std::min(srcY, srcHeight - 1);
+bool X11Capturer::PrepareCursor(PipelineFrame& frame, OutputBuffer& buffer) {
+    if (!m_cursorAvailable) {
+        return false;
+    }
 
-        for (int x = 0; x < m_width / 2; x++) {
-            int srcX = static_cast<int>(x * 2 * scaleX);
-            srcX = std::min(srcX, srcWidth - 1);
+    FrameCursor& cursor = frame.info.cursor;
+    cursor.visible = frame.sourceCursor.visible;
+    cursor.shape = m_cursorOverlay.Scale(frame.sourceCursor.shape);
+    m_cursorOverlay.MapPosition(frame.sourceCursor.x, frame.sourceCursor.y, cursor.x, cursor.y);
+    if (m_cursorMode != CursorMode::Overlay) {
+        return false;
+    }
+
+    // Consumers see the pointer as changed pixels under its old and new position
+    FrameRect newRect = m_cursorOverlay.GetRect(cursor);
+    if (!SameCursor(cursor, m_lastCursor) && !frame.info.fullFrame) {
+        for (const FrameRect& rect : {m_cursorOverlay.GetRect(m_lastCursor), newRect}) {
+            if (rect.width > 0) {
+                frame.info.dirtyRects.push_back(rect);
+            }
+        }
+    }
+    m_lastCursor = cursor;
+
+    // Blending needs clean pixels: restore the tiles under the pointer in this buffer
+    // whenever it moved since the buffer last had it, or damage is about to overwrite it
+    if (SameCursor(cursor, buffer.drawnCursor) && !buffer.pendingTiles.IsAnyDirty(newRect)) {
+        return false;
+    }
+    buffer.pendingTiles.MarkRect(m_cursorOverlay.GetRect(buffer.drawnCursor));
+    buffer.pendingTiles.MarkRect(newRect);
+    return true;
+}
 
-            // Sample 2x2 block and average
-            int rSum = 0, gSum = 0, bSum = 0;
-            int count = 0;
+void X11Capturer::ConvertFrame(const GrabSlot& slot, uint8_t* nv12) {
+    const uint8_t* bgra = slot.pixels;
+    int srcStride = slot.stride;
+    int srcBytesPerPixel = m_bytesPerPixel;
 
-            for (int dy = 0; dy < 2; dy++) {
-                for (int dx = 0; dx < 2; dx++) {
-                    int px = std::min(static_cast<int>((x * 2 + dx) * scaleX), srcWidth - 1);
-                    int py = std::min(static_cast<int>((y * 2 + dy) * scaleY), srcHeight - 1);
+    m_workerPool->Run(m_converter.GetStripeCount(), [&](int stripe) {
+        auto start = std::chrono::steady_clock::now();
+        m_converter.ConvertStripe(stripe, bgra, srcStride, srcBytesPerPixel, nv12);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        m_stripeTimings[stripe].totalMs += std::chrono::duration<double, std::milli>(elapsed).count();
+    });
+}
+
+void X11Capturer::ConvertRects(const GrabSlot& slot, uint8_t* nv12, const std::vector<FrameRect>& rects) {
+    const uint8_t* bgra = slot.pixels;
+    int srcStride = slot.stride;
+    int srcBytesPerPixel = m_bytesPerPixel;
+    int tasks = std::min(m_converter.GetStripeCount(), static_cast<int>(rects.size()));
+
+    // Rectangles are tile-aligned and disjoint, so workers never write the same bytes
+    m_converter.ResetSourceBytesRead();
+    m_workerPool->Run(tasks, [&](int task) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = task; i < rects.size(); i += tasks) {
+            m_converter.ConvertRect(task, bgra, srcStride, srcBytesPerPixel, nv12, rects[i]);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        m_stripeTimings[task].totalMs += std::chrono::duration<double, std::milli>(elapsed).count();
+    });
+}
+
+void X11Capturer::ReportStripeTimings() {
+    double sum = 0.0;
+    double maxMs = 0.0;
+    for (const auto& timing : m_stripeTimings) {
+        double avgMs = timing.totalMs / m_timedFrames;
+        sum += avgMs;
+        maxMs = std::max(maxMs, avgMs);
+    }
+    double meanMs = sum / m_stripeTimings.size();
+
+    // The frame waits for the slowest stripe: imbalance is how far it is above the mean
+    auto flags = std::cerr.flags();
+    auto precision = std::cerr.precision();
+    std::cerr << "SnackaCaptureLinux: Conversion stripe times (avg over " << m_timedFrames << " frames):";
+    for (const auto& timing : m_stripeTimings) {
+        std::cerr << " " << std::fixed << std::setprecision(2) << timing.totalMs / m_timedFrames;
+    }
+    std::cerr << " ms, imbalance " << std::setprecision(0)
+              << (meanMs > 0.0 ? (maxMs - meanMs) / meanMs * 100.0 : 0.0) << "%"
+              << ", source read " << std::setprecision(2)
+              << m_converter.GetSourceBytesRead() / (1024.0 * 1024.0) << " MiB/frame\n";
+    std::cerr.flags(flags);
+    std::cerr.precision(precision);
 
-                    const uint8_t* pixel = bgra + py * srcStride + px * srcBytesPerPixel;
-                    bSum += pixel[0];
-                    gSum += pixel[1];
-                    rSum += pixel[2];
-                    count++;
+    for (auto& timing : m_stripeTimings) {
+        timing.totalMs = 0.0;
+    }
+    m_timedFrames = 0;
+}
+
+void X11Capturer::EmitLoop() {
+    int layerCount = m_pyramid.GetLayerCount();
+    m_stats = PipelineStats{};
+    m_stats.layerMs.assign(layerCount, 0.0);
+    m_stats.windowStart = std::chrono::steady_clock::now();
+
+    PipelineFrame frame;
+    while (m_convertedFrames->Pop(frame)) {
+        auto start = std::chrono::steady_clock::now();
+        const auto& nv12 = m_buffers[frame.buffer].nv12;
+        if (m_callback) {
+            m_callback(nv12.data(), nv12.size(), frame.timestamp, frame.info);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        // Every converted frame is emitted, so each one's dirty rects are relative to
+        // the previous update of the layers
+        if (layerCount > 0) {
+            m_pyramid.Update(nv12.data(), frame.info);
+            for (int i = 0; i < layerCount; i++) {
+                m_stats.layerMs[i] += m_pyramid.GetLayerMs(i);
+                if (m_layerCallback) {
+                    const auto& layer = m_pyramid.GetLayerData(i);
+                    m_layerCallback(i + 1, layer.data(), layer.size(), frame.timestamp, m_pyramid.GetLayerInfo(i));
                 }
             }
+        }
+        m_freeBuffers->Push(frame.buffer);
+
+        m_stats.frames++;
+        m_stats.grabMs += frame.grabMs;
+        m_stats.convertMs += frame.convertMs;
+        m_stats.emitMs += std::chrono::duration<double, std::milli>(end - start).count();
+        m_stats.latencyMs += std::chrono::duration<double, std::milli>(end - frame.grabStart).count();
+        m_stats.grabbedBytes += frame.grabbedBytes;
+        m_stats.convertedPixels += frame.convertedPixels;
+        if (m_stats.frames == 100) {
+            ReportPipelineStats();
+        }
+    }
+}
 
-            int r = rSum / count;
-            int g = gSum / count;
-            int b = bSum / count;
+void X11Capturer::ReportPipelineStats() {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - m_stats.windowStart).count();
+    double frames = m_stats.frames;
 
-            // BT.601 conversion
-            int u = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
-            int v = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    // Achieved fps is bounded by the slowest stage, not by their sum as in a serial loop
+    auto flags = std::cerr.flags();
+    auto precision = std::cerr.precision();
+    std::cerr << "SnackaCaptureLinux: Pipeline (depth " << m_pipelineDepth << "): " << std::fixed
+              << std::setprecision(1) << (seconds > 0.0 ? frames / seconds : 0.0) << " of " << m_fps << " fps"
+              << std::setprecision(2)
+              << ", grab " << m_stats.grabMs / frames << " ms"
+              << ", convert " << m_stats.convertMs / frames << " ms"
+              << ", emit " << m_stats.emitMs / frames << " ms"
+              << ", latency " << m_stats.latencyMs / frames << " ms"
+              << ", dropped " << m_droppedFrames.exchange(0) << "\n";
+    std::cerr << "SnackaCaptureLinux: Pacing: " << m_scheduler.DescribeStats(true) << "\n";
 
-            int uvIndex = y * m_width + x * 2;
-            uvPlane[uvIndex] = static_cast<uint8_t>(std::clamp(u, 0, 255));
-            uvPlane[uvIndex + 1] = static_cast<uint8_t>(std::clamp(v, 0, 255));
+    if (!m_stats.layerMs.empty()) {
+        std::cerr << "SnackaCaptureLinux: Simulcast layers:" << std::setprecision(2);
+        for (size_t i = 0; i < m_stats.layerMs.size(); i++) {
+            FrameSize size = m_pyramid.GetLayerSize(static_cast<int>(i));
+            std::cerr << (i == 0 ? " " : ", ") << size.width << "x" << size.height << " "
+                      << m_stats.layerMs[i] / frames << " ms";
         }
+        std::cerr << "\n";
     }
+
+    if (m_rateController.IsAdaptive()) {
+        std::cerr << "SnackaCaptureLinux: Capture rate now " << m_rateController.GetCurrentFps()
+                  << " fps, time at each rate: " << m_rateController.DescribeTimeAtRates() << "\n";
+    }
+
+    if (m_damage) {
+        double outputPixels = static_cast<double>(m_width) * m_height * frames;
+        std::cerr << "SnackaCaptureLinux: Damage capture: " << std::setprecision(1)
+                  << m_stats.convertedPixels / outputPixels * 100.0 << "% of output reconverted, "
+                  << std::setprecision(2) << m_stats.grabbedBytes / (1024.0 * 1024.0) / frames
+                  << " MiB/frame grabbed\n";
+    }
+    std::cerr.flags(flags);
+    std::cerr.precision(precision);
+
+    size_t layerCount = m_stats.layerMs.size();
+    m_stats = PipelineStats{};
+    m_stats.layerMs.assign(layerCount, 0.0);
+    m_stats.windowStart = now;
 }
 
 uint64_t X11Capturer::GetTimestampMs() const {
@@ -1,14 +1,33 @@
 #pragma once
 
+#include "BoundedQueue.h"
+#include "ColorConverter.h"
+#include "CursorOverlay.h"
+#include "FrameBufferPool.h"
+#include "FrameInfo.h"
+#include "FramePyramid.h"
+#include "FrameRateController.h"
+#include "FrameScheduler.h"
+#include "TileMap.h"
+#include "WorkerPool.h"
+#include "XRenderScaler.h"
+#include "XcbShm.h"
+
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xrandr.h>
 #include <sys/shm.h>
 
+#include <chrono>
 #include <functional>
 #include <thread>
 #include <atomic>
 #include <vector>
+#include <memory>
+#include <mutex>
 #include <cstdint>
 
 namespace snacka {
@@ -17,16 +36,128 @@ namespace snacka {
 /// @param data Pointer to NV12 frame data
 /// @param size Size of the data
 /// @param timestamp Timestamp in milliseconds
-using FrameCallback = std::function<void(const uint8_t* data, size_t size, uint64_t timestamp)>;
+/// @param info Regions of the output that changed since the previous frame
+using FrameCallback = std::function<void(const uint8_t* data, size_t size, uint64_t timestamp, const FrameInfo& info)>;
+
+/// Callback for simulcast layers, called after the full-size frame they were scaled from
+/// @param layer Layer number, 1 = first layer below the full-size output
+/// @param data Pointer to NV12 layer data
+/// @param size Size of the data
+/// @param timestamp Timestamp in milliseconds of the full-size frame
+/// @param info Regions of the layer that changed since its previous frame
+using LayerFrameCallback =
+    std::function<void(int layer, const uint8_t* data, size_t size, uint64_t timestamp, const FrameInfo& info)>;
+
+/// How screen pixels are copied into shared memory
+enum class GrabBackend {
+    Xlib,  // XShmGetImage: one blocking round trip per request, SysV segments
+    Xcb    // xcb_shm_get_image cookies on memfd segments: requests are batched and
+           // full-frame grabs are waited for by the converter, not the grab thread
+};
+
+/// Where the screen is scaled down when the output is much smaller than the captured area
+enum class ServerScaleMode {
+    Off,     // Grab every screen pixel and scale while converting
+    Auto,    // Scale on the X server when a short measurement says the grab gets faster
+    On       // Scale on the X server whenever that at least halves the pixels grabbed
+             // (in both modes only for reductions up to 4:1 per axis, see XRenderScaler)
+};
+
+/// What happens to the mouse pointer, which XShm grabs never include
+enum class CursorMode {
+    Hidden,   // Leave it out
+    Overlay,  // Blend it into the NV12 output
+    Metadata  // Leave it out but report position and image in FrameInfo::cursor
+};
 
-/// X11 screen capturer using XShm for efficient capture
+/// X11 screen capturer using XShm for efficient capture.
+/// With XDamage available, only damaged screen tiles are fetched into a persistent
+/// mirror of the screen and only the output tiles they affect are reconverted;
+/// the rest of the NV12 buffer carries over from the previous frame.
+/// Only the selected monitor's CRTC rectangle (or an explicit region of the screen)
+/// is grabbed; RandR events resize the capture on mode switches and hotplug while
+/// the output size stays fixed.
+///
+/// Grab, convert and emit (the callback) run on three threads connected by bounded
+/// queues, so the grab of frame N+1 overlaps conversion of frame N and a stalled
+/// consumer only costs dropped frames, never a late grab. Each of the pipeline-depth
+/// XShm mirrors and NV12 buffers remembers the tiles changed since it was last
+/// refreshed, so damage tracking stays incremental with several buffers in flight.
+///
+/// The pointer image is fetched with XFixes only when it changes shape; its position
+/// is queried each frame. A pointer move reconverts just the tiles under its old and
+/// new position in each buffer before the cursor is blended on top.
+///
+/// For outputs a quarter to half the captured area per axis, XRender can scale the screen
+/// down on the server first (see XRenderScaler); the mirrors then hold the scaled pixmap and
+/// damage is mapped into its coordinates, so grabs and conversion both shrink.
+///
+/// Simulcast layers are scaled on the emit thread from each emitted frame through a
+/// FramePyramid, so they cost a downscale of the changed regions rather than a grab
+/// and a conversion each.
 class X11Capturer {
 public:
     X11Capturer();
     ~X11Capturer();
 
+    /// Set the number of color conversion threads (call before Initialize)
+    /// @param threads Thread count including the capture thread, 0 = pick from output size
+    void SetConvertThreads(int threads) { m_convertThreads = threads; }
+
+    /// Convert on a pool shared with other capturers instead of a pool of our own (call
+    /// before Initialize). Conversion uses at most the pool's thread count.
+    void SetWorkerPool(std::shared_ptr<WorkerPool> pool) { m_workerPool = std::move(pool); }
+
+    /// Pace grabs on a grid anchored at origin instead of at Start, so capturers given
+    /// the same origin grab in step (call before Start)
+    void SetClockOrigin(FrameScheduler::Clock::time_point origin) {
+        m_clockOrigin = origin;
+        m_hasClockOrigin = true;
+    }
+
+    /// Set the filter used when the output is smaller/larger than the screen (call before Initialize)
+    void SetScaleFilter(ScaleFilter filter) { m_converter.SetScaleFilter(filter); }
+
+    /// Set the output color matrix and range (call before Initialize, default BT.601 limited)
+    void SetColorSpace(const ColorSpace& space) { m_converter.SetColorSpace(space); }
+
+    /// Enable XDamage-driven incremental capture (call before Initialize, default on)
+    void SetDamageTracking(bool enabled) { m_damageTracking = enabled; }
+
+    /// Set how many frames each pipeline stage may hold (call before Initialize, default 2).
+    /// Each step costs one XShm segment of the monitor size and one NV12 buffer.
+    void SetPipelineDepth(int depth) { m_pipelineDepth = depth; }
+
+    /// Select the grab backend (call before Initialize, default Xlib)
+    void SetGrabBackend(GrabBackend backend) { m_grabBackend = backend; }
+
+    /// Select where large reductions are scaled (call before Initialize, default Off)
+    void SetServerScale(ServerScaleMode mode) { m_serverScaleMode = mode; }
+
+    /// Set how the mouse pointer is captured (call before Initialize, default Overlay)
+    void SetCursorMode(CursorMode mode) { m_cursorMode = mode; }
+
+    /// Let the capture rate fall towards this floor while the screen is static (call before Initialize).
+    /// Damage events bring it back to the target within one frame interval.
+    /// @param fps Floor rate, 0 = always capture at the target rate
+    void SetMinFps(int fps) { m_minFps = fps; }
+
+    /// Also produce these smaller outputs from every frame (call before Initialize).
+    /// @param layers Sizes largest first, each even and no larger than the output or the layer above
+    void SetSimulcastLayers(const std::vector<FrameSize>& layers) { m_layerSizes = layers; }
+
+    /// Capture this rectangle of the screen instead of a monitor. May be called again
+    /// while capturing to move or resize it; a move keeps the current buffers, only a
+    /// new size reallocates them. Clamped to stay on screen. Thread-safe.
+    /// @param region Area in root window coordinates
+    void SetRegion(const FrameRect& region);
+
+    /// Report whether the consumer saw the last frame change. Drives the adaptive
+    /// rate when XDamage is unavailable or disabled; ignored otherwise. Thread-safe.
+    void ReportFrameChanged(bool changed);
+
     /// Initialize the capturer
-    /// @param displayIndex Index of the display to capture (currently 0 = root window)
+    /// @param displayIndex XRandR output index as listed by SourceLister (whole screen if not connected)
     /// @param width Output width (capture will be scaled if different from screen)
     /// @param height Output height
     /// @param fps Target frames per second
@@ -34,8 +165,9 @@ public:
     bool Initialize(int displayIndex, int width, int height, int fps);
 
     /// Start capturing
-    /// @param callback Callback to receive captured frames
-    void Start(FrameCallback callback);
+    /// @param callback Callback to receive captured frames (called on the emit thread)
+    /// @param layerCallback Callback to receive simulcast layers (called on the emit thread)
+    void Start(FrameCallback callback, LayerFrameCallback layerCallback = nullptr);
 
     /// Stop capturing
     void Stop();
@@ -43,43 +175,233 @@ public:
     /// Check if capturing is running
     bool IsRunning() const { return m_running; }
 
-    /// Get the screen width
-    int GetScreenWidth() const { return m_screenWidth; }
+    /// Get the width of the captured monitor
+    int GetScreenWidth() const { return m_captureRect.width; }
 
-    /// Get the screen height
-    int GetScreenHeight() const { return m_screenHeight; }
+    /// Get the height of the captured monitor
+    int GetScreenHeight() const { return m_captureRect.height; }
 
 private:
+    /// Shared memory mirror of the captured area (an XImage or an XCB segment, by
+    /// backend); pendingTiles are the source tiles damaged since it was last grabbed
+    struct GrabSlot {
+        XImage* image = nullptr;
+        XShmSegmentInfo shmInfo = {};
+        XcbShmSegment segment;
+        uint8_t* pixels = nullptr;
+        int stride = 0;
+        TileMap pendingTiles;
+    };
+
+    /// NV12 output frame; pendingTiles are the output tiles changed since it was last converted
+    struct OutputBuffer {
+        FrameBuffer nv12;
+        TileMap pendingTiles;
+        FrameCursor drawnCursor;  // What was last blended into nv12
+    };
+
+    /// A frame moving through the pipeline, with what each stage measured
+    struct PipelineFrame {
+        int slot = -1;
+        int buffer = -1;
+        uint64_t timestamp = 0;
+        std::chrono::steady_clock::time_point grabStart;
+        double grabMs = 0.0;
+        double convertMs = 0.0;
+        uint64_t grabbedBytes = 0;
+        uint64_t convertedPixels = 0;
+        FrameInfo info;
+
+        // Pointer in captured-area pixels with the unscaled image
+        FrameCursor sourceCursor;
+
+        // XCB full-frame grab still in flight; the converter waits for it
+        bool awaitingImage = false;
+        xcb_shm_get_image_cookie_t imageCookie = {};
+    };
+
+    bool InitializeDamage();
+    bool InitializeCursor();
+    bool QueryCaptureRect(FrameRect& rect, bool& isRegion) const;
+    bool ApplyCaptureRect(const FrameRect& rect, bool isRegion);
+    void ConfigureServerScaling(const FrameRect& rect);
+    void UpdateGrabArea();
+    bool UpdateCaptureRect();
+    void ProcessEvents();
+    void ApplyRegionChange();
+    void DestroySlots();
+    void ResetSchedule();
+    void WaitForNextFrame();
+
+    // Grab thread
     void CaptureLoop();
-    void ConvertBGRAtoNV12(const uint8_t* bgra, int srcWidth, int srcHeight);
+    void CollectDamage(PipelineFrame& frame);
+    bool GrabSlotContents(GrabSlot& slot, PipelineFrame& frame);
+    bool GrabRect(GrabSlot& slot, const FrameRect& rect);
+    bool GrabRectsXcb(GrabSlot& slot, const std::vector<FrameRect>& rects);
+    bool UpdateCursor(PipelineFrame& frame);
+
+    // Convert thread
+    void ConvertLoop();
+    void ConvertFrame(const GrabSlot& slot, uint8_t* nv12);
+    void ConvertRects(const GrabSlot& slot, uint8_t* nv12, const std::vector<FrameRect>& rects);
+    bool PrepareCursor(PipelineFrame& frame, OutputBuffer& buffer);
+    void ReportStripeTimings();
+
+    // Emit thread
+    void EmitLoop();
+    void ReportPipelineStats();
+
     uint64_t GetTimestampMs() const;
 
     // X11 objects
     Display* m_display = nullptr;
     Window m_rootWindow = 0;
-    XShmSegmentInfo m_shmInfo = {};
-    XImage* m_image = nullptr;
-    bool m_shmAttached = false;
+    int m_depth = 24;
+    int m_bytesPerPixel = 4;
+
+    // XCB grab backend, sharing Xlib's connection
+    GrabBackend m_grabBackend = GrabBackend::Xlib;
+    xcb_connection_t* m_xcb = nullptr;
+    bool m_xcbFdPassing = false;
+    XcbShmSegment m_stagingSegment;
+    std::atomic<bool> m_asyncGrabFailed{false};
+
+    /// A damaged band queued into the staging segment, copied into the mirror once it lands
+    struct StagedBand {
+        FrameRect rect;
+        uint32_t offset = 0;
+        int stride = 0;
+        xcb_shm_get_image_cookie_t cookie = {};
+    };
+    std::vector<StagedBand> m_stagedBands;
 
     // Configuration
     int m_displayIndex = 0;
     int m_width = 0;
     int m_height = 0;
     int m_fps = 30;
+    int m_minFps = 0;
+    int m_pipelineDepth = 2;
+
+    // Captured area in root window coordinates (the region, the selected CRTC, or the whole screen)
+    FrameRect m_captureRect;
 
-    // Screen dimensions
-    int m_screenWidth = 0;
-    int m_screenHeight = 0;
+    // What the mirrors copy: the captured area of the root window, or all of the
+    // server-scaled pixmap
+    Drawable m_grabDrawable = 0;
+    FrameRect m_grabArea;
+
+    // XRender server-side scaling, with the Auto decision remembered per captured size
+    ServerScaleMode m_serverScaleMode = ServerScaleMode::Off;
+    bool m_renderAvailable = false;
+    XRenderScaler m_serverScaler;
+    FrameSize m_serverScaleMeasuredSize;
+    bool m_serverScaleFaster = false;
+
+    // Explicit capture region, written by SetRegion from any thread
+    mutable std::mutex m_regionMutex;
+    bool m_useRegion = false;
+    FrameRect m_region;
+    std::atomic<bool> m_regionChanged{false};
+    int m_regionMoves = 0;
+    int m_stripeCount = 1;
+
+    // RandR change notifications
+    bool m_randrAvailable = false;
+    int m_randrEventBase = 0;
+    bool m_geometryChanged = false;
 
     // Thread control
     std::atomic<bool> m_running{false};
     std::thread m_captureThread;
+    std::thread m_convertThread;
+    std::thread m_emitThread;
 
-    // Callback
+    // Callbacks
     FrameCallback m_callback;
+    LayerFrameCallback m_layerCallback;
+
+    // Simulcast layers, owned by the emit thread once started
+    std::vector<FrameSize> m_layerSizes;
+    FramePyramid m_pyramid;
+
+    // Pipeline buffers and the queues between stages. The free lists hold indices
+    // into m_slots / m_buffers; a stage owns an index from pop until it pushes it on.
+    std::vector<GrabSlot> m_slots;
+    std::vector<OutputBuffer> m_buffers;
+    std::unique_ptr<BoundedQueue<int>> m_freeSlots;
+    std::unique_ptr<BoundedQueue<int>> m_freeBuffers;
+    std::unique_ptr<BoundedQueue<PipelineFrame>> m_grabbedFrames;
+    std::unique_ptr<BoundedQueue<PipelineFrame>> m_convertedFrames;
+
+    // BGRA -> NV12 conversion (SIMD kernel picked at runtime), one stripe per worker.
+    // Ownership follows the slots: the convert thread uses the converter, the cursor
+    // overlay and the stripe timings only while it holds a slot, never after pushing it
+    // to m_freeSlots; the grab thread reconfigures them (ApplyCaptureRect) only while it
+    // holds every slot. m_converterBusy marks the convert thread's span to check that.
+    ColorConverter m_converter;
+    int m_convertThreads = 0;
+    std::shared_ptr<WorkerPool> m_workerPool;
+
+    // Per-stripe conversion time, one cache line each so workers don't share lines
+    struct alignas(64) StripeTiming {
+        double totalMs = 0.0;
+    };
+    std::vector<StripeTiming> m_stripeTimings;
+    int m_timedFrames = 0;
+    std::atomic<bool> m_converterBusy{false};
+
+    // XDamage incremental capture: damaged tiles are fetched into the slot's mirror
+    // through a one-tile-row staging image
+    bool m_damageTracking = true;
+    int m_damageEventBase = 0;
+    Damage m_damage = 0;
+    XserverRegion m_damageRegion = 0;
+    bool m_damagePending = false;
+    bool m_needFullFrame = true;
+    XImage* m_stagingImage = nullptr;
+    XShmSegmentInfo m_stagingShmInfo = {};
+    TileMap m_sourceTiles;
+    TileMap m_outputTiles;
+    std::vector<FrameRect> m_grabRects;
+    std::vector<FrameRect> m_convertRects;
+
+    // Pointer capture. The grab thread owns the XFixes state, the convert thread the
+    // overlay (reconfigured with the converter while the pipeline is drained).
+    CursorMode m_cursorMode = CursorMode::Overlay;
+    bool m_cursorAvailable = false;
+    int m_fixesEventBase = 0;
+    bool m_cursorStale = true;
+    std::shared_ptr<const CursorImage> m_cursorShape;
+    FrameCursor m_lastPointer;
+    CursorOverlay m_cursorOverlay;
+    FrameCursor m_lastCursor;
+
+    // Emit thread statistics since the last report
+    struct PipelineStats {
+        int frames = 0;
+        double grabMs = 0.0;
+        double convertMs = 0.0;
+        double emitMs = 0.0;
+        double latencyMs = 0.0;
+        std::vector<double> layerMs;
+        uint64_t grabbedBytes = 0;
+        uint64_t convertedPixels = 0;
+        std::chrono::steady_clock::time_point windowStart;
+    };
+    PipelineStats m_stats;
+    std::atomic<uint64_t> m_droppedFrames{0};
+
+    // Content-adaptive rate, driven by damage or by ReportFrameChanged.
+    // Feedback bits: 1 = an unchanged frame was reported, 2 = a changed one.
+    FrameRateController m_rateController;
+    std::atomic<int> m_changeFeedback{0};
 
-    // NV12 output buffer
-    std::vector<uint8_t> m_nv12Buffer;
+    // Grab deadlines on a fixed grid at the current rate, with pacing statistics
+    FrameScheduler m_scheduler;
+    FrameScheduler::Clock::time_point m_clockOrigin;
+    bool m_hasClockOrigin = false;
 };
 
 }  // namespace snacka
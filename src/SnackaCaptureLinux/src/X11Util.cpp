@@ -0,0 +1,135 @@
+#include "X11Util.h"
+
+#include <iostream>
+
+namespace snacka {
+
+namespace {
+
+int HandleXError(Display* display, XErrorEvent* error) {
+    static int errorCount = 0;
+    if (++errorCount <= 5 || errorCount % 100 == 0) {
+        char text[128] = {};
+        XGetErrorText(display, error->error_code, text, sizeof(text));
+        std::cerr << "SnackaCaptureLinux: X error " << static_cast<int>(error->error_code)
+                  << " (" << text << ") on request " << static_cast<int>(error->request_code)
+                  << "." << static_cast<int>(error->minor_code) << "\n";
+    }
+    return 0;
+}
+
+}  // namespace
+
+bool CreateShmImage(Display* display, Visual* visual, int depth, int width, int height,
+                    XImage*& image, XShmSegmentInfo& shmInfo) {
+    image = XShmCreateImage(
+        display,
+        visual,
+        depth,
+        ZPixmap,
+        nullptr,
+        &shmInfo,
+        width,
+        height
+    );
+
+    if (!image) {
+        std::cerr << "SnackaCaptureLinux: Failed to create XShm image\n";
+        return false;
+    }
+
+    // Allocate shared memory
+    shmInfo.shmid = shmget(IPC_PRIVATE, image->bytes_per_line * image->height, IPC_CREAT | 0777);
+    if (shmInfo.shmid < 0) {
+        std::cerr << "SnackaCaptureLinux: Failed to allocate shared memory\n";
+        XDestroyImage(image);
+        image = nullptr;
+        return false;
+    }
+
+    shmInfo.shmaddr = image->data = static_cast<char*>(shmat(shmInfo.shmid, nullptr, 0));
+    if (shmInfo.shmaddr == reinterpret_cast<char*>(-1)) {
+        std::cerr << "SnackaCaptureLinux: Failed to attach shared memory\n";
+        shmctl(shmInfo.shmid, IPC_RMID, nullptr);
+        XDestroyImage(image);
+        image = nullptr;
+        return false;
+    }
+
+    shmInfo.readOnly = False;
+
+    if (!XShmAttach(display, &shmInfo)) {
+        std::cerr << "SnackaCaptureLinux: Failed to attach XShm\n";
+        shmdt(shmInfo.shmaddr);
+        shmctl(shmInfo.shmid, IPC_RMID, nullptr);
+        XDestroyImage(image);
+        image = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+void DestroyShmImage(Display* display, XImage*& image, XShmSegmentInfo& shmInfo) {
+    if (!image) {
+        return;
+    }
+
+    XDestroyImage(image);
+    image = nullptr;
+
+    XShmDetach(display, &shmInfo);
+    shmdt(shmInfo.shmaddr);
+    shmctl(shmInfo.shmid, IPC_RMID, nullptr);
+    shmInfo = {};
+}
+
+bool GetPixelLayout(Display* display, const Visual* visual, int depth, PixelLayout& layout) {
+    int bytesPerPixel = 0;
+    int formatCount = 0;
+    XPixmapFormatValues* formats = XListPixmapFormats(display, &formatCount);
+    for (int i = 0; i < formatCount; i++) {
+        if (formats[i].depth == depth) {
+            bytesPerPixel = formats[i].bits_per_pixel / 8;
+        }
+    }
+    if (formats) {
+        XFree(formats);
+    }
+    if (bytesPerPixel != 3 && bytesPerPixel != 4) {
+        return false;
+    }
+
+    // Byte each 8-bit channel lands in once the image is in memory
+    bool lsbFirst = ImageByteOrder(display) == LSBFirst;
+    auto byteOf = [&](unsigned long mask) {
+        if (mask == 0) {
+            return -1;
+        }
+        int shift = __builtin_ctzl(mask);
+        if ((mask >> shift) != 0xFF || shift % 8 != 0) {
+            return -1;
+        }
+        return lsbFirst ? shift / 8 : bytesPerPixel - 1 - shift / 8;
+    };
+    int r = byteOf(visual->red_mask);
+    int g = byteOf(visual->green_mask);
+    int b = byteOf(visual->blue_mask);
+
+    if (r == 2 && g == 1 && b == 0) {
+        layout = PixelLayout::BGRX;
+    } else if (r == 0 && g == 1 && b == 2) {
+        layout = PixelLayout::RGBX;
+    } else if (r == 3 && g == 2 && b == 1 && bytesPerPixel == 4) {
+        layout = PixelLayout::XBGR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void InstallXErrorHandler() {
+    XSetErrorHandler(HandleXError);
+}
+
+}  // namespace snacka
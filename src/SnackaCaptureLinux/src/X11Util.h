@@ -0,0 +1,38 @@
+#pragma once
+
+#include "ColorConverter.h"
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/shm.h>
+
+namespace snacka {
+
+/// Create an XImage backed by a SysV shared memory segment attached to the server
+/// @param display X display connection
+/// @param visual Visual of the drawable the image will be grabbed from
+/// @param depth Depth of that drawable
+/// @param width Image width in pixels
+/// @param height Image height in pixels
+/// @param image Receives the image (nullptr on failure)
+/// @param shmInfo Receives the segment description
+/// @return true if the image was created and attached
+bool CreateShmImage(Display* display, Visual* visual, int depth, int width, int height,
+                    XImage*& image, XShmSegmentInfo& shmInfo);
+
+/// Detach and free an image created by CreateShmImage (no-op for nullptr)
+void DestroyShmImage(Display* display, XImage*& image, XShmSegmentInfo& shmInfo);
+
+/// Get the in-memory byte order of pixels grabbed from a drawable
+/// @param visual Visual of the drawable
+/// @param depth Depth of the drawable
+/// @param layout Receives the layout (unchanged on failure)
+/// @return false if the channel masks and pixel size match no PixelLayout
+bool GetPixelLayout(Display* display, const Visual* visual, int depth, PixelLayout& layout);
+
+/// Replace Xlib's default error handler, which exits the process, with one that logs.
+/// Grabs that race a mode switch or a window being destroyed then fail instead.
+void InstallXErrorHandler();
+
+}  // namespace snacka
@@ -0,0 +1,315 @@
+#include "X11WindowCapturer.h"
+#include "Protocol.h"
+#include "X11Util.h"
+
+#include <X11/extensions/Xcomposite.h>
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+namespace snacka {
+
+namespace {
+
+// Shm segments grow in these steps so a window being drag-resized doesn't reallocate every frame
+constexpr int IMAGE_SIZE_STEP = 64;
+
+}  // namespace
+
+X11WindowCapturer::X11WindowCapturer() {
+}
+
+X11WindowCapturer::~X11WindowCapturer() {
+    Stop();
+
+    if (m_display) {
+        if (m_pixmap) {
+            XFreePixmap(m_display, m_pixmap);
+            m_pixmap = 0;
+        }
+        if (m_redirected) {
+            XCompositeUnredirectWindow(m_display, m_window, CompositeRedirectAutomatic);
+            m_redirected = false;
+        }
+    }
+
+    DestroyShmImage(m_display, m_image, m_shmInfo);
+
+    if (m_display) {
+        XCloseDisplay(m_display);
+        m_display = nullptr;
+    }
+}
+
+bool X11WindowCapturer::Initialize(Window window, int width, int height, int fps) {
+    m_window = window;
+    m_width = width;
+    m_height = height;
+    m_fps = fps;
+
+    // Open X display
+    m_display = XOpenDisplay(nullptr);
+    if (!m_display) {
+        std::cerr << "SnackaCaptureLinux: Failed to open X display\n";
+        return false;
+    }
+
+    InstallXErrorHandler();
+
+    if (!XShmQueryExtension(m_display)) {
+        std::cerr << "SnackaCaptureLinux: XShm extension not available\n";
+        return false;
+    }
+
+    // NameWindowPixmap needs Composite 0.2
+    int compositeEventBase = 0;
+    int compositeErrorBase = 0;
+    int major = 0;
+    int minor = 2;
+    if (!XCompositeQueryExtension(m_display, &compositeEventBase, &compositeErrorBase) ||
+        !XCompositeQueryVersion(m_display, &major, &minor) || (major == 0 && minor < 2)) {
+        std::cerr << "SnackaCaptureLinux: XComposite 0.2 not available, window capture unsupported\n";
+        return false;
+    }
+
+    XWindowAttributes attrs;
+    if (!XGetWindowAttributes(m_display, m_window, &attrs)) {
+        std::cerr << "SnackaCaptureLinux: Window 0x" << std::hex << m_window << std::dec << " not found\n";
+        return false;
+    }
+    m_visual = attrs.visual;
+    m_depth = attrs.depth;
+    m_windowWidth = attrs.width;
+    m_windowHeight = attrs.height;
+    m_borderWidth = attrs.border_width;
+    m_mapped = attrs.map_state == IsViewable;
+
+    // Resize, map/unmap and destroy notifications for this window
+    XSelectInput(m_display, m_window, StructureNotifyMask);
+
+    // Automatic redirection keeps the window on screen; if a compositing manager
+    // already redirects it this just adds a reference
+    XCompositeRedirectWindow(m_display, m_window, CompositeRedirectAutomatic);
+    m_redirected = true;
+    XSync(m_display, False);
+
+    PixelLayout layout = PixelLayout::BGRX;
+    if (!GetPixelLayout(m_display, m_visual, m_depth, layout)) {
+        std::cerr << "SnackaCaptureLinux: Unrecognized pixel format for depth " << m_depth << ", assuming BGRX\n";
+    }
+    m_converter.SetPixelLayout(layout);
+
+    // Output starts black until the window is first mapped
+    const ColorSpace& colorSpace = m_converter.GetColorSpace();
+    m_nv12Buffer = FrameBufferPool::Shared().Acquire(CalculateNV12FrameSize(m_width, m_height));
+    size_t lumaSize = static_cast<size_t>(m_width) * m_height;
+    std::fill(m_nv12Buffer.begin(), m_nv12Buffer.begin() + lumaSize,
+              ColorCoefficients::For(colorSpace.matrix, colorSpace.range).yOffset);
+    std::fill(m_nv12Buffer.begin() + lumaSize, m_nv12Buffer.end(), 128);
+
+    m_stripeCount = ColorConverter::PickStripeCount(m_convertThreads, m_width, m_height);
+    m_converter.Configure(std::max(m_windowWidth, 1), std::max(m_windowHeight, 1), m_width, m_height, m_stripeCount);
+    m_sourceWidth = m_windowWidth;
+    m_sourceHeight = m_windowHeight;
+    m_workerPool = std::make_unique<WorkerPool>(m_converter.GetStripeCount());
+    m_rateController.Configure(m_fps, m_minFps);
+
+    std::cerr << "SnackaCaptureLinux: X11 window capture initialized for window 0x" << std::hex << m_window
+              << std::dec << " (" << m_windowWidth << "x" << m_windowHeight << ", depth " << m_depth
+              << ") to output " << m_width << "x" << m_height << " @ " << m_fps << "fps"
+              << " (conversion: " << ColorConverter::GetCpuLevelName(m_converter.GetCpuLevel())
+              << ", " << m_converter.GetStripeCount() << " thread(s), "
+              << GetColorSpaceName(colorSpace)
+              << (m_rateController.IsAdaptive() ? ", adaptive down to " + std::to_string(m_minFps) + "fps" : "")
+              << ")\n";
+
+    return true;
+}
+
+void X11WindowCapturer::Start(FrameCallback callback) {
+    if (m_running) {
+        return;
+    }
+
+    m_callback = callback;
+    m_running = true;
+    m_captureThread = std::thread(&X11WindowCapturer::CaptureLoop, this);
+}
+
+void X11WindowCapturer::Stop() {
+    m_running = false;
+    if (m_captureThread.joinable()) {
+        m_captureThread.join();
+        if (m_rateController.IsAdaptive()) {
+            std::cerr << "SnackaCaptureLinux: Time at each capture rate: " << m_rateController.DescribeTimeAtRates()
+                      << "\n";
+        }
+    }
+}
+
+void X11WindowCapturer::ProcessEvents() {
+    while (XPending(m_display) > 0) {
+        XEvent event;
+        XNextEvent(m_display, &event);
+        switch (event.type) {
+            case ConfigureNotify:
+                // Moves don't matter, the pixmap is window-relative
+                if (event.xconfigure.width != m_windowWidth || event.xconfigure.height != m_windowHeight ||
+                    event.xconfigure.border_width != m_borderWidth) {
+                    m_windowWidth = event.xconfigure.width;
+                    m_windowHeight = event.xconfigure.height;
+                    m_borderWidth = event.xconfigure.border_width;
+                    m_pixmapStale = true;
+                    m_rateController.OnActivity(std::chrono::steady_clock::now());
+                }
+                break;
+            case MapNotify:
+                // A new backing pixmap is allocated every time the window is mapped
+                m_mapped = true;
+                m_pixmapStale = true;
+                m_rateController.OnActivity(std::chrono::steady_clock::now());
+                break;
+            case UnmapNotify:
+                m_mapped = false;
+                break;
+            case DestroyNotify:
+                std::cerr << "SnackaCaptureLinux: Captured window was destroyed\n";
+                m_redirected = false;
+                m_running = false;
+                break;
+        }
+    }
+}
+
+bool X11WindowCapturer::UpdatePixmap() {
+    if (m_pixmap) {
+        XFreePixmap(m_display, m_pixmap);
+        m_pixmap = 0;
+    }
+
+    m_pixmap = XCompositeNameWindowPixmap(m_display, m_window);
+    if (!m_pixmap) {
+        return false;
+    }
+
+    if (!EnsureImageSize(m_windowWidth, m_windowHeight)) {
+        return false;
+    }
+
+    if (m_windowWidth != m_sourceWidth || m_windowHeight != m_sourceHeight) {
+        // Output size is fixed; only the scaling from the window changes
+        m_converter.Configure(m_windowWidth, m_windowHeight, m_width, m_height, m_stripeCount);
+        m_sourceWidth = m_windowWidth;
+        m_sourceHeight = m_windowHeight;
+        std::cerr << "SnackaCaptureLinux: Window resized to " << m_windowWidth << "x" << m_windowHeight
+                  << " (scaling: " << m_converter.GetScaleDescription() << ")\n";
+    }
+
+    m_pixmapStale = false;
+    return true;
+}
+
+bool X11WindowCapturer::EnsureImageSize(int width, int height) {
+    // Grow the segment only when the window no longer fits; shrinking just reuses it
+    if (!m_image || width > m_imageCapacityWidth || height > m_imageCapacityHeight) {
+        DestroyShmImage(m_display, m_image, m_shmInfo);
+        int capacityWidth = (std::max(width, m_imageCapacityWidth) + IMAGE_SIZE_STEP - 1) / IMAGE_SIZE_STEP * IMAGE_SIZE_STEP;
+        int capacityHeight = (std::max(height, m_imageCapacityHeight) + IMAGE_SIZE_STEP - 1) / IMAGE_SIZE_STEP * IMAGE_SIZE_STEP;
+        if (!CreateShmImage(m_display, m_visual, m_depth, capacityWidth, capacityHeight, m_image, m_shmInfo)) {
+            m_imageCapacityWidth = 0;
+            m_imageCapacityHeight = 0;
+            return false;
+        }
+        m_imageCapacityWidth = capacityWidth;
+        m_imageCapacityHeight = capacityHeight;
+    }
+
+    // The server writes rows with the stride of the requested width
+    m_image->width = width;
+    m_image->height = height;
+    m_image->bytes_per_line = ((width * m_image->bits_per_pixel + 31) / 32) * 4;
+    return true;
+}
+
+bool X11WindowCapturer::CaptureFrame() {
+    m_frameInfo.fullFrame = false;
+    m_frameInfo.dirtyRects.clear();
+
+    // Unmapped windows have no pixmap: repeat the last frame until they come back
+    if (!m_mapped || m_windowWidth <= 0 || m_windowHeight <= 0) {
+        return true;
+    }
+
+    if (m_pixmapStale && !UpdatePixmap()) {
+        return false;
+    }
+
+    // The pixmap includes the window border; grab only the contents
+    if (!XShmGetImage(m_display, m_pixmap, m_image, m_borderWidth, m_borderWidth, AllPlanes)) {
+        return false;
+    }
+
+    const uint8_t* bgra = reinterpret_cast<const uint8_t*>(m_image->data);
+    int srcStride = m_image->bytes_per_line;
+    int srcBytesPerPixel = m_image->bits_per_pixel / 8;
+    m_workerPool->Run(m_converter.GetStripeCount(), [&](int stripe) {
+        m_converter.ConvertStripe(stripe, bgra, srcStride, srcBytesPerPixel, m_nv12Buffer.data());
+    });
+
+    m_frameInfo.fullFrame = true;
+    m_frameInfo.dirtyRects.assign(1, FrameRect{0, 0, m_width, m_height});
+    return true;
+}
+
+void X11WindowCapturer::CaptureLoop() {
+    m_scheduler.Reset(std::chrono::steady_clock::now());
+    int failureCount = 0;
+    uint64_t frameCount = 0;
+
+    while (m_running) {
+        ProcessEvents();
+        if (!m_running) {
+            break;
+        }
+
+        m_scheduler.OnFrameStart(std::chrono::steady_clock::now());
+        if (!CaptureFrame()) {
+            // Usually a resize racing the grab; the ConfigureNotify follows shortly
+            if (++failureCount <= 5 || failureCount % 100 == 0) {
+                std::cerr << "SnackaCaptureLinux: Window grab failed (" << failureCount << ")\n";
+            }
+            m_pixmapStale = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            m_scheduler.Reset(std::chrono::steady_clock::now());
+            continue;
+        }
+
+        // Invoke callback with NV12 data
+        if (m_callback) {
+            m_callback(m_nv12Buffer.data(), m_nv12Buffer.size(), GetTimestampMs(), m_frameInfo);
+        }
+
+        int feedback = m_changeFeedback.exchange(0);
+        if (feedback != 0) {
+            m_rateController.OnFrame((feedback & 2) != 0, std::chrono::steady_clock::now());
+        }
+
+        if (++frameCount % 300 == 0) {
+            std::cerr << "SnackaCaptureLinux: Window pacing: " << m_scheduler.DescribeStats(true) << "\n";
+        }
+
+        // Frame rate control: the next slot on the grid, giving up slots already missed
+        m_scheduler.Advance(m_rateController.GetInterval(), std::chrono::steady_clock::now());
+        m_scheduler.WaitForDeadline();
+    }
+}
+
+uint64_t X11WindowCapturer::GetTimestampMs() const {
+    auto now = std::chrono::steady_clock::now();
+    auto duration = now.time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+}  // namespace snacka
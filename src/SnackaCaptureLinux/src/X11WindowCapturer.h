@@ -0,0 +1,129 @@
+#pragma once
+
+#include "ColorConverter.h"
+#include "FrameBufferPool.h"
+#include "FrameInfo.h"
+#include "FrameRateController.h"
+#include "FrameScheduler.h"
+#include "WorkerPool.h"
+#include "X11Capturer.h"
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace snacka {
+
+/// Single-window capturer using XComposite.
+/// The window is redirected off-screen so its backing pixmap holds its full contents
+/// even while other windows cover it; that pixmap is grabbed through XShm instead of
+/// the root window. Resizes rename the pixmap and only grow the shm segment when the
+/// window outgrows it. Capture stops when the window is destroyed.
+class X11WindowCapturer {
+public:
+    X11WindowCapturer();
+    ~X11WindowCapturer();
+
+    /// Set the number of color conversion threads (call before Initialize)
+    /// @param threads Thread count including the capture thread, 0 = pick from output size
+    void SetConvertThreads(int threads) { m_convertThreads = threads; }
+
+    /// Set the filter used when the output is smaller/larger than the window (call before Initialize)
+    void SetScaleFilter(ScaleFilter filter) { m_converter.SetScaleFilter(filter); }
+
+    /// Set the output color matrix and range (call before Initialize, default BT.601 limited)
+    void SetColorSpace(const ColorSpace& space) { m_converter.SetColorSpace(space); }
+
+    /// Let the capture rate fall towards this floor while the window is static (call before Initialize)
+    /// @param fps Floor rate, 0 = always capture at the target rate
+    void SetMinFps(int fps) { m_minFps = fps; }
+
+    /// Report whether the consumer saw the last frame change; drives the adaptive rate. Thread-safe.
+    void ReportFrameChanged(bool changed) { m_changeFeedback.fetch_or(changed ? 2 : 1); }
+
+    /// Initialize the capturer
+    /// @param window X11 window ID as listed by SourceLister
+    /// @param width Output width (the window is scaled to fill it)
+    /// @param height Output height
+    /// @param fps Target frames per second
+    /// @return true if initialization succeeded
+    bool Initialize(Window window, int width, int height, int fps);
+
+    /// Start capturing
+    /// @param callback Callback to receive captured frames
+    void Start(FrameCallback callback);
+
+    /// Stop capturing
+    void Stop();
+
+    /// Check if capturing is running (false once the window is destroyed)
+    bool IsRunning() const { return m_running; }
+
+private:
+    void ProcessEvents();
+    bool UpdatePixmap();
+    bool EnsureImageSize(int width, int height);
+    bool CaptureFrame();
+    void CaptureLoop();
+    uint64_t GetTimestampMs() const;
+
+    // X11 objects
+    Display* m_display = nullptr;
+    Window m_window = 0;
+    Visual* m_visual = nullptr;
+    int m_depth = 0;
+    bool m_redirected = false;
+    Pixmap m_pixmap = 0;
+    XShmSegmentInfo m_shmInfo = {};
+    XImage* m_image = nullptr;
+    int m_imageCapacityWidth = 0;
+    int m_imageCapacityHeight = 0;
+
+    // Window state, updated from StructureNotify events
+    int m_windowWidth = 0;
+    int m_windowHeight = 0;
+    int m_borderWidth = 0;
+    bool m_mapped = false;
+    bool m_pixmapStale = true;
+
+    // Configuration
+    int m_width = 0;
+    int m_height = 0;
+    int m_fps = 30;
+    int m_minFps = 0;
+
+    // Thread control
+    std::atomic<bool> m_running{false};
+    std::thread m_captureThread;
+
+    // Callback
+    FrameCallback m_callback;
+
+    // BGRA -> NV12 conversion, reconfigured when the window size changes
+    ColorConverter m_converter;
+    int m_convertThreads = 0;
+    int m_stripeCount = 1;
+    int m_sourceWidth = 0;
+    int m_sourceHeight = 0;
+    std::unique_ptr<WorkerPool> m_workerPool;
+
+    // NV12 output buffer and what changed in it
+    FrameBuffer m_nv12Buffer;
+    FrameInfo m_frameInfo;
+
+    // Content-adaptive rate. There is no damage to wake on, so a change seen at the
+    // floor rate takes effect from the next capture.
+    // Feedback bits: 1 = an unchanged frame was reported, 2 = a changed one.
+    FrameRateController m_rateController;
+    std::atomic<int> m_changeFeedback{0};
+
+    // Capture deadlines on a fixed grid, with pacing statistics
+    FrameScheduler m_scheduler;
+};
+
+}  // namespace snacka
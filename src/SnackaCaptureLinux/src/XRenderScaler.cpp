@@ -0,0 +1,149 @@
+#include "XRenderScaler.h"
+#include "X11Util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace snacka {
+
+XRenderScaler::~XRenderScaler() {
+    Destroy();
+}
+
+bool XRenderScaler::QuerySupport(Display* display) {
+    int eventBase = 0;
+    int errorBase = 0;
+    int major = 0;
+    int minor = 0;
+    if (!XRenderQueryExtension(display, &eventBase, &errorBase) || !XRenderQueryVersion(display, &major, &minor)) {
+        return false;
+    }
+    return major > 0 || minor >= 6;
+}
+
+FrameSize XRenderScaler::PickScaledSize(int captureWidth, int captureHeight, int outputWidth, int outputHeight) {
+    FrameSize size;
+    size.width = std::min(captureWidth, outputWidth * 2) & ~1;
+    size.height = std::min(captureHeight, outputHeight * 2) & ~1;
+    return size;
+}
+
+bool XRenderScaler::SamplesCleanly(int captureWidth, int captureHeight, int scaledWidth, int scaledHeight) {
+    return captureWidth <= scaledWidth * 2 && captureHeight <= scaledHeight * 2;
+}
+
+bool XRenderScaler::Create(Display* display, Window root, Visual* visual, int depth, const FrameRect& area,
+                           int scaledWidth, int scaledHeight) {
+    Destroy();
+
+    XRenderPictFormat* format = XRenderFindVisualFormat(display, visual);
+    if (!format) {
+        return false;
+    }
+
+    m_display = display;
+    m_area = area;
+    m_width = scaledWidth;
+    m_height = scaledHeight;
+    m_pixmap = XCreatePixmap(display, root, scaledWidth, scaledHeight, depth);
+
+    // Without IncludeInferiors the root picture would be clipped to the bare background
+    XRenderPictureAttributes attributes = {};
+    attributes.subwindow_mode = IncludeInferiors;
+    m_sourcePicture = XRenderCreatePicture(display, root, format, CPSubwindowMode, &attributes);
+    m_pixmapPicture = XRenderCreatePicture(display, m_pixmap, format, 0, nullptr);
+    XRenderSetPictureFilter(display, m_sourcePicture, FilterBilinear, nullptr, 0);
+    SetOrigin(area.x, area.y);
+    return true;
+}
+
+void XRenderScaler::Destroy() {
+    if (!m_display) {
+        return;
+    }
+    if (m_pixmapPicture) {
+        XRenderFreePicture(m_display, m_pixmapPicture);
+        m_pixmapPicture = 0;
+    }
+    if (m_sourcePicture) {
+        XRenderFreePicture(m_display, m_sourcePicture);
+        m_sourcePicture = 0;
+    }
+    if (m_pixmap) {
+        XFreePixmap(m_display, m_pixmap);
+        m_pixmap = 0;
+    }
+    m_display = nullptr;
+}
+
+void XRenderScaler::SetOrigin(int x, int y) {
+    m_area.x = x;
+    m_area.y = y;
+    if (!m_sourcePicture) {
+        return;
+    }
+
+    // The transform maps pixmap coordinates to root coordinates; Render samples at
+    // pixel centers, so the two grids stay centered on each other
+    XTransform transform = {};
+    transform.matrix[0][0] = XDoubleToFixed(static_cast<double>(m_area.width) / m_width);
+    transform.matrix[0][2] = XDoubleToFixed(x);
+    transform.matrix[1][1] = XDoubleToFixed(static_cast<double>(m_area.height) / m_height);
+    transform.matrix[1][2] = XDoubleToFixed(y);
+    transform.matrix[2][2] = XDoubleToFixed(1.0);
+    XRenderSetPictureTransform(m_display, m_sourcePicture, &transform);
+}
+
+void XRenderScaler::Render(const FrameRect& rect) {
+    XRenderComposite(m_display, PictOpSrc, m_sourcePicture, None, m_pixmapPicture, rect.x, rect.y, 0, 0,
+                     rect.x, rect.y, rect.width, rect.height);
+}
+
+FrameRect XRenderScaler::MapSourceRect(const FrameRect& source) const {
+    // One pixel of margin each side for the bilinear taps
+    int64_t x0 = static_cast<int64_t>(source.x) * m_width / m_area.width - 1;
+    int64_t y0 = static_cast<int64_t>(source.y) * m_height / m_area.height - 1;
+    int64_t x1 = (static_cast<int64_t>(source.x + source.width) * m_width + m_area.width - 1) / m_area.width + 1;
+    int64_t y1 = (static_cast<int64_t>(source.y + source.height) * m_height + m_area.height - 1) / m_area.height + 1;
+    return {static_cast<int>(x0), static_cast<int>(y0), static_cast<int>(x1 - x0), static_cast<int>(y1 - y0)};
+}
+
+bool XRenderScaler::Measure(Display* display, Window root, Visual* visual, int depth, const FrameRect& area,
+                            int scaledWidth, int scaledHeight, int iterations, double& clientMs, double& serverMs) {
+    XImage* fullImage = nullptr;
+    XShmSegmentInfo fullShmInfo = {};
+    XImage* scaledImage = nullptr;
+    XShmSegmentInfo scaledShmInfo = {};
+    XRenderScaler scaler;
+    bool ok = CreateShmImage(display, visual, depth, area.width, area.height, fullImage, fullShmInfo) &&
+              CreateShmImage(display, visual, depth, scaledWidth, scaledHeight, scaledImage, scaledShmInfo) &&
+              scaler.Create(display, root, visual, depth, area, scaledWidth, scaledHeight);
+
+    auto timeLoop = [&](auto&& body) {
+        ok = body() && ok;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations && ok; i++) {
+            ok = body();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double, std::milli>(elapsed).count() / std::max(iterations, 1);
+    };
+
+    if (ok) {
+        clientMs = timeLoop([&]() {
+            return XShmGetImage(display, root, fullImage, area.x, area.y, AllPlanes) != 0;
+        });
+        serverMs = timeLoop([&]() {
+            scaler.Render({0, 0, scaledWidth, scaledHeight});
+            return XShmGetImage(display, scaler.GetPixmap(), scaledImage, 0, 0, AllPlanes) != 0;
+        });
+    }
+
+    scaler.Destroy();
+    DestroyShmImage(display, scaledImage, scaledShmInfo);
+    DestroyShmImage(display, fullImage, fullShmInfo);
+    return ok;
+}
+
+}  // namespace snacka
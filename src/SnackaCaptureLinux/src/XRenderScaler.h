@@ -0,0 +1,81 @@
+#pragma once
+
+#include "FrameInfo.h"
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrender.h>
+
+namespace snacka {
+
+/// Downscales an area of the root window on the X server with XRender (a bilinear
+/// picture transform) into a pixmap, so that shm grabs of the pixmap move only the
+/// scaled pixels to the client. The pixmap is twice the output size per axis (see
+/// PickScaledSize), which leaves the client an exact 2:1 area filter to finish with.
+/// Bilinear taps only cover every source pixel up to a 2:1 reduction, so the render
+/// pass is only used within that (see SamplesCleanly); beyond it columns and rows
+/// would be skipped and text would alias.
+class XRenderScaler {
+public:
+    XRenderScaler() = default;
+    ~XRenderScaler();
+
+    XRenderScaler(const XRenderScaler&) = delete;
+    XRenderScaler& operator=(const XRenderScaler&) = delete;
+
+    /// Check whether the server has RENDER 0.6 or later (picture transforms and filters)
+    static bool QuerySupport(Display* display);
+
+    /// Get the pixmap size for a capture and output size: twice the output per axis,
+    /// even, and never larger than the captured area
+    static FrameSize PickScaledSize(int captureWidth, int captureHeight, int outputWidth, int outputHeight);
+
+    /// Check that a bilinear render from the captured area to the pixmap reads every
+    /// source pixel, i.e. reduces by at most 2:1 per axis
+    static bool SamplesCleanly(int captureWidth, int captureHeight, int scaledWidth, int scaledHeight);
+
+    /// Create the pixmap and pictures (replacing any previous ones)
+    /// @param area Captured area in root window coordinates
+    /// @param scaledWidth Pixmap width, at most area.width
+    /// @param scaledHeight Pixmap height, at most area.height
+    /// @return false if the root visual has no picture format
+    bool Create(Display* display, Window root, Visual* visual, int depth, const FrameRect& area,
+                int scaledWidth, int scaledHeight);
+
+    /// Free the pixmap and pictures (no-op if not created)
+    void Destroy();
+
+    /// Move the captured area without changing its size
+    void SetOrigin(int x, int y);
+
+    /// Queue a render of a pixmap rectangle from the current screen contents. Requests
+    /// on the same connection are ordered, so a grab issued afterwards sees the result.
+    void Render(const FrameRect& rect);
+
+    /// Get the pixmap rectangle whose pixels depend on a captured-area rectangle
+    /// (covers the bilinear footprint; may extend past the pixmap)
+    FrameRect MapSourceRect(const FrameRect& source) const;
+
+    /// Time full-frame shm grabs of an area against rendering it down and grabbing the pixmap
+    /// @param iterations Timed grabs per path, after one warm-up each
+    /// @param clientMs Receives the average time of a full-size grab
+    /// @param serverMs Receives the average time of a render plus scaled grab
+    /// @return false if either path could not be set up
+    static bool Measure(Display* display, Window root, Visual* visual, int depth, const FrameRect& area,
+                        int scaledWidth, int scaledHeight, int iterations, double& clientMs, double& serverMs);
+
+    bool IsCreated() const { return m_pixmap != 0; }
+    Pixmap GetPixmap() const { return m_pixmap; }
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+
+private:
+    Display* m_display = nullptr;
+    Pixmap m_pixmap = 0;
+    Picture m_sourcePicture = 0;
+    Picture m_pixmapPicture = 0;
+    FrameRect m_area;
+    int m_width = 0;
+    int m_height = 0;
+};
+
+}  // namespace snacka
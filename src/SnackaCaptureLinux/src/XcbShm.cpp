@@ -0,0 +1,167 @@
+#include "XcbShm.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iostream>
+
+namespace snacka {
+
+XcbShmSegment::~XcbShmSegment() {
+    Destroy();
+}
+
+bool XcbShmSegment::Create(xcb_connection_t* connection, size_t size, bool useMemfd) {
+    Destroy();
+    m_connection = connection;
+
+    if (useMemfd && CreateMemfd(size)) {
+        return true;
+    }
+    return CreateSysV(size);
+}
+
+bool XcbShmSegment::CreateMemfd(size_t size) {
+    int fd = memfd_create("snacka-capture", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Sealing the size means neither side can truncate the file under the other's mapping
+    if (ftruncate(fd, static_cast<off_t>(size)) < 0 ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    // XCB takes ownership of the fd and closes it once the request is sent
+    xcb_shm_seg_t segment = xcb_generate_id(m_connection);
+    xcb_void_cookie_t cookie = xcb_shm_attach_fd_checked(m_connection, segment, fd, 0);
+    if (xcb_generic_error_t* error = xcb_request_check(m_connection, cookie)) {
+        free(error);
+        munmap(data, size);
+        return false;
+    }
+
+    m_segment = segment;
+    m_data = static_cast<uint8_t*>(data);
+    m_size = size;
+    m_memfd = true;
+    return true;
+}
+
+bool XcbShmSegment::CreateSysV(size_t size) {
+    int shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (shmid < 0) {
+        std::cerr << "SnackaCaptureLinux: Failed to allocate shared memory\n";
+        return false;
+    }
+
+    void* data = shmat(shmid, nullptr, 0);
+    if (data == reinterpret_cast<void*>(-1)) {
+        std::cerr << "SnackaCaptureLinux: Failed to attach shared memory\n";
+        shmctl(shmid, IPC_RMID, nullptr);
+        return false;
+    }
+
+    xcb_shm_seg_t segment = xcb_generate_id(m_connection);
+    xcb_void_cookie_t cookie = xcb_shm_attach_checked(m_connection, segment, shmid, 0);
+    xcb_generic_error_t* error = xcb_request_check(m_connection, cookie);
+
+    // Both sides are attached (or the server failed); the id is no longer needed
+    shmctl(shmid, IPC_RMID, nullptr);
+    if (error) {
+        std::cerr << "SnackaCaptureLinux: Failed to attach XCB shm segment\n";
+        free(error);
+        shmdt(data);
+        return false;
+    }
+
+    m_segment = segment;
+    m_data = static_cast<uint8_t*>(data);
+    m_size = size;
+    m_memfd = false;
+    return true;
+}
+
+void XcbShmSegment::Destroy() {
+    if (!m_data) {
+        return;
+    }
+
+    xcb_shm_detach(m_connection, m_segment);
+    xcb_flush(m_connection);
+    if (m_memfd) {
+        munmap(m_data, m_size);
+    } else {
+        shmdt(m_data);
+    }
+
+    m_segment = 0;
+    m_data = nullptr;
+    m_size = 0;
+    m_memfd = false;
+}
+
+xcb_shm_get_image_cookie_t XcbShmSegment::RequestImage(xcb_drawable_t drawable, int x, int y, int width, int height,
+                                                       uint32_t offset) const {
+    return xcb_shm_get_image(m_connection, drawable,
+                             static_cast<int16_t>(x), static_cast<int16_t>(y),
+                             static_cast<uint16_t>(width), static_cast<uint16_t>(height),
+                             ~0u, XCB_IMAGE_FORMAT_Z_PIXMAP, m_segment, offset);
+}
+
+bool XcbShmSegment::WaitImage(xcb_shm_get_image_cookie_t cookie) const {
+    xcb_generic_error_t* error = nullptr;
+    xcb_shm_get_image_reply_t* reply = xcb_shm_get_image_reply(m_connection, cookie, &error);
+    free(reply);
+    if (error) {
+        free(error);
+        return false;
+    }
+    return reply != nullptr;
+}
+
+bool XcbShmSegment::QuerySupport(xcb_connection_t* connection, bool& fdPassing) {
+    fdPassing = false;
+    const xcb_query_extension_reply_t* extension = xcb_get_extension_data(connection, &xcb_shm_id);
+    if (!extension || !extension->present) {
+        return false;
+    }
+
+    xcb_shm_query_version_reply_t* version =
+        xcb_shm_query_version_reply(connection, xcb_shm_query_version(connection), nullptr);
+    if (!version) {
+        return false;
+    }
+    fdPassing = version->major_version > 1 || (version->major_version == 1 && version->minor_version >= 2);
+    free(version);
+    return true;
+}
+
+bool XcbShmSegment::GetImageLayout(xcb_connection_t* connection, int depth, int width, int& bytesPerPixel,
+                                   int& stride) {
+    xcb_format_iterator_t formats = xcb_setup_pixmap_formats_iterator(xcb_get_setup(connection));
+    for (; formats.rem; xcb_format_next(&formats)) {
+        if (formats.data->depth != depth) {
+            continue;
+        }
+        int bitsPerPixel = formats.data->bits_per_pixel;
+        int pad = formats.data->scanline_pad;
+        bytesPerPixel = bitsPerPixel / 8;
+        stride = ((width * bitsPerPixel + pad - 1) / pad) * pad / 8;
+        return true;
+    }
+    return false;
+}
+
+}  // namespace snacka
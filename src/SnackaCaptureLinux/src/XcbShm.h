@@ -0,0 +1,69 @@
+#pragma once
+
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace snacka {
+
+/// Shared memory segment attached to the X server through XCB MIT-SHM.
+/// Backed by a sealed memfd passed with xcb_shm_attach_fd when the server speaks
+/// MIT-SHM 1.2, otherwise by a private SysV segment that is removed as soon as
+/// both sides have attached it. GetImage requests return a cookie immediately, so
+/// several grabs can be in flight while the caller does other work.
+class XcbShmSegment {
+public:
+    XcbShmSegment() = default;
+    ~XcbShmSegment();
+
+    XcbShmSegment(const XcbShmSegment&) = delete;
+    XcbShmSegment& operator=(const XcbShmSegment&) = delete;
+
+    /// Allocate and attach a segment
+    /// @param connection XCB connection (may be Xlib's, see XGetXCBConnection)
+    /// @param size Size in bytes
+    /// @param useMemfd Try fd passing before falling back to SysV shm
+    /// @return true if the segment is attached
+    bool Create(xcb_connection_t* connection, size_t size, bool useMemfd = true);
+
+    /// Detach and free the segment (no-op if not created)
+    void Destroy();
+
+    /// Queue a ZPixmap GetImage of a drawable rectangle into the segment; does not wait.
+    /// Rows are written with the server's scanline pad for the drawable's depth.
+    /// @param offset Byte offset in the segment for the first row
+    xcb_shm_get_image_cookie_t RequestImage(xcb_drawable_t drawable, int x, int y, int width, int height,
+                                            uint32_t offset) const;
+
+    /// Wait for a request issued by RequestImage
+    /// @return false if the server reported an error
+    bool WaitImage(xcb_shm_get_image_cookie_t cookie) const;
+
+    uint8_t* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+    bool IsCreated() const { return m_data != nullptr; }
+
+    /// Check whether a segment uses fd passing rather than SysV shm
+    bool IsMemfd() const { return m_memfd; }
+
+    /// Check whether the server supports MIT-SHM and whether it can take fds (1.2+)
+    static bool QuerySupport(xcb_connection_t* connection, bool& fdPassing);
+
+    /// Get bytes per pixel and row stride the server uses for ZPixmap images of a depth
+    /// @return false if the depth has no pixmap format
+    static bool GetImageLayout(xcb_connection_t* connection, int depth, int width, int& bytesPerPixel, int& stride);
+
+private:
+    bool CreateMemfd(size_t size);
+    bool CreateSysV(size_t size);
+
+    xcb_connection_t* m_connection = nullptr;
+    xcb_shm_seg_t m_segment = 0;
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_memfd = false;
+};
+
+}  // namespace snacka
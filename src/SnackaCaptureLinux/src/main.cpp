@@ -1,20 +1,35 @@
 #include "Protocol.h"
 #include "SourceLister.h"
 #include "X11Capturer.h"
+#include "X11WindowCapturer.h"
+#include "PipeWireCapturer.h"
+#include "ScreenCastPortal.h"
 #include "V4L2Capturer.h"
 #include "VaapiEncoder.h"
+#include "Benchmark.h"
+#include "FrameBufferPool.h"
+#include "FrameChangeDetector.h"
+#include "PreviewStream.h"
 #include "PulseAudioCapturer.h"
 #include "PulseMicrophoneCapturer.h"
 
 #include <iostream>
 #include <string>
 #include <vector>
+#include <optional>
+#include <algorithm>
 #include <atomic>
 #include <csignal>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <cstdio>
+#include <cstdlib>
 #include <ctime>
 #include <mutex>
 
+#include <X11/Xlib.h>
+
 using namespace snacka;
 
 // Global flag for clean shutdown
@@ -35,14 +50,24 @@ SnackaCaptureLinux - Screen, camera, and microphone capture tool for Linux with
 USAGE:
     SnackaCaptureLinux list [--json]
     SnackaCaptureLinux validate [--json]
+    SnackaCaptureLinux benchmark [--width <pixels>] [--height <pixels>] [--iterations <n>] [--convert-threads <max>] [--grab]
+                                 [--mjpeg <file> [--mjpeg-checksums <file> [--write-checksums]]]
     SnackaCaptureLinux [OPTIONS]
 
 COMMANDS:
     list              List available capture sources (displays, windows, cameras, microphones)
     validate          Check hardware encoding capabilities and system compatibility
+    benchmark         Measure color conversion cost (cycles/pixel) for each CPU level (--grab: also X11 grab backends,
+                      --mjpeg: replay a captured MJPEG camera stream through the decoder, --mjpeg-checksums:
+                      compare each decoded frame with stored NV12 checksums, or store them with --write-checksums)
 
 OPTIONS:
-    --display <index>     Display index to capture (default: 0)
+    --display <index>[@<fps>] Display index to capture (default: 0), optionally at its own rate. Repeat
+                          to capture several displays at once: the first is written to stdout, the
+                          next to file descriptor 3, 4, ... (sharing conversion threads and clock)
+    --window <id>         X11 window ID to capture (decimal or 0x hex, as listed by 'list')
+    --region <x,y,w,h>    Capture only this area of the screen (root window coordinates);
+                          output defaults to the region size. Move it with "region x,y,w,h" lines on stdin
     --camera <id>         Camera device path or index to capture (e.g., /dev/video0 or 0)
     --microphone <id>     Microphone source name or index to capture (audio only, no video)
     --width <pixels>      Output width (default: 1920, camera: 640)
@@ -51,6 +76,37 @@ OPTIONS:
     --audio               Capture system audio (via PulseAudio/PipeWire)
     --encode              Output H.264 encoded video (instead of raw NV12)
     --bitrate <mbps>      Encoding bitrate in Mbps (default: 6, camera: 2)
+    --convert-threads <n> Color conversion threads for display capture (default: 0 = auto)
+    --decode-threads <n>  MJPEG decode threads for camera capture; 1 decodes on the capture thread (default: 0 = auto)
+    --scale-filter <mode> Display downscale filter: smooth (area/bilinear) or nearest (default: smooth)
+    --colorspace <name>   Display/window output colorimetry: bt601, bt709, bt601-full or bt709-full
+                          (default: bt601); announced in a COLR packet on stderr
+    --cursor <mode>       Display pointer: overlay (drawn into the video), metadata (CURP/CURI packets on stderr)
+                          or none (default: overlay)
+    --no-damage           Grab and convert the full screen every frame instead of only damaged regions
+    --idle-frames <mode>  Unchanged frames: send, skip, or marker (REPT packet on stderr) (default: send;
+                          skip/marker need a client that stamps frames with their timestamps)
+    --keepalive-ms <ms>   Resend an unchanged frame at least this often when skipping (default: 1000)
+    --min-fps <rate>      Let display/window capture slow to this rate while the content is static,
+                          returning to --fps as soon as it changes (default: 0 = fixed rate)
+    --pipeline-depth <n>  Frames in flight between display grab, conversion and output, 1-4 (default: 2)
+    --grab-backend <name> Display grab path: xlib (XShmGetImage) or xcb (async, memfd segments) (default: xlib)
+    --server-scale <mode> Display downscale of 2x to 4x per axis: off (client only), on (XRender on the
+                          X server first, grabbing fewer pixels) or auto (on if a grab timing at start
+                          says it is faster; unmeasured on real servers, so opt-in) (default: off)
+    --capture-backend <name> Display capture: x11, pipewire (Wayland, through the ScreenCast portal)
+                          or auto (pipewire when WAYLAND_DISPLAY is set, unless --window, --region or
+                          --simulcast need X11; falls back to X11 if the portal is unavailable) (default: auto)
+    --pipewire-node <id>  Capture this PipeWire node (id, name or serial) from the local daemon instead
+                          of asking the portal, e.g. a test source; implies --capture-backend pipewire
+    --huge-pages <mode>   Back frame buffers with huge pages: off, thp (transparent, madvise) or hugetlb
+                          (reserved pool, vm.nr_hugepages; falls back to thp) (default: thp)
+    --preview-fps <rate>  Also send a small NV12 thumbnail of the video as PREV packets on stderr
+                          at this rate (default: 0 = off)
+    --preview-size <WxH>  Thumbnail size (default: 320 wide, output aspect ratio)
+    --simulcast <WxH,...> Also output these smaller sizes of display capture, largest first; layer N
+                          is written to file descriptor 2+N (3, 4, ...) as raw NV12 or, with --encode,
+                          H.264 at the bitrate scaled by its share of the pixels
     --noise-suppression   Enable AI noise suppression for microphone (default)
     --no-noise-suppression Disable AI noise suppression for microphone
     --json                Output source list as JSON (with 'list' command)
@@ -60,9 +116,17 @@ EXAMPLES:
     SnackaCaptureLinux list --json
     SnackaCaptureLinux --display 0 --width 1920 --height 1080 --fps 30
     SnackaCaptureLinux --display 0 --encode --bitrate 8 --audio
+    SnackaCaptureLinux --window 0x3a00007 --encode --bitrate 4
+    SnackaCaptureLinux --region 2560,1440,1280,720 --encode
+    SnackaCaptureLinux --display 0 --encode --simulcast 1280x720,640x360 3>layer1.h264 4>layer2.h264
+    SnackaCaptureLinux --capture-backend pipewire --encode
+    SnackaCaptureLinux --pipewire-node snacka-test --width 1280 --height 720
     SnackaCaptureLinux --camera 0 --encode --bitrate 2
     SnackaCaptureLinux --camera /dev/video0 --width 640 --height 480 --fps 15
     SnackaCaptureLinux --microphone 0
+    SnackaCaptureLinux benchmark --width 5120 --height 1440 --convert-threads 8
+    SnackaCaptureLinux benchmark --width 1280 --height 720 --mjpeg camera.mjpeg
+    SnackaCaptureLinux benchmark --mjpeg testdata/uvc-320x240.mjpeg --mjpeg-checksums testdata/uvc-320x240.nv12sums
 
 OUTPUT:
     Video: H.264 NAL units in AVCC format (4-byte length prefix) to stdout
@@ -240,6 +304,130 @@ int ValidateEnvironment(bool asJson) {
 // Mutex for stderr output (shared between video preview and audio)
 std::mutex g_stderrMutex;
 
+// What to do with a video frame identical to the previous one
+enum class IdleFrameMode {
+    Send,    // Write it anyway (constant frame rate)
+    Skip,    // Drop it, resending at the keepalive interval
+    Marker   // Drop it and write a REPT packet to stderr instead
+};
+
+// Where display capture gets the screen from
+enum class CaptureBackend {
+    X11,      // XShm grabs of the root window (X11 sessions, or XWayland windows only)
+    PipeWire  // Portal screencast stream (Wayland) or a node of the local PipeWire daemon
+};
+
+// Capture tuning that doesn't change what is captured, only how
+struct CaptureOptions {
+    int convertThreads = 0;  // 0 means pick from output size
+    int decodeThreads = 0;   // MJPEG camera decode threads; 0 means pick from the camera mode
+    ScaleFilter scaleFilter = ScaleFilter::Smooth;
+    bool damageTracking = true;
+    IdleFrameMode idleFrames = IdleFrameMode::Send;
+    int keepaliveMs = 1000;
+    int minFps = 0;  // 0 means capture at the fixed target rate
+    int pipelineDepth = 2;
+    GrabBackend grabBackend = GrabBackend::Xlib;
+    ServerScaleMode serverScale = ServerScaleMode::Off;
+    CursorMode cursorMode = CursorMode::Overlay;
+    ColorSpace colorSpace;
+    std::vector<FrameSize> simulcastLayers;
+    int previewFps = 0;  // 0 means no preview packets
+    FrameSize previewSize;
+    CaptureBackend captureBackend = CaptureBackend::X11;
+    bool backendFallback = false;  // Picked automatically: use X11 if the portal is unavailable
+    std::string pipeWireNode;      // Empty means ask the ScreenCast portal
+};
+
+// First file descriptor of the simulcast layers; layer N is written to SIMULCAST_FIRST_FD + N - 1
+constexpr int SIMULCAST_FIRST_FD = 3;
+
+// Parse "WxH[,WxH...]" as used by --simulcast and --preview-size
+bool ParseFrameSizes(const std::string& text, std::vector<FrameSize>& sizes) {
+    sizes.clear();
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        int w = 0;
+        int h = 0;
+        char trailing = 0;
+        std::string item = text.substr(begin, end - begin);
+        if (sscanf(item.c_str(), "%dx%d%c", &w, &h, &trailing) != 2 || w <= 0 || h <= 0) {
+            return false;
+        }
+        sizes.push_back({w, h});
+        begin = end + 1;
+    }
+    return !sizes.empty();
+}
+
+// Write all of a buffer to fd, retrying short writes; false on error
+bool WriteAll(int fd, const uint8_t* data, size_t size) {
+    size_t written = 0;
+    while (written < size && g_running) {
+        ssize_t result = write(fd, data + written, size - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
+
+// One extra output of display capture: a smaller size on its own file descriptor
+struct SimulcastOutput {
+    int fd = -1;
+    FrameSize size;
+    std::unique_ptr<VaapiEncoder> encoder;
+    bool open = true;
+    uint64_t frames = 0;
+};
+
+// A monitor of a multi-display capture: stream N (from 0) goes to stdout for N = 0,
+// else to file descriptor 2 + N, like simulcast layers
+struct DisplayStream {
+    int displayIndex = 0;
+    int fps = 0;  // 0 means --fps
+};
+
+// Per-stream state of a multi-display capture
+struct DisplayOutput {
+    DisplayStream stream;
+    int fd = STDOUT_FILENO;
+    int fps = 0;
+    X11Capturer capturer;
+    std::unique_ptr<VaapiEncoder> encoder;
+    FrameChangeDetector changeDetector;
+    uint64_t lastSentTimestamp = 0;
+    std::atomic<bool> open{true};
+    uint64_t frames = 0;
+    uint64_t suppressed = 0;
+    uint64_t encoded = 0;
+};
+
+// Parse "index" or "index@fps" as used by --display
+bool ParseDisplayStream(const std::string& text, DisplayStream& stream) {
+    int index = 0;
+    int fps = 0;
+    char trailing = 0;
+    int fields = sscanf(text.c_str(), "%d@%d%c", &index, &fps, &trailing);
+    if (fields == 1 && text.find('@') == std::string::npos) {
+        stream = {index, 0};
+        return index >= 0;
+    }
+    if (fields != 2 || index < 0 || fps <= 0 || fps > 120) {
+        return false;
+    }
+    stream = {index, fps};
+    return true;
+}
+
 int CaptureMicrophone(const std::string& microphoneId, bool noiseSuppression) {
     // Set up signal handlers for clean shutdown
     signal(SIGINT, SignalHandler);
@@ -290,13 +478,78 @@ int CaptureMicrophone(const std::string& microphoneId, bool noiseSuppression) {
     return 0;
 }
 
-int Capture(int displayIndex, const std::string& cameraId, int width, int height, int fps, bool encodeH264, int bitrateMbps, bool captureAudio) {
+// Parse "x,y,w,h" as used by --region and the region control message
+bool ParseRegion(const std::string& text, FrameRect& region) {
+    int x = 0;
+    int y = 0;
+    int w = 0;
+    int h = 0;
+    char trailing = 0;
+    if (sscanf(text.c_str(), "%d,%d,%d,%d%c", &x, &y, &w, &h, &trailing) != 4 || w <= 0 || h <= 0) {
+        return false;
+    }
+    region = {x, y, w, h};
+    return true;
+}
+
+// Text commands from the parent process on stdin, one per line
+struct ControlChannel {
+    std::string pending;
+    bool open = true;
+};
+
+// Wait up to timeoutMs for control input and apply every complete line
+void PollControlMessages(ControlChannel& channel, X11Capturer& capturer, int timeoutMs) {
+    pollfd fd = {STDIN_FILENO, POLLIN, 0};
+    if (!channel.open || poll(&fd, 1, timeoutMs) <= 0) {
+        if (!channel.open) {
+            usleep(timeoutMs * 1000);
+        }
+        return;
+    }
+
+    char buffer[256];
+    ssize_t count = read(STDIN_FILENO, buffer, sizeof(buffer));
+    if (count <= 0) {
+        // Parent closed stdin (or never gave us one): the region stays where it is
+        channel.open = false;
+        return;
+    }
+    channel.pending.append(buffer, static_cast<size_t>(count));
+
+    size_t end;
+    while ((end = channel.pending.find('\n')) != std::string::npos) {
+        std::string line = channel.pending.substr(0, end);
+        channel.pending.erase(0, end + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        FrameRect region;
+        if (line.rfind("region ", 0) == 0 && ParseRegion(line.substr(7), region)) {
+            capturer.SetRegion(region);
+        } else if (!line.empty()) {
+            std::cerr << "SnackaCaptureLinux: Ignoring control message: " << line << "\n";
+        }
+    }
+
+    // A runaway line without a newline is not a command we know
+    if (channel.pending.size() > 4096) {
+        channel.pending.clear();
+    }
+}
+
+int Capture(int displayIndex, Window windowId, const std::optional<FrameRect>& region, const std::string& cameraId, int width, int height, int fps, bool encodeH264, int bitrateMbps, bool captureAudio, const CaptureOptions& options) {
     // Set up signal handlers for clean shutdown
     signal(SIGINT, SignalHandler);
     signal(SIGTERM, SignalHandler);
     signal(SIGPIPE, SignalHandler);
+    if (!options.simulcastLayers.empty()) {
+        // A closed layer descriptor must only end that layer; stdout's EPIPE still stops capture below
+        signal(SIGPIPE, SIG_IGN);
+    }
 
-    std::string sourceType = !cameraId.empty() ? "camera" : "display";
+    std::string sourceType = !cameraId.empty() ? "camera" : (windowId != 0 ? "window" : (region ? "region" : "display"));
     std::cerr << "SnackaCaptureLinux: Starting " << sourceType << " capture "
               << width << "x" << height << " @ " << fps << "fps"
               << (encodeH264 ? ", encode=H.264 @ " + std::to_string(bitrateMbps) + "Mbps" : ", encode=raw NV12")
@@ -306,6 +559,18 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
     // Frame statistics
     uint64_t frameCount = 0;
     uint64_t encodedFrameCount = 0;
+    uint64_t suppressedFrameCount = 0;
+    uint64_t suppressedBytes = 0;
+
+    // Unchanged-frame detection
+    FrameChangeDetector changeDetector;
+    changeDetector.Configure(width, height);
+    uint64_t lastSentTimestamp = 0;
+
+    // Screen capturers lower their rate on static content; without damage events
+    // they learn about it from the change detector here
+    bool adaptiveRate = cameraId.empty() && options.minFps > 0 && options.minFps < fps;
+    std::function<void(bool)> reportFrameChanged;
 
     // Initialize H.264 encoder if requested
     std::unique_ptr<VaapiEncoder> encoder;
@@ -354,6 +619,35 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
         });
     }
 
+    // Simulcast layers, each on its own descriptor; encoded when the full-size output is
+    std::vector<SimulcastOutput> layerOutputs(options.simulcastLayers.size());
+    for (size_t i = 0; i < layerOutputs.size(); i++) {
+        SimulcastOutput& output = layerOutputs[i];
+        output.fd = SIMULCAST_FIRST_FD + static_cast<int>(i);
+        output.size = options.simulcastLayers[i];
+        if (!encodeH264) {
+            continue;
+        }
+
+        double share = static_cast<double>(output.size.width) * output.size.height / (static_cast<double>(width) * height);
+        int layerBitrate = std::max(1, static_cast<int>(bitrateMbps * share + 0.5));
+        output.encoder = std::make_unique<VaapiEncoder>(output.size.width, output.size.height, fps, layerBitrate);
+        if (!output.encoder->Initialize()) {
+            std::cerr << "SnackaCaptureLinux: Failed to initialize VAAPI encoder for simulcast layer " << i + 1 << "\n";
+            return 1;
+        }
+        output.encoder->SetCallback([&output, i](const uint8_t* data, size_t size, bool) {
+            if (!output.open) return;
+            if (!WriteAll(output.fd, data, size)) {
+                // A reader may drop a layer it no longer wants; the others carry on
+                std::cerr << "SnackaCaptureLinux: Simulcast layer " << i + 1 << " closed\n";
+                output.open = false;
+            }
+        });
+        std::cerr << "SnackaCaptureLinux: Simulcast layer " << i + 1 << " " << output.size.width << "x"
+                  << output.size.height << " @ " << layerBitrate << "Mbps on fd " << output.fd << "\n";
+    }
+
     // Initialize audio capture if requested
     std::unique_ptr<PulseAudioCapturer> audioCapturer;
     uint64_t audioPacketCount = 0;
@@ -365,12 +659,94 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
         }
     }
 
+    // Thumbnail for the local UI, scaled from the output and written by its own thread
+    PreviewStream preview;
+    if (options.previewFps > 0) {
+        if (!preview.Configure(width, height, options.previewSize.width, options.previewSize.height, options.previewFps)) {
+            std::cerr << "SnackaCaptureLinux: Preview size must be even and no larger than the output\n";
+            return 1;
+        }
+        preview.Start([](const uint8_t* data, size_t size) {
+            std::lock_guard<std::mutex> lock(g_stderrMutex);
+            WriteAll(STDERR_FILENO, data, size);
+        });
+    }
+
+    // Last pointer state sent as metadata
+    FrameCursor sentCursor;
+    uint32_t sentCursorSerial = 0;
+    bool cursorImageSent = false;
+
+    // Screens are sRGB converted with the selected matrix; cameras deliver BT.601 video levels
+    // (MJPEG is scaled from full range by the decoder)
+    ColorInfoPacketHeader colorInfo = cameraId.empty()
+        ? ColorInfoPacketHeader(1, 13, options.colorSpace.matrix == ColorMatrix::BT709 ? 1 : 6,
+                                options.colorSpace.range == ColorRange::Full)
+        : ColorInfoPacketHeader(6, 6, 6, false);
+
+    // Simulcast layers follow the full-size output: nothing for a frame it suppressed
+    bool mainFrameSent = false;
+
     // Frame callback
-    auto frameCallback = [&](const uint8_t* data, size_t size, uint64_t timestamp) {
+    auto frameCallback = [&](const uint8_t* data, size_t size, uint64_t timestamp, const FrameInfo& info) {
+        mainFrameSent = false;
         if (!g_running) return;
 
         frameCount++;
 
+        // Colorimetry goes out ahead of the first frame
+        if (frameCount == 1) {
+            std::lock_guard<std::mutex> lock(g_stderrMutex);
+            write(STDERR_FILENO, &colorInfo, sizeof(colorInfo));
+        }
+
+        // Pointer metadata goes out even for frames that are suppressed below
+        if (options.cursorMode == CursorMode::Metadata) {
+            const FrameCursor& cursor = info.cursor;
+            std::lock_guard<std::mutex> lock(g_stderrMutex);
+            if (cursor.shape && (!cursorImageSent || cursor.shape->serial != sentCursorSerial)) {
+                const CursorImage& image = *cursor.shape;
+                CursorImagePacketHeader header(image.serial, static_cast<uint16_t>(image.width),
+                                               static_cast<uint16_t>(image.height), static_cast<uint16_t>(image.xhot),
+                                               static_cast<uint16_t>(image.yhot));
+                write(STDERR_FILENO, &header, sizeof(header));
+                write(STDERR_FILENO, image.argb.data(), image.argb.size() * sizeof(uint32_t));
+                sentCursorSerial = image.serial;
+                cursorImageSent = true;
+            }
+            if (cursor.visible != sentCursor.visible || cursor.x != sentCursor.x || cursor.y != sentCursor.y) {
+                CursorPositionPacketHeader packet(timestamp, cursor.x, cursor.y, cursor.visible);
+                write(STDERR_FILENO, &packet, sizeof(packet));
+                sentCursor = cursor;
+            }
+        }
+
+        // Previews keep their own rate whether or not this frame goes out
+        if (options.previewFps > 0 && size == CalculateNV12FrameSize(width, height)) {
+            preview.OfferFrame(data, timestamp, info);
+        }
+
+        // Identical frames are dropped until the keepalive interval forces one through,
+        // and tell an adaptive capturer that it may slow down
+        if ((options.idleFrames != IdleFrameMode::Send || adaptiveRate) && size == CalculateNV12FrameSize(width, height)) {
+            bool changed = changeDetector.Update(data, info) > 0;
+            if (reportFrameChanged) {
+                reportFrameChanged(changed);
+            }
+            bool keepaliveDue = timestamp - lastSentTimestamp >= static_cast<uint64_t>(options.keepaliveMs);
+            if (options.idleFrames != IdleFrameMode::Send && !changed && !keepaliveDue) {
+                suppressedFrameCount++;
+                suppressedBytes += size;
+                if (options.idleFrames == IdleFrameMode::Marker) {
+                    RepeatFramePacketHeader marker(timestamp);
+                    std::lock_guard<std::mutex> lock(g_stderrMutex);
+                    write(STDERR_FILENO, &marker, sizeof(marker));
+                }
+                return;
+            }
+            lastSentTimestamp = timestamp;
+        }
+
         if (encodeH264 && encoder) {
             // Encode to H.264
             if (!encoder->EncodeNV12(data, size, static_cast<int64_t>(timestamp))) {
@@ -378,6 +754,7 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
                     std::cerr << "SnackaCaptureLinux: Warning - Failed to encode frame " << frameCount << "\n";
                 }
             }
+            mainFrameSent = true;
         } else {
             // Output raw NV12
             size_t written = 0;
@@ -397,8 +774,25 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
 
             if (frameCount <= 5 || frameCount % 100 == 0) {
                 std::cerr << "SnackaCaptureLinux: Video frame " << frameCount
-                          << " (" << width << "x" << height << " NV12, " << size << " bytes)\n";
+                          << " (" << width << "x" << height << " NV12, " << size << " bytes"
+                          << (info.fullFrame ? "" : ", " + std::to_string(info.dirtyRects.size()) + " dirty rects")
+                          << ")\n";
             }
+            mainFrameSent = true;
+        }
+    };
+
+    // Layer callback, called on the same thread right after frameCallback
+    auto layerCallback = [&](int layer, const uint8_t* data, size_t size, uint64_t timestamp, const FrameInfo&) {
+        SimulcastOutput& output = layerOutputs[layer - 1];
+        if (!g_running || !mainFrameSent || !output.open) return;
+
+        output.frames++;
+        if (output.encoder) {
+            output.encoder->EncodeNV12(data, size, static_cast<int64_t>(timestamp));
+        } else if (!WriteAll(output.fd, data, size)) {
+            std::cerr << "SnackaCaptureLinux: Simulcast layer " << layer << " closed\n";
+            output.open = false;
         }
     };
 
@@ -428,12 +822,31 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
         audioCapturer->Start(audioCallback);
     }
 
+    // Wayland screens are shared through the portal, whose session must outlive the capture
+    bool usePipeWire = cameraId.empty() && windowId == 0 && options.captureBackend == CaptureBackend::PipeWire;
+    ScreenCastPortal portal;
+    int pipeWireFd = -1;
+    std::string pipeWireTarget = options.pipeWireNode;
+    bool pipeWireReady = true;
+    if (usePipeWire && pipeWireTarget.empty()) {
+        if (portal.Open(options.cursorMode != CursorMode::Hidden, g_running)) {
+            pipeWireFd = portal.TakePipeWireFd();
+            pipeWireTarget = std::to_string(portal.GetNodeId());
+        } else if (options.backendFallback && g_running) {
+            std::cerr << "SnackaCaptureLinux: Falling back to X11 capture, which only sees XWayland windows\n";
+            usePipeWire = false;
+        } else {
+            pipeWireReady = false;
+        }
+    }
+
     // Start video capture
     bool captureStarted = false;
 
     if (!cameraId.empty()) {
         // Camera capture using V4L2
         V4L2Capturer capturer;
+        capturer.SetDecodeThreads(options.decodeThreads);
         if (capturer.Initialize(cameraId, width, height, fps)) {
             capturer.Start(frameCallback);
             captureStarted = true;
@@ -447,16 +860,75 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
         } else {
             std::cerr << "SnackaCaptureLinux: Failed to initialize V4L2 camera capture\n";
         }
+    } else if (windowId != 0) {
+        // Window capture using XComposite
+        X11WindowCapturer capturer;
+        capturer.SetConvertThreads(options.convertThreads);
+        capturer.SetScaleFilter(options.scaleFilter);
+        capturer.SetColorSpace(options.colorSpace);
+        capturer.SetMinFps(options.minFps);
+        reportFrameChanged = [&capturer](bool changed) { capturer.ReportFrameChanged(changed); };
+        if (capturer.Initialize(windowId, width, height, fps)) {
+            capturer.Start(frameCallback);
+            captureStarted = true;
+
+            // Wait for shutdown (or the window closing)
+            while (g_running && capturer.IsRunning()) {
+                usleep(100000);  // 100ms
+            }
+
+            capturer.Stop();
+        } else {
+            std::cerr << "SnackaCaptureLinux: Failed to initialize X11 window capture\n";
+        }
+    } else if (usePipeWire) {
+        // Display capture from a PipeWire stream
+        PipeWireCapturer capturer;
+        capturer.SetConvertThreads(options.convertThreads);
+        capturer.SetScaleFilter(options.scaleFilter);
+        capturer.SetColorSpace(options.colorSpace);
+        if (options.cursorMode == CursorMode::Metadata) {
+            std::cerr << "SnackaCaptureLinux: Pointer metadata needs X11 capture; the pointer is drawn into the video\n";
+        }
+        if (pipeWireReady && capturer.Initialize(pipeWireFd, pipeWireTarget, width, height, fps)) {
+            capturer.Start(frameCallback);
+            captureStarted = true;
+
+            // Wait for shutdown (or the stream ending, e.g. sharing stopped from the desktop)
+            while (g_running && capturer.IsRunning()) {
+                usleep(100000);  // 100ms
+            }
+
+            capturer.Stop();
+        } else {
+            std::cerr << "SnackaCaptureLinux: Failed to initialize PipeWire capture\n";
+        }
     } else {
         // Display capture using X11
         X11Capturer capturer;
+        capturer.SetConvertThreads(options.convertThreads);
+        capturer.SetScaleFilter(options.scaleFilter);
+        capturer.SetColorSpace(options.colorSpace);
+        capturer.SetDamageTracking(options.damageTracking);
+        capturer.SetPipelineDepth(options.pipelineDepth);
+        capturer.SetGrabBackend(options.grabBackend);
+        capturer.SetServerScale(options.serverScale);
+        capturer.SetMinFps(options.minFps);
+        capturer.SetCursorMode(options.cursorMode);
+        capturer.SetSimulcastLayers(options.simulcastLayers);
+        if (region) {
+            capturer.SetRegion(*region);
+        }
+        reportFrameChanged = [&capturer](bool changed) { capturer.ReportFrameChanged(changed); };
         if (capturer.Initialize(displayIndex, width, height, fps)) {
-            capturer.Start(frameCallback);
+            capturer.Start(frameCallback, layerCallback);
             captureStarted = true;
 
-            // Wait for shutdown
+            // Wait for shutdown, following region moves from the parent
+            ControlChannel control;
+            control.open = region.has_value();
             while (g_running && capturer.IsRunning()) {
-                usleep(100000);  // 100ms
+                PollControlMessages(control, capturer, 100);
             }
 
             capturer.Stop();
@@ -465,6 +937,8 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
         }
     }
 
+    preview.Stop();
+
     if (!captureStarted) {
         if (audioCapturer) {
             audioCapturer->Stop();
@@ -472,10 +946,15 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
         return 1;
     }
 
-    // Stop encoder
+    // Stop encoders
     if (encoder) {
         encoder->Stop();
     }
+    for (auto& output : layerOutputs) {
+        if (output.encoder) {
+            output.encoder->Stop();
+        }
+    }
 
     // Stop audio capture
     if (audioCapturer) {
@@ -484,12 +963,196 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
 
     std::cerr << "SnackaCaptureLinux: Capture stopped (video frames: " << frameCount
               << ", encoded: " << encodedFrameCount
+              << ", suppressed: " << suppressedFrameCount
+              << " (" << suppressedBytes / (1024 * 1024) << " MiB)"
               << ", audio packets: " << audioPacketCount << ")\n";
+    for (size_t i = 0; i < layerOutputs.size(); i++) {
+        std::cerr << "SnackaCaptureLinux: Simulcast layer " << i + 1 << ": " << layerOutputs[i].frames << " frames\n";
+    }
+    std::cerr << "SnackaCaptureLinux: Frame buffer pool: " << FrameBufferPool::Shared().DescribeStats() << "\n";
 
     return 0;
 }
 
+// Capture several monitors at once, each into its own stream at its own rate. The
+// capturers share one conversion worker pool and pace on one clock; audio is captured once.
+int CaptureDisplays(const std::vector<DisplayStream>& streams, int width, int height, int fps, bool encodeH264,
+                    int bitrateMbps, bool captureAudio, const CaptureOptions& options) {
+    signal(SIGINT, SignalHandler);
+    signal(SIGTERM, SignalHandler);
+    // A closed stream descriptor only ends that stream
+    signal(SIGPIPE, SIG_IGN);
+
+    std::cerr << "SnackaCaptureLinux: Starting capture of " << streams.size() << " displays "
+              << width << "x" << height
+              << (encodeH264 ? ", encode=H.264 @ " + std::to_string(bitrateMbps) + "Mbps each" : ", encode=raw NV12")
+              << (captureAudio ? ", audio=enabled" : "")
+              << "\n";
+
+    if (encodeH264 && !VaapiEncoder::IsHardwareEncoderAvailable()) {
+        std::cerr << "SnackaCaptureLinux: WARNING - No VAAPI H.264 encoder available, falling back to raw NV12\n";
+        encodeH264 = false;
+    }
+
+    // Conversion of one frame at a time uses every thread, so one pool sized for one
+    // output serves all streams; the pool serializes the capturers' frames
+    auto workerPool =
+        std::make_shared<WorkerPool>(ColorConverter::PickStripeCount(options.convertThreads, width, height));
+    auto clockOrigin = std::chrono::steady_clock::now();
+
+    std::vector<std::unique_ptr<DisplayOutput>> outputs;
+    for (size_t i = 0; i < streams.size(); i++) {
+        auto output = std::make_unique<DisplayOutput>();
+        output->stream = streams[i];
+        output->fd = i == 0 ? STDOUT_FILENO : SIMULCAST_FIRST_FD + static_cast<int>(i) - 1;
+        output->fps = streams[i].fps > 0 ? streams[i].fps : fps;
+        output->changeDetector.Configure(width, height);
+
+        if (encodeH264) {
+            output->encoder = std::make_unique<VaapiEncoder>(width, height, output->fps, bitrateMbps);
+            if (!output->encoder->Initialize()) {
+                std::cerr << "SnackaCaptureLinux: Failed to initialize VAAPI encoder for display "
+                          << streams[i].displayIndex << "\n";
+                return 1;
+            }
+            DisplayOutput* out = output.get();
+            output->encoder->SetCallback([out](const uint8_t* data, size_t size, bool) {
+                if (!out->open) return;
+                if (!WriteAll(out->fd, data, size)) {
+                    std::cerr << "SnackaCaptureLinux: Display " << out->stream.displayIndex << " stream closed\n";
+                    out->open = false;
+                }
+                out->encoded++;
+            });
+        }
+
+        X11Capturer& capturer = output->capturer;
+        capturer.SetWorkerPool(workerPool);
+        capturer.SetClockOrigin(clockOrigin);
+        capturer.SetScaleFilter(options.scaleFilter);
+        capturer.SetColorSpace(options.colorSpace);
+        capturer.SetDamageTracking(options.damageTracking);
+        capturer.SetPipelineDepth(options.pipelineDepth);
+        capturer.SetGrabBackend(options.grabBackend);
+        capturer.SetServerScale(options.serverScale);
+        capturer.SetMinFps(options.minFps);
+        capturer.SetCursorMode(options.cursorMode);
+        if (!capturer.Initialize(streams[i].displayIndex, width, height, output->fps)) {
+            std::cerr << "SnackaCaptureLinux: Failed to initialize X11 capture of display " << streams[i].displayIndex
+                      << "\n";
+            return 1;
+        }
+        std::cerr << "SnackaCaptureLinux: Display " << streams[i].displayIndex << " @ " << output->fps << "fps on "
+                  << (output->fd == STDOUT_FILENO ? std::string("stdout") : "fd " + std::to_string(output->fd))
+                  << "\n";
+        outputs.push_back(std::move(output));
+    }
+
+    std::unique_ptr<PulseAudioCapturer> audioCapturer;
+    uint64_t audioPacketCount = 0;
+    if (captureAudio) {
+        audioCapturer = std::make_unique<PulseAudioCapturer>();
+        if (!audioCapturer->Initialize()) {
+            std::cerr << "SnackaCaptureLinux: WARNING - Failed to initialize PulseAudio, audio capture disabled\n";
+            audioCapturer.reset();
+        }
+    }
+
+    // Every stream uses the same colorimetry, announced once
+    ColorInfoPacketHeader colorInfo(1, 13, options.colorSpace.matrix == ColorMatrix::BT709 ? 1 : 6,
+                                    options.colorSpace.range == ColorRange::Full);
+    {
+        std::lock_guard<std::mutex> lock(g_stderrMutex);
+        write(STDERR_FILENO, &colorInfo, sizeof(colorInfo));
+    }
+
+    if (audioCapturer) {
+        audioCapturer->Start([&](const int16_t* data, size_t sampleCount, uint64_t timestamp) {
+            if (!g_running) return;
+            AudioPacketHeader header(static_cast<uint32_t>(sampleCount), timestamp);
+            {
+                std::lock_guard<std::mutex> lock(g_stderrMutex);
+                write(STDERR_FILENO, &header, sizeof(header));
+                write(STDERR_FILENO, data, sampleCount * 4);  // 2 channels * 2 bytes
+            }
+            audioPacketCount++;
+        });
+    }
+
+    bool adaptiveRate = options.minFps > 0;
+    size_t frameSize = CalculateNV12FrameSize(width, height);
+    for (auto& output : outputs) {
+        DisplayOutput* out = output.get();
+        out->capturer.Start([out, &options, adaptiveRate, frameSize](const uint8_t* data, size_t size,
+                                                                     uint64_t timestamp, const FrameInfo& info) {
+            if (!g_running || !out->open) return;
+            out->frames++;
+
+            // Each stream skips its own unchanged frames, as a single display capture does
+            if ((options.idleFrames != IdleFrameMode::Send || adaptiveRate) && size == frameSize) {
+                bool changed = out->changeDetector.Update(data, info) > 0;
+                out->capturer.ReportFrameChanged(changed);
+                bool keepaliveDue = timestamp - out->lastSentTimestamp >= static_cast<uint64_t>(options.keepaliveMs);
+                if (options.idleFrames != IdleFrameMode::Send && !changed && !keepaliveDue) {
+                    out->suppressed++;
+                    return;
+                }
+                out->lastSentTimestamp = timestamp;
+            }
+
+            if (out->encoder) {
+                out->encoder->EncodeNV12(data, size, static_cast<int64_t>(timestamp));
+            } else if (!WriteAll(out->fd, data, size)) {
+                std::cerr << "SnackaCaptureLinux: Display " << out->stream.displayIndex << " stream closed\n";
+                out->open = false;
+            } else if (out->frames <= 5 || out->frames % 100 == 0) {
+                std::cerr << "SnackaCaptureLinux: Display " << out->stream.displayIndex << " frame " << out->frames
+                          << " (" << size << " bytes"
+                          << (info.fullFrame ? "" : ", " + std::to_string(info.dirtyRects.size()) + " dirty rects")
+                          << ")\n";
+            }
+        });
+    }
+
+    // Run until stopped or every reader has gone
+    auto anyOpen = [&]() {
+        for (const auto& output : outputs) {
+            if (output->open && output->capturer.IsRunning()) {
+                return true;
+            }
+        }
+        return false;
+    };
+    while (g_running && anyOpen()) {
+        usleep(100000);  // 100ms
+    }
+
+    for (auto& output : outputs) {
+        output->capturer.Stop();
+        if (output->encoder) {
+            output->encoder->Stop();
+        }
+    }
+    if (audioCapturer) {
+        audioCapturer->Stop();
+    }
+
+    for (const auto& output : outputs) {
+        std::cerr << "SnackaCaptureLinux: Display " << output->stream.displayIndex << " stopped (video frames: "
+                  << output->frames << ", encoded: " << output->encoded << ", suppressed: " << output->suppressed
+                  << ")\n";
+    }
+    std::cerr << "SnackaCaptureLinux: Audio packets: " << audioPacketCount << "\n";
+    std::cerr << "SnackaCaptureLinux: Frame buffer pool: " << FrameBufferPool::Shared().DescribeStats() << "\n";
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
+    // Before any other Xlib call: the capturers and the benchmark share display
+    // connections across threads (e.g. the xcb backend's converter waits on replies
+    // while the grab thread issues requests), which needs Xlib's locking
+    XInitThreads();
+
     // Parse command line arguments
     std::vector<std::string> args(argv, argv + argc);
 
@@ -523,8 +1186,46 @@ int main(int argc, char* argv[]) {
         return ValidateEnvironment(asJson);
     }
 
+    // Check for 'benchmark' command
+    if (args.size() >= 2 && args[1] == "benchmark") {
+        BenchmarkOptions options;
+        for (size_t i = 2; i < args.size(); i++) {
+            if (args[i] == "--width" && i + 1 < args.size()) {
+                options.width = std::stoi(args[++i]);
+            } else if (args[i] == "--height" && i + 1 < args.size()) {
+                options.height = std::stoi(args[++i]);
+            } else if (args[i] == "--iterations" && i + 1 < args.size()) {
+                options.iterations = std::stoi(args[++i]);
+            } else if (args[i] == "--convert-threads" && i + 1 < args.size()) {
+                options.maxThreads = std::stoi(args[++i]);
+            } else if (args[i] == "--grab") {
+                options.grab = true;
+            } else if (args[i] == "--mjpeg" && i + 1 < args.size()) {
+                options.mjpegFile = args[++i];
+            } else if (args[i] == "--mjpeg-checksums" && i + 1 < args.size()) {
+                options.mjpegChecksums = args[++i];
+            } else if (args[i] == "--write-checksums") {
+                options.writeChecksums = true;
+            }
+        }
+        if (options.width <= 0 || options.height <= 0 || options.iterations <= 0 || options.maxThreads <= 0) {
+            std::cerr << "SnackaCaptureLinux: Invalid benchmark parameters\n";
+            return 1;
+        }
+        if ((!options.mjpegChecksums.empty() && options.mjpegFile.empty()) ||
+            (options.writeChecksums && options.mjpegChecksums.empty())) {
+            std::cerr << "SnackaCaptureLinux: --mjpeg-checksums needs --mjpeg, --write-checksums needs both\n";
+            return 1;
+        }
+        return RunBenchmark(options);
+    }
+
     // Parse capture options
     int displayIndex = 0;
+    std::vector<DisplayStream> displayStreams;
+    Window windowId = 0;
+    std::optional<FrameRect> region;
+    std::string regionText;
     std::string cameraId;
     std::string microphoneId;
     bool hasMicrophone = false;
@@ -535,10 +1236,31 @@ int main(int argc, char* argv[]) {
     int bitrateMbps = -1;
     bool captureAudio = false;
     bool noiseSuppression = true;  // Enabled by default
+    CaptureOptions options;
+    std::string scaleFilterName = "smooth";
+    std::string idleFramesName = "send";
+    std::string grabBackendName = "xlib";
+    std::string serverScaleName = "off";
+    std::string cursorModeName = "overlay";
+    std::string colorSpaceName = "bt601";
+    std::string simulcastText;
+    std::string previewSizeText;
+    std::string captureBackendName = "auto";
+    std::string hugePagesName = "thp";
 
     for (size_t i = 1; i < args.size(); i++) {
         if (args[i] == "--display" && i + 1 < args.size()) {
-            displayIndex = std::stoi(args[++i]);
+            DisplayStream stream;
+            if (!ParseDisplayStream(args[++i], stream)) {
+                std::cerr << "SnackaCaptureLinux: Invalid display (expected <index> or <index>@<fps>)\n";
+                return 1;
+            }
+            displayStreams.push_back(stream);
+            displayIndex = displayStreams[0].displayIndex;
+        } else if (args[i] == "--window" && i + 1 < args.size()) {
+            windowId = static_cast<Window>(std::stoul(args[++i], nullptr, 0));
+        } else if (args[i] == "--region" && i + 1 < args.size()) {
+            regionText = args[++i];
         } else if (args[i] == "--camera" && i + 1 < args.size()) {
             cameraId = args[++i];
         } else if (args[i] == "--microphone" && i + 1 < args.size()) {
@@ -560,6 +1282,42 @@ int main(int argc, char* argv[]) {
             noiseSuppression = true;
         } else if (args[i] == "--no-noise-suppression") {
             noiseSuppression = false;
+        } else if (args[i] == "--convert-threads" && i + 1 < args.size()) {
+            options.convertThreads = std::stoi(args[++i]);
+        } else if (args[i] == "--decode-threads" && i + 1 < args.size()) {
+            options.decodeThreads = std::stoi(args[++i]);
+        } else if (args[i] == "--scale-filter" && i + 1 < args.size()) {
+            scaleFilterName = args[++i];
+        } else if (args[i] == "--colorspace" && i + 1 < args.size()) {
+            colorSpaceName = args[++i];
+        } else if (args[i] == "--cursor" && i + 1 < args.size()) {
+            cursorModeName = args[++i];
+        } else if (args[i] == "--no-damage") {
+            options.damageTracking = false;
+        } else if (args[i] == "--idle-frames" && i + 1 < args.size()) {
+            idleFramesName = args[++i];
+        } else if (args[i] == "--keepalive-ms" && i + 1 < args.size()) {
+            options.keepaliveMs = std::stoi(args[++i]);
+        } else if (args[i] == "--min-fps" && i + 1 < args.size()) {
+            options.minFps = std::stoi(args[++i]);
+        } else if (args[i] == "--pipeline-depth" && i + 1 < args.size()) {
+            options.pipelineDepth = std::stoi(args[++i]);
+        } else if (args[i] == "--grab-backend" && i + 1 < args.size()) {
+            grabBackendName = args[++i];
+        } else if (args[i] == "--server-scale" && i + 1 < args.size()) {
+            serverScaleName = args[++i];
+        } else if (args[i] == "--preview-fps" && i + 1 < args.size()) {
+            options.previewFps = std::stoi(args[++i]);
+        } else if (args[i] == "--preview-size" && i + 1 < args.size()) {
+            previewSizeText = args[++i];
+        } else if (args[i] == "--simulcast" && i + 1 < args.size()) {
+            simulcastText = args[++i];
+        } else if (args[i] == "--capture-backend" && i + 1 < args.size()) {
+            captureBackendName = args[++i];
+        } else if (args[i] == "--pipewire-node" && i + 1 < args.size()) {
+            options.pipeWireNode = args[++i];
+        } else if (args[i] == "--huge-pages" && i + 1 < args.size()) {
+            hugePagesName = args[++i];
         }
     }
 
@@ -568,11 +1326,30 @@ int main(int argc, char* argv[]) {
         return CaptureMicrophone(microphoneId, noiseSuppression);
     }
 
+    if (!regionText.empty()) {
+        FrameRect parsed;
+        if (!ParseRegion(regionText, parsed)) {
+            std::cerr << "SnackaCaptureLinux: Invalid region (expected x,y,width,height)\n";
+            return 1;
+        }
+        if (windowId != 0 || !cameraId.empty()) {
+            std::cerr << "SnackaCaptureLinux: --region only applies to display capture\n";
+            return 1;
+        }
+        region = parsed;
+    }
+
     // Set defaults based on source type
     bool isCamera = !cameraId.empty();
-    if (width < 0) width = isCamera ? 640 : 1920;
-    if (height < 0) height = isCamera ? 480 : 1080;
-    if (fps < 0) fps = isCamera ? 15 : 30;
+    if (region) {
+        // Capture the region 1:1 (rounded to even for NV12) unless told otherwise
+        if (width < 0) width = std::max(region->width & ~1, 2);
+        if (height < 0) height = std::max(region->height & ~1, 2);
+    }
+    if (width < 0) width = isCamera ? DEFAULT_CAMERA_WIDTH : 1920;
+    if (height < 0) height = isCamera ? DEFAULT_CAMERA_HEIGHT : 1080;
+    if (displayStreams.size() == 1 && displayStreams[0].fps > 0) fps = displayStreams[0].fps;
+    if (fps < 0) fps = isCamera ? DEFAULT_CAMERA_FPS : 30;
     if (bitrateMbps < 0) bitrateMbps = isCamera ? 2 : 6;
 
     // Validate parameters
@@ -592,6 +1369,175 @@ int main(int argc, char* argv[]) {
         std::cerr << "SnackaCaptureLinux: Invalid bitrate (must be 1-100 Mbps)\n";
         return 1;
     }
+    if (options.convertThreads < 0 || options.convertThreads > 64) {
+        std::cerr << "SnackaCaptureLinux: Invalid convert threads (must be 0-64, 0 = auto)\n";
+        return 1;
+    }
+    if (options.decodeThreads < 0 || options.decodeThreads > 16) {
+        std::cerr << "SnackaCaptureLinux: Invalid decode threads (must be 0-16, 0 = auto)\n";
+        return 1;
+    }
+    if (scaleFilterName != "smooth" && scaleFilterName != "nearest") {
+        std::cerr << "SnackaCaptureLinux: Invalid scale filter (must be smooth or nearest)\n";
+        return 1;
+    }
+    options.scaleFilter = scaleFilterName == "nearest" ? ScaleFilter::Nearest : ScaleFilter::Smooth;
+    if (!ParseColorSpace(colorSpaceName, options.colorSpace)) {
+        std::cerr << "SnackaCaptureLinux: Invalid colorspace (must be bt601, bt709, bt601-full or bt709-full)\n";
+        return 1;
+    }
+    if (idleFramesName == "send") {
+        options.idleFrames = IdleFrameMode::Send;
+    } else if (idleFramesName == "skip") {
+        options.idleFrames = IdleFrameMode::Skip;
+    } else if (idleFramesName == "marker") {
+        options.idleFrames = IdleFrameMode::Marker;
+    } else {
+        std::cerr << "SnackaCaptureLinux: Invalid idle frame mode (must be send, skip or marker)\n";
+        return 1;
+    }
+    if (options.keepaliveMs < 0 || options.keepaliveMs > 60000) {
+        std::cerr << "SnackaCaptureLinux: Invalid keepalive (must be 0-60000 ms)\n";
+        return 1;
+    }
+    if (options.minFps < 0 || options.minFps > fps) {
+        std::cerr << "SnackaCaptureLinux: Invalid minimum fps (must be 0 up to --fps)\n";
+        return 1;
+    }
+    if (options.pipelineDepth < 1 || options.pipelineDepth > 4) {
+        std::cerr << "SnackaCaptureLinux: Invalid pipeline depth (must be 1-4)\n";
+        return 1;
+    }
+    if (grabBackendName != "xlib" && grabBackendName != "xcb") {
+        std::cerr << "SnackaCaptureLinux: Invalid grab backend (must be xlib or xcb)\n";
+        return 1;
+    }
+    options.grabBackend = grabBackendName == "xcb" ? GrabBackend::Xcb : GrabBackend::Xlib;
+    if (serverScaleName == "off") {
+        options.serverScale = ServerScaleMode::Off;
+    } else if (serverScaleName == "auto") {
+        options.serverScale = ServerScaleMode::Auto;
+    } else if (serverScaleName == "on") {
+        options.serverScale = ServerScaleMode::On;
+    } else {
+        std::cerr << "SnackaCaptureLinux: Invalid server scale mode (must be off, auto or on)\n";
+        return 1;
+    }
+    if (hugePagesName == "off") {
+        FrameBufferPool::Shared().SetHugePageMode(HugePageMode::Off);
+    } else if (hugePagesName == "thp") {
+        FrameBufferPool::Shared().SetHugePageMode(HugePageMode::Advise);
+    } else if (hugePagesName == "hugetlb") {
+        FrameBufferPool::Shared().SetHugePageMode(HugePageMode::Reserved);
+    } else {
+        std::cerr << "SnackaCaptureLinux: Invalid huge page mode (must be off, thp or hugetlb)\n";
+        return 1;
+    }
+    if (cursorModeName == "overlay") {
+        options.cursorMode = CursorMode::Overlay;
+    } else if (cursorModeName == "metadata") {
+        options.cursorMode = CursorMode::Metadata;
+    } else if (cursorModeName == "none") {
+        options.cursorMode = CursorMode::Hidden;
+    } else {
+        std::cerr << "SnackaCaptureLinux: Invalid cursor mode (must be overlay, metadata or none)\n";
+        return 1;
+    }
+    if (options.previewFps < 0 || options.previewFps > fps) {
+        std::cerr << "SnackaCaptureLinux: Invalid preview fps (must be 0 up to --fps)\n";
+        return 1;
+    }
+    if (!previewSizeText.empty()) {
+        std::vector<FrameSize> sizes;
+        if (!ParseFrameSizes(previewSizeText, sizes) || sizes.size() != 1) {
+            std::cerr << "SnackaCaptureLinux: Invalid preview size (expected WxH)\n";
+            return 1;
+        }
+        options.previewSize = sizes[0];
+    } else {
+        int previewWidth = std::min(320, width) & ~1;
+        options.previewSize = {previewWidth, std::max((previewWidth * height / width) & ~1, 2)};
+    }
+
+    if (!simulcastText.empty()) {
+        if (!ParseFrameSizes(simulcastText, options.simulcastLayers)) {
+            std::cerr << "SnackaCaptureLinux: Invalid simulcast layers (expected WxH[,WxH...])\n";
+            return 1;
+        }
+        if (windowId != 0 || isCamera) {
+            std::cerr << "SnackaCaptureLinux: --simulcast only applies to display capture\n";
+            return 1;
+        }
+        FrameSize above = {width, height};
+        for (size_t i = 0; i < options.simulcastLayers.size(); i++) {
+            const FrameSize& layer = options.simulcastLayers[i];
+            if (layer.width % 2 != 0 || layer.height % 2 != 0 || layer.width > above.width || layer.height > above.height) {
+                std::cerr << "SnackaCaptureLinux: Simulcast layer " << layer.width << "x" << layer.height
+                          << " must be even and no larger than " << above.width << "x" << above.height << "\n";
+                return 1;
+            }
+            int fd = SIMULCAST_FIRST_FD + static_cast<int>(i);
+            if (fcntl(fd, F_GETFD) == -1) {
+                std::cerr << "SnackaCaptureLinux: Simulcast layer " << i + 1 << " needs file descriptor " << fd
+                          << " to be open\n";
+                return 1;
+            }
+            above = layer;
+        }
+    }
+
+    // Several displays: one stream each, on stdout and then fd 3, 4, ...
+    bool multiDisplay = displayStreams.size() > 1;
+    if (multiDisplay) {
+        if (windowId != 0 || isCamera || region || !options.simulcastLayers.empty() || options.previewFps > 0) {
+            std::cerr << "SnackaCaptureLinux: Several --display streams cannot be combined with --window, --camera, "
+                         "--region, --simulcast or --preview-fps\n";
+            return 1;
+        }
+        if (options.cursorMode == CursorMode::Metadata || options.idleFrames == IdleFrameMode::Marker) {
+            // Pointer and REPT packets on stderr don't say which stream they belong to
+            std::cerr << "SnackaCaptureLinux: Several --display streams need --cursor overlay or none and "
+                         "--idle-frames send or skip\n";
+            return 1;
+        }
+        for (size_t i = 1; i < displayStreams.size(); i++) {
+            int fd = SIMULCAST_FIRST_FD + static_cast<int>(i) - 1;
+            if (fcntl(fd, F_GETFD) == -1) {
+                std::cerr << "SnackaCaptureLinux: Display " << displayStreams[i].displayIndex
+                          << " needs file descriptor " << fd << " to be open\n";
+                return 1;
+            }
+        }
+    }
+
+    // Wayland sessions only expose XWayland windows to X11, but window, region,
+    // simulcast and multi-display capture are X11 features
+    bool needsX11 = windowId != 0 || region || !options.simulcastLayers.empty() || multiDisplay;
+    if (captureBackendName == "auto") {
+        const char* waylandDisplay = getenv("WAYLAND_DISPLAY");
+        bool onWayland = waylandDisplay && *waylandDisplay;
+        if (!options.pipeWireNode.empty() || (onWayland && !needsX11 && !isCamera)) {
+            options.captureBackend = CaptureBackend::PipeWire;
+            options.backendFallback = options.pipeWireNode.empty();
+        }
+    } else if (captureBackendName == "pipewire") {
+        options.captureBackend = CaptureBackend::PipeWire;
+    } else if (captureBackendName != "x11") {
+        std::cerr << "SnackaCaptureLinux: Invalid capture backend (must be auto, x11 or pipewire)\n";
+        return 1;
+    }
+    if (options.captureBackend == CaptureBackend::PipeWire && (needsX11 || isCamera)) {
+        std::cerr << "SnackaCaptureLinux: The PipeWire backend captures one display only (no --window, --region, "
+                     "--simulcast, --camera or several --display)\n";
+        return 1;
+    }
+    if (options.captureBackend != CaptureBackend::PipeWire && !options.pipeWireNode.empty()) {
+        std::cerr << "SnackaCaptureLinux: --pipewire-node needs the PipeWire backend\n";
+        return 1;
+    }
 
-    return Capture(displayIndex, cameraId, width, height, fps, encodeH264, bitrateMbps, captureAudio);
+    if (multiDisplay) {
+        return CaptureDisplays(displayStreams, width, height, fps, encodeH264, bitrateMbps, captureAudio, options);
+    }
+    return Capture(displayIndex, windowId, region, cameraId, width, height, fps, encodeH264, bitrateMbps, captureAudio, options);
 }